@@ -97,10 +97,27 @@ build_cpp_lib() {
 }
 
 build_cpp() {
+    build_zlib
     build_log_lib
     build_cpp_lib
 }
 
+build_tests() {
+    build_zlib
+    build_log_lib
+    tests_build_path=${build_path}"/tests"
+    makesure_folder ${tests_build_path}
+    cd ${tests_build_path}
+    if [ ${build_type} == "Clean" ]; then
+      echo "clean tests build"
+      rm -rf ./*
+    else
+      cmake ../../tests -DCMAKE_BUILD_TYPE=${build_type}
+      make
+      ctest --output-on-failure
+    fi
+}
+
 build_pybind() {
     cd ${py_source_path}
     if [ ! -d "./pybind11" ];then
@@ -123,6 +140,8 @@ elif [ $1 == "log" ]; then
     build_log
 elif [ $1 == "pybind" ]; then
     build_pybind
+elif [ $1 == "tests" ]; then
+    build_tests
 elif [ $1 == "all" ]; then
     build_cpp
     build_pybind
@@ -0,0 +1,340 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Base64.hpp"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BASE64_X86
+#endif
+
+using namespace MonkeyGL;
+
+namespace {
+	const char Base64Table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	// -1: white space, -2: not part of the alphabet, both are skipped
+	const signed char Base64DecodeTable[] = {
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -1, -1, -2, -2, -1, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-1, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, 62, -2, -2, -2, 63,
+		52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -2, -2, -2, -2, -2, -2,
+		-2,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+		15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -2, -2, -2, -2, -2,
+		-2, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+		41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+		-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2
+	};
+
+	void EncodeScalar(char* pOut, const unsigned char* pCur, size_t nLen)
+	{
+		while (nLen > 2) {
+			pOut[0] = Base64Table[pCur[0] >> 2];
+			pOut[1] = Base64Table[((pCur[0] & 0x03) << 4) + (pCur[1] >> 4)];
+			pOut[2] = Base64Table[((pCur[1] & 0x0f) << 2) + (pCur[2] >> 6)];
+			pOut[3] = Base64Table[pCur[2] & 0x3f];
+
+			pOut += 4;
+			pCur += 3;
+			nLen -= 3;
+		}
+
+		if (nLen > 0)
+		{
+			pOut[0] = Base64Table[pCur[0] >> 2];
+			if (nLen == 1) {
+				pOut[1] = Base64Table[(pCur[0] & 0x03) << 4];
+				pOut[2] = '=';
+				pOut[3] = '=';
+			} else {
+				pOut[1] = Base64Table[((pCur[0] & 0x03) << 4) + (pCur[1] >> 4)];
+				pOut[2] = Base64Table[(pCur[1] & 0x0f) << 2];
+				pOut[3] = '=';
+			}
+		}
+	}
+
+	// returns the number of bytes written, -1 on a misplaced padding
+	long long DecodeScalar(char* pOut, const char* pCur, size_t nLen)
+	{
+		char* pStart = pOut;
+		int bin = 0, i = 0;
+		while (nLen-- > 0)
+		{
+			unsigned char ch = (unsigned char)*pCur++;
+			if (ch == '\0')
+				break;
+			if (ch == '=') {
+				if ((nLen == 0 || *pCur != '=') && (i%4) == 1) {
+					return -1;
+				}
+				continue;
+			}
+			int value = Base64DecodeTable[ch];
+			if (value < 0) {
+				continue;
+			}
+			switch(i%4)
+			{
+				case 0:
+					bin = value << 2;
+					break;
+				case 1:
+					bin |= value >> 4;
+					*pOut++ = (char)bin;
+					bin = (value & 0x0f) << 4;
+					break;
+				case 2:
+					bin |= value >> 2;
+					*pOut++ = (char)bin;
+					bin = (value & 0x03) << 6;
+					break;
+				case 3:
+					bin |= value;
+					*pOut++ = (char)bin;
+					break;
+			}
+			i++;
+		}
+		return pOut - pStart;
+	}
+
+#ifdef BASE64_X86
+	bool HasAVX2()
+	{
+		static const bool bAVX2 = __builtin_cpu_supports("avx2");
+		return bAVX2;
+	}
+#endif
+
+#ifdef __SSSE3__
+	// 12 input bytes in, 16 characters out, see W. Mula, D. Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions"
+	inline __m128i EncodeBlock(__m128i in)
+	{
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		__m128i indices = _mm_or_si128(t1, t3);
+
+		__m128i shift = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		shift = _mm_or_si128(shift, _mm_and_si128(less, _mm_set1_epi8(13)));
+		const __m128i lutShift = _mm_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+		return _mm_add_epi8(_mm_shuffle_epi8(lutShift, shift), indices);
+	}
+
+	size_t EncodeSSSE3(char* pOut, const unsigned char* pSrc, size_t nLen)
+	{
+		size_t nDone = 0;
+		while (nLen - nDone >= 16) {
+			__m128i in = _mm_loadu_si128((const __m128i*)(pSrc + nDone));
+			_mm_storeu_si128((__m128i*)pOut, EncodeBlock(in));
+			pOut += 16;
+			nDone += 12;
+		}
+		return nDone;
+	}
+
+	// 16 characters in, 12 bytes out in the low part, false if any character is outside the alphabet
+	inline bool DecodeBlock(__m128i& out, __m128i in)
+	{
+		const __m128i lutLo = _mm_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+		const __m128i lutHi = _mm_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const __m128i lutRoll = _mm_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+		__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+		__m128i loNibbles = _mm_and_si128(in, mask2F);
+		__m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+		__m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+			return false;
+
+		__m128i eq2F = _mm_cmpeq_epi8(in, mask2F);
+		__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+		__m128i values = _mm_add_epi8(in, roll);
+
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		out = _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		return true;
+	}
+
+	// decodes leading blocks that are made of alphabet characters only, returns the number of characters consumed
+	size_t DecodeSSSE3(char*& pOut, const char* pSrc, size_t nLen)
+	{
+		size_t nDone = 0;
+		while (nLen - nDone >= 16) {
+			__m128i out;
+			if (!DecodeBlock(out, _mm_loadu_si128((const __m128i*)(pSrc + nDone))))
+				break;
+			_mm_storeu_si128((__m128i*)pOut, out);
+			pOut += 12;
+			nDone += 16;
+		}
+		return nDone;
+	}
+#endif
+
+#ifdef BASE64_X86
+	__attribute__((target("avx2")))
+	size_t EncodeAVX2(char* pOut, const unsigned char* pSrc, size_t nLen)
+	{
+		const __m256i shuffle = _mm256_set_epi8(
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+		const __m256i lutShift = _mm256_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+		size_t nDone = 0;
+		while (nLen - nDone >= 28) {
+			__m128i lo = _mm_loadu_si128((const __m128i*)(pSrc + nDone));
+			__m128i hi = _mm_loadu_si128((const __m128i*)(pSrc + nDone + 12));
+			__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+			in = _mm256_shuffle_epi8(in, shuffle);
+			__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+			__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+			__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+			__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+			__m256i indices = _mm256_or_si256(t1, t3);
+
+			__m256i shift = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+			__m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+			shift = _mm256_or_si256(shift, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+			__m256i out = _mm256_add_epi8(_mm256_shuffle_epi8(lutShift, shift), indices);
+
+			_mm256_storeu_si256((__m256i*)pOut, out);
+			pOut += 32;
+			nDone += 24;
+		}
+		return nDone;
+	}
+
+	__attribute__((target("avx2")))
+	size_t DecodeAVX2(char*& pOut, const char* pSrc, size_t nLen)
+	{
+		const __m256i lutLo = _mm256_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+		const __m256i lutHi = _mm256_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const __m256i lutRoll = _mm256_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i mask2F = _mm256_set1_epi8(0x2f);
+		const __m256i pack = _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+		size_t nDone = 0;
+		while (nLen - nDone >= 32) {
+			__m256i in = _mm256_loadu_si256((const __m256i*)(pSrc + nDone));
+			__m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask2F);
+			__m256i loNibbles = _mm256_and_si256(in, mask2F);
+			__m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+			__m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+			if (!_mm256_testz_si256(lo, hi))
+				break;
+
+			__m256i eq2F = _mm256_cmpeq_epi8(in, mask2F);
+			__m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+			__m256i values = _mm256_add_epi8(in, roll);
+
+			__m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+			__m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+			out = _mm256_shuffle_epi8(out, pack);
+			out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+			_mm256_storeu_si256((__m256i*)pOut, out);
+			pOut += 24;
+			nDone += 32;
+		}
+		return nDone;
+	}
+#endif
+}
+
+std::string Base64::Encode(const unsigned char* pSrc, size_t nLen)
+{
+	std::string strResult;
+	if (NULL == pSrc || 0 == nLen)
+		return strResult;
+
+	// the vector loops store whole registers, 16 bytes of slack covers the last store
+	strResult.resize(GetEncodedSize(nLen) + 16);
+	char* pOut = &strResult[0];
+	size_t nDone = 0;
+#ifdef BASE64_X86
+	if (HasAVX2()) {
+		nDone = EncodeAVX2(pOut, pSrc, nLen);
+	}
+#endif
+#ifdef __SSSE3__
+	nDone += EncodeSSSE3(pOut + nDone/3*4, pSrc + nDone, nLen - nDone);
+#endif
+	EncodeScalar(pOut + nDone/3*4, pSrc + nDone, nLen - nDone);
+	strResult.resize(GetEncodedSize(nLen));
+	return strResult;
+}
+
+std::string Base64::Decode(const char* pSrc, size_t nLen)
+{
+	std::string strResult;
+	if (NULL == pSrc || 0 == nLen)
+		return strResult;
+
+	strResult.resize(nLen/4*3 + 3 + 32);
+	char* pStart = &strResult[0];
+	char* pOut = pStart;
+	size_t nDone = 0;
+#ifdef BASE64_X86
+	if (HasAVX2()) {
+		nDone = DecodeAVX2(pOut, pSrc, nLen);
+	}
+#endif
+#ifdef __SSSE3__
+	nDone += DecodeSSSE3(pOut, pSrc + nDone, nLen - nDone);
+#endif
+	long long nTail = DecodeScalar(pOut, pSrc + nDone, nLen - nDone);
+	if (nTail < 0)
+		return "";
+	strResult.resize((pOut - pStart) + nTail);
+	return strResult;
+}
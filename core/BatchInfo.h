@@ -23,9 +23,19 @@
 #pragma once
 #include "Direction.h"
 #include "PlaneInfo.h"
+#include <cmath>
 
 namespace MonkeyGL{
 
+    // one plane of a batch, dirN is dirH x dirV
+    struct BatchPlane
+    {
+        Direction3d dirH;
+        Direction3d dirV;
+        Direction3d dirN;
+        Point3d ptLeftTop;
+    };
+
     class BatchInfo
     {
     public:
@@ -44,6 +54,10 @@ namespace MonkeyGL{
         double m_fSliceDistance;
         int m_nNum;
         MPRType m_MPRType;
+        BatchType m_batchType;
+        // degrees between neighbouring planes of radial and rotating batches, 0 spreads
+        // the m_nNum planes over 180 (radial) or 360 (rotating) degrees
+        double m_fAngleStep;
 
         int Width(){
             return int(m_fLengthH / m_fPixelSpacing);
@@ -51,6 +65,42 @@ namespace MonkeyGL{
         int Height(){
             return int(m_fLengthV / m_fPixelSpacing);
         }
+        // parallel slices are m_fSliceDistance apart along dirH x dirV and centered on
+        // m_ptCenter. radial and rotating planes all go through m_ptCenter, dirH turns
+        // about dirV as GetBatchDirection3D does for a single angle. nIndex runs from 0
+        // to m_nNum-1
+        BatchPlane GetPlane(int nIndex){
+            BatchPlane plane;
+            plane.dirH = m_dirH;
+            plane.dirV = m_dirV;
+            Point3d ptCenterPlane = m_ptCenter;
+            if (m_batchType == BatchTypeParallel){
+                Direction3d dirN = m_dirH.cross(m_dirV);
+                ptCenterPlane = m_ptCenter + dirN * ((nIndex - (m_nNum-1)/2.0) * m_fSliceDistance);
+            }
+            else{
+                double fAngleStep = m_fAngleStep;
+                if (fAngleStep == 0 && m_nNum > 0)
+                    fAngleStep = (m_batchType == BatchTypeRadial ? 180.0 : 360.0) / m_nNum;
+                double fAngle = nIndex*fAngleStep/180*PI;
+                // rodrigues rotation of dirH about the unit axis dirV
+                Direction3d dirA = m_dirV;
+                Direction3d dirH = m_dirH;
+                Direction3d dirAxH = dirA.cross(dirH);
+                double fDot = dirA.x()*dirH.x() + dirA.y()*dirH.y() + dirA.z()*dirH.z();
+                double fCos = cos(fAngle);
+                double fSin = sin(fAngle);
+                plane.dirH = Direction3d(
+                    dirH.x()*fCos + dirAxH.x()*fSin + dirA.x()*fDot*(1-fCos),
+                    dirH.y()*fCos + dirAxH.y()*fSin + dirA.y()*fDot*(1-fCos),
+                    dirH.z()*fCos + dirAxH.z()*fSin + dirA.z()*fDot*(1-fCos)
+                );
+            }
+            plane.dirN = plane.dirH.cross(plane.dirV);
+            Point3d ptLeftTop = ptCenterPlane - plane.dirH*(0.5*m_fLengthH);
+            plane.ptLeftTop = ptLeftTop - plane.dirV*(0.5*m_fLengthV);
+            return plane;
+        }
     };
 
 }
@@ -0,0 +1,335 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "BrickTable.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include "ThreadPool.h"
+#include "StopWatch.h"
+
+using namespace MonkeyGL;
+
+namespace {
+	// a sample is composited by the ray caster only when its alpha is above this
+	const float c_fVisibleAlpha = 0.0005f;
+
+	template <typename T, typename TRange>
+	void BuildRange(std::vector<TRange>& vecMin, std::vector<TRange>& vecMax, const T* pData, const int* pDims, const int* pBricks, int bzFirst, int bzLast)
+	{
+		const int nBrickSize = BrickTable::BRICK_SIZE;
+		int nBricksXY = pBricks[0]*pBricks[1];
+		vecMin.resize(nBricksXY*pBricks[2]);
+		vecMax.resize(nBricksXY*pBricks[2]);
+
+		ThreadPool::Instance()->ParallelFor(bzFirst, bzLast+1, [&](int bz){
+			std::vector<T> vecColMin(pDims[0]);
+			std::vector<T> vecColMax(pDims[0]);
+			T* pColMin = &vecColMin[0];
+			T* pColMax = &vecColMax[0];
+
+			int zStart = bz*nBrickSize - 1;
+			int zEnd = bz*nBrickSize + nBrickSize;
+			zStart = zStart < 0 ? 0 : zStart;
+			zEnd = zEnd > pDims[2]-1 ? pDims[2]-1 : zEnd;
+			for (int by=0; by<pBricks[1]; by++)
+			{
+				int yStart = by*nBrickSize - 1;
+				int yEnd = by*nBrickSize + nBrickSize;
+				yStart = yStart < 0 ? 0 : yStart;
+				yEnd = yEnd > pDims[1]-1 ? pDims[1]-1 : yEnd;
+
+				// reduce the rows of the brick row column-wise first, this part vectorizes
+				std::fill(pColMin, pColMin+pDims[0], std::numeric_limits<T>::max());
+				std::fill(pColMax, pColMax+pDims[0], std::numeric_limits<T>::lowest());
+				for (int z=zStart; z<=zEnd; z++)
+				{
+					for (int y=yStart; y<=yEnd; y++)
+					{
+						const T* pRow = pData + ((long long)z*pDims[1] + y)*pDims[0];
+						for (int x=0; x<pDims[0]; x++)
+						{
+							pColMin[x] = pRow[x] < pColMin[x] ? pRow[x] : pColMin[x];
+							pColMax[x] = pRow[x] > pColMax[x] ? pRow[x] : pColMax[x];
+						}
+					}
+				}
+
+				TRange* pMin = &vecMin[bz*nBricksXY + by*pBricks[0]];
+				TRange* pMax = &vecMax[bz*nBricksXY + by*pBricks[0]];
+				for (int bx=0; bx<pBricks[0]; bx++)
+				{
+					int xStart = bx*nBrickSize - 1;
+					int xEnd = bx*nBrickSize + nBrickSize;
+					xStart = xStart < 0 ? 0 : xStart;
+					xEnd = xEnd > pDims[0]-1 ? pDims[0]-1 : xEnd;
+					T vMin = pColMin[xStart];
+					T vMax = pColMax[xStart];
+					for (int x=xStart+1; x<=xEnd; x++)
+					{
+						vMin = pColMin[x] < vMin ? pColMin[x] : vMin;
+						vMax = pColMax[x] > vMax ? pColMax[x] : vMax;
+					}
+					pMin[bx] = vMin;
+					pMax[bx] = vMax;
+				}
+			}
+		});
+	}
+
+	template <typename TRange>
+	void BuildRange(std::vector<TRange>& vecMin, std::vector<TRange>& vecMax, const void* pData, VoxelType type, const int* pDims, const int* pBricks, int bzFirst, int bzLast)
+	{
+		switch (type)
+		{
+		case VoxelTypeUInt8:
+			BuildRange(vecMin, vecMax, (const unsigned char*)pData, pDims, pBricks, bzFirst, bzLast);
+			break;
+		case VoxelTypeUInt16:
+			BuildRange(vecMin, vecMax, (const unsigned short*)pData, pDims, pBricks, bzFirst, bzLast);
+			break;
+		case VoxelTypeInt32:
+			BuildRange(vecMin, vecMax, (const int*)pData, pDims, pBricks, bzFirst, bzLast);
+			break;
+		case VoxelTypeFloat32:
+			BuildRange(vecMin, vecMax, (const float*)pData, pDims, pBricks, bzFirst, bzLast);
+			break;
+		default:
+			BuildRange(vecMin, vecMax, (const short*)pData, pDims, pBricks, bzFirst, bzLast);
+			break;
+		}
+	}
+}
+
+BrickTable::BrickTable(void)
+{
+	Clear();
+}
+
+BrickTable::~BrickTable(void)
+{
+}
+
+void BrickTable::Clear()
+{
+	memset(m_Dims, 0, 3*sizeof(int));
+	memset(m_nBricks, 0, 3*sizeof(int));
+	memset(m_nRegions, 0, 3*sizeof(int));
+	m_vecMin.clear();
+	m_vecMax.clear();
+	m_vecLabelMin.clear();
+	m_vecLabelMax.clear();
+	m_vecEmptyBricks.clear();
+	m_vecEmptyRegions.clear();
+	ResetTransparency();
+}
+
+bool BrickTable::Build(const short* pVolume, int nWidth, int nHeight, int nDepth)
+{
+	return Build(pVolume, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool BrickTable::Build(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	StopWatch sw("BrickTable::Build");
+
+	Clear();
+	if (NULL == pVolume || nWidth<=0 || nHeight<=0 || nDepth<=0)
+		return false;
+
+	m_Dims[0] = nWidth;
+	m_Dims[1] = nHeight;
+	m_Dims[2] = nDepth;
+	for (int i=0; i<3; i++)
+	{
+		m_nBricks[i] = (m_Dims[i] + BRICK_SIZE - 1) >> BRICK_SHIFT;
+		m_nRegions[i] = (m_nBricks[i] + (1<<REGION_SHIFT) - 1) >> REGION_SHIFT;
+	}
+
+	BuildRange(m_vecMin, m_vecMax, pVolume, type, m_Dims, m_nBricks, 0, m_nBricks[2]-1);
+
+	// nothing is known to be transparent until the transfer functions are set
+	m_vecEmptyBricks.assign(m_vecMin.size(), 0);
+	m_vecEmptyRegions.assign(m_nRegions[0]*m_nRegions[1]*m_nRegions[2], 0);
+	return true;
+}
+
+bool BrickTable::UpdateSlices(const void* pVolume, VoxelType type, int nFirst, int nLast)
+{
+	if (!IsValid() || NULL == pVolume)
+		return false;
+
+	nFirst = nFirst < 0 ? 0 : nFirst;
+	nLast = nLast > m_Dims[2]-1 ? m_Dims[2]-1 : nLast;
+	if (nFirst > nLast)
+		return true;
+
+	// the aprons reach one slice into the neighbouring brick layers
+	int bzFirst = nFirst > 0 ? (nFirst-1) >> BRICK_SHIFT : 0;
+	int bzLast = (nLast+1) >> BRICK_SHIFT;
+	bzLast = bzLast > m_nBricks[2]-1 ? m_nBricks[2]-1 : bzLast;
+	BuildRange(m_vecMin, m_vecMax, pVolume, type, m_Dims, m_nBricks, bzFirst, bzLast);
+
+	// with the transparency known the flags are worked out again, until then nothing
+	// in these layers may be skipped
+	if (m_bTransparencySet)
+	{
+		UpdateEmptyBricks();
+		return true;
+	}
+	int nBricksXY = m_nBricks[0]*m_nBricks[1];
+	std::fill(m_vecEmptyBricks.begin() + bzFirst*nBricksXY, m_vecEmptyBricks.begin() + (bzLast+1)*nBricksXY, 0);
+	int nRegionsXY = m_nRegions[0]*m_nRegions[1];
+	std::fill(m_vecEmptyRegions.begin() + (bzFirst >> REGION_SHIFT)*nRegionsXY, m_vecEmptyRegions.begin() + ((bzLast >> REGION_SHIFT) + 1)*nRegionsXY, 0);
+	return true;
+}
+
+bool BrickTable::BuildMask(const unsigned char* pMask)
+{
+	if (!IsValid())
+		return false;
+
+	if (NULL == pMask)
+	{
+		m_vecLabelMin.clear();
+		m_vecLabelMax.clear();
+		return true;
+	}
+	// interpolated labels are rounded, so any label between the min and max may show up
+	BuildRange(m_vecLabelMin, m_vecLabelMax, pMask, m_Dims, m_nBricks, 0, m_nBricks[2]-1);
+	return true;
+}
+
+void BrickTable::ResetTransparency()
+{
+	m_bTransparencySet = false;
+	for (int i=0; i<MAXOBJECTCOUNT+1; i++)
+	{
+		m_labelOpacity[i].bValid = false;
+		m_labelOpacity[i].fWW = 0.0f;
+		m_labelOpacity[i].fWL = 0.0f;
+		m_labelOpacity[i].vecVisiblePrefix.clear();
+	}
+}
+
+void BrickTable::SetTransparency(unsigned char nLabel, const RGBA* pTransferFunc, int nLen, float fWW, float fWL)
+{
+	if (nLabel > MAXOBJECTCOUNT)
+		return;
+
+	LabelOpacity& opacity = m_labelOpacity[nLabel];
+	opacity.bValid = NULL != pTransferFunc && nLen > 0;
+	opacity.fWW = fWW;
+	opacity.fWL = fWL;
+	opacity.vecVisiblePrefix.clear();
+	if (!opacity.bValid)
+		return;
+
+	opacity.vecVisiblePrefix.resize(nLen+1);
+	opacity.vecVisiblePrefix[0] = 0;
+	for (int i=0; i<nLen; i++)
+	{
+		int nVisible = pTransferFunc[i].alpha > c_fVisibleAlpha ? 1 : 0;
+		opacity.vecVisiblePrefix[i+1] = opacity.vecVisiblePrefix[i] + nVisible;
+	}
+}
+
+bool BrickTable::IsTransparent(unsigned char nLabel, float fMin, float fMax)
+{
+	if (nLabel > MAXOBJECTCOUNT)
+		return false;
+
+	LabelOpacity& opacity = m_labelOpacity[nLabel];
+	if (!opacity.bValid)
+		return true;
+	if (!(opacity.fWW > 0.0f))
+		return false;
+
+	// same mapping as the ray caster, widened by one entry for rounding
+	int nLen = (int)opacity.vecVisiblePrefix.size() - 1;
+	float tMin = (fMin - opacity.fWL)/opacity.fWW + 0.5f;
+	float tMax = (fMax - opacity.fWL)/opacity.fWW + 0.5f;
+	tMin = tMin > 1.0f ? 1.0f : tMin;
+	tMax = tMax > 1.0f ? 1.0f : tMax;
+	int nStart = (int)floorf(tMin*nLen - 0.5f) - 1;
+	int nEnd = (int)floorf(tMax*nLen - 0.5f) + 2;
+	nStart = nStart < 0 ? 0 : (nStart > nLen-1 ? nLen-1 : nStart);
+	nEnd = nEnd < 0 ? 0 : (nEnd > nLen-1 ? nLen-1 : nEnd);
+
+	return opacity.vecVisiblePrefix[nEnd+1] == opacity.vecVisiblePrefix[nStart];
+}
+
+bool BrickTable::IsEmptyBrick(int nIndex)
+{
+	unsigned char nLabelMin = m_vecLabelMin.empty() ? 0 : m_vecLabelMin[nIndex];
+	unsigned char nLabelMax = m_vecLabelMax.empty() ? 0 : m_vecLabelMax[nIndex];
+	for (int nLabel=nLabelMin; nLabel<=nLabelMax; nLabel++)
+	{
+		if (!IsTransparent(nLabel, m_vecMin[nIndex], m_vecMax[nIndex]))
+			return false;
+	}
+	return true;
+}
+
+void BrickTable::UpdateEmptyBricks()
+{
+	if (!IsValid())
+		return;
+
+	StopWatch sw("BrickTable::UpdateEmptyBricks");
+
+	int nBricksXY = m_nBricks[0]*m_nBricks[1];
+	ThreadPool::Instance()->ParallelFor(0, m_nBricks[2], [&](int bz){
+		for (int i=bz*nBricksXY; i<(bz+1)*nBricksXY; i++)
+		{
+			m_vecEmptyBricks[i] = IsEmptyBrick(i) ? 1 : 0;
+		}
+	});
+
+	int nRegionsXY = m_nRegions[0]*m_nRegions[1];
+	ThreadPool::Instance()->ParallelFor(0, m_nRegions[2], [&](int rz){
+		for (int ry=0; ry<m_nRegions[1]; ry++)
+		{
+			for (int rx=0; rx<m_nRegions[0]; rx++)
+			{
+				unsigned char bEmpty = 1;
+				for (int bz=rz<<REGION_SHIFT; bEmpty && bz<((rz+1)<<REGION_SHIFT) && bz<m_nBricks[2]; bz++)
+				{
+					for (int by=ry<<REGION_SHIFT; bEmpty && by<((ry+1)<<REGION_SHIFT) && by<m_nBricks[1]; by++)
+					{
+						for (int bx=rx<<REGION_SHIFT; bx<((rx+1)<<REGION_SHIFT) && bx<m_nBricks[0]; bx++)
+						{
+							if (!m_vecEmptyBricks[(bz*m_nBricks[1] + by)*m_nBricks[0] + bx])
+							{
+								bEmpty = 0;
+								break;
+							}
+						}
+					}
+				}
+				m_vecEmptyRegions[rz*nRegionsXY + ry*m_nRegions[0] + rx] = bEmpty;
+			}
+		}
+	});
+	m_bTransparencySet = true;
+}
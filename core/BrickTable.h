@@ -0,0 +1,122 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <vector>
+#include "Defines.h"
+
+namespace MonkeyGL {
+
+    // min/max of the volume per 8^3 brick and per 64^3 region, used to skip bricks
+    // that are fully transparent under the current transfer functions and WW/WL.
+    // ranges include a one voxel apron so they bound every trilinear fetch made
+    // from a position inside the brick.
+    class BrickTable
+    {
+    public:
+        BrickTable(void);
+        ~BrickTable(void);
+
+    public:
+        static const int BRICK_SHIFT = 3;
+        static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+        static const int REGION_SHIFT = 3;
+        static const int REGION_SIZE = BRICK_SIZE << REGION_SHIFT;
+
+        void Clear();
+        bool Build(const short* pVolume, int nWidth, int nHeight, int nDepth);
+        bool Build(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth);
+        bool BuildMask(const unsigned char* pMask);
+        // slices nFirst..nLast of the volume were rewritten: the brick layers whose
+        // ranges include them are recomputed and the empty flags follow
+        bool UpdateSlices(const void* pVolume, VoxelType type, int nFirst, int nLast);
+
+        void ResetTransparency();
+        void SetTransparency(unsigned char nLabel, const RGBA* pTransferFunc, int nLen, float fWW, float fWL);
+        bool IsTransparent(unsigned char nLabel, float fMin, float fMax);
+        void UpdateEmptyBricks();
+
+        bool IsValid(){
+            return m_nBricks[0] > 0;
+        }
+        int GetDim(int index){
+            return m_Dims[index];
+        }
+        int GetBrickCount(int index){
+            return m_nBricks[index];
+        }
+        int GetRegionCount(int index){
+            return m_nRegions[index];
+        }
+        // one byte per brick, x fastest, nonzero when the brick can be skipped
+        const unsigned char* GetEmptyBricks(){
+            return m_vecEmptyBricks.empty() ? NULL : &m_vecEmptyBricks[0];
+        }
+        const unsigned char* GetEmptyRegions(){
+            return m_vecEmptyRegions.empty() ? NULL : &m_vecEmptyRegions[0];
+        }
+        bool IsEmptyBrick(int bx, int by, int bz){
+            return m_vecEmptyBricks[(bz*m_nBricks[1] + by)*m_nBricks[0] + bx] != 0;
+        }
+        bool IsEmptyRegion(int rx, int ry, int rz){
+            return m_vecEmptyRegions[(rz*m_nRegions[1] + ry)*m_nRegions[0] + rx] != 0;
+        }
+        void GetBrickRange(float& fMin, float& fMax, int bx, int by, int bz){
+            int nIndex = (bz*m_nBricks[1] + by)*m_nBricks[0] + bx;
+            fMin = m_vecMin[nIndex];
+            fMax = m_vecMax[nIndex];
+        }
+        void GetBrickLabelRange(unsigned char& nMin, unsigned char& nMax, int bx, int by, int bz){
+            int nIndex = (bz*m_nBricks[1] + by)*m_nBricks[0] + bx;
+            nMin = m_vecLabelMin.empty() ? 0 : m_vecLabelMin[nIndex];
+            nMax = m_vecLabelMax.empty() ? 0 : m_vecLabelMax[nIndex];
+        }
+
+    private:
+        bool IsEmptyBrick(int nIndex);
+
+    private:
+        int m_Dims[3];
+        int m_nBricks[3];
+        int m_nRegions[3];
+        // in the units of the samples whatever the voxel type
+        std::vector<float> m_vecMin;
+        std::vector<float> m_vecMax;
+        std::vector<unsigned char> m_vecLabelMin;
+        std::vector<unsigned char> m_vecLabelMax;
+
+        // per label: wl, ww and a prefix count of transfer function entries that are visible
+        struct LabelOpacity
+        {
+            bool bValid;
+            float fWW;
+            float fWL;
+            std::vector<int> vecVisiblePrefix;
+        };
+        LabelOpacity m_labelOpacity[MAXOBJECTCOUNT+1];
+        // the empty flags were worked out from the current transparency
+        bool m_bTransparencySet;
+
+        std::vector<unsigned char> m_vecEmptyBricks;
+        std::vector<unsigned char> m_vecEmptyRegions;
+    };
+}
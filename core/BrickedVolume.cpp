@@ -0,0 +1,83 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "BrickedVolume.h"
+#include "VolumeSampler.h"
+#include "ThreadPool.h"
+#include "StopWatch.h"
+#include <cstring>
+
+using namespace MonkeyGL;
+
+BrickedVolume::BrickedVolume(void)
+{
+	memset(m_Dims, 0, 3*sizeof(int));
+}
+
+BrickedVolume::~BrickedVolume(void)
+{
+}
+
+void BrickedVolume::Clear()
+{
+	std::vector<short>().swap(m_vecData);
+	for (int i=0; i<3; i++){
+		std::vector<int>().swap(m_vecOffsets[i]);
+	}
+	memset(m_Dims, 0, 3*sizeof(int));
+}
+
+bool BrickedVolume::Build(const short* pLinear, int nWidth, int nHeight, int nDepth)
+{
+	StopWatch sw("BrickedVolume::Build");
+	Clear();
+	if (!VolumeSampler::BuildBricked(pLinear, nWidth, nHeight, nDepth, BRICK_SHIFT, m_vecData, m_vecOffsets[0], m_vecOffsets[1], m_vecOffsets[2])){
+		Clear();
+		return false;
+	}
+	m_Dims[0] = nWidth;
+	m_Dims[1] = nHeight;
+	m_Dims[2] = nDepth;
+	return true;
+}
+
+void BrickedVolume::CopyToLinear(short* pLinear) const
+{
+	if (NULL == pLinear || !IsValid())
+		return;
+
+	const short* pData = GetData();
+	const int* pX = GetOffsets(0);
+	const int* pY = GetOffsets(1);
+	const int* pZ = GetOffsets(2);
+	int nWidth = m_Dims[0];
+	int nHeight = m_Dims[1];
+	ThreadPool::Instance()->ParallelFor(0, m_Dims[2], [&](int z){
+		for (int y=0; y<nHeight; y++){
+			const short* pSrc = pData + pY[y] + pZ[z];
+			short* pDst = pLinear + ((size_t)z*nHeight + y)*nWidth;
+			for (int x=0; x<nWidth; x++){
+				pDst[x] = pSrc[pX[x]];
+			}
+		}
+	});
+}
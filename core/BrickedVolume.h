@@ -0,0 +1,77 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace MonkeyGL {
+
+    // copy of the volume in 16^3 bricks, z-ordered in groups of 4x4x4 bricks so that
+    // sagittal, coronal and oblique walks stay within a few pages. the address of a voxel
+    // is the sum of one table entry per axis, which is what the samplers take.
+    class BrickedVolume
+    {
+    public:
+        BrickedVolume(void);
+        ~BrickedVolume(void);
+
+    public:
+        static const int BRICK_SHIFT = 4;
+        static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+
+        void Clear();
+        bool Build(const short* pLinear, int nWidth, int nHeight, int nDepth);
+        // back to x fastest order, pLinear holds nWidth*nHeight*nDepth voxels
+        void CopyToLinear(short* pLinear) const;
+
+        bool IsValid() const{
+            return !m_vecData.empty();
+        }
+        int GetDim(int index) const{
+            return m_Dims[index];
+        }
+        const short* GetData() const{
+            return m_vecData.empty() ? NULL : &m_vecData[0];
+        }
+        // voxels including the padding to whole brick groups
+        size_t GetVoxelCount() const{
+            return m_vecData.size();
+        }
+        // per axis address terms, GetOffsets(0)[x] + GetOffsets(1)[y] + GetOffsets(2)[z]
+        const int* GetOffsets(int index) const{
+            return m_vecOffsets[index].empty() ? NULL : &m_vecOffsets[index][0];
+        }
+        size_t GetIndex(int x, int y, int z) const{
+            return (size_t)m_vecOffsets[0][x] + m_vecOffsets[1][y] + m_vecOffsets[2][z];
+        }
+        short GetVoxel(int x, int y, int z) const{
+            return m_vecData[GetIndex(x, y, z)];
+        }
+
+    private:
+        std::vector<short> m_vecData;
+        std::vector<int> m_vecOffsets[3];
+        int m_Dims[3];
+    };
+
+}
@@ -0,0 +1,367 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "CPREngine.h"
+#include <cmath>
+
+using namespace MonkeyGL;
+
+namespace {
+
+	inline double Dot(const double* a, const double* b)
+	{
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	inline void Cross(const double* a, const double* b, double* c)
+	{
+		c[0] = a[1]*b[2] - a[2]*b[1];
+		c[1] = a[2]*b[0] - a[0]*b[2];
+		c[2] = a[0]*b[1] - a[1]*b[0];
+	}
+
+	inline bool Normalize(double* a)
+	{
+		double fLen = sqrt(Dot(a, a));
+		if (fLen < 1e-12)
+			return false;
+		for (int i=0; i<3; i++){
+			a[i] /= fLen;
+		}
+		return true;
+	}
+
+	// reflects a in the plane through the origin with normal v, c is v.v
+	inline void Reflect(const double* a, const double* v, double c, double* r)
+	{
+		double f = 2.0*Dot(v, a)/c;
+		for (int i=0; i<3; i++){
+			r[i] = a[i] - f*v[i];
+		}
+	}
+
+	// n turned fAngle degrees about the unit t, n is orthogonal to t
+	inline void Turn(const double* t, const double* n, double fAngle, double* r)
+	{
+		double b[3];
+		Cross(t, n, b);
+		double fRad = fAngle/180*PI;
+		double fCos = cos(fRad);
+		double fSin = sin(fRad);
+		for (int i=0; i<3; i++){
+			r[i] = n[i]*fCos + b[i]*fSin;
+		}
+	}
+
+	BatchPlane MakePlane(const double* pCenter, const double* pH, const double* pV, const double* pN, double fHalfH, double fHalfV)
+	{
+		BatchPlane plane;
+		plane.dirH = Direction3d(pH[0], pH[1], pH[2]);
+		plane.dirV = Direction3d(pV[0], pV[1], pV[2]);
+		plane.dirN = Direction3d(pN[0], pN[1], pN[2]);
+		plane.ptLeftTop = Point3d(
+			pCenter[0] - pH[0]*fHalfH - pV[0]*fHalfV,
+			pCenter[1] - pH[1]*fHalfH - pV[1]*fHalfV,
+			pCenter[2] - pH[2]*fHalfH - pV[2]*fHalfV
+		);
+		return plane;
+	}
+}
+
+CPREngine::CPREngine(void) :
+	m_fPixelSpacing(1.0)
+{
+}
+
+CPREngine::~CPREngine(void)
+{
+}
+
+void CPREngine::Clear()
+{
+	m_vecPoints.clear();
+	m_vecTangents.clear();
+	m_vecNormals.clear();
+}
+
+int CPREngine::GetPointCount() const
+{
+	return (int)(m_vecPoints.size()/3);
+}
+
+double CPREngine::GetPixelSpacing() const
+{
+	return m_fPixelSpacing;
+}
+
+double CPREngine::GetLength() const
+{
+	int nCount = GetPointCount();
+	return nCount>0 ? (nCount-1)*m_fPixelSpacing : 0;
+}
+
+bool CPREngine::SetCenterline(const std::vector<Point3d>& vecPoints, double fPixelSpacing)
+{
+	Clear();
+	if (fPixelSpacing <= 0)
+		return false;
+
+	// drop repeated points, they have no direction
+	std::vector<double> vecInput;
+	for (size_t i=0; i<vecPoints.size(); i++){
+		Point3d pt = vecPoints[i];
+		double p[3] = {pt.x(), pt.y(), pt.z()};
+		size_t nCount = vecInput.size();
+		if (nCount >= 3){
+			double d[3] = {p[0]-vecInput[nCount-3], p[1]-vecInput[nCount-2], p[2]-vecInput[nCount-1]};
+			if (Dot(d, d) < 1e-12)
+				continue;
+		}
+		vecInput.insert(vecInput.end(), p, p+3);
+	}
+	int nInput = (int)(vecInput.size()/3);
+	if (nInput < 2)
+		return false;
+
+	// points every fPixelSpacing of arc length, the last partial step is left out
+	std::vector<double> vecArc(nInput, 0.0);
+	for (int i=1; i<nInput; i++){
+		const double* a = &vecInput[3*(i-1)];
+		const double* b = &vecInput[3*i];
+		double d[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+		vecArc[i] = vecArc[i-1] + sqrt(Dot(d, d));
+	}
+	m_fPixelSpacing = fPixelSpacing;
+	int nCount = (int)(vecArc[nInput-1]/fPixelSpacing) + 1;
+	m_vecPoints.resize(3*nCount);
+	int nSegment = 1;
+	for (int k=0; k<nCount; k++){
+		double fArc = k*fPixelSpacing;
+		while (nSegment < nInput-1 && vecArc[nSegment] < fArc)
+			nSegment++;
+		double fLen = vecArc[nSegment] - vecArc[nSegment-1];
+		double f = fLen>0 ? (fArc - vecArc[nSegment-1])/fLen : 0;
+		f = f<0 ? 0 : (f>1 ? 1 : f);
+		for (int i=0; i<3; i++){
+			m_vecPoints[3*k+i] = vecInput[3*(nSegment-1)+i]*(1-f) + vecInput[3*nSegment+i]*f;
+		}
+	}
+
+	// central differences, one sided at the ends and for a single point the polyline direction
+	m_vecTangents.resize(3*nCount);
+	for (int k=0; k<nCount; k++){
+		int k0 = k>0 ? k-1 : 0;
+		int k1 = k<nCount-1 ? k+1 : nCount-1;
+		double* t = &m_vecTangents[3*k];
+		if (k0 == k1){
+			for (int i=0; i<3; i++){
+				t[i] = vecInput[3+i] - vecInput[i];
+			}
+		}
+		else{
+			for (int i=0; i<3; i++){
+				t[i] = m_vecPoints[3*k1+i] - m_vecPoints[3*k0+i];
+			}
+		}
+		if (!Normalize(t) && k>0){
+			for (int i=0; i<3; i++){
+				t[i] = m_vecTangents[3*(k-1)+i];
+			}
+		}
+	}
+
+	// the first normal comes from the volume axis least aligned with the tangent, the
+	// others follow by the double reflection method of Wang et al.
+	m_vecNormals.resize(3*nCount);
+	{
+		const double* t = &m_vecTangents[0];
+		int nAxis = 0;
+		for (int i=1; i<3; i++){
+			if (fabs(t[i]) < fabs(t[nAxis]))
+				nAxis = i;
+		}
+		double* r = &m_vecNormals[0];
+		for (int i=0; i<3; i++){
+			r[i] = (i==nAxis ? 1.0 : 0.0) - t[nAxis]*t[i];
+		}
+		Normalize(r);
+	}
+	for (int k=0; k<nCount-1; k++){
+		const double* x0 = &m_vecPoints[3*k];
+		const double* x1 = &m_vecPoints[3*(k+1)];
+		const double* t0 = &m_vecTangents[3*k];
+		const double* t1 = &m_vecTangents[3*(k+1)];
+		const double* r0 = &m_vecNormals[3*k];
+		double* r1 = &m_vecNormals[3*(k+1)];
+
+		double v1[3] = {x1[0]-x0[0], x1[1]-x0[1], x1[2]-x0[2]};
+		double c1 = Dot(v1, v1);
+		double rL[3], tL[3];
+		Reflect(r0, v1, c1, rL);
+		Reflect(t0, v1, c1, tL);
+		double v2[3] = {t1[0]-tL[0], t1[1]-tL[1], t1[2]-tL[2]};
+		double c2 = Dot(v2, v2);
+		if (c2 < 1e-24){
+			for (int i=0; i<3; i++){
+				r1[i] = rL[i];
+			}
+		}
+		else{
+			Reflect(rL, v2, c2, r1);
+		}
+		// keep it exactly orthogonal to the tangent against rounding
+		double f = Dot(r1, t1);
+		for (int i=0; i<3; i++){
+			r1[i] -= f*t1[i];
+		}
+		Normalize(r1);
+	}
+	return true;
+}
+
+void CPREngine::GetFrame(double fArc, double* pPoint, double* pTangent, double* pNormal) const
+{
+	int nCount = GetPointCount();
+	double fIndex = fArc/m_fPixelSpacing;
+	fIndex = fIndex<0 ? 0 : (fIndex>nCount-1 ? nCount-1 : fIndex);
+	int k = (int)fIndex;
+	k = k<nCount-1 ? k : nCount-2;
+	k = k<0 ? 0 : k;
+	double f = fIndex - k;
+	int k1 = k+1<nCount ? k+1 : k;
+	for (int i=0; i<3; i++){
+		pPoint[i] = m_vecPoints[3*k+i]*(1-f) + m_vecPoints[3*k1+i]*f;
+		pTangent[i] = m_vecTangents[3*k+i]*(1-f) + m_vecTangents[3*k1+i]*f;
+		pNormal[i] = m_vecNormals[3*k+i]*(1-f) + m_vecNormals[3*k1+i]*f;
+	}
+	Normalize(pTangent);
+	double d = Dot(pNormal, pTangent);
+	for (int i=0; i<3; i++){
+		pNormal[i] -= d*pTangent[i];
+	}
+	Normalize(pNormal);
+}
+
+void CPREngine::GetStraightenedPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, double fAngle)
+{
+	vecPlanes.clear();
+	double fHalfH = 0.5*nWidth*m_fPixelSpacing;
+	for (int k=0; k<GetPointCount(); k++){
+		const double* p = &m_vecPoints[3*k];
+		const double* t = &m_vecTangents[3*k];
+		double h[3], n[3];
+		Turn(t, &m_vecNormals[3*k], fAngle, h);
+		Cross(h, t, n);
+		vecPlanes.push_back(MakePlane(p, h, t, n, fHalfH, 0));
+	}
+}
+
+int CPREngine::GetStretchedArcs(std::vector<double>& vecArcs, Direction3d dirLateral) const
+{
+	vecArcs.clear();
+	int nCount = GetPointCount();
+	double h[3] = {dirLateral.x(), dirLateral.y(), dirLateral.z()};
+	if (nCount <= 0 || !Normalize(h))
+		return 0;
+	// every step of one pixel spacing of arc length counts with the part of its chord
+	// that is left once the dirLateral component is taken out
+	vecArcs.resize(nCount, 0.0);
+	for (int k=1; k<nCount; k++){
+		const double* a = &m_vecPoints[3*(k-1)];
+		const double* b = &m_vecPoints[3*k];
+		double d[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+		double fLen = sqrt(Dot(d, d));
+		double f = Dot(d, h);
+		double fProjected = sqrt(fLen*fLen - f*f > 0 ? fLen*fLen - f*f : 0);
+		vecArcs[k] = vecArcs[k-1] + (fLen > 0 ? m_fPixelSpacing*fProjected/fLen : 0);
+	}
+	return (int)(vecArcs[nCount-1]/m_fPixelSpacing + 1e-6) + 1;
+}
+
+int CPREngine::GetStretchedHeight(Direction3d dirLateral) const
+{
+	std::vector<double> vecArcs;
+	return GetStretchedArcs(vecArcs, dirLateral);
+}
+
+void CPREngine::GetStretchedPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, Direction3d dirLateral)
+{
+	vecPlanes.clear();
+	std::vector<double> vecArcs;
+	int nRows = GetStretchedArcs(vecArcs, dirLateral);
+	if (nRows <= 0)
+		return;
+	double fHalfH = 0.5*nWidth*m_fPixelSpacing;
+	double h[3] = {dirLateral.x(), dirLateral.y(), dirLateral.z()};
+	Normalize(h);
+	int nCount = GetPointCount();
+	int k = 0;
+	for (int nRow=0; nRow<nRows; nRow++){
+		// rows are a pixel spacing apart on the curve projected along dirLateral, the
+		// point and tangent are interpolated within the resampled step holding the row
+		double fArc = nRow*m_fPixelSpacing;
+		while (k < nCount-2 && vecArcs[k+1] < fArc)
+			k++;
+		int k1 = k+1 < nCount ? k+1 : k;
+		double fLen = vecArcs[k1] - vecArcs[k];
+		double f = fLen>0 ? (fArc - vecArcs[k])/fLen : 0;
+		f = f<0 ? 0 : (f>1 ? 1 : f);
+		double p[3], t[3], r[3];
+		for (int i=0; i<3; i++){
+			p[i] = m_vecPoints[3*k+i]*(1-f) + m_vecPoints[3*k1+i]*f;
+			t[i] = m_vecTangents[3*k+i]*(1-f) + m_vecTangents[3*k1+i]*f;
+			r[i] = m_vecNormals[3*k+i]*(1-f) + m_vecNormals[3*k1+i]*f;
+		}
+		if (!Normalize(t)){
+			for (int i=0; i<3; i++){
+				t[i] = m_vecTangents[3*k+i];
+			}
+		}
+		// the slab normal is undefined where the curve runs along dirLateral, the frame
+		// normal stands in there
+		double n[3];
+		Cross(h, t, n);
+		if (!Normalize(n)){
+			for (int i=0; i<3; i++){
+				n[i] = r[i];
+			}
+			Normalize(n);
+		}
+		vecPlanes.push_back(MakePlane(p, h, t, n, fHalfH, 0));
+	}
+}
+
+void CPREngine::GetCrossSectionPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, int nHeight, int nNum, double fDistance, double fAngle)
+{
+	vecPlanes.clear();
+	if (GetPointCount() < 2)
+		return;
+	double fHalfH = 0.5*nWidth*m_fPixelSpacing;
+	double fHalfV = 0.5*nHeight*m_fPixelSpacing;
+	for (int i=0; i<nNum; i++){
+		double p[3], t[3], r[3], h[3], v[3];
+		GetFrame(i*fDistance, p, t, r);
+		Turn(t, r, fAngle, h);
+		Cross(t, h, v);
+		vecPlanes.push_back(MakePlane(p, h, v, t, fHalfH, fHalfV));
+	}
+}
@@ -0,0 +1,77 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <vector>
+#include "Direction.h"
+#include "Point.h"
+#include "BatchInfo.h"
+
+namespace MonkeyGL {
+
+    // geometry of curved planar reformations along a centerline in object coordinates.
+    // the centerline is resampled every pixel spacing of arc length and carries rotation
+    // minimizing frames (double reflection), the images are laid out as batch planes so
+    // either backend renders them with its MPR sampling.
+    class CPREngine
+    {
+    public:
+        CPREngine(void);
+        ~CPREngine(void);
+
+    public:
+        // needs at least two distinct points
+        bool SetCenterline(const std::vector<Point3d>& vecPoints, double fPixelSpacing);
+        void Clear();
+
+        // resampled points, one image row each for the straightened and stretched CPR
+        int GetPointCount() const;
+        double GetPixelSpacing() const;
+        double GetLength() const;
+
+        // one plane of height 1 per row. the straightened rows run along the frame
+        // normal turned fAngle degrees about the tangent, one per resampled point. the
+        // stretched rows run along the fixed dirLateral and are a pixel spacing apart on
+        // the curve projected onto the plane orthogonal to dirLateral, so distances down
+        // the image are those of that projection, GetStretchedHeight rows of them. the
+        // centerline sits in pixel nWidth/2 of every row
+        void GetStraightenedPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, double fAngle);
+        int GetStretchedHeight(Direction3d dirLateral) const;
+        void GetStretchedPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, Direction3d dirLateral);
+
+        // nNum sections orthogonal to the curve, fDistance apart along it from its first
+        // point, dirH is the frame normal turned fAngle degrees about the tangent
+        void GetCrossSectionPlanes(std::vector<BatchPlane>& vecPlanes, int nWidth, int nHeight, int nNum, double fDistance, double fAngle);
+
+    private:
+        // point, tangent and normal at fArc along the resampled curve
+        void GetFrame(double fArc, double* pPoint, double* pTangent, double* pNormal) const;
+        // projected arc length at every resampled point, returns the stretched row count
+        int GetStretchedArcs(std::vector<double>& vecArcs, Direction3d dirLateral) const;
+
+    private:
+        double m_fPixelSpacing;
+        // 3 doubles per resampled point
+        std::vector<double> m_vecPoints;
+        std::vector<double> m_vecTangents;
+        std::vector<double> m_vecNormals;
+    };
+}
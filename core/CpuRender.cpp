@@ -0,0 +1,793 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "CpuRender.h"
+#include "OrthoSlicer.h"
+#include <cmath>
+#include <cstdio>
+#include "ThreadPool.h"
+#include "StopWatch.h"
+#include "Logger.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace MonkeyGL;
+
+namespace {
+	const int c_nTileSize = 32;
+	const int c_nRun = VolumeSampler::BATCH_SIZE;
+
+	// samples pixels x0 to x0+7 of row y, t pixel spacings along the normal, -32768 outside
+	// the volume. the plane positions are the ones the per pixel path computed, only the
+	// fetch is batched
+	void SampleRun(const VolumeSampler& sampler, const float* ptOrigin, const float* fStepH, const float* fStepV, const float* fStepN, const float* f3Size, int x0, int y, float t, float* pOut)
+	{
+		const int* pDims = sampler.GetLayout().nDims;
+		float fX[c_nRun], fY[c_nRun], fZ[c_nRun];
+		bool bInside[c_nRun];
+#if defined(__SSE2__)
+		// four lanes at a time with the scalar operations in the scalar order
+		__m128 vZero = _mm_setzero_ps();
+		__m128 vOne = _mm_set1_ps(1.0f);
+		__m128 vHalf = _mm_set1_ps(0.5f);
+		__m128 vT = _mm_set1_ps(t);
+		__m128 vY = _mm_set1_ps((float)y);
+		float* pOutAxis[3] = {fX, fY, fZ};
+		for (int i=0; i<c_nRun; i+=4){
+			__m128 vX = _mm_cvtepi32_ps(_mm_setr_epi32(x0+i, x0+i+1, x0+i+2, x0+i+3));
+			__m128 vInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int j=0; j<3; j++){
+				__m128 v = _mm_add_ps(_mm_set1_ps(ptOrigin[j]), _mm_mul_ps(vT, _mm_set1_ps(fStepN[j])));
+				v = _mm_add_ps(v, _mm_mul_ps(vX, _mm_set1_ps(fStepH[j])));
+				v = _mm_add_ps(v, _mm_mul_ps(vY, _mm_set1_ps(fStepV[j])));
+				v = _mm_div_ps(v, _mm_set1_ps(f3Size[j]));
+				vInside = _mm_and_ps(vInside, _mm_and_ps(_mm_cmpge_ps(v, vZero), _mm_cmple_ps(v, vOne)));
+				if (j == 2)
+					v = _mm_sub_ps(vOne, v);
+				_mm_storeu_ps(pOutAxis[j]+i, _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps((float)pDims[j])), vHalf));
+			}
+			int nMask = _mm_movemask_ps(vInside);
+			for (int k=0; k<4; k++){
+				bInside[i+k] = (nMask >> k) & 1;
+			}
+		}
+#else
+		for (int i=0; i<c_nRun; i++){
+			int x = x0 + i;
+			float fx = (ptOrigin[0] + t*fStepN[0] + x*fStepH[0] + y*fStepV[0])/f3Size[0];
+			float fy = (ptOrigin[1] + t*fStepN[1] + x*fStepH[1] + y*fStepV[1])/f3Size[1];
+			float fz = (ptOrigin[2] + t*fStepN[2] + x*fStepH[2] + y*fStepV[2])/f3Size[2];
+			bInside[i] = fx>=0 && fx<=1 && fy>=0 && fy<=1 && fz>=0 && fz<=1;
+			fX[i] = fx*pDims[0] - 0.5f;
+			fY[i] = fy*pDims[1] - 0.5f;
+			fZ[i] = (1.0f-fz)*pDims[2] - 0.5f;
+		}
+#endif
+		sampler.Sample8(fX, fY, fZ, pOut, VolumeSampler::FilterTrilinear);
+		for (int i=0; i<c_nRun; i++){
+			if (!bInside[i])
+				pOut[i] = -32768;
+		}
+	}
+}
+
+CpuRender::CpuRender(void)
+{
+	m_fTotalXTranslate = 0.0f;
+	m_fTotalYTranslate = 0.0f;
+	m_fTotalScale = 1.0f;
+	m_nVRWidth = 512;
+	m_nVRHeight = 512;
+
+	m_pRotateMatrix = new float[9];
+	Methods::SetSeg(m_pRotateMatrix,3);
+	m_pTransposRotateMatrix = new float[9];
+	Methods::SetSeg(m_pTransposRotateMatrix,3);
+	m_pTransformMatrix = new float[9];
+	Methods::SetSeg(m_pTransformMatrix,3);
+	m_pTransposeTransformMatrix = new float[9];
+	Methods::SetSeg(m_pTransposeTransformMatrix,3);
+
+	m_rayCaster.SetTransformMatrix(m_pTransformMatrix);
+	m_rayCaster.SetAlphaAndMapping(m_AlphaAndMapping);
+
+	Logger::Info("CpuRender: %d render threads", ThreadPool::Instance()->GetThreadCount());
+}
+
+CpuRender::~CpuRender(void)
+{
+	if (NULL != m_pRotateMatrix)
+		delete [] m_pRotateMatrix;
+	if (NULL != m_pTransposRotateMatrix)
+		delete [] m_pTransposRotateMatrix;
+	if (NULL != m_pTransformMatrix)
+		delete [] m_pTransformMatrix;
+	if (NULL != m_pTransposeTransformMatrix)
+		delete [] m_pTransposeTransformMatrix;
+}
+
+bool CpuRender::SetTransferFunc( std::map<int, RGBA> ctrlPoints )
+{
+	if (!IRender::SetTransferFunc(ctrlPoints)){
+		return false;
+	}
+	UpdateTransferFunc();
+	return true;
+}
+
+bool CpuRender::SetTransferFunc(std::map<int, RGBA> ctrlPoints, unsigned char nLabel )
+{
+	if (!IRender::SetTransferFunc(ctrlPoints, nLabel)){
+		return false;
+	}
+	UpdateTransferFunc();
+	return true;
+}
+
+bool CpuRender::SetTransferFunc(std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints)
+{
+	if (!IRender::SetTransferFunc(rgbPoints, alphaPoints)){
+		return false;
+	}
+	UpdateTransferFunc();
+	return true;
+}
+
+bool CpuRender::SetTransferFunc(std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints, unsigned char nLabel)
+{
+	if (!IRender::SetTransferFunc(rgbPoints, alphaPoints, nLabel)){
+		return false;
+	}
+	UpdateTransferFunc();
+	return true;
+}
+
+void CpuRender::UpdateTransferFunc()
+{
+	// the ray caster reads the manager's tables in place, rebuilt labels keep their buffers
+	m_dataMan.UpdateTransferFunctions();
+	const TransferFunctionManager& tfManager = m_dataMan.GetTransferFunctionManager();
+	for (int label=0; label<=MAXOBJECTCOUNT; label++){
+		m_rayCaster.SetTransferFunc(tfManager.GetLUT(label), TransferFunctionManager::LUT_SIZE, label);
+		m_rayCaster.SetPreIntegrationTable(tfManager.GetPreIntegrationTable(label), TransferFunctionManager::PREINTEGRATION_SIZE, label);
+	}
+	m_rayCaster.SetPreIntegration(tfManager.IsPreIntegrationEnabled(), 1.0f);
+	m_progressive.Invalidate();
+}
+
+void CpuRender::SetPreIntegrationEnabled(bool bEnable)
+{
+	IRender::SetPreIntegrationEnabled(bEnable);
+	UpdateTransferFunc();
+}
+
+bool CpuRender::SetVRWWWL(float fWW, float fWL)
+{
+	if (!IRender::SetVRWWWL(fWW, fWL)){
+		return false;
+	}
+	UpdateAlphaWWWL();
+	return true;
+}
+
+bool CpuRender::SetVRWWWL(float fWW, float fWL, unsigned char nLabel)
+{
+	if (!IRender::SetVRWWWL(fWW, fWL, nLabel)){
+		return false;
+	}
+	UpdateAlphaWWWL();
+	return true;
+}
+
+bool CpuRender::SetObjectAlpha(float fAlpha)
+{
+	if (!IRender::SetObjectAlpha(fAlpha)){
+		return false;
+	}
+	UpdateAlphaWWWL();
+	return true;
+}
+
+bool CpuRender::SetObjectAlpha(float fAlpha, unsigned char nLabel)
+{
+	if (!IRender::SetObjectAlpha(fAlpha, nLabel)){
+		return false;
+	}
+	UpdateAlphaWWWL();
+	return true;
+}
+
+void CpuRender::UpdateAlphaWWWL()
+{
+	m_dataMan.UpdateTransferFunctions();
+	const TransferFunctionManager& tfManager = m_dataMan.GetTransferFunctionManager();
+	std::map<unsigned char, ObjectInfo> objectInfos = m_dataMan.GetObjectInfos();
+	for (std::map<unsigned char, ObjectInfo>::iterator iter=objectInfos.begin(); iter!=objectInfos.end(); iter++){
+		unsigned char label = iter->first;
+		if (label > MAXOBJECTCOUNT)
+			continue;
+		ObjectInfo info = iter->second;
+		float fScale = 0.0f, fOffset = 0.0f;
+		tfManager.GetLUTMapping(label, fScale, fOffset);
+		m_AlphaAndMapping[label] = AlphaAndMapping(info.alpha, fScale, fOffset);
+		Logger::Info("CpuRender::UpdateAlphaWWWL: label[%d], alpha[%.2f], ww[%.2f], wl[%.2f]", label, info.alpha, info.ww, info.wl);
+	}
+	m_progressive.Invalidate();
+}
+
+void CpuRender::UpdateVolume()
+{
+	int nDims[3];
+	SetRenderLevel(0.0, nDims);
+	m_rayCaster.SetOrientation(m_dataMan.GetOrientation());
+	InvalidateSlabs();
+
+	// the object list changes with the volume and masks, the tables follow it
+	UpdateTransferFunc();
+	UpdateAlphaWWWL();
+}
+
+bool CpuRender::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	if (!IRender::SetVolumeData(pData, type, nWidth, nHeight, nDepth))
+		return false;
+
+	UpdateVolume();
+
+	return true;
+}
+
+unsigned char CpuRender::AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth)
+{
+	unsigned char nLabel = IRender::AddNewObjectMask(pData, nWidth, nHeight, nDepth);
+	if (nLabel == 0)
+		return 0;
+
+	UpdateVolume();
+
+	return nLabel;
+}
+
+bool CpuRender::UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel)
+{
+	if (!IRender::UpdateObjectMask(pData, nWidth, nHeight, nDepth, nLabel))
+		return false;
+
+	UpdateVolume();
+
+	return true;
+}
+
+void CpuRender::SetVolumeFile( const char* szFile, int nWidth, int nHeight, int nDepth )
+{
+	Logger::Info("load volume file: %s", szFile);
+
+	IRender::SetVolumeFile(szFile, nWidth, nHeight, nDepth);
+
+	UpdateVolume();
+}
+
+bool CpuRender::LoadVolumeContainer(const char* szFile)
+{
+	Logger::Info("load volume container: %s", szFile);
+
+	if (!IRender::LoadVolumeContainer(szFile))
+		return false;
+
+	UpdateVolume();
+
+	return true;
+}
+
+bool CpuRender::BeginVolume(int nWidth, int nHeight, int nDepth)
+{
+	if (!IRender::BeginVolume(nWidth, nHeight, nDepth))
+		return false;
+
+	UpdateVolume();
+
+	return true;
+}
+
+void CpuRender::SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride)
+{
+	IRender::SetVolumeSlices(pSlices, nFirst, nCount, nStride);
+
+	// the volume is sampled in place, frames and slabs made before are stale
+	m_progressive.Invalidate();
+	InvalidateSlabs();
+}
+
+void CpuRender::CommitVolumeSlices(bool bComplete)
+{
+	IRender::CommitVolumeSlices(bComplete);
+
+	// the bricked copy may take the place of the volume, the samplers have to follow
+	UpdateVolume();
+}
+
+void CpuRender::SetSpacing( double x, double y, double z )
+{
+	IRender::SetSpacing(x, y, z);
+	m_rayCaster.SetSpacing(x, y, z);
+	m_progressive.Invalidate();
+	InvalidateSlabs();
+}
+
+void CpuRender::InvalidateSlabs()
+{
+	for (std::map<PlaneType, SlabEngine>::iterator iter=m_slabEngines.begin(); iter!=m_slabEngines.end(); iter++){
+		iter->second.Invalidate();
+	}
+}
+
+void CpuRender::RenderPlane(short* pData, int nWidth, int nHeight, Direction3d dirH, Direction3d dirV, Direction3d dirN, Point3d ptLeftTop, double fPixelSpacing, float halfNum, MPRType mprType)
+{
+	BatchPlane plane;
+	plane.dirH = dirH;
+	plane.dirV = dirV;
+	plane.dirN = dirN;
+	plane.ptLeftTop = ptLeftTop;
+	RenderPlanes(pData, nWidth, nHeight, &plane, 1, fPixelSpacing, halfNum, mprType);
+}
+
+void CpuRender::RenderPlanes(short* pData, int nWidth, int nHeight, const BatchPlane* pPlanes, int nPlanes, double fPixelSpacing, float halfNum, MPRType mprType)
+{
+	float f3Size[3];
+	for (int i=0; i<3; i++){
+		f3Size[i] = m_dataMan.GetSpacing(i)*m_dataMan.GetDim(i);
+	}
+
+	// origin and the steps along h, v and n of every plane, 12 floats each
+	float ps = fPixelSpacing;
+	std::vector<float> vecGeometry(12*nPlanes);
+	for (int i=0; i<nPlanes; i++){
+		BatchPlane plane = pPlanes[i];
+		float* pGeometry = &vecGeometry[12*i];
+		for (int j=0; j<3; j++){
+			pGeometry[j] = plane.ptLeftTop[j];
+		}
+		Direction3d dirs[3] = {plane.dirH, plane.dirV, plane.dirN};
+		for (int j=0; j<3; j++){
+			pGeometry[3+3*j] = ps*dirs[j].x();
+			pGeometry[4+3*j] = ps*dirs[j].y();
+			pGeometry[5+3*j] = ps*dirs[j].z();
+		}
+	}
+
+	int nDims[3];
+	SetRenderLevel(fPixelSpacing, nDims);
+
+	const VolumeSampler* pSampler = &m_sampler;
+	ThreadPool::Instance()->ParallelFor(0, nPlanes*nHeight, [&](int nRow){
+		int y = nRow % nHeight;
+		const float* ptOrigin = &vecGeometry[12*(nRow/nHeight)];
+		const float* fStepH = ptOrigin + 3;
+		const float* fStepV = ptOrigin + 6;
+		const float* fStepN = ptOrigin + 9;
+		short* pLine = pData + (size_t)nRow*nWidth;
+		for (int x0=0; x0<nWidth; x0+=c_nRun)
+		{
+			double fSum[c_nRun];
+			short nResult[c_nRun];
+			for (int i=0; i<c_nRun; i++){
+				fSum[i] = 0;
+				nResult[i] = mprType==MPRTypeMinIP ? 32767 : -32768;
+			}
+			float fVal[c_nRun];
+			for (float t=-halfNum; t<=halfNum; t+=1)
+			{
+				SampleRun(*pSampler, ptOrigin, fStepH, fStepV, fStepN, f3Size, x0, y, t, fVal);
+				for (int i=0; i<c_nRun; i++){
+					if (mprType == MPRTypeAverage){
+						fSum[i] += fVal[i];
+						continue;
+					}
+					short nVal = SaturateShort(fVal[i]);
+					if (mprType == MPRTypeMIP)
+						nResult[i] = nResult[i]>nVal ? nResult[i]:nVal;
+					else
+						nResult[i] = nResult[i]<nVal ? nResult[i]:nVal;
+				}
+			}
+			int nCount = nWidth - x0 < c_nRun ? nWidth - x0 : c_nRun;
+			for (int i=0; i<nCount; i++){
+				if (mprType == MPRTypeAverage)
+					nResult[i] = SaturateShort(fSum[i]/(2*halfNum+1));
+				pLine[x0+i] = nResult[i];
+			}
+		}
+	});
+}
+
+void CpuRender::SamplePlane(float* pPlane, int nWidth, int nHeight, Direction3d dirH, Direction3d dirV, Direction3d dirN, Point3d ptLeftTop, double fPixelSpacing, float t)
+{
+	float f3Size[3];
+	for (int i=0; i<3; i++){
+		f3Size[i] = m_dataMan.GetSpacing(i)*m_dataMan.GetDim(i);
+	}
+	float ps = fPixelSpacing;
+	float fStepH[3] = {(float)(ps*dirH.x()), (float)(ps*dirH.y()), (float)(ps*dirH.z())};
+	float fStepV[3] = {(float)(ps*dirV.x()), (float)(ps*dirV.y()), (float)(ps*dirV.z())};
+	float fStepN[3] = {(float)(ps*dirN.x()), (float)(ps*dirN.y()), (float)(ps*dirN.z())};
+	float ptOrigin[3] = {(float)ptLeftTop[0], (float)ptLeftTop[1], (float)ptLeftTop[2]};
+
+	int nDims[3];
+	SetRenderLevel(fPixelSpacing, nDims);
+
+	const VolumeSampler* pSampler = &m_sampler;
+	ThreadPool::Instance()->ParallelFor(0, nHeight, [&](int y){
+		float* pLine = pPlane + y*nWidth;
+		float fVal[c_nRun];
+		for (int x0=0; x0<nWidth; x0+=c_nRun)
+		{
+			SampleRun(*pSampler, ptOrigin, fStepH, fStepV, fStepN, f3Size, x0, y, t, fVal);
+			int nCount = nWidth - x0 < c_nRun ? nWidth - x0 : c_nRun;
+			for (int i=0; i<nCount; i++){
+				pLine[x0+i] = fVal[i];
+			}
+		}
+	});
+}
+
+bool CpuRender::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneInfo& planeInfo, Point3d ptCenter)
+{
+	nWidth = planeInfo.m_nWidth;
+	nHeight = planeInfo.m_nHeight;
+	if (nWidth % 2){
+		nWidth += 1;
+	}
+
+	if (NULL == pData || nWidth<=0 || nHeight<=0)
+		return false;
+
+	PlaneInfo info = planeInfo;
+	PlaneType planeType = info.m_PlaneType;
+	Direction3d& dirH = info.m_dirH;
+	Direction3d& dirV = info.m_dirV;
+	Direction3d dirN = info.GetNormDirection();
+	double fPixelSpacing = info.m_fPixelSpacing;
+	Point3d ptLeftTop = ptCenter - dirH*(0.5*nWidth*fPixelSpacing);
+	ptLeftTop = ptLeftTop - dirV*(0.5*nHeight*fPixelSpacing);
+
+	double fSliceThickness = info.m_fSliceThickness;
+	int nSliceNum = fSliceThickness/fPixelSpacing;
+	nSliceNum = nSliceNum<1 ? 1:nSliceNum;
+	float halfNum = 1.0f*(nSliceNum-1)/2;
+
+	// axis aligned single slices come straight from the volume
+	{
+		int nDims[3] = {m_dataMan.GetDim(0), m_dataMan.GetDim(1), m_dataMan.GetDim(2)};
+		double fSpacing[3] = {m_dataMan.GetSpacing(0), m_dataMan.GetSpacing(1), m_dataMan.GetSpacing(2)};
+		bool bSliced = false;
+		if (m_dataMan.IsBrickedLayout())
+		{
+			BrickedVolume& bricked = m_dataMan.GetBrickedVolume();
+			const int* pOffsets[3] = {bricked.GetOffsets(0), bricked.GetOffsets(1), bricked.GetOffsets(2)};
+			bSliced = OrthoSlicer::GetPlaneData(pData, nWidth, nHeight, bricked.GetData(), pOffsets, nDims, fSpacing, dirH, dirV, ptLeftTop, fPixelSpacing, nSliceNum);
+		}
+		else
+		{
+			bSliced = OrthoSlicer::GetPlaneData(pData, nWidth, nHeight, m_dataMan.GetVoxelData().get(), m_dataMan.GetVoxelType(), NULL, nDims, fSpacing, dirH, dirV, ptLeftTop, fPixelSpacing, nSliceNum);
+		}
+		if (bSliced)
+			return true;
+	}
+
+	switch (info.m_MPRType)
+	{
+	case MPRTypeAverage:
+	case MPRTypeMIP:
+	case MPRTypeMinIP:
+		{
+			char szMsg[64];
+			snprintf(szMsg, sizeof(szMsg), "CpuRender::GetPlaneData level[%d]", m_dataMan.SelectLevel(fPixelSpacing));
+			StopWatch sw(szMsg);
+			if (nSliceNum > 1){
+				// browsing a thick slab only samples the planes that enter it
+				m_slabEngines[planeType].Render(pData, nWidth, nHeight, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, nSliceNum, info.m_MPRType,
+					[&](float* pPlane, float t){
+						SamplePlane(pPlane, nWidth, nHeight, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, t);
+					});
+				return true;
+			}
+			RenderPlane(pData, nWidth, nHeight, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, info.m_MPRType);
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+bool CpuRender::GetPlaneMaxSize( int& nWidth, int& nHeight, const PlaneType& planeType )
+{
+	return IRender::GetPlaneMaxSize(nWidth, nHeight, planeType);
+}
+
+bool CpuRender::GetCrossHairPoint( double& x, double& y, const PlaneType& planeType )
+{
+	if (PlaneVR == planeType)
+	{
+		int nWidth = m_nVRWidth;
+		int nHeight = m_nVRHeight;
+		Point3d ptCrossHair = m_dataMan.GetCrossHair();
+		Point3d ptDelta = ptCrossHair - m_dataMan.GetCenterPoint();
+		Point3d ptRotate = Methods::matrixMul(m_pTransposeTransformMatrix, ptDelta);
+
+		double xRotate = ptRotate.x();
+		double zRotate = ptRotate.z();
+
+		double xLen = m_dataMan.GetDim(0)*m_dataMan.GetSpacing(0);
+		double zLen = m_dataMan.GetDim(2)*m_dataMan.GetSpacing(2);
+
+		double spacing = (xLen/nWidth)>(zLen/nHeight) ? (xLen/nWidth) : (zLen/nHeight);
+
+		x = (nWidth-1)/2.0 + (xRotate/spacing) + m_fTotalXTranslate;
+		y = (nHeight-1)/2.0 + (zRotate/spacing) + m_fTotalYTranslate;
+	}
+	else
+	{
+		return m_dataMan.GetCrossHairPoint(x, y, planeType);
+	}
+	return true;
+}
+
+int CpuRender::SetRenderLevel(double fPixelSpacing, int* pDims)
+{
+	int nLevel = m_dataMan.SelectLevel(fPixelSpacing);
+	VolumePyramid& pyramid = m_dataMan.GetVolumePyramid();
+	if (nLevel == 0)
+	{
+		for (int i=0; i<3; i++)
+			pDims[i] = m_dataMan.GetDim(i);
+		if (m_dataMan.IsBrickedLayout())
+		{
+			BrickedVolume& bricked = m_dataMan.GetBrickedVolume();
+			const int* pOffsets[3] = {bricked.GetOffsets(0), bricked.GetOffsets(1), bricked.GetOffsets(2)};
+			m_rayCaster.SetVolume(bricked.GetData(), m_dataMan.GetMaskData().get(), pDims[0], pDims[1], pDims[2], pOffsets, bricked.GetVoxelCount());
+			m_sampler.SetVolume(bricked.GetData(), pDims[0], pDims[1], pDims[2], pOffsets[0], pOffsets[1], pOffsets[2], bricked.GetVoxelCount());
+		}
+		else
+		{
+			m_rayCaster.SetVolume(m_dataMan.GetVoxelData().get(), m_dataMan.GetVoxelType(), m_dataMan.GetMaskData().get(), pDims[0], pDims[1], pDims[2]);
+			m_sampler.SetVolume(m_dataMan.GetVoxelData().get(), m_dataMan.GetVoxelType(), pDims[0], pDims[1], pDims[2]);
+		}
+		m_rayCaster.SetLevelScale(1.0f);
+		m_rayCaster.SetSpacing(m_dataMan.GetSpacing(0), m_dataMan.GetSpacing(1), m_dataMan.GetSpacing(2));
+		m_sampler.SetSpacing(m_dataMan.GetSpacing(0), m_dataMan.GetSpacing(1), m_dataMan.GetSpacing(2));
+		return nLevel;
+	}
+
+	// the level keeps the physical extent, its spacing follows from the shorter sides
+	double fSpacing[3];
+	for (int i=0; i<3; i++)
+	{
+		pDims[i] = pyramid.GetDim(nLevel, i);
+		fSpacing[i] = m_dataMan.GetSpacing(i)*m_dataMan.GetDim(i)/pDims[i];
+	}
+	const unsigned char* pMask = m_dataMan.GetMaskData() ? pyramid.GetMaskData(nLevel) : NULL;
+	m_rayCaster.SetVolume(pyramid.GetVolumeData(nLevel), pyramid.GetVoxelType(), pMask, pDims[0], pDims[1], pDims[2]);
+	m_rayCaster.SetLevelScale(1.0f*m_dataMan.GetDim(2)/pDims[2]);
+	m_rayCaster.SetSpacing(fSpacing[0], fSpacing[1], fSpacing[2]);
+	m_sampler.SetVolume(pyramid.GetVolumeData(nLevel), pyramid.GetVoxelType(), pDims[0], pDims[1], pDims[2]);
+	m_sampler.SetSpacing(fSpacing[0], fSpacing[1], fSpacing[2]);
+	return nLevel;
+}
+
+bool CpuRender::PrepareVR(int nWidth, int nHeight, int& nLevel)
+{
+	if (nWidth<=0 || nHeight<=0)
+		return false;
+	if (!m_dataMan.HasVolumeData())
+		return false;
+	m_nVRWidth = nWidth;
+	m_nVRHeight = nHeight;
+
+	// a pixel step moves the ray origin by a matrix column in units of the longest side
+	double fMaxLen = 0.0;
+	for (int i=0; i<3; i++)
+	{
+		double fLen = m_dataMan.GetDim(i)*m_dataMan.GetSpacing(i);
+		fMaxLen = fLen > fMaxLen ? fLen : fMaxLen;
+	}
+	const float* m = m_pTransformMatrix;
+	double fLenH = sqrt(m[0]*m[0] + m[3]*m[3] + m[6]*m[6])*fMaxLen/nWidth;
+	double fLenV = sqrt(m[2]*m[2] + m[5]*m[5] + m[8]*m[8])*fMaxLen/nHeight;
+	int nDims[3];
+	nLevel = SetRenderLevel(fLenH < fLenV ? fLenH : fLenV, nDims);
+
+	VOI voi;
+	voi.left = 0;
+	voi.right = nDims[0] - 1;
+	voi.posterior = 0;
+	voi.anterior = nDims[1] - 1;
+	voi.head = 0;
+	voi.foot = nDims[2] - 1;
+	m_rayCaster.SetVOI(voi);
+	m_rayCaster.SetColorBackground(m_dataMan.GetColorBackground());
+	m_rayCaster.SetTransformMatrix(m_pTransformMatrix);
+	m_rayCaster.SetView(nWidth, nHeight, m_fTotalXTranslate, m_fTotalYTranslate, m_fTotalScale);
+
+	m_dataMan.UpdateEmptyBricks();
+	BrickTable& brickTable = m_dataMan.GetBrickTable();
+	m_rayCaster.SetBrickTable(brickTable.IsValid() ? &brickTable : NULL);
+	return true;
+}
+
+void CpuRender::RenderVR(unsigned char* pVR, int nWidth, int nHeight, int nStep, int nSkipStep)
+{
+	int nTilesX = (nWidth + c_nTileSize - 1)/c_nTileSize;
+	int nTilesY = (nHeight + c_nTileSize - 1)/c_nTileSize;
+	RayCaster* pRayCaster = &m_rayCaster;
+	ThreadPool::Instance()->ParallelFor(0, nTilesX*nTilesY, [&](int nTile){
+		int xStart = (nTile%nTilesX)*c_nTileSize;
+		int yStart = (nTile/nTilesX)*c_nTileSize;
+		int xEnd = xStart+c_nTileSize < nWidth ? xStart+c_nTileSize : nWidth;
+		int yEnd = yStart+c_nTileSize < nHeight ? yStart+c_nTileSize : nHeight;
+		if (nStep == 1 && nSkipStep == 0)
+			pRayCaster->RenderTile(pVR, xStart, yStart, xEnd, yEnd);
+		else
+			pRayCaster->RenderTile(pVR, xStart, yStart, xEnd, yEnd, nStep, nSkipStep);
+	});
+}
+
+bool CpuRender::GetVRData( unsigned char* pVR, int nWidth, int nHeight )
+{
+	int nLevel = 0;
+	if (NULL == pVR || !PrepareVR(nWidth, nHeight, nLevel))
+		return false;
+
+	char szMsg[64];
+	snprintf(szMsg, sizeof(szMsg), "CpuRender::GetVRData level[%d]", nLevel);
+	StopWatch sw(szMsg);
+	RenderVR(pVR, nWidth, nHeight, 1, 0);
+
+	return true;
+}
+
+void CpuRender::GetVRViewKey( std::vector<double>& vecViewKey )
+{
+	vecViewKey.insert(vecViewKey.end(), m_pTransformMatrix, m_pTransformMatrix+9);
+	vecViewKey.push_back(m_fTotalXTranslate);
+	vecViewKey.push_back(m_fTotalYTranslate);
+	vecViewKey.push_back(m_fTotalScale);
+	RGBA clrBG = m_dataMan.GetColorBackground();
+	vecViewKey.push_back(clrBG.red);
+	vecViewKey.push_back(clrBG.green);
+	vecViewKey.push_back(clrBG.blue);
+}
+
+bool CpuRender::GetVRDataProgressive( unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal )
+{
+	int nLevel = 0;
+	if (NULL == pVR || !PrepareVR(nWidth, nHeight, nLevel))
+		return false;
+
+	std::vector<double> vecViewKey;
+	GetVRViewKey(vecViewKey);
+
+	RayCaster* pRayCaster = &m_rayCaster;
+	return m_progressive.Render(pVR, nWidth, nHeight, vecViewKey, [&](unsigned char* pFrame, int w, int h, int nStep, int nSkipStep, bool bPreview){
+		pRayCaster->SetPreview(bPreview);
+		RenderVR(pFrame, w, h, nStep, nSkipStep);
+		pRayCaster->SetPreview(false);
+		return true;
+	}, nQualityLevel, bFinal);
+}
+
+bool CpuRender::RenderBatchPlanes( short* pData, int nWidth, int nHeight, const std::vector<BatchPlane>& vecPlanes, double fPixelSpacing, float halfNum, MPRType mprType )
+{
+	char szMsg[64];
+	snprintf(szMsg, sizeof(szMsg), "CpuRender::RenderBatchPlanes level[%d]", m_dataMan.SelectLevel(fPixelSpacing));
+	StopWatch sw(szMsg);
+
+	RenderPlanes(pData, nWidth, nHeight, vecPlanes.data(), (int)vecPlanes.size(), fPixelSpacing, halfNum, mprType);
+	return true;
+}
+
+void CpuRender::PanCrossHair( int nx, int ny, PlaneType planeType )
+{
+	if (PlaneVR != planeType)
+	{
+		IRender::PanCrossHair(nx, ny, planeType);
+		return;
+	}
+
+	int nLevel = 0;
+	if (!PrepareVR(m_nVRWidth, m_nVRHeight, nLevel))
+		return;
+
+	// a ray through empty background picks nothing, the crosshair stays
+	float pos[3];
+	if (!m_rayCaster.PickRay(nx, ny, pos))
+		return;
+	SetCrossHairFromVR(pos);
+}
+
+bool CpuRender::GetPlaneRotateMatrix( float* pMatirx, PlaneType planeType )
+{
+	if (planeType == PlaneVR)
+	{
+		memcpy(pMatirx, m_pRotateMatrix, 9*sizeof(float));
+		return true;
+	}
+	return IRender::GetPlaneRotateMatrix(pMatirx, planeType);
+}
+
+void CpuRender::ResetTransformMatrix(float fxRotate, float fyRotate)
+{
+	Methods::SetSeg(m_pRotateMatrix, 3);
+	Methods::SetSeg(m_pTransposRotateMatrix, 3);
+	Methods::SetSeg(m_pTransformMatrix, 3);
+	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
+	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, fxRotate, fyRotate, m_fTotalScale);
+}
+
+void CpuRender::Anterior()
+{
+	ResetTransformMatrix(0.0f, 0.0f);
+}
+
+void CpuRender::Posterior()
+{
+	ResetTransformMatrix(0.0f, 180.0f);
+}
+
+void CpuRender::Left()
+{
+	ResetTransformMatrix(0.0f, -90.0f);
+}
+
+void CpuRender::Right()
+{
+	ResetTransformMatrix(0.0f, 90.0f);
+}
+
+void CpuRender::Head()
+{
+	ResetTransformMatrix(90.0f, 180.0f);
+}
+
+void CpuRender::Foot()
+{
+	ResetTransformMatrix(-90.0f, 0.0f);
+}
+
+void CpuRender::Rotate( float fxRotate, float fyRotate )
+{
+	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, fyRotate, fxRotate, 1.0f);
+}
+
+void CpuRender::Zoom( float ratio)
+{
+	m_fTotalScale *= ratio;
+	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, 0.0f, ratio);
+}
+
+void CpuRender::Pan(float fxShift, float fyShift)
+{
+	m_fTotalXTranslate += fxShift;
+	m_fTotalYTranslate += fyShift;
+}
@@ -0,0 +1,133 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "Defines.h"
+#include "TransferFunction.h"
+#include "VolumeInfo.h"
+#include "Methods.h"
+#include "IRender.h"
+#include "RayCaster.h"
+#include "ProgressiveRefinement.h"
+#include "SlabEngine.h"
+#include "VolumeSampler.h"
+
+namespace MonkeyGL {
+
+    // render backend for machines without a cuda device, ray casting is done
+    // on the host by tiles spread over the thread pool.
+    class CpuRender : public IRender
+    {
+    public:
+        CpuRender(void);
+        ~CpuRender(void);
+
+    public:
+    // volume info
+        using IRender::SetVolumeData;
+        virtual bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
+        virtual unsigned char AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
+        virtual bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
+        virtual void SetVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        virtual bool LoadVolumeContainer(const char* szFile);
+        virtual bool BeginVolume(int nWidth, int nHeight, int nDepth);
+        virtual void SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride);
+        virtual void CommitVolumeSlices(bool bComplete);
+        virtual void SetSpacing(double x, double y, double z);
+
+    // output
+        virtual bool GetPlaneMaxSize(int& nWidth, int& nHeight, const PlaneType& planeType);
+        using IRender::GetPlaneData;
+        virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneInfo& planeInfo, Point3d ptCenter);
+
+        virtual bool GetCrossHairPoint(double& x, double& y, const PlaneType& planeType);
+        // on PlaneVR the crosshair goes where the ray under the pixel turns opaque
+        virtual void PanCrossHair(int nx, int ny, PlaneType planeType);
+
+        virtual bool GetVRData(unsigned char* pVR, int nWidth, int nHeight);
+        virtual bool GetVRDataProgressive(unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal);
+
+        virtual bool GetPlaneRotateMatrix(float* pMatirx, PlaneType planeType);
+
+        virtual void Anterior();
+        virtual void Posterior();
+        virtual void Left();
+        virtual void Right();
+        virtual void Head();
+        virtual void Foot();
+
+        virtual void Rotate(float fxRotate, float fyRotate);
+        virtual void Zoom(float ratio);
+        virtual void Pan(float fxShift, float fyShift);
+
+        virtual bool SetVRWWWL(float fWW, float fWL);
+        virtual bool SetVRWWWL(float fWW, float fWL, unsigned char nLabel);
+        virtual bool SetObjectAlpha(float fAlpha);
+        virtual bool SetObjectAlpha(float fAlpha, unsigned char nLabel);
+        virtual bool SetTransferFunc(std::map<int, RGBA> ctrlPts);
+        virtual bool SetTransferFunc(std::map<int, RGBA> ctrlPts, unsigned char nLabel);
+        virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts);
+        virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts, unsigned char nLabel);
+        virtual void SetPreIntegrationEnabled(bool bEnable);
+
+    protected:
+        virtual bool RenderBatchPlanes(short* pData, int nWidth, int nHeight, const std::vector<BatchPlane>& vecPlanes, double fPixelSpacing, float halfNum, MPRType mprType);
+        virtual void GetVRViewKey(std::vector<double>& vecViewKey);
+
+    private:
+        void UpdateVolume();
+        void InvalidateSlabs();
+        void UpdateTransferFunc();
+        void UpdateAlphaWWWL();
+        void ResetTransformMatrix(float fxRotate, float fyRotate);
+        // points the ray caster and the sampler at the pyramid level for fPixelSpacing, returns the level
+        int SetRenderLevel(double fPixelSpacing, int* pDims);
+        bool PrepareVR(int nWidth, int nHeight, int& nLevel);
+        void RenderVR(unsigned char* pVR, int nWidth, int nHeight, int nStep, int nSkipStep);
+
+        void RenderPlane(short* pData, int nWidth, int nHeight, Direction3d dirH, Direction3d dirV, Direction3d dirN, Point3d ptLeftTop, double fPixelSpacing, float halfNum, MPRType mprType);
+        // nPlanes planes back to back, the rows of all planes share one parallel loop
+        void RenderPlanes(short* pData, int nWidth, int nHeight, const BatchPlane* pPlanes, int nPlanes, double fPixelSpacing, float halfNum, MPRType mprType);
+        // samples of the single plane t pixel spacings along dirN from ptLeftTop
+        void SamplePlane(float* pPlane, int nWidth, int nHeight, Direction3d dirH, Direction3d dirV, Direction3d dirN, Point3d ptLeftTop, double fPixelSpacing, float t);
+
+    private:
+        RayCaster m_rayCaster;
+        // batched fetches for the MPR paths, follows the ray caster's level
+        VolumeSampler m_sampler;
+        ProgressiveRefinement m_progressive;
+        std::map<PlaneType, SlabEngine> m_slabEngines;
+
+        float m_fTotalXTranslate;
+        float m_fTotalYTranslate;
+        float m_fTotalScale;
+        // size of the last VR frame, clicks and the crosshair are in its pixels
+        int m_nVRWidth;
+        int m_nVRHeight;
+
+        AlphaAndMapping m_AlphaAndMapping[MAXOBJECTCOUNT+1];
+        float* m_pRotateMatrix;
+        float* m_pTransposRotateMatrix;
+        float* m_pTransformMatrix;
+        float* m_pTransposeTransformMatrix;
+    };
+}
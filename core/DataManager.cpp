@@ -22,13 +22,28 @@
 
 #include "DataManager.h"
 #include "Logger.h"
+#include "StopWatch.h"
 
 using namespace MonkeyGL;
 
+namespace {
+	// a longer gap between two scroll steps starts a new scroll
+	const long long c_nScrollPauseMS = 500;
+}
+
 DataManager::DataManager(void)
 {
 	m_activeLabel = -1;
 	m_objectInfos.clear();
+	m_bEmptyBricksDirty = true;
+	m_nDataVersion = 0;
+	m_scrollPlaneType = PlaneNotDefined;
+	m_bScrollByIndex = false;
+	m_fScrollDelta = 0.0f;
+	m_nScrollIndex = 0;
+	m_nScrollIndexStep = 0;
+	m_nScrollTime = 0;
+	m_fScrollVelocity = 0.0;
 }
 
 DataManager::~DataManager(void)
@@ -41,6 +56,10 @@ void DataManager::ClearAndReset()
 	m_orientation.reset();
 	m_objectInfos.clear();
 	m_volInfo.Clear();
+	m_tfManager.Clear();
+	m_bEmptyBricksDirty = true;
+	m_nDataVersion++;
+	m_scrollPlaneType = PlaneNotDefined;
 }
 
 bool DataManager::LoadVolumeFile( const char* szFile, int nWidth, int nHeight, int nDepth )
@@ -53,10 +72,71 @@ bool DataManager::LoadVolumeFile( const char* szFile, int nWidth, int nHeight, i
 	return res;
 }
 
+bool DataManager::SaveVolumeContainer(const char* szFile)
+{
+	std::vector<unsigned char> vecLabels;
+	for (std::map<unsigned char, ObjectInfo>::iterator iter=m_objectInfos.begin(); iter!=m_objectInfos.end(); iter++){
+		if (iter->first > 0)
+			vecLabels.push_back(iter->first);
+	}
+	return m_volInfo.SaveVolumeContainer(szFile, vecLabels);
+}
+
+bool DataManager::LoadVolumeContainer(const char* szFile)
+{
+	ClearAndReset();
+	std::vector<unsigned char> vecLabels;
+	bool res = m_volInfo.LoadVolumeContainer(szFile, vecLabels);
+	ResetPlaneInfos();
+	m_activeLabel = 0;
+	m_objectInfos[0] = ObjectInfo();
+	for (size_t i=0; i<vecLabels.size(); i++){
+		m_objectInfos[vecLabels[i]] = ObjectInfo();
+		m_activeLabel = vecLabels[i];
+	}
+	return res;
+}
+
+bool DataManager::BeginVolume(int nWidth, int nHeight, int nDepth)
+{
+	if (!m_volInfo.IsPerpendicularCoord())
+		return false;
+
+	ClearAndReset();
+	bool res = m_volInfo.BeginVolume(nWidth, nHeight, nDepth);
+	ResetPlaneInfos();
+	m_activeLabel = 0;
+	m_objectInfos[0] = ObjectInfo();
+	return res;
+}
+
+void DataManager::SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride)
+{
+	m_volInfo.SetVolumeSlices(pSlices, nFirst, nCount, nStride);
+	m_nDataVersion++;
+}
+
+void DataManager::CommitVolumeSlices(bool bComplete)
+{
+	m_volInfo.CommitVolumeSlices(bComplete);
+	m_bEmptyBricksDirty = true;
+	m_nDataVersion++;
+}
+
+void DataManager::SetMemoryMapEnabled(bool bEnable)
+{
+	m_volInfo.SetMemoryMapEnabled(bEnable);
+}
+
 bool DataManager::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth)
+{
+	return SetVolumeData(pData, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool DataManager::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
 {
 	ClearAndReset();
-	bool res = m_volInfo.SetVolumeData(pData, nWidth, nHeight, nDepth);
+	bool res = m_volInfo.SetVolumeData(pData, type, nWidth, nHeight, nDepth);
 	ResetPlaneInfos();
 	m_activeLabel = 0;
 	m_objectInfos[0] = ObjectInfo();
@@ -92,6 +172,8 @@ unsigned char DataManager::AddNewObjectMask(std::shared_ptr<unsigned char>pData,
 
 	m_objectInfos[nLabel] = m_objectInfos[m_activeLabel];
 	m_activeLabel = nLabel;
+	m_bEmptyBricksDirty = true;
+	m_nDataVersion++;
 	return nLabel;
 }
 
@@ -107,6 +189,8 @@ bool DataManager::UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWid
 	if (m_objectInfos.find(nLabel) == m_objectInfos.end()){
 		return false;
 	}
+	m_bEmptyBricksDirty = true;
+	m_nDataVersion++;
 	return m_volInfo.UpdateObjectMask(pData, nWidth, nHeight, nDepth, nLabel);
 }
 
@@ -122,6 +206,7 @@ bool DataManager::SetControlPoints_TF( std::map<int, RGBA> ctrlPts, unsigned cha
 		return false;
 	}
 	m_objectInfos[nLabel].idx2rgba = ctrlPts;
+	m_bEmptyBricksDirty = true;
 	return true;
 }
 
@@ -138,6 +223,7 @@ bool DataManager::SetControlPoints_TF( std::map<int, RGBA> rgbPts, std::map<int,
 	}
 	m_objectInfos[nLabel].idx2rgba = rgbPts;
 	m_objectInfos[nLabel].idx2alpha = alphaPts;
+	m_bEmptyBricksDirty = true;
 	return true;
 }
 
@@ -146,6 +232,31 @@ std::map<unsigned char, ObjectInfo> DataManager::GetObjectInfos()
 	return m_objectInfos;
 }
 
+int DataManager::UpdateTransferFunctions()
+{
+	return m_tfManager.Update(m_objectInfos);
+}
+
+bool DataManager::UpdateEmptyBricks()
+{
+	BrickTable& brickTable = m_volInfo.GetBrickTable();
+	if (!m_bEmptyBricksDirty || !brickTable.IsValid())
+		return false;
+
+	UpdateTransferFunctions();
+	brickTable.ResetTransparency();
+	for (std::map<unsigned char, ObjectInfo>::iterator iter=m_objectInfos.begin(); iter!=m_objectInfos.end(); iter++){
+		int ntfLength = 0;
+		const RGBA* pTransferFunc = m_tfManager.GetTransferFunction(iter->first, ntfLength);
+		if (NULL != pTransferFunc){
+			brickTable.SetTransparency(iter->first, pTransferFunc, ntfLength, iter->second.ww, iter->second.wl);
+		}
+	}
+	brickTable.UpdateEmptyBricks();
+	m_bEmptyBricksDirty = false;
+	return true;
+}
+
 void DataManager::SetColorBackground(RGBA clrBG)
 {
 	m_colorBG = clrBG;
@@ -159,11 +270,13 @@ RGBA DataManager::GetColorBackground()
 void DataManager::SetDirection(Direction3d dirX, Direction3d dirY, Direction3d dirZ)
 {
 	m_volInfo.SetDirection(dirX, dirY, dirZ);
+	m_nDataVersion++;
 }
 
 void DataManager::SetSpacing( double x, double y, double z )
 {
 	m_volInfo.SetSpacing(x, y, z);
+	m_nDataVersion++;
 	ResetPlaneInfos();
 }
 
@@ -241,6 +354,16 @@ std::shared_ptr<short> DataManager::GetVolumeData(int& nWidth, int& nHeight, int
 	return m_volInfo.GetVolumeData(nWidth, nHeight, nDepth);
 }
 
+std::shared_ptr<void> DataManager::GetVoxelData()
+{
+	return m_volInfo.GetVoxelData();
+}
+
+VoxelType DataManager::GetVoxelType()
+{
+	return m_volInfo.GetVoxelType();
+}
+
 std::shared_ptr<unsigned char> DataManager::GetMaskData()
 {
 	return m_volInfo.GetMaskData();
@@ -476,11 +599,23 @@ bool DataManager::GetPlaneMaxSize( int& nWidth, int& nHeight, const PlaneType& p
 
 void DataManager::Browse( float fDelta, PlaneType planeType )
 {
-	if (m_planeInfos.find(planeType) == m_planeInfos.end())
+	Point3d ptCrossHair;
+	if (!GetBrowsePoint(ptCrossHair, m_ptCrossHair, fDelta, planeType))
 		return;
+	RecordScroll(ptCrossHair, planeType);
+	m_bScrollByIndex = false;
+	m_fScrollDelta = fDelta;
+	m_ptCrossHair = ptCrossHair;
+}
+
+bool DataManager::GetBrowsePoint( Point3d& pt, Point3d ptCrossHair, float fDelta, PlaneType planeType )
+{
+	if (m_planeInfos.find(planeType) == m_planeInfos.end())
+		return false;
 	PlaneInfo& info = m_planeInfos[planeType];
 	Direction3d dirN = info.GetNormDirection();
-	m_ptCrossHair = m_ptCrossHair + dirN*fDelta;
+	pt = ptCrossHair + dirN*fDelta;
+	return true;
 }
 
 bool DataManager::SetVRWWWL(float fWW, float fWL)
@@ -495,6 +630,7 @@ bool DataManager::SetVRWWWL(float fWW, float fWL, unsigned char nLabel)
 	}
 	m_objectInfos[nLabel].ww = fWW;
 	m_objectInfos[nLabel].wl = fWL;
+	m_bEmptyBricksDirty = true;
 	return true;
 }
 
@@ -515,15 +651,78 @@ bool DataManager::SetObjectAlpha(float fAlpha, unsigned char nLabel)
 
 void DataManager::SetPlaneIndex( int index, PlaneType planeType )
 {
-	if (m_planeInfos.find(planeType) == m_planeInfos.end())
+	Point3d ptCrossHair;
+	if (!GetIndexPoint(ptCrossHair, m_ptCrossHair, index, planeType))
 		return;
+	bool bContinued = m_bScrollByIndex && m_scrollPlaneType == planeType;
+	RecordScroll(ptCrossHair, planeType);
+	m_nScrollIndexStep = bContinued ? index - m_nScrollIndex : 0;
+	m_bScrollByIndex = true;
+	m_nScrollIndex = index;
+	m_ptCrossHair = ptCrossHair;
+}
+
+bool DataManager::GetIndexPoint( Point3d& pt, Point3d ptCrossHair, int index, PlaneType planeType )
+{
+	if (m_planeInfos.find(planeType) == m_planeInfos.end())
+		return false;
 	PlaneInfo& info = m_planeInfos[planeType];
 	Direction3d dirN = info.GetNormDirection();
 	int nTotalNum = info.m_nNumber;
 	double spacing = GetMinSpacing();
 	double dist2Center = (index - (nTotalNum-1)/2) * spacing;
-	Point3d ptProj = Projection_Point2Plane(m_ptCrossHair, info.m_dirH, info.m_dirV, m_ptCenter);
-	m_ptCrossHair = ptProj + dirN*dist2Center;
+	Point3d ptProj = Projection_Point2Plane(ptCrossHair, info.m_dirH, info.m_dirV, m_ptCenter);
+	pt = ptProj + dirN*dist2Center;
+	return true;
+}
+
+void DataManager::RecordScroll( Point3d ptCrossHair, PlaneType planeType )
+{
+	PlaneInfo& info = m_planeInfos[planeType];
+	double fDistance = Distance_Point2Plane(ptCrossHair, info.m_dirH, info.m_dirV, m_ptCrossHair);
+	long long nNow = StopWatch::GetMSStamp();
+	long long nElapsed = nNow - m_nScrollTime;
+	if (planeType != m_scrollPlaneType || nElapsed > c_nScrollPauseMS)
+	{
+		m_fScrollVelocity = 0.0;
+	}
+	else
+	{
+		// steps arriving within the same millisecond are averaged over one
+		double fVelocity = 1000.0*fDistance/(nElapsed > 1 ? nElapsed : 1);
+		m_fScrollVelocity = m_fScrollVelocity == 0.0 ? fVelocity : 0.5*(m_fScrollVelocity + fVelocity);
+	}
+	m_scrollPlaneType = planeType;
+	m_nScrollTime = nNow;
+}
+
+double DataManager::GetScrollVelocity( PlaneType planeType )
+{
+	if (planeType != m_scrollPlaneType || StopWatch::GetMSStamp() - m_nScrollTime > c_nScrollPauseMS)
+		return 0.0;
+	return m_fScrollVelocity;
+}
+
+bool DataManager::GetScrollAhead( std::vector<Point3d>& vecPoints, PlaneType planeType, int nCount )
+{
+	vecPoints.clear();
+	if (planeType != m_scrollPlaneType)
+		return false;
+	if ((m_bScrollByIndex && m_nScrollIndexStep == 0) || (!m_bScrollByIndex && m_fScrollDelta == 0.0f))
+		return false;
+
+	// step by step from the crosshair, so each point is what the next call would compute
+	Point3d ptCrossHair = m_ptCrossHair;
+	for (int i=1; i<=nCount; i++)
+	{
+		bool bValid = m_bScrollByIndex ?
+			GetIndexPoint(ptCrossHair, ptCrossHair, m_nScrollIndex + i*m_nScrollIndexStep, planeType) :
+			GetBrowsePoint(ptCrossHair, ptCrossHair, m_fScrollDelta, planeType);
+		if (!bValid)
+			break;
+		vecPoints.push_back(ptCrossHair);
+	}
+	return !vecPoints.empty();
 }
 
 void DataManager::PanCrossHair(int nx, int ny, PlaneType planeType)
@@ -28,6 +28,7 @@
 #include <vector>
 #include <set>
 #include "ObjectInfo.h"
+#include "TransferFunctionManager.h"
 
 namespace MonkeyGL {
 
@@ -39,12 +40,23 @@ namespace MonkeyGL {
 
     public:
         bool LoadVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        bool SaveVolumeContainer(const char* szFile);
+        bool LoadVolumeContainer(const char* szFile);
+        // a volume loaded in pieces, see VolumeInfo::BeginVolume. fails for volumes whose
+        // axes are not perpendicular, their normalization needs all the slices at once
+        bool BeginVolume(int nWidth, int nHeight, int nDepth);
+        void SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride);
+        void CommitVolumeSlices(bool bComplete);
+        void SetMemoryMapEnabled(bool bEnable);
         bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
         unsigned char AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
         bool UpdateActiveObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
         bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
         std::shared_ptr<short> GetVolumeData();
         std::shared_ptr<short> GetVolumeData(int& nWidth, int& nHeight, int& nDepth);
+        std::shared_ptr<void> GetVoxelData();
+        VoxelType GetVoxelType();
         std::shared_ptr<unsigned char> GetMaskData();
 
         void SetDirection(Direction3d dirX, Direction3d dirY, Direction3d dirZ);
@@ -60,7 +72,55 @@ namespace MonkeyGL {
         bool SetControlPoints_TF(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts, unsigned char nLabel);
         std::map<unsigned char, ObjectInfo> GetObjectInfos();
 
+        // rebuilds the tables of the labels whose control points changed and refreshes
+        // the window mappings, returns the number of labels rebuilt
+        int UpdateTransferFunctions();
+        const TransferFunctionManager& GetTransferFunctionManager(){
+            return m_tfManager;
+        }
+        void SetPreIntegrationEnabled(bool bEnable){
+            m_tfManager.SetPreIntegrationEnabled(bEnable);
+        }
+        bool IsPreIntegrationEnabled(){
+            return m_tfManager.IsPreIntegrationEnabled();
+        }
+
+        // reclassifies the bricks only after a transfer function, WW/WL or mask change,
+        // returns true when the empty flags have changed
+        bool UpdateEmptyBricks();
+        BrickTable& GetBrickTable(){
+            return m_volInfo.GetBrickTable();
+        }
+
+        void SetPyramidEnabled(bool bEnable){
+            m_volInfo.SetPyramidEnabled(bEnable);
+        }
+        VolumePyramid& GetVolumePyramid(){
+            return m_volInfo.GetVolumePyramid();
+        }
+
+        void SetBrickedLayoutEnabled(bool bEnable){
+            m_volInfo.SetBrickedLayoutEnabled(bEnable);
+        }
+        bool IsBrickedLayout(){
+            return m_volInfo.IsBrickedLayout();
+        }
+        BrickedVolume& GetBrickedVolume(){
+            return m_volInfo.GetBrickedVolume();
+        }
+        bool HasVolumeData(){
+            return m_volInfo.HasVolumeData();
+        }
+        // pyramid level for an output of fPixelSpacing mm per pixel, 0 is full resolution
+        int SelectLevel(double fPixelSpacing){
+            return m_volInfo.SelectLevel(fPixelSpacing);
+        }
+
         void Reset();
+        // changes with the volume, its masks, spacing or direction
+        unsigned int GetDataVersion(){
+            return m_nDataVersion;
+        }
 
         Orientation& GetOrientation(){
             return m_orientation;
@@ -80,6 +140,11 @@ namespace MonkeyGL {
 
         void Browse(float fDelta, PlaneType planeType);
         void SetPlaneIndex( int index, PlaneType planeType );
+        // velocity of the Browse and SetPlaneIndex steps of planeType along its normal in
+        // mm per second, smoothed over the steps and 0 once the scrolling has paused
+        double GetScrollVelocity(PlaneType planeType);
+        // the crosshairs of the next nCount steps when the last scroll of planeType goes on
+        bool GetScrollAhead(std::vector<Point3d>& vecPoints, PlaneType planeType, int nCount);
         void PanCrossHair(int nx, int ny, PlaneType planeType);
         void RotateCrossHair( float fAngle, PlaneType planeType );
         void UpdateThickness(double val);
@@ -142,6 +207,9 @@ namespace MonkeyGL {
         Point3d GetTransferPoint(double m[3][3], Point3d pt);
         std::vector<PlaneType> GetCrossPlaneType(PlaneType planeType);
         void UpdatePlaneSize(PlaneType planeType);
+        bool GetBrowsePoint(Point3d& pt, Point3d ptCrossHair, float fDelta, PlaneType planeType);
+        bool GetIndexPoint(Point3d& pt, Point3d ptCrossHair, int index, PlaneType planeType);
+        void RecordScroll(Point3d ptCrossHair, PlaneType planeType);
 
         std::vector<Point3d> GetVertexes();
 
@@ -149,12 +217,24 @@ namespace MonkeyGL {
         VolumeInfo m_volInfo;
         int m_activeLabel;
         std::map<unsigned char, ObjectInfo> m_objectInfos;
+        bool m_bEmptyBricksDirty;
+        unsigned int m_nDataVersion;
+        TransferFunctionManager m_tfManager;
 
         Orientation m_orientation;
         Point3d m_ptCrossHair;
         Point3d m_ptCenter;
         RGBA m_colorBG;
 
+        // the last scroll step, which GetScrollAhead continues
+        PlaneType m_scrollPlaneType;
+        bool m_bScrollByIndex;
+        float m_fScrollDelta;
+        int m_nScrollIndex;
+        int m_nScrollIndexStep;
+        long long m_nScrollTime;
+        double m_fScrollVelocity;
+
         std::map<PlaneType, PlaneInfo> m_planeInfos;
     };
 
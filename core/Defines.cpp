@@ -21,5 +21,46 @@
 // SOFTWARE.
 
 #include "Defines.h"
+#include "ThreadPool.h"
 
 using namespace MonkeyGL;
+
+namespace {
+	const size_t c_nConvertChunk = 1 << 20;
+
+	template <typename T>
+	void ConvertToShort(short* pDst, const T* pSrc, size_t nCount)
+	{
+		ThreadPool::Instance()->ParallelForBlocks(nCount, c_nConvertChunk, [&](size_t nStart, size_t nEnd){
+			for (size_t i=nStart; i<nEnd; i++){
+				float v = (float)pSrc[i];
+				pDst[i] = SaturateShort(v >= 0.0f ? v + 0.5f : v - 0.5f);
+			}
+		});
+	}
+}
+
+void MonkeyGL::CopyVoxelsToShort(short* pDst, const void* pSrc, VoxelType type, size_t nCount)
+{
+	if (NULL == pDst || NULL == pSrc)
+		return;
+
+	switch (type)
+	{
+	case VoxelTypeUInt8:
+		ConvertToShort(pDst, (const unsigned char*)pSrc, nCount);
+		break;
+	case VoxelTypeUInt16:
+		ConvertToShort(pDst, (const unsigned short*)pSrc, nCount);
+		break;
+	case VoxelTypeInt32:
+		ConvertToShort(pDst, (const int*)pSrc, nCount);
+		break;
+	case VoxelTypeFloat32:
+		ConvertToShort(pDst, (const float*)pSrc, nCount);
+		break;
+	default:
+		memcpy(pDst, pSrc, nCount*sizeof(short));
+		break;
+	}
+}
@@ -23,6 +23,7 @@
 #pragma once
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 
 using namespace std;
 
@@ -105,20 +106,22 @@ namespace MonkeyGL{
         float globalAmbient[4];
     };
 
-    struct AlphaAndWWWL{
+    // per object constants of the ray casters, the WW/WL is folded into the
+    // mapping of a sample value onto the object's lut: value*scale + offset
+    struct AlphaAndMapping{
         float alpha;
-        float ww;
-        float wl;
+        float scale;
+        float offset;
 
-        AlphaAndWWWL(){
+        AlphaAndMapping(){
             alpha = 0.0f;
-            ww = 0.0f;
-            wl = 0.0f;
+            scale = 0.0f;
+            offset = 0.0f;
         }
-        AlphaAndWWWL(float a, float w, float l){
+        AlphaAndMapping(float a, float s, float o){
             alpha = a;
-            ww = w;
-            wl = l;
+            scale = s;
+            offset = o;
         }
     };
     
@@ -142,6 +145,13 @@ namespace MonkeyGL{
 		MPRTypeMinIP
 	};
 
+	enum BatchType
+	{
+		BatchTypeParallel = 0,
+		BatchTypeRadial,
+		BatchTypeRotating
+	};
+
     enum LogLevel
     {
         LogLevelNotDefined = -1,
@@ -149,4 +159,65 @@ namespace MonkeyGL{
         LogLevelWarn,
         LogLevelError
     };
+
+    // storage type of the volume voxels. samples keep the native values, so WW/WL and
+    // transfer functions are in the units of the data whatever its type
+    enum VoxelType
+    {
+        VoxelTypeInt16 = 0,
+        VoxelTypeUInt8,
+        VoxelTypeUInt16,
+        VoxelTypeInt32,
+        VoxelTypeFloat32
+    };
+
+    inline int GetVoxelBytes(VoxelType type){
+        switch (type)
+        {
+        case VoxelTypeUInt8:
+            return 1;
+        case VoxelTypeInt32:
+        case VoxelTypeFloat32:
+            return 4;
+        default:
+            return 2;
+        }
+    }
+
+    // the VoxelType of a C++ voxel type, for the typed kernels
+    template <typename T> struct VoxelTraits;
+    template <> struct VoxelTraits<short>{ static const VoxelType type = VoxelTypeInt16; };
+    template <> struct VoxelTraits<unsigned char>{ static const VoxelType type = VoxelTypeUInt8; };
+    template <> struct VoxelTraits<unsigned short>{ static const VoxelType type = VoxelTypeUInt16; };
+    template <> struct VoxelTraits<int>{ static const VoxelType type = VoxelTypeInt32; };
+    template <> struct VoxelTraits<float>{ static const VoxelType type = VoxelTypeFloat32; };
+
+    // planes leave the renderers as shorts: truncated like the plain conversion, and
+    // clamped for the voxel types whose values do not fit
+    inline short SaturateShort(float v){
+        return v >= 32767.0f ? (short)32767 : (v <= -32768.0f ? (short)-32768 : (short)v);
+    }
+    inline short SaturateShort(double v){
+        return v >= 32767.0 ? (short)32767 : (v <= -32768.0 ? (short)-32768 : (short)v);
+    }
+
+    // 64 bit file offsets, fseeko/ftello are POSIX only
+    inline int SeekFile(FILE* fp, long long nOffset, int nOrigin){
+#if defined(_WIN32)
+        return _fseeki64(fp, nOffset, nOrigin);
+#else
+        return fseeko(fp, (off_t)nOffset, nOrigin);
+#endif
+    }
+    inline long long TellFile(FILE* fp){
+#if defined(_WIN32)
+        return _ftelli64(fp);
+#else
+        return (long long)ftello(fp);
+#endif
+    }
+
+    // nCount voxels of any type as shorts, rounded to nearest and clamped, for the
+    // consumers that stay 16 bit, like the origin slices
+    void CopyVoxelsToShort(short* pDst, const void* pSrc, VoxelType type, size_t nCount);
 }
\ No newline at end of file
@@ -27,7 +27,7 @@ using namespace MonkeyGL;
 
 DeviceInfo::DeviceInfo()
 {
-	bool m_bInit = false;
+	m_bInit = false;
 	m_nCount = 0;
 	m_vecProp.clear();
 
@@ -66,11 +66,7 @@ DeviceInfo::~DeviceInfo()
 
 DeviceInfo* DeviceInfo::Instance()
 {
-	static DeviceInfo* pDeviceInfo = NULL;
-	if (NULL == pDeviceInfo)
-	{
-		pDeviceInfo = new DeviceInfo();
-	}
+	static DeviceInfo* pDeviceInfo = new DeviceInfo();
 	return pDeviceInfo;
 }
 
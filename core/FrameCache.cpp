@@ -0,0 +1,130 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "FrameCache.h"
+
+using namespace MonkeyGL;
+
+namespace {
+	const unsigned long long c_nFnvOffset = 14695981039346656037ULL;
+	const unsigned long long c_nFnvPrime = 1099511628211ULL;
+}
+
+FrameCache::FrameCache(void)
+{
+	m_nBudget = DEFAULT_BUDGET;
+	m_nSize = 0;
+	m_nHits = 0;
+	m_nMisses = 0;
+}
+
+FrameCache::~FrameCache(void)
+{
+}
+
+unsigned long long FrameCache::Hash(const std::vector<double>& vecKey)
+{
+	unsigned long long nHash = c_nFnvOffset;
+	const unsigned char* p = (const unsigned char*)vecKey.data();
+	for (size_t i=0; i<vecKey.size()*sizeof(double); i++)
+	{
+		nHash ^= p[i];
+		nHash *= c_nFnvPrime;
+	}
+	return nHash;
+}
+
+size_t FrameCache::GetCost(const Entry& entry)
+{
+	return sizeof(Entry) + entry.vecKey.size()*sizeof(double) + entry.strFrame.size();
+}
+
+void FrameCache::SetBudget(size_t nBytes)
+{
+	m_nBudget = nBytes;
+	Shrink(m_nBudget);
+}
+
+bool FrameCache::Get(const std::vector<double>& vecKey, std::string& strFrame)
+{
+	if (m_nBudget == 0)
+		return false;
+
+	std::unordered_map<unsigned long long, EntryIter>::iterator iter = m_mapEntries.find(Hash(vecKey));
+	if (iter == m_mapEntries.end() || iter->second->vecKey != vecKey)
+	{
+		m_nMisses++;
+		return false;
+	}
+	m_lstEntries.splice(m_lstEntries.begin(), m_lstEntries, iter->second);
+	strFrame = iter->second->strFrame;
+	m_nHits++;
+	return true;
+}
+
+bool FrameCache::Contains(const std::vector<double>& vecKey) const
+{
+	std::unordered_map<unsigned long long, EntryIter>::const_iterator iter = m_mapEntries.find(Hash(vecKey));
+	return iter != m_mapEntries.end() && iter->second->vecKey == vecKey;
+}
+
+void FrameCache::Put(const std::vector<double>& vecKey, const std::string& strFrame)
+{
+	Entry entry;
+	entry.nHash = Hash(vecKey);
+	entry.vecKey = vecKey;
+	std::unordered_map<unsigned long long, EntryIter>::iterator iter = m_mapEntries.find(entry.nHash);
+	if (iter != m_mapEntries.end())
+		Erase(iter->second);
+
+	size_t nCost = GetCost(entry) + strFrame.size();
+	if (nCost > m_nBudget)
+		return;
+	Shrink(m_nBudget - nCost);
+
+	entry.strFrame = strFrame;
+	m_lstEntries.push_front(entry);
+	m_mapEntries[entry.nHash] = m_lstEntries.begin();
+	m_nSize += nCost;
+}
+
+void FrameCache::Clear()
+{
+	m_lstEntries.clear();
+	m_mapEntries.clear();
+	m_nSize = 0;
+}
+
+void FrameCache::Erase(EntryIter iter)
+{
+	m_nSize -= GetCost(*iter);
+	m_mapEntries.erase(iter->nHash);
+	m_lstEntries.erase(iter);
+}
+
+void FrameCache::Shrink(size_t nBudget)
+{
+	while (m_nSize > nBudget && !m_lstEntries.empty())
+	{
+		Erase(--m_lstEntries.end());
+	}
+}
@@ -0,0 +1,94 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MonkeyGL {
+
+    // least recently used store of encoded frames within a byte budget. a frame is
+    // filed under a key vector holding everything its pixels depend on, the key is
+    // hashed for the lookup and compared in full on a hit, so a hash collision can
+    // only cost a miss.
+    class FrameCache
+    {
+    public:
+        FrameCache(void);
+        ~FrameCache(void);
+
+    public:
+        static const size_t DEFAULT_BUDGET = 64*1024*1024;
+
+        // 0 turns the cache off, a smaller budget drops the oldest frames at once
+        void SetBudget(size_t nBytes);
+        size_t GetBudget() const {
+            return m_nBudget;
+        }
+
+        bool Get(const std::vector<double>& vecKey, std::string& strFrame);
+        // neither counted as a hit or miss nor made the most recent frame
+        bool Contains(const std::vector<double>& vecKey) const;
+        // frames larger than the whole budget are not kept
+        void Put(const std::vector<double>& vecKey, const std::string& strFrame);
+        void Clear();
+
+        unsigned long long GetHits() const {
+            return m_nHits;
+        }
+        unsigned long long GetMisses() const {
+            return m_nMisses;
+        }
+        size_t GetSize() const {
+            return m_nSize;
+        }
+        size_t GetCount() const {
+            return m_lstEntries.size();
+        }
+
+        static unsigned long long Hash(const std::vector<double>& vecKey);
+
+    private:
+        struct Entry
+        {
+            unsigned long long nHash;
+            std::vector<double> vecKey;
+            std::string strFrame;
+        };
+        typedef std::list<Entry>::iterator EntryIter;
+
+        static size_t GetCost(const Entry& entry);
+        void Erase(EntryIter iter);
+        void Shrink(size_t nBudget);
+
+    private:
+        size_t m_nBudget;
+        size_t m_nSize;
+        unsigned long long m_nHits;
+        unsigned long long m_nMisses;
+        // the most recently used frame first
+        std::list<Entry> m_lstEntries;
+        std::unordered_map<unsigned long long, EntryIter> m_mapEntries;
+    };
+}
@@ -21,26 +21,80 @@
 // SOFTWARE.
 
 #include "HelloMonkey.h"
-#include "Render.h"
+#include "IRender.h"
 #include <memory>
+#include <mutex>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include "Base64.hpp"
 #include "StopWatch.h"
 #include "fpng/fpng.h"
+#include "SliceCodec.h"
 #include "Logger.h"
 
 using namespace MonkeyGL;
 
-std::shared_ptr<IRender> _pRender;
+namespace {
+	enum FrameKind
+	{
+		FrameVRPng = 0,
+		FrameVRPngString,
+		FramePlanePngString
+	};
+
+	const int c_nPrefetchDepth = 4;
+	// seconds of scrolling at the current velocity that are rendered ahead
+	const double c_fPrefetchHorizon = 0.25;
+
+	// slices of the preview pass of an async load, slices per read after it and
+	// commits to the renderer on the way to the last slice
+	const int c_nLoadPreviewSlices = 64;
+	const int c_nLoadChunkSlices = 16;
+	const int c_nLoadCommits = 2;
+
+	// a request the caller waits for, the prefetch thread holds back from the lock
+	// while one is pending and is woken when the last one leaves
+	class ForegroundScope
+	{
+	public:
+		ForegroundScope(int& nRequests, std::mutex& mtx, std::condition_variable& cv) : m_nRequests(nRequests), m_mtx(mtx), m_cv(cv) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_nRequests++;
+		}
+		~ForegroundScope() {
+			bool bLast = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mtx);
+				bLast = --m_nRequests == 0;
+			}
+			if (bLast)
+				m_cv.notify_all();
+		}
 
-HelloMonkey::HelloMonkey()
-{
-	_pRender.reset(new Render());
+	private:
+		int& m_nRequests;
+		std::mutex& m_mtx;
+		std::condition_variable& m_cv;
+	};
+}
 
+HelloMonkey::HelloMonkey(std::shared_ptr<IRender> pRender)
+{
+	m_nPrefetchDepth = c_nPrefetchDepth;
+	m_nLoadHandle = 0;
+	m_nForegroundRequests = 0;
 	Logger::Init();
 
 	Logger::Info("MonkeyGL has started....");
 
-	fpng::fpng_init();
+	m_pRender = pRender;
+
+	static std::once_flag fpngInitFlag;
+	std::call_once(fpngInitFlag, [](){
+		fpng::fpng_init();
+	});
 	if (fpng::fpng_cpu_supports_sse41()){
 		Logger::Info("fpng cpu supports sse41");
 	}
@@ -59,148 +113,570 @@ void HelloMonkey::SetLogLevel(LogLevel level){
 
 bool HelloMonkey::SetTransferFunc( std::map<int, RGBA> ctrlPoints )
 {	
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetTransferFunc(ctrlPoints);
+	return m_pRender->SetTransferFunc(ctrlPoints);
 }
 
 bool HelloMonkey::SetTransferFunc( std::map<int, RGBA> ctrlPoints, unsigned char nLabel )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
 	
-	return _pRender->SetTransferFunc(ctrlPoints, nLabel);
+	return m_pRender->SetTransferFunc(ctrlPoints, nLabel);
 }
 
 bool HelloMonkey::SetTransferFunc( std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
 
-	return _pRender->SetTransferFunc(rgbPoints, alphaPoints);
+	return m_pRender->SetTransferFunc(rgbPoints, alphaPoints);
 }
 
 bool HelloMonkey::SetTransferFunc( std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints, unsigned char nLabel)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
 
-	return _pRender->SetTransferFunc(rgbPoints, alphaPoints, nLabel);
+	return m_pRender->SetTransferFunc(rgbPoints, alphaPoints, nLabel);
+}
+
+void HelloMonkey::SetPreIntegrationEnabled(bool bEnable)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return;
+
+	m_pRender->SetPreIntegrationEnabled(bEnable);
 }
 
 void HelloMonkey::SetColorBackground(RGBA clrBG)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
 
-	_pRender->SetColorBackground(clrBG);
+	m_pRender->SetColorBackground(clrBG);
 }
 
 void HelloMonkey::SetVolumeFile( const char* szFile, int nWidth, int nHeight, int nDepth )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return;
+
+	CancelPrefetch();
+	CancelAsyncLoad();
+	m_frameCache.Clear();
+	m_pRender->SetVolumeFile(szFile, nWidth, nHeight, nDepth);
+}
+
+int HelloMonkey::LoadVolumeFileAsync(const char* szFile, int nWidth, int nHeight, int nDepth)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender || !szFile || nWidth<=0 || nHeight<=0 || nDepth<=0)
+		return 0;
+
+	FILE* fp = fopen(szFile, "rb");
+	if (!fp){
+		Logger::Warn("failed to open volume file: %s", szFile);
+		return 0;
+	}
+	fclose(fp);
+
+	CancelPrefetch();
+	CancelAsyncLoad();
+	m_frameCache.Clear();
+
+	std::shared_ptr<AsyncLoad> pLoad(new AsyncLoad());
+	pLoad->nHandle = ++m_nLoadHandle;
+	pLoad->strFile = szFile;
+	pLoad->nDims[0] = nWidth;
+	pLoad->nDims[1] = nHeight;
+	pLoad->nDims[2] = nDepth;
+	pLoad->nStride = nDepth / c_nLoadPreviewSlices;
+	pLoad->bProgressive = pLoad->nStride > 1 && m_pRender->BeginVolume(nWidth, nHeight, nDepth);
+	// the preview slices count twice, a volume set whole counts one more step for SetVolumeData
+	pLoad->nTotal = nDepth + (pLoad->bProgressive ? (nDepth + pLoad->nStride - 1) / pLoad->nStride : 1);
+	pLoad->nDone = 0;
+	pLoad->bFailed = false;
+	m_pLoad = pLoad;
+
+	m_loader.Post([this, pLoad](unsigned int nGeneration){
+		RunAsyncLoad(pLoad, nGeneration);
+	});
+	return pLoad->nHandle;
+}
+
+float HelloMonkey::GetLoadProgress(int nHandle)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pLoad || m_pLoad->nHandle != nHandle || m_pLoad->bFailed)
+		return -1.0f;
+	return 1.0f*m_pLoad->nDone/m_pLoad->nTotal;
+}
+
+void HelloMonkey::CancelPrefetch()
+{
+	m_prefetch.Cancel();
+	// a prefetch waiting for the foreground requests sees the new generation
+	{
+		std::lock_guard<std::mutex> lock(m_mtxForeground);
+	}
+	m_cvForeground.notify_all();
+}
+
+void HelloMonkey::CancelAsyncLoad()
+{
+	m_loader.Cancel();
+	m_pLoad.reset();
+}
+
+void HelloMonkey::RunAsyncLoad(std::shared_ptr<AsyncLoad> pLoad, unsigned int nGeneration)
+{
+	StopWatch sw("HelloMonkey::RunAsyncLoad");
+
+	const int nDepth = pLoad->nDims[2];
+	const size_t nSliceVoxels = (size_t)pLoad->nDims[0]*pLoad->nDims[1];
+	FILE* fp = fopen(pLoad->strFile.c_str(), "rb");
+	if (!fp){
+		pLoad->bFailed = true;
 		return;
+	}
 
-	_pRender->SetVolumeFile(szFile, nWidth, nHeight, nDepth);
+	// the file is read without the lock, the slices are handed over under it
+	auto readSlices = [&](short* pDst, int nFirst, int nCount) -> bool {
+		size_t nRead = 0;
+		if (SeekFile(fp, (long long)(nFirst*nSliceVoxels*sizeof(short)), SEEK_SET) == 0)
+			nRead = fread(pDst, sizeof(short), nCount*nSliceVoxels, fp);
+		if (nRead < nCount*nSliceVoxels){
+			memset(pDst + nRead, 0, (nCount*nSliceVoxels - nRead)*sizeof(short));
+			return false;
+		}
+		return true;
+	};
+	bool bShort = false;
+
+	if (!pLoad->bProgressive){
+		// volumes whose normalization needs every slice are read whole and set at the end
+		std::shared_ptr<short> pVolume(new short[nDepth*nSliceVoxels], std::default_delete<short[]>());
+		for (int z=0; z<nDepth && !m_loader.IsCancelled(nGeneration); z+=c_nLoadChunkSlices){
+			int nCount = std::min(c_nLoadChunkSlices, nDepth - z);
+			bShort = !readSlices(pVolume.get() + z*nSliceVoxels, z, nCount) || bShort;
+			pLoad->nDone = z + nCount;
+		}
+		fclose(fp);
+		if (bShort)
+			Logger::Warn("volume file %s is shorter than expected, the missing voxels are 0", pLoad->strFile.c_str());
+
+		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		if (m_loader.IsCancelled(nGeneration) || !m_pRender)
+			return;
+		if (!m_pRender->SetVolumeData(pVolume, pLoad->nDims[0], pLoad->nDims[1], nDepth))
+			pLoad->bFailed = true;
+		m_frameCache.Clear();
+		pLoad->nDone = pLoad->nTotal;
+		return;
+	}
+
+	// every nStride-th slice first, each standing in for the slices up to the next one
+	int nPreview = (nDepth + pLoad->nStride - 1) / pLoad->nStride;
+	std::vector<short> vecSlices(nPreview*nSliceVoxels);
+	for (int i=0; i<nPreview && !m_loader.IsCancelled(nGeneration); i++)
+		bShort = !readSlices(&vecSlices[i*nSliceVoxels], i*pLoad->nStride, 1) || bShort;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		if (m_loader.IsCancelled(nGeneration) || !m_pRender){
+			fclose(fp);
+			return;
+		}
+		m_pRender->SetVolumeSlices(&vecSlices[0], 0, nPreview, pLoad->nStride);
+		m_pRender->CommitVolumeSlices(false);
+		pLoad->nDone = nPreview;
+	}
+	std::vector<short>().swap(vecSlices);
+
+	// then the slices in order, committed to the renderer a few times on the way
+	std::vector<short> vecChunk(c_nLoadChunkSlices*nSliceVoxels);
+	int nNextCommit = nDepth / c_nLoadCommits;
+	for (int z=0; z<nDepth; z+=c_nLoadChunkSlices){
+		int nCount = std::min(c_nLoadChunkSlices, nDepth - z);
+		bShort = !readSlices(&vecChunk[0], z, nCount) || bShort;
+
+		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		if (m_loader.IsCancelled(nGeneration) || !m_pRender){
+			fclose(fp);
+			return;
+		}
+		m_pRender->SetVolumeSlices(&vecChunk[0], z, nCount, 1);
+		bool bComplete = z + nCount >= nDepth;
+		if (bComplete || z + nCount >= nNextCommit){
+			m_pRender->CommitVolumeSlices(bComplete);
+			nNextCommit += nDepth / c_nLoadCommits;
+		}
+		pLoad->nDone = nPreview + z + nCount;
+	}
+	fclose(fp);
+
+	if (bShort)
+		Logger::Warn("volume file %s is shorter than expected, the missing voxels are 0", pLoad->strFile.c_str());
+}
+
+bool HelloMonkey::LoadVolumeFile(const char* szFile)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+
+	CancelPrefetch();
+	CancelAsyncLoad();
+	m_frameCache.Clear();
+	return m_pRender->LoadVolumeFile(szFile);
+}
+
+unsigned char HelloMonkey::AddNewObjectMaskFile(const char* szFile)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return 0;
+	return m_pRender->AddNewObjectMaskFile(szFile);
+}
+
+bool HelloMonkey::SaveVolumeContainer(const char* szFile)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->SaveVolumeContainer(szFile);
+}
+
+bool HelloMonkey::LoadVolumeContainer(const char* szFile)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+
+	CancelPrefetch();
+	CancelAsyncLoad();
+	m_frameCache.Clear();
+	return m_pRender->LoadVolumeContainer(szFile);
+}
+
+void HelloMonkey::SetMemoryMapEnabled(bool bEnable)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return;
+	m_pRender->SetMemoryMapEnabled(bEnable);
+}
+
+void HelloMonkey::SetBrickedLayoutEnabled(bool bEnable)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return;
+	m_pRender->SetBrickedLayoutEnabled(bEnable);
+}
+
+void HelloMonkey::SetFrameCacheBudget(size_t nBytes)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	m_frameCache.SetBudget(nBytes);
+}
+
+void HelloMonkey::GetFrameCacheStats(unsigned long long& nHits, unsigned long long& nMisses, size_t& nBytes, size_t& nCount)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	nHits = m_frameCache.GetHits();
+	nMisses = m_frameCache.GetMisses();
+	nBytes = m_frameCache.GetSize();
+	nCount = m_frameCache.GetCount();
+}
+
+void HelloMonkey::ClearFrameCache()
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	m_frameCache.Clear();
+}
+
+void HelloMonkey::SetPrefetchDepth(int nPlanes)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	m_nPrefetchDepth = nPlanes;
+	if (m_nPrefetchDepth <= 0)
+		CancelPrefetch();
+}
+
+void HelloMonkey::SchedulePrefetch(PlaneType planeType)
+{
+	// a new scroll step replaces the planes still queued, so a change of direction
+	// or geometry never leaves stale work behind
+	CancelPrefetch();
+	std::vector<Point3d> vecPoints;
+	if (m_nPrefetchDepth <= 0 || m_frameCache.GetBudget() == 0 || !m_pRender->GetScrollAhead(vecPoints, planeType, m_nPrefetchDepth))
+		return;
+
+	// two planes when the velocity is not known yet, more as the scrolling speeds up
+	Point3d ptCrossHair;
+	m_pRender->GetCrossHairPoint3D(ptCrossHair);
+	double fStep = ptCrossHair.DistanceTo(vecPoints[0]);
+	double fVelocity = fabs(m_pRender->GetScrollVelocity(planeType));
+	int nCount = 2;
+	if (fStep > 0){
+		int nAhead = (int)ceil(fVelocity*c_fPrefetchHorizon/fStep);
+		nCount = nAhead > nCount ? nAhead : nCount;
+	}
+	nCount = nCount < (int)vecPoints.size() ? nCount : (int)vecPoints.size();
+
+	for (int i=0; i<nCount; i++){
+		Point3d pt = vecPoints[i];
+		m_prefetch.Post([this, planeType, pt](unsigned int nGeneration){
+			PrefetchPlane(planeType, pt, nGeneration);
+		});
+	}
+}
+
+void HelloMonkey::PrefetchPlane(PlaneType planeType, Point3d ptCrossHair, unsigned int nGeneration)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mtxForeground);
+		m_cvForeground.wait(lock, [&](){
+			return m_nForegroundRequests == 0 || m_prefetch.IsCancelled(nGeneration);
+		});
+	}
+
+	// the plane is rendered as it would be with the crosshair at ptCrossHair, the shared
+	// crosshair stays where it is. the lock is not held while the frame is encoded
+	std::vector<double> vecKey;
+	int nWidth = 0, nHeight = 0;
+	std::shared_ptr<short> pData;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		if (m_prefetch.IsCancelled(nGeneration) || !m_pRender)
+			return;
+		vecKey = GetFrameKey(FramePlanePngString, 0, 0, planeType, &ptCrossHair);
+		if (vecKey.empty() || m_frameCache.Contains(vecKey))
+			return;
+		StopWatch sw("PrefetchPlane");
+		if (!GetPlaneShort(pData, nWidth, nHeight, planeType, ptCrossHair))
+			return;
+	}
+
+	std::string strFrame = EncodeSlice_string(pData.get(), nWidth, nHeight, SliceFormatPng);
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!strFrame.empty() && !m_prefetch.IsCancelled(nGeneration))
+		m_frameCache.Put(vecKey, strFrame);
+}
+
+std::vector<double> HelloMonkey::GetFrameKey(int nKind, int nWidth, int nHeight, PlaneType planeType, const Point3d* pCrossHair)
+{
+	std::vector<double> vecKey;
+	if (!m_pRender || m_frameCache.GetBudget() == 0)
+		return vecKey;
+
+	vecKey.push_back(nKind);
+	vecKey.push_back(nWidth);
+	vecKey.push_back(nHeight);
+	bool bKey = pCrossHair ? m_pRender->GetFrameKey(vecKey, planeType, *pCrossHair) : m_pRender->GetFrameKey(vecKey, planeType);
+	if (!bKey)
+		vecKey.clear();
+	return vecKey;
 }
 
 void HelloMonkey::SetDirection( Direction3d dirX, Direction3d dirY, Direction3d dirZ )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->SetDirection(dirX, dirY, dirZ);
+	CancelPrefetch();
+	m_pRender->SetDirection(dirX, dirY, dirZ);
 }
 
 void HelloMonkey::SetSpacing( double x, double y, double z )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->SetSpacing(x, y, z);
+	CancelPrefetch();
+	m_pRender->SetSpacing(x, y, z);
 }
 
 void HelloMonkey::Reset()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Reset();
+	CancelPrefetch();
+	m_pRender->Reset();
 }
 
 bool HelloMonkey::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth)
 {
-	if (!_pRender)
+	return SetVolumeData(pData, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool HelloMonkey::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetVolumeData(pData, nWidth, nHeight, nDepth);
+	CancelPrefetch();
+	CancelAsyncLoad();
+	m_frameCache.Clear();
+	return m_pRender->SetVolumeData(pData, type, nWidth, nHeight, nDepth);
 }
 
 unsigned char HelloMonkey::AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return 0;
-	return _pRender->AddNewObjectMask(pData, nWidth, nHeight, nDepth);
+	return m_pRender->AddNewObjectMask(pData, nWidth, nHeight, nDepth);
 }
 
 bool HelloMonkey::UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return 0;
-	return _pRender->UpdateObjectMask(pData, nWidth, nHeight, nDepth, nLabel);
+	return m_pRender->UpdateObjectMask(pData, nWidth, nHeight, nDepth, nLabel);
 }
 
 std::shared_ptr<short> HelloMonkey::GetVolumeData(int& nWidth, int& nHeight, int& nDepth)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return NULL;
+	return m_pRender->GetVolumeData(nWidth, nHeight, nDepth);
+}
+
+std::shared_ptr<void> HelloMonkey::GetVoxelData(int& nWidth, int& nHeight, int& nDepth, VoxelType& type)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetVolumeData(nWidth, nHeight, nDepth);
+	return m_pRender->GetVoxelData(nWidth, nHeight, nDepth, type);
 }
 
 bool HelloMonkey::GetPlaneMaxSize( int& nWidth, int& nHeight, const PlaneType& planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetPlaneMaxSize(nWidth, nHeight, planeType);
+	return m_pRender->GetPlaneMaxSize(nWidth, nHeight, planeType);
 }
 
 bool HelloMonkey::GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneType& planeType)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetPlaneData(pData, nWidth, nHeight, planeType);
+	return m_pRender->GetPlaneData(pData, nWidth, nHeight, planeType);
 }
 
 std::string HelloMonkey::GetPlaneData_pngString(const PlaneType& planeType)
 {
-	if (!_pRender)
+	ForegroundScope foreground(m_nForegroundRequests, m_mtxForeground, m_cvForeground);
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return "";
 
 	StopWatch sw("GetPlaneData_pngString");
 
+	std::vector<double> vecKey = GetFrameKey(FramePlanePngString, 0, 0, planeType);
+	std::string strFrame;
+	if (!vecKey.empty() && m_frameCache.Get(vecKey, strFrame)){
+		Logger::Info("plane from frame cache, %zu bytes", strFrame.length());
+		return strFrame;
+	}
+
+	Point3d ptCrossHair;
+	m_pRender->GetCrossHairPoint3D(ptCrossHair);
 	int nWidth = 0, nHeight = 0;
-	GetPlaneMaxSize(nWidth, nHeight, planeType);
-	
- 	std::shared_ptr<short> pData (new short[nWidth*nHeight]);
-	{
-		StopWatch sw("GetPlaneData");
-		if (!_pRender->GetPlaneData(pData.get(), nWidth, nHeight, planeType))
-			return "";
+	std::shared_ptr<short> pData;
+	if (!GetPlaneShort(pData, nWidth, nHeight, planeType, ptCrossHair))
+		return "";
+	strFrame = EncodeSlice_string(pData.get(), nWidth, nHeight, SliceFormatPng);
+	if (!vecKey.empty() && !strFrame.empty())
+		m_frameCache.Put(vecKey, strFrame);
+	return strFrame;
+}
+
+bool HelloMonkey::GetPlaneShort(std::shared_ptr<short>& pData, int& nWidth, int& nHeight, PlaneType planeType, const Point3d& ptCrossHair)
+{
+	PlaneInfo info;
+	Point3d ptCenter;
+	if (!m_pRender || !m_pRender->GetPlaneGeometry(info, ptCenter, planeType, ptCrossHair))
+		return false;
+
+	// the backends round the width up to even
+	nWidth = info.m_nWidth + info.m_nWidth%2;
+	nHeight = info.m_nHeight;
+	if (nWidth<=0 || nHeight<=0)
+		return false;
+	pData.reset(new short[nWidth*nHeight], std::default_delete<short[]>());
+	StopWatch sw("GetPlaneData");
+	return m_pRender->GetPlaneData(pData.get(), nWidth, nHeight, info, ptCenter);
+}
+
+bool HelloMonkey::GetOriginSliceShort(std::shared_ptr<short>& pSliceData, int& nWidth, int& nHeight, int slice)
+{
+	int nDepth = 0;
+	VoxelType type = VoxelTypeInt16;
+	std::shared_ptr<void> pData = GetVoxelData(nWidth, nHeight, nDepth, type);
+	std::shared_ptr<unsigned char> pMask = m_pRender->GetMaskData();
+	if (!pData)
+		return false;
+
+	if (slice < 0)
+		slice = 0;
+	else if (slice >= nDepth)
+		slice = nDepth-1;
+
+	pSliceData.reset(new short[nWidth*nHeight], std::default_delete<short[]>());
+	const char* pSlice = (const char*)pData.get() + (size_t)nWidth*nHeight*slice*GetVoxelBytes(type);
+	CopyVoxelsToShort(pSliceData.get(), pSlice, type, (size_t)nWidth*nHeight);
+	if (pMask){
+		unsigned char* pSliceMask = pMask.get() + (size_t)nWidth*nHeight*slice;
+		for (int i=0; i<nWidth*nHeight; i++){
+			if (pSliceMask[i] == 0){
+				pSliceData.get()[i] = -2048;
+			}
+		}
 	}
+	return true;
+}
 
+std::string HelloMonkey::EncodeSlice_string(const short* pData, int nWidth, int nHeight, SliceFormat format)
+{
+	size_t nRawBytes = (size_t)nWidth*nHeight*sizeof(short);
 	std::vector<uint8_t> out_buf;
-	{
+	if (format == SliceFormatPng){
 		StopWatch sw("fpng");
 		fpng::fpng_encode_image_to_memory(
-			(void*)pData.get(),
+			(const void*)pData,
 			nWidth/2,
 			nHeight,
 			4,
 			out_buf
 		);
-		Logger::Info(
-			"plane encode, from %d to %d, ratio %.4f",
-			nWidth*nHeight*sizeof(short),
-			out_buf.size(),
-			1.0*out_buf.size()/(nWidth*nHeight*sizeof(short))
-		);
 	}
+	else{
+		StopWatch sw("SliceCodec");
+		if (!SliceCodec::Encode(out_buf, pData, nWidth, nHeight))
+			return "";
+	}
+	Logger::Info(
+		"plane encode, from %zu to %zu, ratio %.4f",
+		nRawBytes,
+		out_buf.size(),
+		1.0*out_buf.size()/nRawBytes
+	);
 
 	std::string strBase64 = "";
 	{
@@ -208,7 +684,7 @@ std::string HelloMonkey::GetPlaneData_pngString(const PlaneType& planeType)
 		strBase64 = Base64::Encode(out_buf.data(), out_buf.size());
 
 		Logger::Info(
-			"plane base64, from %d to %d, ratio %.4f",
+			"plane base64, from %zu to %zu, ratio %.4f",
 			out_buf.size(),
 			strBase64.length(),
 			1.0*strBase64.length()/out_buf.size()
@@ -220,88 +696,141 @@ std::string HelloMonkey::GetPlaneData_pngString(const PlaneType& planeType)
 
 std::string HelloMonkey::GetOriginData_pngString(int slice)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return "";
 
 	StopWatch sw("GetOriginData_pngString");
 
-	int nWidth = 0, nHeight = 0, nDepth = 0;
-	std::shared_ptr<short> pData = GetVolumeData(nWidth, nHeight, nDepth);
-	std::shared_ptr<unsigned char> pMask = _pRender->GetMaskData();
+	int nWidth = 0, nHeight = 0;
+	std::shared_ptr<short> pSliceData;
+	if (!GetOriginSliceShort(pSliceData, nWidth, nHeight, slice))
+		return "";
+	return EncodeSlice_string(pSliceData.get(), nWidth, nHeight, SliceFormatPng);
+}
 
-	if (slice < 0)
-		slice = 0;
-	else if (slice >= nDepth)
-		slice = nDepth-1;
+std::string HelloMonkey::GetPlaneData_sliceCodecString(const PlaneType& planeType)
+{
+	ForegroundScope foreground(m_nForegroundRequests, m_mtxForeground, m_cvForeground);
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return "";
 
-	std::shared_ptr<short> pSliceData(new short[nWidth*nHeight]);
-	memcpy(pSliceData.get(), pData.get()+nWidth*nHeight*slice, nWidth*nHeight*sizeof(short));
-	unsigned char* pSliceMask = pMask.get()+nWidth*nHeight*slice;
-	if (pMask){
-		for (int i=0; i<nWidth*nHeight; i++){
-			if (pSliceMask[i] == 0){
-				pSliceData.get()[i] = -2048;
-			}
-		}
+	StopWatch sw("GetPlaneData_sliceCodecString");
+
+	Point3d ptCrossHair;
+	m_pRender->GetCrossHairPoint3D(ptCrossHair);
+	int nWidth = 0, nHeight = 0;
+	std::shared_ptr<short> pData;
+	if (!GetPlaneShort(pData, nWidth, nHeight, planeType, ptCrossHair))
+		return "";
+	return EncodeSlice_string(pData.get(), nWidth, nHeight, SliceFormatSliceCodec);
+}
+
+std::string HelloMonkey::GetOriginData_sliceCodecString(int slice)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return "";
+
+	StopWatch sw("GetOriginData_sliceCodecString");
+
+	int nWidth = 0, nHeight = 0;
+	std::shared_ptr<short> pSliceData;
+	if (!GetOriginSliceShort(pSliceData, nWidth, nHeight, slice))
+		return "";
+	return EncodeSlice_string(pSliceData.get(), nWidth, nHeight, SliceFormatSliceCodec);
+}
+
+bool HelloMonkey::GetVRData( unsigned char* pVR, int nWidth, int nHeight )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	if (!m_pRender->GetVRData(pVR, nWidth, nHeight))
+		return false;
+
+	return true;	
+}
+
+bool HelloMonkey::GetVRDataProgressive( unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	if (!m_pRender->GetVRDataProgressive(pVR, nWidth, nHeight, nQualityLevel, bFinal))
+		return false;
+
+	return true;
+}
+
+std::string HelloMonkey::GetVRDataProgressive_pngString(int nWidth, int nHeight, int& nQualityLevel, bool& bFinal)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	StopWatch sw("GetVRDataProgressive_pngString");
+	nQualityLevel = 0;
+	bFinal = false;
+	if (!m_pRender)
+		return "";
+
+ 	std::shared_ptr<unsigned char> pVR (new unsigned char[nWidth*nHeight*3], std::default_delete<unsigned char[]>());
+	{
+		StopWatch sw("GetVRDataProgressive");
+		if (!m_pRender->GetVRDataProgressive(pVR.get(), nWidth, nHeight, nQualityLevel, bFinal))
+			return "";
 	}
 
 	std::vector<uint8_t> out_buf;
 	{
 		StopWatch sw("fpng");
 		fpng::fpng_encode_image_to_memory(
-			(void*)(pSliceData.get()),
-			nWidth/2,
+			(void*)pVR.get(),
+			nWidth,
 			nHeight,
-			4,
+			3,
 			out_buf
 		);
-		Logger::Info(
-			"plane encode, from %d to %d, ratio %.4f",
-			nWidth*nHeight*sizeof(short),
-			out_buf.size(),
-			1.0*out_buf.size()/(nWidth*nHeight*sizeof(short))
-		);
 	}
 
 	std::string strBase64 = "";
 	{
 		StopWatch sw("Base64 Encode");
 		strBase64 = Base64::Encode(out_buf.data(), out_buf.size());
-
-		Logger::Info(
-			"plane base64, from %d to %d, ratio %.4f",
-			out_buf.size(),
-			strBase64.length(),
-			1.0*strBase64.length()/out_buf.size()
-		);
 	}
+	Logger::Info("vr progressive, quality level %d, final %d", nQualityLevel, bFinal);
 
 	return strBase64;
 }
 
-bool HelloMonkey::GetVRData( unsigned char* pVR, int nWidth, int nHeight )
+
+std::vector<uint8_t> HelloMonkey::GetVRData_png(int nWidth, int nHeight)
 {
-	if (!_pRender)
-		return false;
-	if (!_pRender->GetVRData(pVR, nWidth, nHeight))
-		return false;
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	StopWatch sw("GetVRData_png");
+	std::vector<double> vecKey = GetFrameKey(FrameVRPng, nWidth, nHeight, PlaneVR);
+	std::string strFrame;
+	if (!vecKey.empty() && m_frameCache.Get(vecKey, strFrame)){
+		Logger::Info("vr from frame cache, %zu bytes", strFrame.length());
+		return std::vector<uint8_t>(strFrame.begin(), strFrame.end());
+	}
 
-	return true;	
+	std::vector<uint8_t> out_buf = EncodeVR_png(nWidth, nHeight);
+	if (!vecKey.empty() && !out_buf.empty())
+		m_frameCache.Put(vecKey, std::string(out_buf.begin(), out_buf.end()));
+	return out_buf;
 }
 
-
-std::vector<uint8_t> HelloMonkey::GetVRData_png(int nWidth, int nHeight)
+std::vector<uint8_t> HelloMonkey::EncodeVR_png(int nWidth, int nHeight)
 {
-	StopWatch sw("GetVRData_png");
 	std::vector<uint8_t> out_buf;
-	if (!_pRender)
+	if (!m_pRender)
 		return out_buf;
 	
- 	std::shared_ptr<unsigned char> pVR (new unsigned char[nWidth*nHeight*3]);
+ 	std::shared_ptr<unsigned char> pVR (new unsigned char[nWidth*nHeight*3], std::default_delete<unsigned char[]>());
 
 	{
 		StopWatch sw("GetVRData");
-		if (!_pRender->GetVRData(pVR.get(), nWidth, nHeight))
+		if (!m_pRender->GetVRData(pVR.get(), nWidth, nHeight))
 			return out_buf;
 	}
 	{
@@ -315,7 +844,7 @@ std::vector<uint8_t> HelloMonkey::GetVRData_png(int nWidth, int nHeight)
 		);
 
 		Logger::Info(
-			"vr encode, from %d to %d, ratio %.4f",
+			"vr encode, from %d to %zu, ratio %.4f",
 			nWidth*nHeight*3,
 			out_buf.size(),
 			1.0*out_buf.size()/(nWidth*nHeight*3)
@@ -327,6 +856,7 @@ std::vector<uint8_t> HelloMonkey::GetVRData_png(int nWidth, int nHeight)
 
 void HelloMonkey::SaveVR2Png(const char* szFile, int nWidth, int nHeight)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
 	std::vector<uint8_t> out_buf = GetVRData_png(nWidth, nHeight);
 
 	FILE* fp = fopen(szFile, "wb");
@@ -341,8 +871,18 @@ void HelloMonkey::SaveVR2Png(const char* szFile, int nWidth, int nHeight)
 
 std::string HelloMonkey::GetVRData_pngString(int nWidth, int nHeight)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
 	StopWatch sw("GetVRData_pngString");
-	std::vector<uint8_t> out_buf = GetVRData_png(nWidth, nHeight);
+	std::vector<double> vecKey = GetFrameKey(FrameVRPngString, nWidth, nHeight, PlaneVR);
+	std::string strFrame;
+	if (!vecKey.empty() && m_frameCache.Get(vecKey, strFrame)){
+		Logger::Info("vr from frame cache, %zu bytes", strFrame.length());
+		return strFrame;
+	}
+
+	std::vector<uint8_t> out_buf = EncodeVR_png(nWidth, nHeight);
+	if (out_buf.empty())
+		return "";
 
 	std::string strBase64 = "";
 	{
@@ -350,236 +890,333 @@ std::string HelloMonkey::GetVRData_pngString(int nWidth, int nHeight)
 		strBase64 = Base64::Encode(out_buf.data(), out_buf.size());
 
 		Logger::Info(
-			"vr base64, from %d to %d, ratio %.4f",
+			"vr base64, from %zu to %zu, ratio %.4f",
 			out_buf.size(),
 			strBase64.length(),
 			1.0*strBase64.length()/out_buf.size()
 		);
 	}
 
+	if (!vecKey.empty())
+		m_frameCache.Put(vecKey, strBase64);
 	return strBase64;
 }
 
 bool HelloMonkey::GetBatchData( std::vector<short*>& vecBatchData, const BatchInfo& batchInfo )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetBatchData(vecBatchData, batchInfo);
+	return m_pRender->GetBatchData(vecBatchData, batchInfo);
+}
+
+bool HelloMonkey::GetBatchData( short* pData, const BatchInfo& batchInfo )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->GetBatchData(pData, batchInfo);
+}
+
+bool HelloMonkey::SetCPRCenterline( const std::vector<Point3d>& vecPoints )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->SetCPRCenterline(vecPoints);
+}
+
+int HelloMonkey::GetCPRHeight()
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return 0;
+	return m_pRender->GetCPRHeight();
+}
+
+int HelloMonkey::GetCPRStretchedHeight( Direction3d dirLateral )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return 0;
+	return m_pRender->GetCPRStretchedHeight(dirLateral);
+}
+
+bool HelloMonkey::GetCPRStraightenedData( short* pData, int nWidth, double fAngle )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->GetCPRStraightenedData(pData, nWidth, fAngle);
+}
+
+bool HelloMonkey::GetCPRStretchedData( short* pData, int nWidth, Direction3d dirLateral )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->GetCPRStretchedData(pData, nWidth, dirLateral);
+}
+
+bool HelloMonkey::GetCPRCrossSectionData( short* pData, int nWidth, int nHeight, int nNum, double fDistance, double fAngle )
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
+		return false;
+	return m_pRender->GetCPRCrossSectionData(pData, nWidth, nHeight, nNum, fDistance, fAngle);
 }
 
 bool HelloMonkey::GetPlaneIndex( int& index, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetPlaneIndex(index, planeType);
+	return m_pRender->GetPlaneIndex(index, planeType);
 }
 
 bool HelloMonkey::GetPlaneNumber( int& nTotalNum, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetPlaneNumber(nTotalNum, planeType);
+	return m_pRender->GetPlaneNumber(nTotalNum, planeType);
 }
 
 bool HelloMonkey::GetPlaneRotateMatrix( float* pMatrix, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return NULL;
-	return _pRender->GetPlaneRotateMatrix(pMatrix, planeType);
+	return m_pRender->GetPlaneRotateMatrix(pMatrix, planeType);
 }
 
 void HelloMonkey::Anterior()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Anterior();
+	m_pRender->Anterior();
 }
 
 void HelloMonkey::Posterior()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Posterior();
+	m_pRender->Posterior();
 }
 
 void HelloMonkey::Left()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Left();
+	m_pRender->Left();
 }
 
 void HelloMonkey::Right()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Right();
+	m_pRender->Right();
 }
 
 void HelloMonkey::Head()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Head();
+	m_pRender->Head();
 }
 
 void HelloMonkey::Foot()
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Foot();
+	m_pRender->Foot();
 }
 
 void HelloMonkey::Rotate( float fxRotate, float fyRotate )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Rotate(fxRotate, fyRotate);
+	m_pRender->Rotate(fxRotate, fyRotate);
 }
 
 void HelloMonkey::Zoom( float ratio )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Zoom(ratio);
+	m_pRender->Zoom(ratio);
 }
 
 void HelloMonkey::Pan( float fxShift, float fyShift )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Pan(fxShift, fyShift);
+	m_pRender->Pan(fxShift, fyShift);
 }
 
 bool HelloMonkey::SetVRWWWL(float fWW, float fWL)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetVRWWWL(fWW, fWL);
+	return m_pRender->SetVRWWWL(fWW, fWL);
 }
 
 bool HelloMonkey::SetVRWWWL(float fWW, float fWL, unsigned char nLabel)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetVRWWWL(fWW, fWL, nLabel);
+	return m_pRender->SetVRWWWL(fWW, fWL, nLabel);
 }
 
 bool HelloMonkey::SetObjectAlpha(float fAlpha)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetObjectAlpha(fAlpha);
+	return m_pRender->SetObjectAlpha(fAlpha);
 }
 
 bool HelloMonkey::SetObjectAlpha(float fAlpha, unsigned char nLabel)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->SetObjectAlpha(fAlpha, nLabel);
+	return m_pRender->SetObjectAlpha(fAlpha, nLabel);
 }
 
 void HelloMonkey::Browse( float fDelta, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->Browse(fDelta, planeType);
+	m_pRender->Browse(fDelta, planeType);
+	SchedulePrefetch(planeType);
 }
 
 void HelloMonkey::PanCrossHair( int nx, int ny, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->PanCrossHair(nx, ny, planeType);
+	CancelPrefetch();
+	m_pRender->PanCrossHair(nx, ny, planeType);
 }
 
 bool HelloMonkey::GetCrossHairPoint( double& x, double& y, const PlaneType& planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetCrossHairPoint(x, y, planeType);
+	return m_pRender->GetCrossHairPoint(x, y, planeType);
 }
 
 bool HelloMonkey::GetDirection( Direction2d& dirH, Direction2d& dirV, const PlaneType& planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetDirection(dirH, dirV, planeType);
+	return m_pRender->GetDirection(dirH, dirV, planeType);
 }
 
 bool HelloMonkey::GetDirection3D( Direction3d& dir3dH, Direction3d& dir3dV, const PlaneType& planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetDirection3D(dir3dH, dir3dV, planeType);
+	return m_pRender->GetDirection3D(dir3dH, dir3dV, planeType);
 }
 
 bool HelloMonkey::GetBatchDirection3D( Direction3d& dir3dH, Direction3d& dir3dV, double fAngle, const PlaneType& planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetBatchDirection3D(dir3dH, dir3dV, fAngle, planeType);
+	return m_pRender->GetBatchDirection3D(dir3dH, dir3dV, fAngle, planeType);
 }
 
 void HelloMonkey::RotateCrossHair( float fAngle, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->RotateCrossHair(fAngle, planeType);
+	CancelPrefetch();
+	m_pRender->RotateCrossHair(fAngle, planeType);
 }
 
 void HelloMonkey::SetPlaneIndex( int index, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	_pRender->SetPlaneIndex(index, planeType);
+	m_pRender->SetPlaneIndex(index, planeType);
+	SchedulePrefetch(planeType);
 }
 
 double HelloMonkey::GetPixelSpacing( PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return 1.0;
-	return _pRender->GetPixelSpacing(planeType);
+	return m_pRender->GetPixelSpacing(planeType);
 }
 
 bool HelloMonkey::TransferImage2Object( double& x, double& y, double& z, double xImage, double yImage, PlaneType planeType )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->TransferImage2Object( x, y, z, xImage, yImage, planeType );
+	return m_pRender->TransferImage2Object( x, y, z, xImage, yImage, planeType );
 }
 
 bool HelloMonkey::GetCrossHairPoint3D( Point3d& pt )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetCrossHairPoint3D( pt );
+	return m_pRender->GetCrossHairPoint3D( pt );
 }
 
 void HelloMonkey::UpdateThickness( double val )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	return _pRender->UpdateThickness( val );
+	CancelPrefetch();
+	return m_pRender->UpdateThickness( val );
 }
 
 void HelloMonkey::SetThickness(double val, PlaneType planeType)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	return _pRender->SetThickness(val, planeType);
+	CancelPrefetch();
+	return m_pRender->SetThickness(val, planeType);
 }
 
 bool HelloMonkey::GetThickness(double& val, PlaneType planeType)
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return false;
-	return _pRender->GetThickness(val, planeType);
+	return m_pRender->GetThickness(val, planeType);
 }
 
 void HelloMonkey::SetMPRType( MPRType type )
 {
-	if (!_pRender)
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	if (!m_pRender)
 		return;
-	return _pRender->SetMPRType(type);
+	CancelPrefetch();
+	return m_pRender->SetMPRType(type);
 }
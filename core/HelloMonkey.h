@@ -24,36 +24,81 @@
 #include <map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
 #include "Defines.h"
 #include "Direction.h"
 #include "PlaneInfo.h"
 #include "BatchInfo.h"
+#include "FrameCache.h"
+#include "PrefetchQueue.h"
 
 namespace MonkeyGL {
 
+    class IRender;
+
+    // every instance owns its renderer and device state, instances can be
+    // driven from different threads as long as each one stays on its own thread.
+    // the calls of an instance are serialized with its background plane prefetching.
     class HelloMonkey
     {
     public:
+        // the CUDA backend when a device is found, the CPU one otherwise
         HelloMonkey();
+        explicit HelloMonkey(std::shared_ptr<IRender> pRender);
         ~HelloMonkey(void);
 
     public:
         virtual void SetLogLevel(LogLevel level);
         virtual void SetVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        // reads the raw 16 bit file of SetVolumeFile on a background thread and returns a handle for
+        // GetLoadProgress, 0 when the file can not be opened. a strided subset of the slices
+        // comes in first and fills the volume as a coarse preview, then the slices in order.
+        // planes and VR can be rendered as soon as the progress is above 0
+        virtual int LoadVolumeFileAsync(const char* szFile, int nWidth, int nHeight, int nDepth);
+        // 0 to 1 for the load of nHandle, -1 when it failed or another volume replaced it
+        virtual float GetLoadProgress(int nHandle);
+        // .nrrd/.nhdr (raw or gzip) and .nii/.nii.gz, size, spacing and direction come from the file
+        virtual bool LoadVolumeFile(const char* szFile);
+        virtual unsigned char AddNewObjectMaskFile(const char* szFile);
+        // .mgv container of the loaded volume and masks, compressed in 64^3 bricks. reopening
+        // it skips the file parsing and the normalization of the original load
+        virtual bool SaveVolumeContainer(const char* szFile);
+        virtual bool LoadVolumeContainer(const char* szFile);
+        // map raw files instead of reading them, off by default. the file must not be truncated
+        // or replaced while the volume is loaded, see VolumeInfo::SetMemoryMapEnabled
+        virtual void SetMemoryMapEnabled(bool bEnable);
+        virtual void SetBrickedLayoutEnabled(bool bEnable);
+        // the png frames of GetVRData_png, GetVRData_pngString and GetPlaneData_pngString are
+        // kept within nBytes and returned as long as nothing they depend on has changed, 0 turns it off
+        virtual void SetFrameCacheBudget(size_t nBytes);
+        virtual void GetFrameCacheStats(unsigned long long& nHits, unsigned long long& nMisses, size_t& nBytes, size_t& nCount);
+        virtual void ClearFrameCache();
+        // Browse and SetPlaneIndex render and encode up to nPlanes further planes in the
+        // scroll direction in the background, into the frame cache. 0 turns it off
+        virtual void SetPrefetchDepth(int nPlanes);
         virtual void SetDirection(Direction3d dirX, Direction3d dirY, Direction3d dirZ);
         virtual void SetSpacing(double x, double y, double z);
         virtual void Reset();
         virtual void SetColorBackground(RGBA clrBG);
         virtual bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        // voxels of any VoxelType. both backends sample them in that type, the GPU one
+        // uploads int32 as float32, and planes are shorts either way
+        virtual bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
         virtual unsigned char AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
         virtual bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
 
     // output
         virtual std::shared_ptr<short> GetVolumeData(int& nWidth, int& nHeight, int& nDepth);
+        virtual std::shared_ptr<void> GetVoxelData(int& nWidth, int& nHeight, int& nDepth, VoxelType& type);
         virtual bool GetPlaneMaxSize(int& nWidth, int& nHeight, const PlaneType& planeType);
         virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneType& planeType);
         virtual std::string GetPlaneData_pngString(const PlaneType& planeType);
         virtual std::string GetOriginData_pngString(int slice);
+        virtual std::string GetPlaneData_sliceCodecString(const PlaneType& planeType);
+        virtual std::string GetOriginData_sliceCodecString(int slice);
 
         virtual bool GetCrossHairPoint(double& x, double& y, const PlaneType& planeType);
         virtual bool TransferImage2Object(double& x, double& y, double& z, double xImage, double yImage, PlaneType planeType);
@@ -68,8 +113,24 @@ namespace MonkeyGL {
         virtual std::string GetVRData_pngString(int nWidth, int nHeight);
         virtual std::vector<uint8_t> GetVRData_png(int nWidth, int nHeight);
         virtual void SaveVR2Png(const char* szFile, int nWidth, int nHeight);
+        // for interaction, the first call of a new view returns a coarse frame and the
+        // following calls refine it, bFinal is set once the frame matches GetVRData
+        virtual bool GetVRDataProgressive(unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal);
+        virtual std::string GetVRDataProgressive_pngString(int nWidth, int nHeight, int& nQualityLevel, bool& bFinal);
 
         virtual bool GetBatchData(std::vector<short*>& vecBatchData, const BatchInfo& batchInfo);
+        // the whole batch into one buffer of batchInfo.Width()*Height()*m_nNum shorts, slice after slice
+        virtual bool GetBatchData(short* pData, const BatchInfo& batchInfo);
+
+        // curved planar reformation along a centerline in object coordinates, the
+        // straightened image is nWidth x GetCPRHeight(), the stretched one nWidth x
+        // GetCPRStretchedHeight(dirLateral), which is never more than GetCPRHeight()
+        virtual bool SetCPRCenterline(const std::vector<Point3d>& vecPoints);
+        virtual int GetCPRHeight();
+        virtual int GetCPRStretchedHeight(Direction3d dirLateral);
+        virtual bool GetCPRStraightenedData(short* pData, int nWidth, double fAngle);
+        virtual bool GetCPRStretchedData(short* pData, int nWidth, Direction3d dirLateral);
+        virtual bool GetCPRCrossSectionData(short* pData, int nWidth, int nHeight, int nNum, double fDistance, double fAngle);
 
         virtual bool GetPlaneIndex(int& index, PlaneType planeType);
         virtual bool GetPlaneNumber(int& nTotalNum, PlaneType planeType);
@@ -95,6 +156,7 @@ namespace MonkeyGL {
         virtual bool SetTransferFunc(std::map<int, RGBA> ctrlPoints, unsigned char nLabel);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPoints, std::map<int, float> alphaPoints, unsigned char nLabel);
+        virtual void SetPreIntegrationEnabled(bool bEnable);
 
         virtual void Browse(float fDelta, PlaneType planeType);	
         virtual void PanCrossHair(int nx, int ny, PlaneType planeType);
@@ -105,5 +167,55 @@ namespace MonkeyGL {
         virtual void SetThickness(double val, PlaneType planeType);
         virtual bool GetThickness(double& val, PlaneType planeType);
         virtual void SetMPRType(MPRType type);
+
+    private:
+        // the key of an encoded frame of the given kind, empty when there is nothing to render.
+        // planes are keyed as drawn with the crosshair at pCrossHair when it is given
+        std::vector<double> GetFrameKey(int nKind, int nWidth, int nHeight, PlaneType planeType, const Point3d* pCrossHair = NULL);
+        std::vector<uint8_t> EncodeVR_png(int nWidth, int nHeight);
+        // int16 pixels of a plane drawn with the crosshair at ptCrossHair, or of an original
+        // slice with the voxels outside the mask set to -2048, and their encoding followed by Base64
+        enum SliceFormat
+        {
+            SliceFormatPng = 0,
+            SliceFormatSliceCodec
+        };
+        bool GetPlaneShort(std::shared_ptr<short>& pData, int& nWidth, int& nHeight, PlaneType planeType, const Point3d& ptCrossHair);
+        bool GetOriginSliceShort(std::shared_ptr<short>& pSliceData, int& nWidth, int& nHeight, int slice);
+        std::string EncodeSlice_string(const short* pData, int nWidth, int nHeight, SliceFormat format);
+        void SchedulePrefetch(PlaneType planeType);
+        void PrefetchPlane(PlaneType planeType, Point3d ptCrossHair, unsigned int nGeneration);
+
+        struct AsyncLoad
+        {
+            int nHandle;
+            std::string strFile;
+            int nDims[3];
+            bool bProgressive;
+            int nStride;
+            int nTotal;
+            std::atomic<int> nDone;
+            std::atomic<bool> bFailed;
+        };
+        void RunAsyncLoad(std::shared_ptr<AsyncLoad> pLoad, unsigned int nGeneration);
+        // drops the queued prefetches and wakes the one waiting for the foreground requests
+        void CancelPrefetch();
+        void CancelAsyncLoad();
+
+    private:
+        std::recursive_mutex m_mutex;
+        std::shared_ptr<IRender> m_pRender;
+        FrameCache m_frameCache;
+        int m_nPrefetchDepth;
+        int m_nLoadHandle;
+        // requests the caller waits for, see ForegroundScope
+        int m_nForegroundRequests;
+        std::mutex m_mtxForeground;
+        std::condition_variable m_cvForeground;
+        std::shared_ptr<AsyncLoad> m_pLoad;
+        // last, so their threads are joined before the renderer goes away. the async
+        // loads run on a queue of their own so that prefetching never waits on the disk
+        PrefetchQueue m_prefetch;
+        PrefetchQueue m_loader;
     };
 }
@@ -0,0 +1,49 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "HelloMonkey.h"
+#include "Render.h"
+#include "CpuRender.h"
+#include "DeviceInfo.h"
+#include "Logger.h"
+
+using namespace MonkeyGL;
+
+// the choice of the backend is the only part of HelloMonkey that needs cuda, it lives
+// here so that HelloMonkey.cpp also builds into the CPU-only tests
+namespace {
+	std::shared_ptr<IRender> CreateRender()
+	{
+		Logger::Init();
+		int nDeviceCount = 0;
+		if (DeviceInfo::Instance()->GetCount(nDeviceCount) && nDeviceCount > 0){
+			Logger::Info("render backend: cuda, %d device(s)", nDeviceCount);
+			return std::shared_ptr<IRender>(new Render());
+		}
+		Logger::Info("render backend: cpu, no cuda device found");
+		return std::shared_ptr<IRender>(new CpuRender());
+	}
+}
+
+HelloMonkey::HelloMonkey() : HelloMonkey(CreateRender())
+{
+}
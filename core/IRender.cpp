@@ -21,6 +21,11 @@
 // SOFTWARE.
 
 #include "IRender.h"
+#include "ProgressiveRefinement.h"
+#include "VolumeReader.h"
+#include "Logger.h"
+#include <cstring>
+#include <cmath>
 
 using namespace MonkeyGL;
 
@@ -35,7 +40,12 @@ IRender::~IRender(void)
 
 bool IRender::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth)
 {
-	return m_dataMan.SetVolumeData(pData, nWidth, nHeight, nDepth);
+	return SetVolumeData(pData, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool IRender::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	return m_dataMan.SetVolumeData(pData, type, nWidth, nHeight, nDepth);
 }
 
 unsigned char IRender::AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth)
@@ -53,6 +63,64 @@ void IRender::SetVolumeFile( const char* szFile, int nWidth, int nHeight, int nD
 	m_dataMan.LoadVolumeFile(szFile, nWidth, nHeight, nDepth);
 }
 
+bool IRender::LoadVolumeFile(const char* szFile)
+{
+	VolumeHeader header;
+	std::shared_ptr<void> pData;
+	VoxelType type = VoxelTypeInt16;
+	if (!VolumeReader::ReadVolume(szFile, header, pData, type))
+		return false;
+
+	// geometry first, the volume is normalized against it when it is set
+	SetDirection(header.dirX, header.dirY, header.dirZ);
+	SetSpacing(header.spacing[0], header.spacing[1], header.spacing[2]);
+	return SetVolumeData(pData, type, header.dims[0], header.dims[1], header.dims[2]);
+}
+
+unsigned char IRender::AddNewObjectMaskFile(const char* szFile)
+{
+	VolumeHeader header;
+	std::shared_ptr<unsigned char> pData;
+	if (!VolumeReader::ReadMask(szFile, header, pData))
+		return 0;
+	return AddNewObjectMask(pData, header.dims[0], header.dims[1], header.dims[2]);
+}
+
+bool IRender::SaveVolumeContainer(const char* szFile)
+{
+	return m_dataMan.SaveVolumeContainer(szFile);
+}
+
+bool IRender::LoadVolumeContainer(const char* szFile)
+{
+	return m_dataMan.LoadVolumeContainer(szFile);
+}
+
+bool IRender::BeginVolume(int nWidth, int nHeight, int nDepth)
+{
+	return m_dataMan.BeginVolume(nWidth, nHeight, nDepth);
+}
+
+void IRender::SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride)
+{
+	m_dataMan.SetVolumeSlices(pSlices, nFirst, nCount, nStride);
+}
+
+void IRender::CommitVolumeSlices(bool bComplete)
+{
+	m_dataMan.CommitVolumeSlices(bComplete);
+}
+
+void IRender::SetMemoryMapEnabled(bool bEnable)
+{
+	m_dataMan.SetMemoryMapEnabled(bEnable);
+}
+
+void IRender::SetBrickedLayoutEnabled(bool bEnable)
+{
+	m_dataMan.SetBrickedLayoutEnabled(bEnable);
+}
+
 void IRender::SetDirection( Direction3d dirX, Direction3d dirY, Direction3d dirZ )
 {
 	m_dataMan.SetDirection(dirX, dirY, dirZ);
@@ -89,6 +157,11 @@ bool IRender::SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> a
 	return m_dataMan.SetControlPoints_TF(rgbPts, alphaPts, nLabel);
 }
 
+void IRender::SetPreIntegrationEnabled(bool bEnable)
+{
+	m_dataMan.SetPreIntegrationEnabled(bEnable);
+}
+
 void IRender::SetColorBackground(RGBA clrBG)
 {
 	m_dataMan.SetColorBackground(clrBG);
@@ -99,6 +172,15 @@ std::shared_ptr<short> IRender::GetVolumeData(int& nWidth, int& nHeight, int& nD
 	return m_dataMan.GetVolumeData(nWidth, nHeight, nDepth);
 }
 
+std::shared_ptr<void> IRender::GetVoxelData(int& nWidth, int& nHeight, int& nDepth, VoxelType& type)
+{
+	nWidth = m_dataMan.GetDim(0);
+	nHeight = m_dataMan.GetDim(1);
+	nDepth = m_dataMan.GetDim(2);
+	type = m_dataMan.GetVoxelType();
+	return m_dataMan.GetVoxelData();
+}
+
 std::shared_ptr<unsigned char> IRender::GetMaskData()
 {
 	return m_dataMan.GetMaskData();
@@ -111,7 +193,19 @@ bool IRender::GetPlaneMaxSize( int& nWidth, int& nHeight, const PlaneType& plane
 
 bool IRender::GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneType& planeType)
 {
-	return false;
+	PlaneInfo info;
+	Point3d ptCenter;
+	if (!GetPlaneGeometry(info, ptCenter, planeType, m_dataMan.GetCrossHair()))
+		return false;
+	return GetPlaneData(pData, nWidth, nHeight, info, ptCenter);
+}
+
+bool IRender::GetPlaneGeometry(PlaneInfo& info, Point3d& ptCenter, PlaneType planeType, const Point3d& ptCrossHair)
+{
+	if (!m_dataMan.GetPlaneInfo(planeType, info))
+		return false;
+	ptCenter = DataManager::GetProjectPoint(info.GetNormDirection(), ptCrossHair, m_dataMan.GetCenterPoint());
+	return true;
 }
 
 bool IRender::GetCrossHairPoint( double& x, double& y, const PlaneType& planeType )
@@ -130,6 +224,11 @@ bool IRender::GetCrossHairPoint3D( Point3d& pt )
 	return true;
 }
 
+void IRender::SetCrossHairPoint3D( const Point3d& pt )
+{
+	m_dataMan.SetCrossHair(pt);
+}
+
 bool IRender::GetDirection( Direction2d& dirH, Direction2d& dirV, const PlaneType& planeType )
 {
 	return m_dataMan.GetDirection(dirH, dirV, planeType);
@@ -155,6 +254,16 @@ void IRender::SetPlaneIndex( int index, PlaneType planeType )
 	m_dataMan.SetPlaneIndex(index, planeType);
 }
 
+double IRender::GetScrollVelocity( PlaneType planeType )
+{
+	return m_dataMan.GetScrollVelocity(planeType);
+}
+
+bool IRender::GetScrollAhead( std::vector<Point3d>& vecPoints, PlaneType planeType, int nCount )
+{
+	return m_dataMan.GetScrollAhead(vecPoints, planeType, nCount);
+}
+
 void IRender::PanCrossHair( int nx, int ny, PlaneType planeType )
 {
 	m_dataMan.PanCrossHair(nx, ny, planeType);
@@ -170,6 +279,140 @@ double IRender::GetPixelSpacing( PlaneType planeType )
 	return m_dataMan.GetPixelSpacing(planeType);
 }
 
+bool IRender::GetVRDataProgressive( unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal )
+{
+	if (!GetVRData(pVR, nWidth, nHeight))
+		return false;
+
+	nQualityLevel = ProgressiveRefinement::LEVEL_COUNT - 1;
+	bFinal = true;
+	return true;
+}
+
+bool IRender::GetBatchData( std::vector<short*>& vecBatchData, BatchInfo batchInfo )
+{
+	for (size_t i=0; i<vecBatchData.size(); i++)
+	{
+		if (nullptr != vecBatchData[i])
+		{
+			delete [] vecBatchData[i];
+			vecBatchData[i] = nullptr;
+		}
+	}
+	vecBatchData.clear();
+
+	int nWidth = batchInfo.Width();
+	int nHeight = batchInfo.Height();
+	if (nWidth <= 0 || nHeight <= 0 || batchInfo.m_nNum <= 0)
+		return false;
+
+	size_t nSliceSize = (size_t)nWidth*nHeight;
+	std::vector<short> vecData(nSliceSize*batchInfo.m_nNum);
+	if (!GetBatchData(vecData.data(), batchInfo))
+		return false;
+
+	for (int i=0; i<batchInfo.m_nNum; i++)
+	{
+		short* pData = new short[nSliceSize];
+		memcpy(pData, vecData.data() + i*nSliceSize, nSliceSize*sizeof(short));
+		vecBatchData.push_back(pData);
+	}
+	return true;
+}
+
+bool IRender::GetBatchPlanes( BatchInfo& batchInfo, std::vector<BatchPlane>& vecPlanes, float& halfNum )
+{
+	vecPlanes.clear();
+	if (batchInfo.m_fPixelSpacing <= 0 || batchInfo.Width() <= 0 || batchInfo.Height() <= 0 || batchInfo.m_nNum <= 0)
+		return false;
+	if (batchInfo.m_MPRType != MPRTypeAverage && batchInfo.m_MPRType != MPRTypeMIP && batchInfo.m_MPRType != MPRTypeMinIP)
+		return false;
+
+	double fSliceThickness = batchInfo.m_fSliceThickness;
+	if (batchInfo.m_batchType == BatchTypeRotating && fSliceThickness <= 0)
+	{
+		double fDiagonal = 0;
+		for (int i=0; i<3; i++){
+			double fLength = m_dataMan.GetDim(i)*m_dataMan.GetSpacing(i);
+			fDiagonal += fLength*fLength;
+		}
+		fSliceThickness = sqrt(fDiagonal);
+	}
+	int nSliceNum = fSliceThickness/batchInfo.m_fPixelSpacing;
+	nSliceNum = nSliceNum<1 ? 1:nSliceNum;
+	halfNum = 1.0f*(nSliceNum-1)/2;
+
+	for (int i=0; i<batchInfo.m_nNum; i++)
+	{
+		vecPlanes.push_back(batchInfo.GetPlane(i));
+	}
+	return true;
+}
+
+bool IRender::GetBatchData( short* pData, BatchInfo batchInfo )
+{
+	std::vector<BatchPlane> vecPlanes;
+	float halfNum = 0;
+	if (NULL == pData || !GetBatchPlanes(batchInfo, vecPlanes, halfNum))
+		return false;
+
+	return RenderBatchPlanes(pData, batchInfo.Width(), batchInfo.Height(), vecPlanes, batchInfo.m_fPixelSpacing, halfNum, batchInfo.m_MPRType);
+}
+
+bool IRender::SetCPRCenterline( const std::vector<Point3d>& vecPoints )
+{
+	if (!m_cpr.SetCenterline(vecPoints, m_dataMan.GetMinSpacing()))
+	{
+		Logger::Warn("IRender::SetCPRCenterline: the centerline needs at least two distinct points");
+		return false;
+	}
+	return true;
+}
+
+int IRender::GetCPRHeight()
+{
+	return m_cpr.GetPointCount();
+}
+
+int IRender::GetCPRStretchedHeight( Direction3d dirLateral )
+{
+	return m_cpr.GetStretchedHeight(dirLateral);
+}
+
+bool IRender::GetCPRStraightenedData( short* pData, int nWidth, double fAngle )
+{
+	if (NULL == pData || nWidth <= 0 || m_cpr.GetPointCount() <= 0)
+		return false;
+
+	std::vector<BatchPlane> vecPlanes;
+	m_cpr.GetStraightenedPlanes(vecPlanes, nWidth, fAngle);
+	return RenderBatchPlanes(pData, nWidth, 1, vecPlanes, m_cpr.GetPixelSpacing(), 0, MPRTypeAverage);
+}
+
+bool IRender::GetCPRStretchedData( short* pData, int nWidth, Direction3d dirLateral )
+{
+	if (NULL == pData || nWidth <= 0 || m_cpr.GetPointCount() <= 0)
+		return false;
+
+	std::vector<BatchPlane> vecPlanes;
+	m_cpr.GetStretchedPlanes(vecPlanes, nWidth, dirLateral);
+	if (vecPlanes.empty())
+		return false;
+	return RenderBatchPlanes(pData, nWidth, 1, vecPlanes, m_cpr.GetPixelSpacing(), 0, MPRTypeAverage);
+}
+
+bool IRender::GetCPRCrossSectionData( short* pData, int nWidth, int nHeight, int nNum, double fDistance, double fAngle )
+{
+	if (NULL == pData || nWidth <= 0 || nHeight <= 0 || nNum <= 0)
+		return false;
+
+	std::vector<BatchPlane> vecPlanes;
+	m_cpr.GetCrossSectionPlanes(vecPlanes, nWidth, nHeight, nNum, fDistance, fAngle);
+	if (vecPlanes.empty())
+		return false;
+	return RenderBatchPlanes(pData, nWidth, nHeight, vecPlanes, m_cpr.GetPixelSpacing(), 0, MPRTypeAverage);
+}
+
 bool IRender::GetPlaneIndex( int& index, PlaneType planeType )
 {
 	return m_dataMan.GetPlaneIndex(index, planeType);
@@ -225,3 +468,76 @@ bool IRender::SetObjectAlpha(float fAlpha, unsigned char nLabel)
 	return m_dataMan.SetObjectAlpha(fAlpha, nLabel);
 }
 
+void IRender::SetCrossHairFromVR( const float* pPos )
+{
+	// the volume is sampled at 1-z, as in the plane renderers
+	Point3d ptObject(
+		pPos[0]*m_dataMan.GetDim(0)*m_dataMan.GetSpacing(0),
+		pPos[1]*m_dataMan.GetDim(1)*m_dataMan.GetSpacing(1),
+		(1.0f - pPos[2])*m_dataMan.GetDim(2)*m_dataMan.GetSpacing(2)
+	);
+	m_dataMan.SetCrossHair(ptObject);
+}
+
+bool IRender::GetFrameKey( std::vector<double>& vecKey, PlaneType planeType )
+{
+	return GetFrameKey(vecKey, planeType, m_dataMan.GetCrossHair());
+}
+
+bool IRender::GetFrameKey( std::vector<double>& vecKey, PlaneType planeType, const Point3d& ptCrossHair )
+{
+	if (!m_dataMan.HasVolumeData())
+		return false;
+
+	vecKey.push_back(planeType);
+	vecKey.push_back(m_dataMan.GetDataVersion());
+	if (PlaneVR == planeType)
+	{
+		GetVRViewKey(vecKey);
+		vecKey.push_back(m_dataMan.IsPreIntegrationEnabled());
+		std::map<unsigned char, ObjectInfo> objectInfos = m_dataMan.GetObjectInfos();
+		for (std::map<unsigned char, ObjectInfo>::iterator iter=objectInfos.begin(); iter!=objectInfos.end(); iter++){
+			const ObjectInfo& info = iter->second;
+			vecKey.push_back(iter->first);
+			vecKey.push_back(info.alpha);
+			vecKey.push_back(info.ww);
+			vecKey.push_back(info.wl);
+			// the counts keep the control points of neighbouring labels apart
+			vecKey.push_back(info.idx2rgba.size());
+			for (std::map<int, RGBA>::const_iterator it=info.idx2rgba.begin(); it!=info.idx2rgba.end(); it++){
+				vecKey.push_back(it->first);
+				vecKey.push_back(it->second.red);
+				vecKey.push_back(it->second.green);
+				vecKey.push_back(it->second.blue);
+				vecKey.push_back(it->second.alpha);
+			}
+			vecKey.push_back(info.idx2alpha.size());
+			for (std::map<int, float>::const_iterator it=info.idx2alpha.begin(); it!=info.idx2alpha.end(); it++){
+				vecKey.push_back(it->first);
+				vecKey.push_back(it->second);
+			}
+		}
+		return true;
+	}
+
+	PlaneInfo info;
+	Point3d ptCenter;
+	if (!GetPlaneGeometry(info, ptCenter, planeType, ptCrossHair))
+		return false;
+	vecKey.push_back(info.m_dirH.x());
+	vecKey.push_back(info.m_dirH.y());
+	vecKey.push_back(info.m_dirH.z());
+	vecKey.push_back(info.m_dirV.x());
+	vecKey.push_back(info.m_dirV.y());
+	vecKey.push_back(info.m_dirV.z());
+	vecKey.push_back(info.m_nWidth);
+	vecKey.push_back(info.m_nHeight);
+	vecKey.push_back(info.m_fPixelSpacing);
+	vecKey.push_back(info.m_fSliceThickness);
+	vecKey.push_back(info.m_MPRType);
+	// the plane is placed by its center only, so scrolling one plane keeps the others
+	vecKey.push_back(ptCenter.x());
+	vecKey.push_back(ptCenter.y());
+	vecKey.push_back(ptCenter.z());
+	return true;
+}
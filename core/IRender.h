@@ -29,6 +29,7 @@
 #include "Direction.h"
 #include "DataManager.h"
 #include "BatchInfo.h"
+#include "CPREngine.h"
 
 namespace MonkeyGL{
     
@@ -40,10 +41,30 @@ namespace MonkeyGL{
 
     public:
     // volume info
-        virtual bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        // voxels of any VoxelType, sampled in that type on the CPU and uploaded in it to the
+        // GPU. the bricked layout and the containers take 16 bit volumes only
+        virtual bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
         virtual unsigned char AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
-        bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
+        virtual bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
+        // raw 16 bit voxels, LoadVolumeFile reads the other voxel types
         virtual void SetVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        // .nrrd/.nhdr and .nii/.nii.gz, size, spacing and direction come from the file
+        bool LoadVolumeFile(const char* szFile);
+        unsigned char AddNewObjectMaskFile(const char* szFile);
+        // .mgv container of the normalized volume and masks, see VolumeContainer
+        bool SaveVolumeContainer(const char* szFile);
+        virtual bool LoadVolumeContainer(const char* szFile);
+        // a volume loaded in pieces, see DataManager::BeginVolume. the CPU backend samples the
+        // slices as they are set, the GPU backend uploads the slices set so far at every commit
+        virtual bool BeginVolume(int nWidth, int nHeight, int nDepth);
+        virtual void SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride);
+        virtual void CommitVolumeSlices(bool bComplete);
+        // off by default, see VolumeInfo::SetMemoryMapEnabled. the raw file must not be truncated
+        // or replaced while a mapped volume is loaded
+        virtual void SetMemoryMapEnabled(bool bEnable);
+        // keep the CPU volume in 16^3 z-ordered bricks, takes effect at the next load
+        virtual void SetBrickedLayoutEnabled(bool bEnable);
         virtual void SetDirection(Direction3d dirX, Direction3d dirY, Direction3d dirZ);
         virtual void SetSpacing(double x, double y, double z);
         virtual void Reset();
@@ -51,6 +72,10 @@ namespace MonkeyGL{
 
         virtual void Browse(float fDelta, PlaneType planeType);
         virtual void SetPlaneIndex(int index, PlaneType planeType);
+        // scroll velocity in mm per second and the crosshairs of the next nCount scroll
+        // steps of planeType, for rendering ahead of the scrolling
+        double GetScrollVelocity(PlaneType planeType);
+        bool GetScrollAhead(std::vector<Point3d>& vecPoints, PlaneType planeType, int nCount);
         virtual void PanCrossHair(int nx, int ny, PlaneType planeType);
         virtual void RotateCrossHair(float fAngle, PlaneType planeType);
         virtual void UpdateThickness(double val);
@@ -60,13 +85,19 @@ namespace MonkeyGL{
 
     // output
         virtual std::shared_ptr<short> GetVolumeData(int& nWidth, int& nHeight, int& nDepth);
+        std::shared_ptr<void> GetVoxelData(int& nWidth, int& nHeight, int& nDepth, VoxelType& type);
         virtual std::shared_ptr<unsigned char> GetMaskData();
         virtual bool GetPlaneMaxSize(int& nWidth, int& nHeight, const PlaneType& planeType);
         virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneType& planeType);
+        // the geometry of planeType and its center as drawn with the crosshair at ptCrossHair
+        bool GetPlaneGeometry(PlaneInfo& info, Point3d& ptCenter, PlaneType planeType, const Point3d& ptCrossHair);
+        // renders the plane of GetPlaneGeometry, the crosshair is neither read nor moved
+        virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneInfo& info, Point3d ptCenter) = 0;
 
         virtual bool GetCrossHairPoint(double& x, double& y, const PlaneType& planeType) = 0;
         virtual bool TransferImage2Object(double& x, double& y, double& z, double xImage, double yImage, PlaneType planeType);
         virtual bool GetCrossHairPoint3D(Point3d& pt);
+        void SetCrossHairPoint3D(const Point3d& pt);
         virtual bool GetDirection(Direction2d& dirH, Direction2d& dirV, const PlaneType& planeType);
         virtual bool GetDirection3D(Direction3d& dir3dH, Direction3d& dir3dV, const PlaneType& planeType);
         virtual bool GetBatchDirection3D(Direction3d& dir3dH, Direction3d& dir3dV, double fAngle, const PlaneType& planeType);
@@ -74,8 +105,26 @@ namespace MonkeyGL{
         virtual double GetPixelSpacing(PlaneType planeType);
 
         virtual bool GetVRData(unsigned char* pVR, int nWidth, int nHeight) = 0;
-
-        virtual bool GetBatchData( std::vector<short*>& vecBatchData, BatchInfo batchInfo ) = 0;
+        // coarse frame first while the view keeps changing, refined by the following calls
+        virtual bool GetVRDataProgressive(unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal);
+
+        // one new[] slice per entry, the caller owns them
+        virtual bool GetBatchData( std::vector<short*>& vecBatchData, BatchInfo batchInfo );
+        // all m_nNum slices back to back into pData, which holds Width()*Height()*m_nNum shorts
+        virtual bool GetBatchData( short* pData, BatchInfo batchInfo );
+
+        // curved planar reformation along a centerline in object coordinates, resampled
+        // every minimum voxel spacing of arc length. the straightened image has one row per
+        // resampled point (GetCPRHeight), the stretched image one row per spacing of the
+        // curve projected along dirLateral (GetCPRStretchedHeight, at most GetCPRHeight).
+        // both are nWidth pixels across with the centerline in pixel nWidth/2
+        virtual bool SetCPRCenterline(const std::vector<Point3d>& vecPoints);
+        virtual int GetCPRHeight();
+        virtual int GetCPRStretchedHeight(Direction3d dirLateral);
+        virtual bool GetCPRStraightenedData(short* pData, int nWidth, double fAngle);
+        virtual bool GetCPRStretchedData(short* pData, int nWidth, Direction3d dirLateral);
+        // nNum nWidth x nHeight sections orthogonal to the curve, fDistance apart from its first point
+        virtual bool GetCPRCrossSectionData(short* pData, int nWidth, int nHeight, int nNum, double fDistance, double fAngle);
 
         virtual bool GetPlaneIndex(int& index, PlaneType planeType);
         virtual bool GetPlaneNumber(int& nTotalNum, PlaneType planeType);
@@ -100,9 +149,30 @@ namespace MonkeyGL{
         virtual bool SetTransferFunc(std::map<int, RGBA> ctrlPts, unsigned char nLabel);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts, unsigned char nLabel);
+        // samples the VR at fStepL1 with pre-integrated segment tables instead of refining the step
+        virtual void SetPreIntegrationEnabled(bool bEnable);
+
+        // appends everything the output of planeType depends on apart from its size,
+        // equal keys give equal frames. false when there is nothing to render
+        bool GetFrameKey(std::vector<double>& vecKey, PlaneType planeType);
+        // the key of the plane drawn with the crosshair at ptCrossHair
+        bool GetFrameKey(std::vector<double>& vecKey, PlaneType planeType, const Point3d& ptCrossHair);
+
+    protected:
+        // validates the batch and lays out its planes, rotating projections without a
+        // slice thickness take a slab through the whole volume
+        bool GetBatchPlanes(BatchInfo& batchInfo, std::vector<BatchPlane>& vecPlanes, float& halfNum);
+        // the backends render nWidth x nHeight planes back to back into pData
+        virtual bool RenderBatchPlanes(short* pData, int nWidth, int nHeight, const std::vector<BatchPlane>& vecPlanes, double fPixelSpacing, float halfNum, MPRType mprType) = 0;
+        // rotation, pan, zoom and background of the VR camera
+        virtual void GetVRViewKey(std::vector<double>& vecViewKey) = 0;
+        // moves the crosshair to a VR ray position, given in the normalized texture
+        // coordinates the ray is marched in
+        void SetCrossHairFromVR(const float* pPos);
 
     protected:
         DataManager m_dataMan;
+        CPREngine m_cpr;
     };
 
 }
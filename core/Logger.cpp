@@ -22,6 +22,7 @@
 
 #include "Logger.h"
 #include "log4cplus/log4cplus.h"
+#include <mutex>
 
 using namespace MonkeyGL;
 
@@ -53,7 +54,9 @@ std::string Logger::FormatMsg(const char * format, ...)
 }
 
 void Logger::Init(){
-    initLogger();
+    // every HelloMonkey calls Init, the appender must only be added once
+    static std::once_flag initFlag;
+    std::call_once(initFlag, initLogger);
 }
 
 void Logger::SetLevel(LogLevel level){
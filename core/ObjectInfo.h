@@ -36,7 +36,7 @@ namespace MonkeyGL{
 
         void Print();
 
-        bool GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int& nLen ) {
+        bool GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int& nLen ) const {
             TransferFunction tf;
             tf.SetControlPoints(idx2rgba, idx2alpha);
             return tf.GetTransferFunction(pBuffer, nLen);
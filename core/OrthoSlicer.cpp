@@ -0,0 +1,409 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "OrthoSlicer.h"
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+#include "ThreadPool.h"
+
+using namespace MonkeyGL;
+
+namespace {
+	const double c_fEpsilon = 1e-4;
+	const int c_nTileSize = 64;
+	// rows of a blended tile fetched ahead when the pixels of a row are lines apart
+	const int c_nPrefetchRows = 3;
+
+	// the volume axis a unit direction runs along and its sign, -1 if it is oblique
+	int GetAxis(double* pDir, int& nSign)
+	{
+		for (int i=0; i<3; i++)
+		{
+			if (fabs(fabs(pDir[i]) - 1.0) > c_fEpsilon)
+				continue;
+			if (fabs(pDir[(i+1)%3]) > c_fEpsilon || fabs(pDir[(i+2)%3]) > c_fEpsilon)
+				return -1;
+			nSign = pDir[i] > 0 ? 1 : -1;
+			return i;
+		}
+		return -1;
+	}
+
+	inline int Clamp(int i, int n)
+	{
+		return i<0 ? 0 : (i>=n ? n-1 : i);
+	}
+
+	// lower voxel, offset to the upper one and the weight of the upper one for the
+	// sample coordinate s, with the same clamping as the texture addressing
+	struct AxisSample
+	{
+		bool bValid;
+		ptrdiff_t nOffset;
+		ptrdiff_t nDelta;
+	};
+
+	inline AxisSample GetAxisSample(double s, int nFloor, int nDim, ptrdiff_t nStride, const int* pOffsets)
+	{
+		AxisSample sample;
+		sample.bValid = s >= -0.5 - c_fEpsilon && s <= nDim - 0.5 + c_fEpsilon;
+		int i0 = Clamp(nFloor, nDim);
+		int i1 = Clamp(nFloor+1, nDim);
+		if (NULL != pOffsets)
+		{
+			sample.nOffset = pOffsets[i0];
+			sample.nDelta = pOffsets[i1] - pOffsets[i0];
+			return sample;
+		}
+		sample.nOffset = i0*nStride;
+		sample.nDelta = (i1-i0)*nStride;
+		return sample;
+	}
+
+	// what the rows of a plane share, worked out once before the voxel type is known
+	struct PlaneLayout
+	{
+		short* pData;
+		int nWidth;
+		int nHeight;
+		const int* const* pOffsets;
+		const int* pDims;
+		int nAxis[3];
+		int nStep[3];
+		int nFloor[3];
+		ptrdiff_t nStride[3];
+		double fStart[3];
+		float fFrac[3];
+		const int* pTables[3];
+		AxisSample sampleN;
+		std::vector<AxisSample> vecH;
+		bool bCopy;
+		bool bTranspose;
+	};
+
+	// the trilinear blend of the corners at p00 + nDelta along the volume axes, in the
+	// order Trilinear blends them in
+	template <typename T>
+	inline short Blend(const T* p00, const ptrdiff_t* nDelta, const float* fFrac)
+	{
+		const T* p10 = p00 + nDelta[1];
+		const T* p01 = p00 + nDelta[2];
+		const T* p11 = p10 + nDelta[2];
+		float c00 = p00[0] + fFrac[0]*((float)p00[nDelta[0]] - p00[0]);
+		float c10 = p10[0] + fFrac[0]*((float)p10[nDelta[0]] - p10[0]);
+		float c01 = p01[0] + fFrac[0]*((float)p01[nDelta[0]] - p01[0]);
+		float c11 = p11[0] + fFrac[0]*((float)p11[nDelta[0]] - p11[0]);
+		float d0 = c00 + fFrac[1]*(c10 - c00);
+		float d1 = c01 + fFrac[1]*(c11 - c01);
+		return SaturateShort(d0 + fFrac[2]*(d1 - d0));
+	}
+
+	// the lowest and highest clamped voxel of an axis over nCount pixels from nFirst,
+	// with the upper blend neighbour when bBlend
+	inline void GetTileRange(const PlaneLayout& plane, int nAxis, int nFirst, int nCount, bool bBlend, int& nMin, int& nMax)
+	{
+		int a = plane.nFloor[nAxis] + nFirst*plane.nStep[nAxis];
+		int b = a + (nCount-1)*plane.nStep[nAxis];
+		nMin = Clamp(a<b ? a : b, plane.pDims[nAxis]);
+		nMax = Clamp((a>b ? a : b) + (bBlend ? 1 : 0), plane.pDims[nAxis]);
+	}
+
+	// a plane whose vertical runs along x has a pixel column in every volume row. the rows
+	// of the tile are read whole into a buffer that holds the tile's voxels x fastest, and
+	// the pixels are written row by row from there, which transposes the tile
+	template <typename T>
+	void SampleTileTransposed(const PlaneLayout& plane, const T* pVolume, int xStart, int yStart, int xEnd, int yEnd)
+	{
+		const int c_nSide = c_nTileSize + 1;
+		T buffer[2*c_nSide*c_nSide];
+		int nAxisH = plane.nAxis[0];
+		int nAxisN = plane.nAxis[2];
+		bool bBlend = !plane.bCopy;
+		int nMinV, nMaxV, nMinH, nMaxH, nMinN, nMaxN;
+		GetTileRange(plane, 0, yStart, yEnd-yStart, bBlend, nMinV, nMaxV);
+		GetTileRange(plane, nAxisH, xStart, xEnd-xStart, bBlend, nMinH, nMaxH);
+		GetTileRange(plane, nAxisN, 0, 1, bBlend, nMinN, nMaxN);
+		ptrdiff_t nLenV = nMaxV - nMinV + 1;
+		ptrdiff_t nLenH = nMaxH - nMinH + 1;
+		for (int n=nMinN; n<=nMaxN; n++)
+		{
+			for (int h=nMinH; h<=nMaxH; h++)
+			{
+				const T* pSrc = pVolume + n*plane.nStride[nAxisN] + h*plane.nStride[nAxisH] + nMinV;
+				memcpy(buffer + ((n-nMinN)*nLenH + (h-nMinH))*nLenV, pSrc, nLenV*sizeof(T));
+			}
+		}
+
+		// the same samples as on the volume, with the buffer's strides
+		AxisSample sampleN = GetAxisSample(plane.fStart[nAxisN], plane.nFloor[nAxisN], plane.pDims[nAxisN], nLenV*nLenH, NULL);
+		ptrdiff_t nTile = sampleN.nOffset - nMinN*nLenV*nLenH - nMinH*nLenV - nMinV;
+		AxisSample vecH[c_nTileSize];
+		for (int x=xStart; x<xEnd; x++)
+		{
+			vecH[x-xStart] = GetAxisSample(plane.fStart[nAxisH] + x*plane.nStep[nAxisH], plane.nFloor[nAxisH] + x*plane.nStep[nAxisH], plane.pDims[nAxisH], nLenV, NULL);
+		}
+		ptrdiff_t nDelta[3];
+		nDelta[nAxisN] = sampleN.nDelta;
+		for (int y=yStart; y<yEnd; y++)
+		{
+			short* pLine = plane.pData + (ptrdiff_t)y*plane.nWidth;
+			AxisSample sampleV = GetAxisSample(plane.fStart[0] + y*plane.nStep[0], plane.nFloor[0] + y*plane.nStep[0], plane.pDims[0], 1, NULL);
+			nDelta[0] = sampleV.nDelta;
+			ptrdiff_t nRow = nTile + sampleV.nOffset;
+			for (int x=xStart; x<xEnd; x++)
+			{
+				const AxisSample& sampleH = vecH[x-xStart];
+				if (!sampleV.bValid || !sampleH.bValid)
+				{
+					pLine[x] = -32768;
+					continue;
+				}
+				if (plane.bCopy)
+				{
+					pLine[x] = SaturateShort((float)buffer[nRow + sampleH.nOffset]);
+					continue;
+				}
+				nDelta[nAxisH] = sampleH.nDelta;
+				pLine[x] = Blend(buffer + nRow + sampleH.nOffset, nDelta, plane.fFrac);
+			}
+		}
+	}
+
+	template <typename T>
+	void SamplePlane(const PlaneLayout& plane, const T* pVolume)
+	{
+		short* pData = plane.pData;
+		int nWidth = plane.nWidth;
+		int nHeight = plane.nHeight;
+		const int* pDims = plane.pDims;
+		int nAxisH = plane.nAxis[0];
+		int nAxisV = plane.nAxis[1];
+		int nAxisN = plane.nAxis[2];
+		const int* nStep = plane.nStep;
+		const float* fFrac = plane.fFrac;
+		const std::vector<AxisSample>& vecH = plane.vecH;
+		const AxisSample& sampleN = plane.sampleN;
+		int nTilesX = (nWidth + c_nTileSize - 1)/c_nTileSize;
+		int nTilesY = (nHeight + c_nTileSize - 1)/c_nTileSize;
+		// tiles keep the rows of a block within the lines they share when the plane is
+		// not along x and consecutive pixels are a slice or a row apart
+		ThreadPool::Instance()->ParallelFor(0, nTilesX*nTilesY, [&](int nTile){
+			int xStart = (nTile%nTilesX)*c_nTileSize;
+			int yStart = (nTile/nTilesX)*c_nTileSize;
+			int xEnd = xStart+c_nTileSize < nWidth ? xStart+c_nTileSize : nWidth;
+			int yEnd = yStart+c_nTileSize < nHeight ? yStart+c_nTileSize : nHeight;
+			if (plane.bTranspose)
+			{
+				SampleTileTransposed(plane, pVolume, xStart, yStart, xEnd, yEnd);
+				return;
+			}
+			for (int y=yStart; y<yEnd; y++)
+			{
+				short* pLine = pData + y*nWidth;
+				AxisSample sampleV = GetAxisSample(plane.fStart[nAxisV] + y*nStep[nAxisV], plane.nFloor[nAxisV] + y*nStep[nAxisV], pDims[nAxisV], plane.nStride[nAxisV], plane.pTables[nAxisV]);
+				if (!sampleV.bValid)
+				{
+					for (int x=xStart; x<xEnd; x++)
+						pLine[x] = -32768;
+					continue;
+				}
+				const T* pRow = pVolume + sampleN.nOffset + sampleV.nOffset;
+
+				if (plane.bCopy)
+				{
+					// rows are contiguous in a linear short volume only
+					if (std::is_same<T, short>::value && NULL == plane.pOffsets && nAxisH == 0 && nStep[0] == 1 && vecH[xStart].bValid && vecH[xEnd-1].bValid)
+					{
+						memcpy(pLine + xStart, pRow + vecH[xStart].nOffset, (xEnd-xStart)*sizeof(short));
+						continue;
+					}
+					for (int x=xStart; x<xEnd; x++)
+						pLine[x] = vecH[x].bValid ? SaturateShort((float)pRow[vecH[x].nOffset]) : -32768;
+					continue;
+				}
+
+				// corner offsets along the volume axes, the order Trilinear blends them in
+				ptrdiff_t nDelta[3];
+				nDelta[nAxisV] = sampleV.nDelta;
+				nDelta[nAxisN] = sampleN.nDelta;
+				// a sagittal row blends lines a row apart at a stride the hardware prefetcher
+				// drops at every page, the lines of the rows further down are asked for early
+				ptrdiff_t nAhead = NULL == plane.pOffsets && nAxisH != 0 ? c_nPrefetchRows*nStep[nAxisV]*plane.nStride[nAxisV] : 0;
+				for (int x=xStart; x<xEnd; x++)
+				{
+					const AxisSample& sampleH = vecH[x];
+					if (!sampleH.bValid)
+					{
+						pLine[x] = -32768;
+						continue;
+					}
+					if (0 != nAhead)
+						__builtin_prefetch(pRow + sampleH.nOffset + nAhead);
+					nDelta[nAxisH] = sampleH.nDelta;
+					pLine[x] = Blend(pRow + sampleH.nOffset, nDelta, fFrac);
+				}
+			}
+		});
+	}
+}
+
+bool OrthoSlicer::GetPlaneData(
+	short* pData,
+	int nWidth,
+	int nHeight,
+	const short* pVolume,
+	const int* const* pOffsets,
+	const int* pDims,
+	const double* pSpacing,
+	Direction3d dirH,
+	Direction3d dirV,
+	Point3d ptLeftTop,
+	double fPixelSpacing,
+	int nSliceNum
+)
+{
+	return GetPlaneData(pData, nWidth, nHeight, pVolume, VoxelTypeInt16, pOffsets, pDims, pSpacing, dirH, dirV, ptLeftTop, fPixelSpacing, nSliceNum);
+}
+
+bool OrthoSlicer::GetPlaneData(
+	short* pData,
+	int nWidth,
+	int nHeight,
+	const void* pVolume,
+	VoxelType type,
+	const int* const* pOffsets,
+	const int* pDims,
+	const double* pSpacing,
+	Direction3d dirH,
+	Direction3d dirV,
+	Point3d ptLeftTop,
+	double fPixelSpacing,
+	int nSliceNum
+)
+{
+	if (NULL == pData || NULL == pVolume || nWidth<=0 || nHeight<=0 || nSliceNum != 1)
+		return false;
+
+	double fDirH[3] = {dirH.x(), dirH.y(), dirH.z()};
+	double fDirV[3] = {dirV.x(), dirV.y(), dirV.z()};
+	int nSignH = 0, nSignV = 0;
+	int nAxisH = GetAxis(fDirH, nSignH);
+	int nAxisV = GetAxis(fDirV, nSignV);
+	if (nAxisH < 0 || nAxisV < 0 || nAxisH == nAxisV)
+		return false;
+	int nAxisN = 3 - nAxisH - nAxisV;
+	if (fabs(fPixelSpacing - pSpacing[nAxisH]) > c_fEpsilon*pSpacing[nAxisH] ||
+		fabs(fPixelSpacing - pSpacing[nAxisV]) > c_fEpsilon*pSpacing[nAxisV])
+		return false;
+
+	// sample coordinate of the left top pixel in voxels, z is flipped as in the kernels
+	double fStart[3];
+	fStart[0] = ptLeftTop[0]/pSpacing[0] - 0.5;
+	fStart[1] = ptLeftTop[1]/pSpacing[1] - 0.5;
+	fStart[2] = pDims[2] - ptLeftTop[2]/pSpacing[2] - 0.5;
+	int nStep[3] = {0, 0, 0};
+	nStep[nAxisH] = nAxisH == 2 ? -nSignH : nSignH;
+	nStep[nAxisV] = nAxisV == 2 ? -nSignV : nSignV;
+
+	// the fractions are the same for every pixel, snap them so voxel aligned planes copy
+	int nFloor[3];
+	float fFrac[3];
+	for (int i=0; i<3; i++)
+	{
+		double fFloor = floor(fStart[i]);
+		double f = fStart[i] - fFloor;
+		if (f < c_fEpsilon)
+			f = 0.0;
+		if (f > 1.0 - c_fEpsilon)
+		{
+			f = 0.0;
+			fFloor += 1.0;
+		}
+		nFloor[i] = (int)fFloor;
+		fFrac[i] = (float)f;
+	}
+
+	// a slice offset passes 2^31 voxels in large volumes
+	ptrdiff_t nStride[3] = {1, pDims[0], (ptrdiff_t)pDims[0]*pDims[1]};
+	const int* pTables[3] = {NULL, NULL, NULL};
+	if (NULL != pOffsets)
+	{
+		for (int i=0; i<3; i++)
+			pTables[i] = pOffsets[i];
+	}
+	AxisSample sampleN = GetAxisSample(fStart[nAxisN], nFloor[nAxisN], pDims[nAxisN], nStride[nAxisN], pTables[nAxisN]);
+	if (!sampleN.bValid)
+	{
+		for (int i=0; i<nWidth*nHeight; i++)
+			pData[i] = -32768;
+		return true;
+	}
+
+	PlaneLayout plane;
+	plane.vecH.resize(nWidth);
+	for (int x=0; x<nWidth; x++)
+	{
+		plane.vecH[x] = GetAxisSample(fStart[nAxisH] + x*nStep[nAxisH], nFloor[nAxisH] + x*nStep[nAxisH], pDims[nAxisH], nStride[nAxisH], pTables[nAxisH]);
+	}
+	plane.pData = pData;
+	plane.nWidth = nWidth;
+	plane.nHeight = nHeight;
+	plane.pOffsets = pOffsets;
+	plane.pDims = pDims;
+	plane.nAxis[0] = nAxisH;
+	plane.nAxis[1] = nAxisV;
+	plane.nAxis[2] = nAxisN;
+	for (int i=0; i<3; i++)
+	{
+		plane.nStep[i] = nStep[i];
+		plane.nFloor[i] = nFloor[i];
+		plane.nStride[i] = nStride[i];
+		plane.fStart[i] = fStart[i];
+		plane.fFrac[i] = fFrac[i];
+		plane.pTables[i] = pTables[i];
+	}
+	plane.sampleN = sampleN;
+	plane.bCopy = fFrac[0] == 0.0f && fFrac[1] == 0.0f && fFrac[2] == 0.0f;
+	// rows of a bricked volume break at every brick
+	plane.bTranspose = nAxisV == 0 && NULL == pOffsets;
+	switch (type)
+	{
+	case VoxelTypeUInt8:
+		SamplePlane(plane, (const unsigned char*)pVolume);
+		break;
+	case VoxelTypeUInt16:
+		SamplePlane(plane, (const unsigned short*)pVolume);
+		break;
+	case VoxelTypeInt32:
+		SamplePlane(plane, (const int*)pVolume);
+		break;
+	case VoxelTypeFloat32:
+		SamplePlane(plane, (const float*)pVolume);
+		break;
+	default:
+		SamplePlane(plane, (const short*)pVolume);
+		break;
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include "Direction.h"
+#include "Point.h"
+#include "Defines.h"
+
+namespace MonkeyGL {
+
+    // host path for MPR planes that step whole voxels along two volume axes and sample
+    // a single slice. the sample positions then keep the same fractional offsets over
+    // the whole plane, so every pixel is a trilinear blend with fixed weights of voxels
+    // at fixed offsets, which is read straight from the volume instead of resampled.
+    class OrthoSlicer
+    {
+    public:
+        // same sampling as the generic plane renderers, including their clamping and the
+        // -32768 outside the volume. returns false, leaving pData untouched, when the
+        // plane is oblique, the pixel spacing differs from the voxel spacing or nSliceNum
+        // is more than one. pOffsets are the per axis address tables of a bricked volume,
+        // NULL for a linear one
+        static bool GetPlaneData(
+            short* pData,
+            int nWidth,
+            int nHeight,
+            const short* pVolume,
+            const int* const* pOffsets,
+            const int* pDims,
+            const double* pSpacing,
+            Direction3d dirH,
+            Direction3d dirV,
+            Point3d ptLeftTop,
+            double fPixelSpacing,
+            int nSliceNum
+        );
+        // a volume of any voxel type, values that do not fit a short are clamped
+        static bool GetPlaneData(
+            short* pData,
+            int nWidth,
+            int nHeight,
+            const void* pVolume,
+            VoxelType type,
+            const int* const* pOffsets,
+            const int* pDims,
+            const double* pSpacing,
+            Direction3d dirH,
+            Direction3d dirV,
+            Point3d ptLeftTop,
+            double fPixelSpacing,
+            int nSliceNum
+        );
+    };
+}
@@ -0,0 +1,85 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "PrefetchQueue.h"
+
+using namespace MonkeyGL;
+
+PrefetchQueue::PrefetchQueue(void)
+{
+	m_nGeneration = 0;
+	m_bStop = false;
+}
+
+PrefetchQueue::~PrefetchQueue(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_bStop = true;
+		m_tasks.clear();
+		m_nGeneration++;
+	}
+	m_cvWake.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void PrefetchQueue::Post(const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		if (m_bStop)
+			return;
+		if (!m_thread.joinable())
+			m_thread = std::thread(&PrefetchQueue::WorkerLoop, this);
+		m_tasks.push_back(task);
+	}
+	m_cvWake.notify_one();
+}
+
+void PrefetchQueue::Cancel()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_tasks.clear();
+	m_nGeneration++;
+}
+
+void PrefetchQueue::WorkerLoop()
+{
+	while (true)
+	{
+		Task task;
+		unsigned int nGeneration = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_cvWake.wait(lock, [this](){
+				return m_bStop || !m_tasks.empty();
+			});
+			if (m_bStop)
+				return;
+			task = m_tasks.front();
+			m_tasks.pop_front();
+			nGeneration = m_nGeneration;
+		}
+		task(nGeneration);
+	}
+}
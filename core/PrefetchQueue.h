@@ -0,0 +1,64 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace MonkeyGL {
+
+    // one background thread running speculative work in the order it was posted.
+    // Cancel drops the tasks that have not started, a running task is handed the
+    // generation it was posted in and can stop early once IsCancelled says so.
+    // the thread is started with the first task and joined by the destructor.
+    class PrefetchQueue
+    {
+    public:
+        PrefetchQueue(void);
+        ~PrefetchQueue(void);
+
+    public:
+        typedef std::function<void(unsigned int nGeneration)> Task;
+
+        void Post(const Task& task);
+        void Cancel();
+        bool IsCancelled(unsigned int nGeneration) const {
+            return nGeneration != m_nGeneration;
+        }
+
+    private:
+        void WorkerLoop();
+
+    private:
+        std::thread m_thread;
+        std::mutex m_mtx;
+        std::condition_variable m_cvWake;
+        std::deque<Task> m_tasks;
+        std::atomic<unsigned int> m_nGeneration;
+        bool m_bStop;
+    };
+
+}
@@ -0,0 +1,129 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ProgressiveRefinement.h"
+#include "ThreadPool.h"
+#include <cstring>
+
+using namespace MonkeyGL;
+
+namespace {
+	struct Level
+	{
+		int nStep;
+		int nSkipStep;
+		bool bPreview;
+	};
+
+	// the coarse grid is cast again at full quality by the second pass, so every
+	// pixel of the final frame comes from a full quality ray
+	const Level c_levels[ProgressiveRefinement::LEVEL_COUNT] = {
+		{4, 0, true},
+		{2, 0, false},
+		{1, 2, false}
+	};
+}
+
+ProgressiveRefinement::ProgressiveRefinement(void)
+{
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_nLevel = -1;
+}
+
+ProgressiveRefinement::~ProgressiveRefinement(void)
+{
+}
+
+void ProgressiveRefinement::Invalidate()
+{
+	m_nLevel = -1;
+}
+
+bool ProgressiveRefinement::Render(unsigned char* pVR, int nWidth, int nHeight, const std::vector<double>& vecViewKey, const PassFunc& pass, int& nQualityLevel, bool& bFinal)
+{
+	if (NULL == pVR || nWidth<=0 || nHeight<=0)
+		return false;
+
+	if (nWidth != m_nWidth || nHeight != m_nHeight || vecViewKey != m_vecViewKey)
+	{
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+		m_vecViewKey = vecViewKey;
+		m_nLevel = -1;
+	}
+	if ((int)m_vecFrame.size() != nWidth*nHeight*3)
+	{
+		m_vecFrame.resize(nWidth*nHeight*3);
+		m_nLevel = -1;
+	}
+
+	if (m_nLevel < LEVEL_COUNT-1)
+	{
+		int nLevel = m_nLevel + 1;
+		const Level& level = c_levels[nLevel];
+		if (!pass(&m_vecFrame[0], nWidth, nHeight, level.nStep, level.nSkipStep, level.bPreview))
+		{
+			m_nLevel = -1;
+			return false;
+		}
+		if (level.nStep > 1)
+			Upsample(&m_vecFrame[0], nWidth, nHeight, level.nStep);
+		m_nLevel = nLevel;
+	}
+
+	memcpy(pVR, &m_vecFrame[0], m_vecFrame.size());
+	nQualityLevel = m_nLevel;
+	bFinal = m_nLevel == LEVEL_COUNT-1;
+	return true;
+}
+
+void ProgressiveRefinement::Upsample(unsigned char* pFrame, int nWidth, int nHeight, int nStep)
+{
+	// the last grid line may be short of the border, pixels past it repeat it
+	int nLastX = ((nWidth-1)/nStep)*nStep;
+	int nLastY = ((nHeight-1)/nStep)*nStep;
+	float fInv = 1.0f/nStep;
+	ThreadPool::Instance()->ParallelFor(0, nHeight, [&](int y){
+		int y0 = (y/nStep)*nStep;
+		int y1 = y0+nStep <= nLastY ? y0+nStep : y0;
+		float fy = y1 > y0 ? (y-y0)*fInv : 0.0f;
+		const unsigned char* pRow0 = pFrame + y0*nWidth*3;
+		const unsigned char* pRow1 = pFrame + y1*nWidth*3;
+		unsigned char* pRow = pFrame + y*nWidth*3;
+		bool bGridRow = y == y0;
+		for (int x=0; x<nWidth; x++)
+		{
+			int x0 = (x/nStep)*nStep;
+			if (bGridRow && x == x0)
+				continue;
+			int x1 = x0+nStep <= nLastX ? x0+nStep : x0;
+			float fx = x1 > x0 ? (x-x0)*fInv : 0.0f;
+			for (int c=0; c<3; c++)
+			{
+				float c0 = pRow0[x0*3+c] + fx*(pRow0[x1*3+c] - pRow0[x0*3+c]);
+				float c1 = pRow1[x0*3+c] + fx*(pRow1[x1*3+c] - pRow1[x0*3+c]);
+				pRow[x*3+c] = (unsigned char)(c0 + fy*(c1 - c0) + 0.5f);
+			}
+		}
+	});
+}
@@ -0,0 +1,63 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <functional>
+
+namespace MonkeyGL {
+
+    // host side scheduling of progressive VR frames. the first call for a new view
+    // casts a quarter resolution ray grid at preview quality and upsamples it, the
+    // following calls for the same view fill in the interleaved pixels at full
+    // quality until the frame is final, after which the converged frame is reused.
+    class ProgressiveRefinement
+    {
+    public:
+        ProgressiveRefinement(void);
+        ~ProgressiveRefinement(void);
+
+    public:
+        static const int LEVEL_COUNT = 3;
+
+        // one pass casts the pixels whose x and y are both multiples of nStep, leaving
+        // out those that are multiples of nSkipStep as well when it is not 0
+        typedef std::function<bool(unsigned char* pFrame, int nWidth, int nHeight, int nStep, int nSkipStep, bool bPreview)> PassFunc;
+
+        // vecViewKey holds whatever moves the camera (rotation, pan, zoom, background),
+        // nQualityLevel is 0 for the coarse frame and LEVEL_COUNT-1 for the final one
+        bool Render(unsigned char* pVR, int nWidth, int nHeight, const std::vector<double>& vecViewKey, const PassFunc& pass, int& nQualityLevel, bool& bFinal);
+
+        // the volume, masks or transfer functions changed, restart at the coarse frame
+        void Invalidate();
+
+        // fills every pixel off the nStep grid by bilinear interpolation of the grid pixels
+        static void Upsample(unsigned char* pFrame, int nWidth, int nHeight, int nStep);
+
+    private:
+        std::vector<double> m_vecViewKey;
+        int m_nWidth;
+        int m_nHeight;
+        int m_nLevel;
+        std::vector<unsigned char> m_vecFrame;
+    };
+}
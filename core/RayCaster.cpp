@@ -0,0 +1,906 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "RayCaster.h"
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace MonkeyGL;
+
+namespace {
+	// address tables of a linear volume, the mask is always linear
+	const int* const c_pLinearLayout[3] = {NULL, NULL, NULL};
+	// accumulated opacity at which a pick ray reports its position
+	const float c_fPickOpacity = 0.5f;
+
+	inline int ClampIndex(int i, int n)
+	{
+		return i<0 ? 0 : (i>=n ? n-1 : i);
+	}
+
+	// same addressing as a normalized-coordinate, clamped, linear filtered cuda texture.
+	// bBricked reads through the offset tables, which the caller resolves once per ray
+	template <typename T, bool bBricked>
+	inline float Trilinear(const T* pData, const int* pDims, const int* const* pOffsets, float x, float y, float z)
+	{
+		x = x*pDims[0] - 0.5f;
+		y = y*pDims[1] - 0.5f;
+		z = z*pDims[2] - 0.5f;
+		float fx0 = floorf(x);
+		float fy0 = floorf(y);
+		float fz0 = floorf(z);
+		float fx = x - fx0;
+		float fy = y - fy0;
+		float fz = z - fz0;
+		int x0 = ClampIndex((int)fx0, pDims[0]);
+		int x1 = ClampIndex((int)fx0+1, pDims[0]);
+		int y0 = ClampIndex((int)fy0, pDims[1]);
+		int y1 = ClampIndex((int)fy0+1, pDims[1]);
+		int z0 = ClampIndex((int)fz0, pDims[2]);
+		int z1 = ClampIndex((int)fz0+1, pDims[2]);
+
+		const T *p00, *p10, *p01, *p11;
+		if (bBricked)
+		{
+			p00 = pData + pOffsets[2][z0] + pOffsets[1][y0];
+			p10 = pData + pOffsets[2][z0] + pOffsets[1][y1];
+			p01 = pData + pOffsets[2][z1] + pOffsets[1][y0];
+			p11 = pData + pOffsets[2][z1] + pOffsets[1][y1];
+			x0 = pOffsets[0][x0];
+			x1 = pOffsets[0][x1];
+		}
+		else
+		{
+			size_t nLine = pDims[0];
+			size_t nFrame = (size_t)pDims[0]*pDims[1];
+			p00 = pData + z0*nFrame + y0*nLine;
+			p10 = pData + z0*nFrame + y1*nLine;
+			p01 = pData + z1*nFrame + y0*nLine;
+			p11 = pData + z1*nFrame + y1*nLine;
+		}
+
+#if defined(__SSE2__)
+		// lerp the four x pairs at once, then y, then z
+		__m128 a = _mm_setr_ps(p00[x0], p10[x0], p01[x0], p11[x0]);
+		__m128 b = _mm_setr_ps(p00[x1], p10[x1], p01[x1], p11[x1]);
+		__m128 c = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(fx), _mm_sub_ps(b, a)));
+		__m128 lo = _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 hi = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 d = _mm_add_ps(lo, _mm_mul_ps(_mm_set1_ps(fy), _mm_sub_ps(hi, lo)));
+		float d0 = _mm_cvtss_f32(d);
+		float d1 = _mm_cvtss_f32(_mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+#else
+		float c00 = p00[x0] + fx*((float)p00[x1] - p00[x0]);
+		float c10 = p10[x0] + fx*((float)p10[x1] - p10[x0]);
+		float c01 = p01[x0] + fx*((float)p01[x1] - p01[x0]);
+		float c11 = p11[x0] + fx*((float)p11[x1] - p11[x0]);
+		float d0 = c00 + fy*(c10 - c00);
+		float d1 = c01 + fy*(c11 - c01);
+#endif
+		return d0 + fz*(d1 - d0);
+	}
+
+	// the voxel coordinate of the samplers for texture coordinate x of an axis with nDim voxels
+	inline float ToVoxel(float x, int nDim)
+	{
+		return x*nDim - 0.5f;
+	}
+
+	inline unsigned char GetMaskLabel(float val)
+	{
+		unsigned char label = (unsigned char)(val);
+		float delta = val - label;
+		if (delta > 0.5){
+			label = label + 1;
+		}
+		return label;
+	}
+
+	inline float Saturate(float v)
+	{
+		return v<0.0f ? 0.0f : (v>1.0f ? 1.0f : v);
+	}
+
+	inline bool GetNextStep(
+		float& fAlphaTemp,
+		float& fStepTemp,
+		float& accuLength,
+		float fAlphaPre,
+		float fStepL1,
+		float fStepL4,
+		float fStepL8
+	)
+	{
+		if (fStepTemp == fStepL4)
+			fAlphaTemp = 1 - powf(1-fAlphaTemp, 0.25f);
+		else if(fStepTemp == fStepL8)
+			fAlphaTemp = 1 - powf(1-fAlphaTemp, 0.125f);
+
+		if (accuLength > 0.0f)
+		{
+			if ((fAlphaTemp>fAlphaPre ? fAlphaTemp:fAlphaPre) > 0.001f)
+			{
+				if (fStepTemp == fStepL1)
+				{
+					accuLength -= (fStepL1 - fStepL4);
+					fStepTemp = fStepL4;
+					return false;
+				}
+				else if(fStepTemp == fStepL4)
+				{
+					accuLength -= (fStepL4 - fStepL8);
+					fStepTemp = fStepL8;
+					return false;
+				}
+			}
+			else
+			{
+				if (fStepTemp == fStepL8)
+					fStepTemp = fStepL4;
+				else
+					fStepTemp = fStepL1;
+			}
+		}
+		return true;
+	}
+}
+
+RayCaster::RayCaster(void)
+{
+	m_pVolume = NULL;
+	m_voxelType = VoxelTypeInt16;
+	memset(m_pOffsets, 0, sizeof(m_pOffsets));
+	m_pMask = NULL;
+	m_bRayPackets = true;
+	memset(m_Dims, 0, 3*sizeof(int));
+	m_fLevelScale = 1.0f;
+	for (int i=0; i<3; i++)
+	{
+		m_f3Spacing[i] = 1.0f;
+		m_f3Nor[i] = 0.0f;
+		m_f3maxper[i] = 1.0f;
+	}
+	float m[9] = {1,0,0,0,1,0,0,0,1};
+	memcpy(m_TransformMatrix, m, 9*sizeof(float));
+	for (int i=0; i<MAXOBJECTCOUNT+1; i++)
+	{
+		m_pTransferFuncs[i] = NULL;
+		m_nLenTransferFuncs[i] = 0;
+		m_pPreIntegrationTables[i] = NULL;
+		m_nPreIntegrationSizes[i] = 0;
+	}
+	m_bPreIntegration = false;
+	m_bPreview = false;
+	m_fPreIntegrationStep = 1.0f;
+	m_pAlphaAndMapping = NULL;
+	m_pBrickTable = NULL;
+	memset(m_BrickDims, 0, 3*sizeof(int));
+	m_nWidth = 0;
+	m_nHeight = 0;
+	m_fxTranslate = 0.0f;
+	m_fyTranslate = 0.0f;
+	m_fScale = 1.0f;
+}
+
+RayCaster::~RayCaster(void)
+{
+}
+
+void RayCaster::SetVolume(const short* pVolume, const unsigned char* pMask, int nWidth, int nHeight, int nDepth)
+{
+	SetVolume(pVolume, VoxelTypeInt16, pMask, nWidth, nHeight, nDepth);
+}
+
+void RayCaster::SetVolume(const void* pVolume, VoxelType type, const unsigned char* pMask, int nWidth, int nHeight, int nDepth)
+{
+	const int* pOffsets[3] = {NULL, NULL, NULL};
+	SetVolume(NULL, pMask, nWidth, nHeight, nDepth, pOffsets, 0);
+	m_pVolume = pVolume;
+	m_voxelType = type;
+	m_volumeSampler.SetVolume(pVolume, type, nWidth, nHeight, nDepth);
+}
+
+void RayCaster::SetVolume(const short* pVolume, const unsigned char* pMask, int nWidth, int nHeight, int nDepth, const int* const* pOffsets, size_t nVoxels)
+{
+	m_pVolume = pVolume;
+	m_voxelType = VoxelTypeInt16;
+	for (int i=0; i<3; i++){
+		m_pOffsets[i] = pOffsets[i];
+	}
+	m_pMask = pMask;
+	if (NULL != pOffsets[0])
+		m_volumeSampler.SetVolume(pVolume, nWidth, nHeight, nDepth, pOffsets[0], pOffsets[1], pOffsets[2], nVoxels);
+	else
+		m_volumeSampler.SetVolume(pVolume, nWidth, nHeight, nDepth);
+	m_maskSampler.SetVolume(pMask, VoxelTypeUInt8, nWidth, nHeight, nDepth);
+	m_Dims[0] = nWidth;
+	m_Dims[1] = nHeight;
+	m_Dims[2] = nDepth;
+
+	m_voi.left = 0;
+	m_voi.right = nWidth - 1;
+	m_voi.posterior = 0;
+	m_voi.anterior = nHeight - 1;
+	m_voi.head = 0;
+	m_voi.foot = nDepth - 1;
+}
+
+void RayCaster::SetLevelScale(float fLevelScale)
+{
+	m_fLevelScale = fLevelScale > 0.0f ? fLevelScale : 1.0f;
+}
+
+void RayCaster::SetSpacing(double x, double y, double z)
+{
+	m_f3Spacing[0] = x;
+	m_f3Spacing[1] = y;
+	m_f3Spacing[2] = z;
+	// gradients keep the full resolution offsets on a coarser level, a level wide
+	// difference would widen the lit shell around every surface
+	for (int i=0; i<3; i++)
+	{
+		m_f3Nor[i] = m_Dims[i]>0 ? 1.0f/(m_Dims[i]*m_fLevelScale) : 0.0f;
+	}
+
+	float fMaxLen = m_Dims[0]*m_f3Spacing[0];
+	fMaxLen = fMaxLen > m_Dims[1]*m_f3Spacing[1] ? fMaxLen : m_Dims[1]*m_f3Spacing[1];
+	fMaxLen = fMaxLen > m_Dims[2]*m_f3Spacing[2] ? fMaxLen : m_Dims[2]*m_f3Spacing[2];
+	for (int i=0; i<3; i++)
+	{
+		m_f3maxper[i] = 1.0f*fMaxLen/(m_Dims[i]*m_f3Spacing[i]);
+	}
+}
+
+void RayCaster::SetOrientation(const Orientation& orientation)
+{
+	m_orientation = orientation;
+}
+
+void RayCaster::SetVOI(const VOI& voi)
+{
+	m_voi = voi;
+}
+
+void RayCaster::SetTransformMatrix(const float* pTransformMatrix)
+{
+	memcpy(m_TransformMatrix, pTransformMatrix, 9*sizeof(float));
+}
+
+void RayCaster::SetTransferFunc(const RGBA* pTransferFunc, int nLen, unsigned char nLabel)
+{
+	if (nLabel > MAXOBJECTCOUNT)
+		return;
+	m_pTransferFuncs[nLabel] = pTransferFunc;
+	m_nLenTransferFuncs[nLabel] = pTransferFunc==NULL ? 0 : nLen;
+}
+
+void RayCaster::SetPreIntegrationTable(const RGBA* pTable, int nSize, unsigned char nLabel)
+{
+	if (nLabel > MAXOBJECTCOUNT)
+		return;
+	m_pPreIntegrationTables[nLabel] = pTable;
+	m_nPreIntegrationSizes[nLabel] = pTable==NULL ? 0 : nSize;
+}
+
+void RayCaster::SetPreIntegration(bool bEnable, float fStepScale)
+{
+	m_bPreIntegration = bEnable;
+	m_fPreIntegrationStep = fStepScale > 0.0f ? fStepScale : 1.0f;
+}
+
+void RayCaster::SetPreview(bool bPreview)
+{
+	m_bPreview = bPreview;
+}
+
+void RayCaster::SetAlphaAndMapping(const AlphaAndMapping* pAlphaAndMapping)
+{
+	m_pAlphaAndMapping = pAlphaAndMapping;
+}
+
+void RayCaster::SetColorBackground(RGBA clrBG)
+{
+	m_colorBG = clrBG;
+}
+
+void RayCaster::SetBrickTable(BrickTable* pBrickTable)
+{
+	m_pBrickTable = pBrickTable;
+	for (int i=0; i<3; i++)
+	{
+		m_BrickDims[i] = NULL != pBrickTable ? pBrickTable->GetDim(i) : 0;
+	}
+}
+
+void RayCaster::SetView(int nWidth, int nHeight, float fxTranslate, float fyTranslate, float fScale)
+{
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_fxTranslate = fxTranslate;
+	m_fyTranslate = fyTranslate;
+	m_fScale = fScale;
+}
+
+void RayCaster::SetRayPackets(bool bEnable)
+{
+	m_bRayPackets = bEnable;
+}
+
+float RayCaster::SampleVolume(float x, float y, float z)
+{
+	float fValue = 0.0f;
+	SampleVolume(&x, &y, &z, &fValue, 1);
+	return fValue;
+}
+
+void RayCaster::SampleVolume(const float* pX, const float* pY, const float* pZ, float* pOut, int nCount)
+{
+	// the bricked layout holds 16 bit volumes only
+	if (NULL != m_pOffsets[0])
+	{
+		SampleVolumeBatch<short, true>(pX, pY, pZ, pOut, nCount);
+		return;
+	}
+	switch (m_voxelType)
+	{
+	case VoxelTypeUInt8:
+		SampleVolumeBatch<unsigned char, false>(pX, pY, pZ, pOut, nCount);
+		break;
+	case VoxelTypeUInt16:
+		SampleVolumeBatch<unsigned short, false>(pX, pY, pZ, pOut, nCount);
+		break;
+	case VoxelTypeInt32:
+		SampleVolumeBatch<int, false>(pX, pY, pZ, pOut, nCount);
+		break;
+	case VoxelTypeFloat32:
+		SampleVolumeBatch<float, false>(pX, pY, pZ, pOut, nCount);
+		break;
+	default:
+		SampleVolumeBatch<short, false>(pX, pY, pZ, pOut, nCount);
+		break;
+	}
+}
+
+template <typename T, bool bBricked>
+void RayCaster::SampleVolumeBatch(const float* pX, const float* pY, const float* pZ, float* pOut, int nCount)
+{
+	for (int i=0; i<nCount; i++)
+		pOut[i] = Fetch<T, bBricked>(pX[i], pY[i], pZ[i]);
+}
+
+template <typename T, bool bBricked>
+float RayCaster::Fetch(float x, float y, float z)
+{
+	return Trilinear<T, bBricked>((const T*)m_pVolume, m_Dims, m_pOffsets, x, y, z);
+}
+
+unsigned char RayCaster::SampleLabel(float x, float y, float z)
+{
+	if (NULL == m_pMask)
+		return 0;
+	return GetMaskLabel(Trilinear<unsigned char, false>(m_pMask, m_Dims, c_pLinearLayout, x, y, z));
+}
+
+void RayCaster::ToTexture(const float* pIn, float* pOut, bool bOffset)
+{
+	const float* m = m_TransformMatrix;
+	float pos[3];
+	pos[0] = m[0]*pIn[0] + m[1]*pIn[1] + m[2]*pIn[2];
+	pos[1] = m[3]*pIn[0] + m[4]*pIn[1] + m[5]*pIn[2];
+	pos[2] = m[6]*pIn[0] + m[7]*pIn[1] + m[8]*pIn[2];
+
+	float xTemp = pos[0] * m_f3maxper[0];
+	float yTemp = pos[1] * m_f3maxper[1];
+	float fOffset = bOffset ? 0.5f : 0.0f;
+	pOut[0] = xTemp*m_orientation.rx + yTemp*m_orientation.ry + fOffset;
+	pOut[1] = xTemp*m_orientation.cx + yTemp*m_orientation.cy + fOffset;
+	pOut[2] = pos[2] * m_f3maxper[2] + fOffset;
+}
+
+void RayCaster::SampleTransferFunc(float* pColor, unsigned char nLabel, float fPos)
+{
+	int nLen = m_nLenTransferFuncs[nLabel];
+	if (nLen <= 0)
+	{
+		pColor[0] = pColor[1] = pColor[2] = pColor[3] = 0.0f;
+		return;
+	}
+	const RGBA* pTF = m_pTransferFuncs[nLabel];
+	// same as a clamped texture fetch, and keeps the index in int range
+	fPos = fPos < 0.0f ? 0.0f : (fPos > 1.0f ? 1.0f : fPos);
+	float t = fPos*nLen - 0.5f;
+	float ft0 = floorf(t);
+	float f = t - ft0;
+	const RGBA& c0 = pTF[ClampIndex((int)ft0, nLen)];
+	const RGBA& c1 = pTF[ClampIndex((int)ft0+1, nLen)];
+	pColor[0] = c0.red + f*(c1.red - c0.red);
+	pColor[1] = c0.green + f*(c1.green - c0.green);
+	pColor[2] = c0.blue + f*(c1.blue - c0.blue);
+	pColor[3] = c0.alpha + f*(c1.alpha - c0.alpha);
+}
+
+void RayCaster::SamplePreIntegration(float* pColor, unsigned char nLabel, float fFront, float fBack)
+{
+	int nSize = m_nPreIntegrationSizes[nLabel];
+	if (nSize <= 0)
+	{
+		pColor[0] = pColor[1] = pColor[2] = pColor[3] = 0.0f;
+		return;
+	}
+	const RGBA* pTable = m_pPreIntegrationTables[nLabel];
+	fFront = fFront < 0.0f ? 0.0f : (fFront > 1.0f ? 1.0f : fFront);
+	fBack = fBack < 0.0f ? 0.0f : (fBack > 1.0f ? 1.0f : fBack);
+	float y = fFront*nSize - 0.5f;
+	float x = fBack*nSize - 0.5f;
+	float fy0 = floorf(y);
+	float fx0 = floorf(x);
+	float fy = y - fy0;
+	float fx = x - fx0;
+	const RGBA* pRow0 = pTable + ClampIndex((int)fy0, nSize)*nSize;
+	const RGBA* pRow1 = pTable + ClampIndex((int)fy0+1, nSize)*nSize;
+	int x0 = ClampIndex((int)fx0, nSize);
+	int x1 = ClampIndex((int)fx0+1, nSize);
+	const float* c00 = &pRow0[x0].red;
+	const float* c01 = &pRow0[x1].red;
+	const float* c10 = &pRow1[x0].red;
+	const float* c11 = &pRow1[x1].red;
+	for (int i=0; i<4; i++)
+	{
+		float c0 = c00[i] + fx*(c01[i] - c00[i]);
+		float c1 = c10[i] + fx*(c11[i] - c10[i]);
+		pColor[i] = c0 + fy*(c1 - c0);
+	}
+}
+
+template <typename T, bool bBricked>
+void RayCaster::Gradient(const float* pPos, float* pGradient)
+{
+	const float* nor = m_f3Nor;
+	pGradient[0] = (Fetch<T, bBricked>(pPos[0]+nor[0], pPos[1], pPos[2]) - Fetch<T, bBricked>(pPos[0]-nor[0], pPos[1], pPos[2]))*m_f3Spacing[0];
+	pGradient[1] = (Fetch<T, bBricked>(pPos[0], pPos[1]+nor[1], pPos[2]) - Fetch<T, bBricked>(pPos[0], pPos[1]-nor[1], pPos[2]))*m_f3Spacing[1];
+	pGradient[2] = (Fetch<T, bBricked>(pPos[0], pPos[1], pPos[2]+nor[2]) - Fetch<T, bBricked>(pPos[0], pPos[1], pPos[2]-nor[2]))*m_f3Spacing[2];
+}
+
+// ray length left inside the empty region or brick holding the sample, 0 if it is not empty
+float RayCaster::GetEmptySkipLength(const float* pPos, const float* pDirRay, int nxIdx, int nyIdx, int nzIdx)
+{
+	int nShift = 0;
+	if (m_pBrickTable->IsEmptyRegion(nxIdx>>(BrickTable::BRICK_SHIFT+BrickTable::REGION_SHIFT), nyIdx>>(BrickTable::BRICK_SHIFT+BrickTable::REGION_SHIFT), nzIdx>>(BrickTable::BRICK_SHIFT+BrickTable::REGION_SHIFT)))
+		nShift = BrickTable::BRICK_SHIFT+BrickTable::REGION_SHIFT;
+	else if (m_pBrickTable->IsEmptyBrick(nxIdx>>BrickTable::BRICK_SHIFT, nyIdx>>BrickTable::BRICK_SHIFT, nzIdx>>BrickTable::BRICK_SHIFT))
+		nShift = BrickTable::BRICK_SHIFT;
+	else
+		return 0.0f;
+
+	int nIdx[3] = {nxIdx, nyIdx, nzIdx};
+	float fLength = 1.0e10f;
+	for (int i=0; i<3; i++)
+	{
+		float fBound = 0.0f;
+		if (pDirRay[i] > 0.0f)
+			fBound = 1.0f*(((nIdx[i]>>nShift)+1)<<nShift)/m_BrickDims[i];
+		else if (pDirRay[i] < 0.0f)
+			fBound = 1.0f*((nIdx[i]>>nShift)<<nShift)/m_BrickDims[i];
+		else
+			continue;
+		float fAxis = (fBound - pPos[i])/pDirRay[i];
+		fLength = fAxis < fLength ? fAxis : fLength;
+	}
+	return fLength;
+}
+
+/*
+**   z
+**   |__x
+**  /-y
+*/
+RGBA RayCaster::CastRay(int x, int y)
+{
+	float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	March(x, y, sum, NULL);
+
+	if (sum[0]==0.0f && sum[1]==0.0f && sum[2]==0.0f && sum[3]==0.0f){
+		return m_colorBG;
+	}
+	return RGBA(sum[0], sum[1], sum[2], sum[3]);
+}
+
+bool RayCaster::PickRay(int x, int y, float* pPos)
+{
+	return March(x, y, NULL, pPos);
+}
+
+void RayCaster::GetRay(int x, int y, float* pBase, float* pDir)
+{
+	float u = 1.0f*(x-m_nWidth/2.0f-m_fxTranslate)/m_nWidth;
+	float v = 1.0f*(y-m_nHeight/2.0f-m_fyTranslate)/m_nHeight;
+
+	// the sample position is affine in the ray length, so only its base and slope are transformed
+	float ptIn[3] = {u, -0.866f*m_fScale, v};
+	ToTexture(ptIn, pBase, true);
+	float dirIn[3] = {0.0f, m_fScale, 0.0f};
+	ToTexture(dirIn, pDir, false);
+}
+
+void RayCaster::GetMarchConstants(MarchConstants& mc)
+{
+	const float* m = m_TransformMatrix;
+	float l[3] = {m[1], m[4], m[7]};
+	float fLen = sqrtf(l[0]*l[0] + l[1]*l[1] + l[2]*l[2]);
+	for (int i=0; i<3; i++)
+		mc.dirLight[i] = fLen>0.0f ? l[i]/fLen : 0.0f;
+
+	mc.fStepL1 = 1.0f/m_Dims[2];
+	mc.fStepL4 = mc.fStepL1/4.0f;
+	mc.fStepL8 = mc.fStepL1/8.0f;
+	mc.fStepScale = m_bPreIntegration ? m_fPreIntegrationStep : 1.0f;
+	// a preview walks twice the step and never refines it
+	if (m_bPreview)
+		mc.fStepScale *= 2.0f;
+	mc.bFixedStep = m_bPreIntegration || m_bPreview;
+	mc.fAlphaScale = mc.bFixedStep ? mc.fStepScale*m_fLevelScale : m_fLevelScale;
+}
+
+void RayCaster::BeginRay(int x, int y, const MarchConstants& mc, RayState& ray)
+{
+	GetRay(x, y, ray.ptBase, ray.dirRay);
+	ray.accuLength = 0.0f;
+	ray.fStepTemp = mc.bFixedStep ? mc.fStepL1*mc.fStepScale : mc.fStepL1;
+	ray.fAlphaPre = 0.0f;
+	ray.alphaAcc = 0.0f;
+	ray.tempPre = 0.0f;
+	ray.nLabelPre = -1;
+	for (int i=0; i<4; i++)
+		ray.sum[i] = 0.0f;
+	for (int i=0; i<MAXOBJECTCOUNT+1; i++)
+		ray.alphaAccObject[i] = 0.0f;
+}
+
+bool RayCaster::NextSample(RayState& ray, const MarchConstants& mc, float* pPos)
+{
+	while (ray.accuLength < 1.732)
+	{
+		pPos[0] = ray.ptBase[0] + ray.accuLength*ray.dirRay[0];
+		pPos[1] = ray.ptBase[1] + ray.accuLength*ray.dirRay[1];
+		pPos[2] = ray.ptBase[2] + ray.accuLength*ray.dirRay[2];
+
+		int nxIdx = pPos[0] * m_Dims[0];
+		int nyIdx = pPos[1] * m_Dims[1];
+		int nzIdx = pPos[2] * m_Dims[2];
+		if (nxIdx<m_voi.left || nxIdx>m_voi.right || nyIdx<m_voi.posterior || nyIdx>m_voi.anterior || nzIdx<m_voi.head || nzIdx>m_voi.foot)
+		{
+			ray.accuLength += ray.fStepTemp;
+			ray.nLabelPre = -1;
+			continue;
+		}
+
+		// only a ray at the coarse step whose last sample was clear would march straight
+		// through, so jumping whole steps keeps the samples the same as without skipping;
+		// at a coarser level the VOI test lets through positions just below zero, which
+		// would index before the first full-resolution brick
+		if (NULL != m_pBrickTable && (mc.bFixedStep || ray.fStepTemp == mc.fStepL1) && ray.fAlphaPre <= 0.001f &&
+			pPos[0] >= 0.0f && pPos[1] >= 0.0f && pPos[2] >= 0.0f)
+		{
+			float fSkipLength = GetEmptySkipLength(pPos, ray.dirRay, (int)(pPos[0]*m_BrickDims[0]), (int)(pPos[1]*m_BrickDims[1]), (int)(pPos[2]*m_BrickDims[2]));
+			if (fSkipLength > 0.0f)
+			{
+				int nSteps = (int)(fSkipLength/ray.fStepTemp);
+				nSteps = nSteps < 1 ? 1 : nSteps;
+				ray.accuLength += nSteps*ray.fStepTemp;
+				ray.fAlphaPre = 0.0f;
+				ray.nLabelPre = -1;
+				continue;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+bool RayCaster::ClassifySample(RayState& ray, const MarchConstants& mc, float fValue, unsigned char nLabel, float* pColor)
+{
+	const AlphaAndMapping& alphaMapping = m_pAlphaAndMapping[nLabel];
+	float temp = fValue*alphaMapping.scale + alphaMapping.offset;
+	float fAlphaTemp = 0.0f;
+	if (m_bPreIntegration)
+	{
+		// the segment from the previous sample, a label change starts a new one
+		float tempFront = nLabel == ray.nLabelPre ? ray.tempPre : temp;
+		SamplePreIntegration(pColor, nLabel, tempFront, temp);
+		ray.nLabelPre = nLabel;
+		ray.tempPre = temp;
+		fAlphaTemp = pColor[3];
+	}
+	else
+	{
+		SampleTransferFunc(pColor, nLabel, temp);
+		fAlphaTemp = pColor[3];
+
+		if (!mc.bFixedStep && !GetNextStep(fAlphaTemp, ray.fStepTemp, ray.accuLength, ray.fAlphaPre, mc.fStepL1, mc.fStepL4, mc.fStepL8)){
+			return false;
+		}
+	}
+	if (mc.fAlphaScale != 1.0f)
+		fAlphaTemp = 1 - powf(1-fAlphaTemp, mc.fAlphaScale);
+
+	ray.fAlphaPre = fAlphaTemp;
+	ray.accuLength += ray.fStepTemp;
+
+	pColor[3] = fAlphaTemp;
+	return pColor[3] > 0.0005f && ray.alphaAccObject[nLabel] < alphaMapping.alpha;
+}
+
+bool RayCaster::Composite(RayState& ray, const MarchConstants& mc, const float* pPos, const float* pColor, unsigned char nLabel, const float* pGradient, float* pPickPos)
+{
+	float fWeight = (1.0f - ray.alphaAcc) * pColor[3];
+	if (NULL == pGradient)
+	{
+		for (int i=0; i<4; i++)
+			ray.sum[i] += fWeight * pColor[i];
+	}
+	else
+	{
+		float N[3];
+		N[0] = pGradient[0]*m_orientation.rx + pGradient[1]*m_orientation.ry;
+		N[1] = pGradient[0]*m_orientation.cx + pGradient[1]*m_orientation.cy;
+		N[2] = pGradient[2];
+		float fLen = sqrtf(N[0]*N[0] + N[1]*N[1] + N[2]*N[2]);
+
+		float diffuse = 0.0f;
+		if (fLen > 0.0f)
+		{
+			diffuse = (N[0]*mc.dirLight[0] + N[1]*mc.dirLight[1] + N[2]*mc.dirLight[2])/fLen;
+		}
+
+		float clrLight[4];
+		for (int i=0; i<4; i++)
+		{
+			clrLight[i] = pColor[i] * 0.35f;
+		}
+		if (diffuse > 0.0f)
+		{
+			float fFactor = diffuse*0.6f + 0.16f*powf(diffuse, 8.0f);
+			for (int i=0; i<4; i++)
+			{
+				clrLight[i] += pColor[i] * fFactor;
+			}
+		}
+		for (int i=0; i<4; i++)
+		{
+			ray.sum[i] += fWeight * clrLight[i];
+		}
+	}
+	ray.alphaAccObject[nLabel] += (1.0f - ray.alphaAcc) * pColor[3];
+	ray.alphaAcc += (1.0f - ray.alphaAcc) * pColor[3];
+
+	if (NULL != pPickPos && ray.alphaAcc >= c_fPickOpacity){
+		for (int i=0; i<3; i++)
+			pPickPos[i] = pPos[i];
+		return false;
+	}
+	return ray.alphaAcc <= 0.995f;
+}
+
+bool RayCaster::March(int x, int y, float* pSum, float* pPickPos)
+{
+	// the bricked layout holds 16 bit volumes only
+	if (NULL != m_pOffsets[0])
+		return MarchVolume<short, true>(x, y, pSum, pPickPos);
+	switch (m_voxelType)
+	{
+	case VoxelTypeUInt8:
+		return MarchVolume<unsigned char, false>(x, y, pSum, pPickPos);
+	case VoxelTypeUInt16:
+		return MarchVolume<unsigned short, false>(x, y, pSum, pPickPos);
+	case VoxelTypeInt32:
+		return MarchVolume<int, false>(x, y, pSum, pPickPos);
+	case VoxelTypeFloat32:
+		return MarchVolume<float, false>(x, y, pSum, pPickPos);
+	default:
+		return MarchVolume<short, false>(x, y, pSum, pPickPos);
+	}
+}
+
+template <typename T, bool bBricked>
+bool RayCaster::MarchVolume(int x, int y, float* pSum, float* pPickPos)
+{
+	MarchConstants mc;
+	GetMarchConstants(mc);
+	RayState ray;
+	BeginRay(x, y, mc, ray);
+	bool bShade = NULL != pSum && !m_bPreview;
+
+	float pos[3];
+	float col[4];
+	float gradient[3];
+	bool bPicked = false;
+	while (NextSample(ray, mc, pos))
+	{
+		unsigned char label = SampleLabel(pos[0], pos[1], pos[2]);
+		if (label > MAXOBJECTCOUNT)
+			label = 0;
+		if (!ClassifySample(ray, mc, Fetch<T, bBricked>(pos[0], pos[1], pos[2]), label, col))
+			continue;
+		if (bShade)
+			Gradient<T, bBricked>(pos, gradient);
+		if (!Composite(ray, mc, pos, col, label, bShade ? gradient : NULL, pPickPos))
+		{
+			// the pick opacity is below the opaque one, a pick stops at it first
+			bPicked = NULL != pPickPos;
+			break;
+		}
+	}
+	if (NULL != pSum)
+	{
+		for (int i=0; i<4; i++)
+			pSum[i] = ray.sum[i];
+	}
+	return bPicked;
+}
+
+bool RayCaster::UsePackets() const
+{
+	// Sample8 falls back to single samples without AVX2, the rays on their own are faster then
+	return m_bRayPackets && m_volumeSampler.HasGather() && (NULL == m_pMask || m_maskSampler.HasGather());
+}
+
+void RayCaster::MarchPacket(const int* pX, const int* pY, int nCount, unsigned char* pVR)
+{
+	const int c_nLanes = VolumeSampler::BATCH_SIZE;
+	MarchConstants mc;
+	GetMarchConstants(mc);
+	bool bShade = !m_bPreview;
+
+	RayState rays[c_nLanes];
+	unsigned int nActive = 0;
+	for (int i=0; i<nCount; i++)
+	{
+		BeginRay(pX[i], pY[i], mc, rays[i]);
+		nActive |= 1u << i;
+	}
+
+	float pos[c_nLanes][3];
+	float col[c_nLanes][4];
+	unsigned char labels[c_nLanes];
+	float x[c_nLanes], y[c_nLanes], z[c_nLanes];
+	float values[c_nLanes];
+	float masks[c_nLanes];
+	float gradient[c_nLanes][3];
+	while (0 != nActive)
+	{
+		// every ray moves on to its own next sample, lanes without one read the corner
+		for (int i=0; i<c_nLanes; i++)
+		{
+			if ((nActive & (1u << i)) && !NextSample(rays[i], mc, pos[i]))
+				nActive &= ~(1u << i);
+			bool bLane = 0 != (nActive & (1u << i));
+			x[i] = bLane ? ToVoxel(pos[i][0], m_Dims[0]) : 0.0f;
+			y[i] = bLane ? ToVoxel(pos[i][1], m_Dims[1]) : 0.0f;
+			z[i] = bLane ? ToVoxel(pos[i][2], m_Dims[2]) : 0.0f;
+		}
+		if (0 == nActive)
+			break;
+
+		m_volumeSampler.Sample8(x, y, z, values, VolumeSampler::FilterTrilinear);
+		if (NULL != m_pMask)
+			m_maskSampler.Sample8(x, y, z, masks, VolumeSampler::FilterTrilinear);
+
+		unsigned int nComposite = 0;
+		for (int i=0; i<c_nLanes; i++)
+		{
+			if (0 == (nActive & (1u << i)))
+				continue;
+			unsigned char label = NULL != m_pMask ? GetMaskLabel(masks[i]) : 0;
+			labels[i] = label > MAXOBJECTCOUNT ? 0 : label;
+			if (ClassifySample(rays[i], mc, values[i], labels[i], col[i]))
+				nComposite |= 1u << i;
+		}
+		if (0 == nComposite)
+			continue;
+
+		if (bShade)
+		{
+			// central differences, one gather per offset for the lanes that add a sample
+			for (int a=0; a<3; a++)
+			{
+				float fSides[2][c_nLanes];
+				for (int s=0; s<2; s++)
+				{
+					float fOffset = s == 0 ? m_f3Nor[a] : -m_f3Nor[a];
+					for (int i=0; i<c_nLanes; i++)
+					{
+						bool bLane = 0 != (nComposite & (1u << i));
+						x[i] = bLane ? ToVoxel(pos[i][0] + (a == 0 ? fOffset : 0.0f), m_Dims[0]) : 0.0f;
+						y[i] = bLane ? ToVoxel(pos[i][1] + (a == 1 ? fOffset : 0.0f), m_Dims[1]) : 0.0f;
+						z[i] = bLane ? ToVoxel(pos[i][2] + (a == 2 ? fOffset : 0.0f), m_Dims[2]) : 0.0f;
+					}
+					m_volumeSampler.Sample8(x, y, z, fSides[s], VolumeSampler::FilterTrilinear);
+				}
+				for (int i=0; i<c_nLanes; i++)
+					gradient[i][a] = (fSides[0][i] - fSides[1][i])*m_f3Spacing[a];
+			}
+		}
+
+		for (int i=0; i<c_nLanes; i++)
+		{
+			if ((nComposite & (1u << i)) && !Composite(rays[i], mc, pos[i], col[i], labels[i], bShade ? gradient[i] : NULL, NULL))
+				nActive &= ~(1u << i);
+		}
+	}
+
+	for (int i=0; i<nCount; i++)
+		WritePixel(pVR, pX[i], pY[i], rays[i].sum);
+}
+
+void RayCaster::WritePixel(unsigned char* pVR, int x, int y, const float* pSum)
+{
+	RGBA clr = m_colorBG;
+	if (pSum[0]!=0.0f || pSum[1]!=0.0f || pSum[2]!=0.0f || pSum[3]!=0.0f)
+		clr = RGBA(pSum[0], pSum[1], pSum[2], pSum[3]);
+	unsigned char* pPixel = pVR + (y*m_nWidth + x)*3;
+	pPixel[0] = (unsigned char)(Saturate(clr.red)*255);
+	pPixel[1] = (unsigned char)(Saturate(clr.green)*255);
+	pPixel[2] = (unsigned char)(Saturate(clr.blue)*255);
+}
+
+void RayCaster::RenderTile(unsigned char* pVR, int xStart, int yStart, int xEnd, int yEnd, int nStep, int nSkipStep)
+{
+	bool bPackets = UsePackets();
+	int pX[VolumeSampler::BATCH_SIZE];
+	int pY[VolumeSampler::BATCH_SIZE];
+	int nCount = 0;
+	float sum[4];
+	int yFirst = ((yStart + nStep - 1)/nStep)*nStep;
+	for (int y=yFirst; y<yEnd; y+=nStep)
+	{
+		bool bSkipRow = nSkipStep > 0 && y%nSkipStep == 0;
+		int xFirst = ((xStart + nStep - 1)/nStep)*nStep;
+		for (int x=xFirst; x<xEnd; x+=nStep)
+		{
+			if (bSkipRow && x%nSkipStep == 0)
+				continue;
+			if (!bPackets)
+			{
+				March(x, y, sum, NULL);
+				WritePixel(pVR, x, y, sum);
+				continue;
+			}
+			pX[nCount] = x;
+			pY[nCount] = y;
+			if (++nCount == VolumeSampler::BATCH_SIZE)
+			{
+				MarchPacket(pX, pY, nCount, pVR);
+				nCount = 0;
+			}
+		}
+	}
+	if (nCount > 0)
+		MarchPacket(pX, pY, nCount, pVR);
+}
+
+void RayCaster::RenderTile(unsigned char* pVR, int xStart, int yStart, int xEnd, int yEnd)
+{
+	RenderTile(pVR, xStart, yStart, xEnd, yEnd, 1, 0);
+}
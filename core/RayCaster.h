@@ -0,0 +1,181 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "Defines.h"
+#include "BrickTable.h"
+#include "VolumeSampler.h"
+
+namespace MonkeyGL {
+
+    // host side port of d_render in kernel.cu, one ray per pixel. tiles are marched 8 rays
+    // at a time when the samplers have AVX2 gathers, each ray keeps its own step and stops
+    // on its own, the 8 samples of a step go through one gather.
+    class RayCaster
+    {
+    public:
+        RayCaster(void);
+        ~RayCaster(void);
+
+    public:
+        void SetVolume(const short* pVolume, const unsigned char* pMask, int nWidth, int nHeight, int nDepth);
+        void SetVolume(const void* pVolume, VoxelType type, const unsigned char* pMask, int nWidth, int nHeight, int nDepth);
+        // volume in a separable layout such as BrickedVolume, voxel (x, y, z) is at
+        // pOffsets[0][x] + pOffsets[1][y] + pOffsets[2][z] of nVoxels. the mask stays linear
+        void SetVolume(const short* pVolume, const unsigned char* pMask, int nWidth, int nHeight, int nDepth, const int* const* pOffsets, size_t nVoxels);
+        // the volume is a pyramid level fLevelScale times coarser in z than the one the
+        // opacities are meant for, every sample is corrected for the longer step.
+        // set before SetSpacing, which derives the gradient offsets from it
+        void SetLevelScale(float fLevelScale);
+        void SetSpacing(double x, double y, double z);
+        void SetOrientation(const Orientation& orientation);
+        void SetVOI(const VOI& voi);
+        void SetTransformMatrix(const float* pTransformMatrix);
+        void SetTransferFunc(const RGBA* pTransferFunc, int nLen, unsigned char nLabel);
+        void SetAlphaAndMapping(const AlphaAndMapping* pAlphaAndMapping);
+        void SetPreIntegrationTable(const RGBA* pTable, int nSize, unsigned char nLabel);
+        // fStepScale is the step in units of fStepL1, the opacity is corrected for it
+        void SetPreIntegration(bool bEnable, float fStepScale);
+        // twice the step, no refinement and no shading, for the coarse progressive frame
+        void SetPreview(bool bPreview);
+        void SetColorBackground(RGBA clrBG);
+        void SetBrickTable(BrickTable* pBrickTable);
+        void SetView(int nWidth, int nHeight, float fxTranslate, float fyTranslate, float fScale);
+        // on by default, off marches every ray on its own. both give the same image
+        void SetRayPackets(bool bEnable);
+
+        void RenderTile(unsigned char* pVR, int xStart, int yStart, int xEnd, int yEnd);
+        // only the pixels on the nStep grid that are off the nSkipStep grid (0 for none)
+        void RenderTile(unsigned char* pVR, int xStart, int yStart, int xEnd, int yEnd, int nStep, int nSkipStep);
+        RGBA CastRay(int x, int y);
+        // marches the ray of pixel (x, y) with the compositing of CastRay and stores the
+        // texture coordinate where the accumulated opacity reaches one half. returns false,
+        // leaving pPos untouched, when it never does
+        bool PickRay(int x, int y, float* pPos);
+
+        float SampleVolume(float x, float y, float z);
+        // nCount samples at (pX[i], pY[i], pZ[i]), the voxel type is picked once for all of them
+        void SampleVolume(const float* pX, const float* pY, const float* pZ, float* pOut, int nCount);
+        unsigned char SampleLabel(float x, float y, float z);
+
+    private:
+        // step sizes and light of a frame, the same for every ray
+        struct MarchConstants
+        {
+            float fStepL1;
+            float fStepL4;
+            float fStepL8;
+            float fStepScale;
+            float fAlphaScale;
+            bool bFixedStep;
+            float dirLight[3];
+        };
+
+        // a ray between two samples
+        struct RayState
+        {
+            float ptBase[3];
+            float dirRay[3];
+            float accuLength;
+            float fStepTemp;
+            float fAlphaPre;
+            float alphaAcc;
+            float tempPre;
+            int nLabelPre;
+            float sum[4];
+            float alphaAccObject[MAXOBJECTCOUNT+1];
+        };
+
+    private:
+        void ToTexture(const float* pIn, float* pOut, bool bOffset);
+        void GetRay(int x, int y, float* pBase, float* pDir);
+        void GetMarchConstants(MarchConstants& mc);
+        void BeginRay(int x, int y, const MarchConstants& mc, RayState& ray);
+        // moves the ray to the next position that needs a sample, false once it left the volume
+        bool NextSample(RayState& ray, const MarchConstants& mc, float* pPos);
+        // classifies the sample and moves the ray on, true when it adds to the ray
+        bool ClassifySample(RayState& ray, const MarchConstants& mc, float fValue, unsigned char nLabel, float* pColor);
+        // adds the sample, shaded with the gradient when there is one. false once the ray is
+        // opaque or, with pPickPos, reached the pick opacity
+        bool Composite(RayState& ray, const MarchConstants& mc, const float* pPos, const float* pColor, unsigned char nLabel, const float* pGradient, float* pPickPos);
+        // composites into pSum, or stops at the pick opacity when pPickPos is set. March
+        // picks the instance of the voxel type and layout once per ray
+        bool March(int x, int y, float* pSum, float* pPickPos);
+        template <typename T, bool bBricked>
+        bool MarchVolume(int x, int y, float* pSum, float* pPickPos);
+        // the rays of nCount <= 8 pixels in lockstep. the samples and gradients of all lanes
+        // are gathered at once with Sample8, but classification and compositing still run
+        // lane by lane: the adaptive step, the per label tables and the byte exact match
+        // with March keep them scalar. a lane leaves the active mask once it is opaque or
+        // out of the volume, the packet ends when the mask is empty
+        void MarchPacket(const int* pX, const int* pY, int nCount, unsigned char* pVR);
+        bool UsePackets() const;
+        template <typename T, bool bBricked>
+        float Fetch(float x, float y, float z);
+        template <typename T, bool bBricked>
+        void SampleVolumeBatch(const float* pX, const float* pY, const float* pZ, float* pOut, int nCount);
+        void SampleTransferFunc(float* pColor, unsigned char nLabel, float fPos);
+        void SamplePreIntegration(float* pColor, unsigned char nLabel, float fFront, float fBack);
+        template <typename T, bool bBricked>
+        void Gradient(const float* pPos, float* pGradient);
+        float GetEmptySkipLength(const float* pPos, const float* pDirRay, int nxIdx, int nyIdx, int nzIdx);
+        void WritePixel(unsigned char* pVR, int x, int y, const float* pSum);
+
+    private:
+        const void* m_pVolume;
+        VoxelType m_voxelType;
+        // NULL for a linear volume
+        const int* m_pOffsets[3];
+        const unsigned char* m_pMask;
+        // the volume and mask again, for the packets
+        VolumeSampler m_volumeSampler;
+        VolumeSampler m_maskSampler;
+        bool m_bRayPackets;
+        int m_Dims[3];
+        float m_fLevelScale;
+        float m_f3Spacing[3];
+        float m_f3Nor[3];
+        float m_f3maxper[3];
+        Orientation m_orientation;
+        VOI m_voi;
+        float m_TransformMatrix[9];
+        const RGBA* m_pTransferFuncs[MAXOBJECTCOUNT+1];
+        int m_nLenTransferFuncs[MAXOBJECTCOUNT+1];
+        const AlphaAndMapping* m_pAlphaAndMapping;
+        const RGBA* m_pPreIntegrationTables[MAXOBJECTCOUNT+1];
+        int m_nPreIntegrationSizes[MAXOBJECTCOUNT+1];
+        bool m_bPreIntegration;
+        float m_fPreIntegrationStep;
+        bool m_bPreview;
+        RGBA m_colorBG;
+        BrickTable* m_pBrickTable;
+        // the brick table stays at full resolution whichever level is sampled
+        int m_BrickDims[3];
+
+        int m_nWidth;
+        int m_nHeight;
+        float m_fxTranslate;
+        float m_fyTranslate;
+        float m_fScale;
+    };
+
+}
@@ -21,6 +21,7 @@
 // SOFTWARE.
 
 #include "Render.h"
+#include "OrthoSlicer.h"
 #include <driver_types.h>
 #include "vector_types.h"
 #include "StopWatch.h"
@@ -30,41 +31,46 @@
 using namespace MonkeyGL;
 
 extern "C"
-void cu_InitCommon(float fxSpacing, float fySpacing, float fzSpacing);
+RenderContext* cu_createContext();
 extern "C"
-void cu_copyVolumeData( short* h_volumeData, cudaExtent volumeSize, Orientation orientation);
+void cu_destroyContext(RenderContext* ctx);
 extern "C"
-void cu_copyMaskData( unsigned char* h_maskData);
+void cu_InitCommon(RenderContext* ctx, float fxSpacing, float fySpacing, float fzSpacing);
 extern "C"
-bool cu_setTransferFunc( float* pTransferFunc, int nLenTransferFunc, unsigned char nLabel);
+float cu_copyVolumeData(RenderContext* ctx, const void* h_volumeData, int nVoxelType, cudaExtent volumeSize, Orientation orientation);
 extern "C"
-void cu_copyOperatorMatrix( float *pTransformMatrix, float *pTransposeTransformMatrix);
+void cu_copyMaskData(RenderContext* ctx, unsigned char* h_maskData);
 extern "C"
-void cu_copyLightPara( float *pLightPara, int nLen);
+bool cu_setTransferFunc(RenderContext* ctx, float* pTransferFunc, int nLenTransferFunc, unsigned char nLabel);
 extern "C"
-void cu_setVOI(VOI voi);
+bool cu_setPreIntegrationTable(RenderContext* ctx, float* pTable, int nSize, unsigned char nLabel);
 extern "C"
-void cu_copyAlphaAndWWWL(float *pAlphaAndWWWL);
-
+void cu_copyOperatorMatrix(RenderContext* ctx, float *pTransformMatrix, float *pTransposeTransformMatrix);
 extern "C"
-void cu_render(unsigned char* pVR, int nWidth, int nHeight, float fxTranslate, float fyTranslate, float fScale, RGBA colorBG);
-
+void cu_copyLightPara(RenderContext* ctx, float *pLightPara, int nLen);
 extern "C"
-void cu_renderAxial(short* pData, int nWidth, int nHeight, float fDepth);
+void cu_setVOI(RenderContext* ctx, VOI voi);
 extern "C"
-void cu_renderSagittal(short* pData, int nWidth, int nHeight, float fDepth);
+void cu_copyAlphaAndMapping(RenderContext* ctx, float *pAlphaAndMapping);
+extern "C"
+void cu_copyEmptyBricks(RenderContext* ctx, const unsigned char* h_pEmptyBricks, int nxBricks, int nyBricks, int nzBricks, const unsigned char* h_pEmptyRegions, int nxRegions, int nyRegions, int nzRegions);
+
 extern "C"
-void cu_renderCoronal(short* pData, int nWidth, int nHeight, float fDepth);
+void cu_render(RenderContext* ctx, unsigned char* pVR, int nWidth, int nHeight, float fxTranslate, float fyTranslate, float fScale, RGBA colorBG, bool bPreIntegration);
 
 extern "C"
-void cu_renderPlane_MIP(short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
+void cu_renderAxial(RenderContext* ctx, short* pData, int nWidth, int nHeight, float fDepth);
 extern "C"
-void cu_renderPlane_MinIP(short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
+void cu_renderSagittal(RenderContext* ctx, short* pData, int nWidth, int nHeight, float fDepth);
 extern "C"
-void cu_renderPlane_Average(short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
+void cu_renderCoronal(RenderContext* ctx, short* pData, int nWidth, int nHeight, float fDepth);
 
 extern "C"
-void ReleaseCuda();
+void cu_renderPlane_MIP(RenderContext* ctx, short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
+extern "C"
+void cu_renderPlane_MinIP(RenderContext* ctx, short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
+extern "C"
+void cu_renderPlane_Average(RenderContext* ctx, short* pData, int nWidth, int nHeight, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum);
 
 extern "C" 
 void cu_test_3d( short* h_volumeData, cudaExtent volumeSize );
@@ -75,13 +81,26 @@ bool cu_set_1d( float* h_volumeData, int nLen, unsigned char nLabel );
 extern "C" 
 void cu_test_1d( int nLen,  unsigned char nLabel );
 
-cudaExtent m_VolumeSize;
-
 Render::Render(void)
 {
+	m_pContext = cu_createContext();
+	m_VolumeSize.width = 0;
+	m_VolumeSize.height = 0;
+	m_VolumeSize.depth = 0;
+	m_textureType = VoxelTypeInt16;
+	m_fVolumeScale = 32768.0f;
+
 	m_fTotalXTranslate = 0.0f;
 	m_fTotalYTranslate = 0.0f;
 	m_fTotalScale = 1.0f;
+	m_nVRWidth = 512;
+	m_nVRHeight = 512;
+
+	for (int i=0; i<=MAXOBJECTCOUNT; i++)
+		m_nTransferFuncVersions[i] = 0;
+
+	// the kernels sample the full resolution texture only, the pyramid would be unused
+	m_dataMan.SetPyramidEnabled(false);
 
 	m_pRotateMatrix = new float[9];
 	Methods::SetSeg(m_pRotateMatrix,3);
@@ -106,6 +125,9 @@ Render::~Render(void)
 		delete [] m_pTransformMatrix;
 	if (NULL != m_pTransposeTransformMatrix)
 		delete [] m_pTransposeTransformMatrix;
+
+	cu_destroyContext(m_pContext);
+	m_pContext = NULL;
 }
 
 bool Render::SetTransferFunc( std::map<int, RGBA> ctrlPoints )
@@ -146,16 +168,31 @@ bool Render::SetTransferFunc(std::map<int, RGBA> rgbPoints, std::map<int, float>
 
 void Render::CopyTransferFunc2Device()
 {
-	std::shared_ptr<RGBA> ptfBuffer(NULL);
-	int ntfLength = 0;
-
-	std::map<unsigned char, ObjectInfo> objectInfos = m_dataMan.GetObjectInfos();
-	for (std::map<unsigned char, ObjectInfo>::iterator iter=objectInfos.begin(); iter!=objectInfos.end(); iter++){
-		if (iter->second.GetTransferFunction(ptfBuffer, ntfLength))
+	// only the labels whose tables were rebuilt since the last upload go to the device
+	m_dataMan.UpdateTransferFunctions();
+	const TransferFunctionManager& tfManager = m_dataMan.GetTransferFunctionManager();
+	for (int label=0; label<=MAXOBJECTCOUNT; label++){
+		unsigned int nVersion = tfManager.GetVersion(label);
+		if (nVersion == m_nTransferFuncVersions[label])
+			continue;
+		m_nTransferFuncVersions[label] = nVersion;
+		if (tfManager.IsValid(label))
 		{
-			cu_setTransferFunc((float*)(ptfBuffer.get()), ntfLength, iter->first);
+			cu_setTransferFunc(m_pContext, (float*)tfManager.GetLUT(label), TransferFunctionManager::LUT_SIZE, label);
+		}
+		const RGBA* pPreIntegration = tfManager.GetPreIntegrationTable(label);
+		if (NULL != pPreIntegration)
+		{
+			cu_setPreIntegrationTable(m_pContext, (float*)pPreIntegration, TransferFunctionManager::PREINTEGRATION_SIZE, label);
 		}
 	}
+	m_progressive.Invalidate();
+}
+
+void Render::SetPreIntegrationEnabled(bool bEnable)
+{
+	IRender::SetPreIntegrationEnabled(bEnable);
+	CopyTransferFunc2Device();
 }
 
 bool Render::SetVRWWWL(float fWW, float fWL)
@@ -196,20 +233,48 @@ bool Render::SetObjectAlpha(float fAlpha, unsigned char nLabel)
 
 void Render::CopyAlphaWWWL2Device()
 {
+	m_dataMan.UpdateTransferFunctions();
+	const TransferFunctionManager& tfManager = m_dataMan.GetTransferFunctionManager();
 	std::map<unsigned char, ObjectInfo> objectInfos = m_dataMan.GetObjectInfos();
 	for (std::map<unsigned char, ObjectInfo>::iterator iter=objectInfos.begin(); iter!=objectInfos.end(); iter++){
 		unsigned char label = iter->first;
+		if (label > MAXOBJECTCOUNT)
+			continue;
 		ObjectInfo info = iter->second;
-		m_AlphaAndWWWL[label] = AlphaAndWWWL(info.alpha, info.ww, info.wl);
+		float fScale = 0.0f, fOffset = 0.0f;
+		tfManager.GetLUTMapping(label, fScale, fOffset);
+		// the kernel reads the volume normalized by m_fVolumeScale
+		m_AlphaAndMapping[label] = AlphaAndMapping(info.alpha, m_fVolumeScale*fScale, fOffset);
 		Logger::Info("Render::CopyAlphaWWWL2Device: label[%d], alpha[%.2f], ww[%.2f], wl[%.2f]", label, info.alpha, info.ww, info.wl);
 	}
-	cu_copyAlphaAndWWWL((float*)m_AlphaAndWWWL);
+	cu_copyAlphaAndMapping(m_pContext, (float*)m_AlphaAndMapping);
+	m_progressive.Invalidate();
+}
+
+void Render::CopyVolume2Device()
+{
+	m_textureType = m_dataMan.GetVoxelType();
+	m_pTextureVolume = m_dataMan.GetVoxelData();
+	if (VoxelTypeInt32 == m_textureType && m_pTextureVolume){
+		// 32 bit integer textures can not be filtered
+		Logger::Warn("Render::CopyVolume2Device: int32 voxels are uploaded as float32");
+		size_t nVoxels = (size_t)m_VolumeSize.width*m_VolumeSize.height*m_VolumeSize.depth;
+		const int* pSrc = (const int*)m_pTextureVolume.get();
+		std::shared_ptr<float> pFloat(new float[nVoxels], std::default_delete<float[]>());
+		for (size_t i=0; i<nVoxels; i++){
+			pFloat.get()[i] = (float)pSrc[i];
+		}
+		m_pTextureVolume = pFloat;
+		m_textureType = VoxelTypeFloat32;
+	}
+	m_fVolumeScale = cu_copyVolumeData(m_pContext, m_pTextureVolume.get(), (int)m_textureType, m_VolumeSize, m_dataMan.GetOrientation());
+	CopyAlphaWWWL2Device();
 }
 
 void Render::InitLights()
 {
 	float m[9] = {1,0,0,0,1,0,0,0,1};
-	cu_copyOperatorMatrix(m, m);
+	cu_copyOperatorMatrix(m_pContext, m, m);
 
 	float light[11];
 	light[0] = 0.7f;//ka
@@ -219,19 +284,21 @@ void Render::InitLights()
 	light[3] = 0.4f; light[4] = 0.0f; light[5] = 0.0f; light[6] = 0.0f;
 	//globalAmbient
 	light[7] = 0.5f; light[8] = 0.0f; light[9] = 0.0f; light[10] = 0.0f;
-	cu_copyLightPara(light, 11);
+	cu_copyLightPara(m_pContext, light, 11);
+	m_progressive.Invalidate();
 }
 
-bool Render::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth)
+bool Render::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
 {
-	if (!IRender::SetVolumeData(pData, nWidth, nHeight, nDepth))
+	if (!IRender::SetVolumeData(pData, type, nWidth, nHeight, nDepth))
 		return false;
 
 	m_VolumeSize.width = m_dataMan.GetDim(0);
 	m_VolumeSize.height = m_dataMan.GetDim(1);
 	m_VolumeSize.depth = m_dataMan.GetDim(2);
 
-	cu_copyVolumeData(m_dataMan.GetVolumeData().get(), m_VolumeSize, m_dataMan.GetOrientation());
+	CopyVolume2Device();
+	cu_copyEmptyBricks(m_pContext, NULL, 0, 0, 0, NULL, 0, 0, 0);
 
 	InitLights();
 
@@ -244,17 +311,19 @@ unsigned char Render::AddNewObjectMask(std::shared_ptr<unsigned char>pData, int
 	if (nLabel == 0)
 		return 0;
 
-	cu_copyMaskData(m_dataMan.GetMaskData().get());
+	cu_copyMaskData(m_pContext, m_dataMan.GetMaskData().get());
+	m_progressive.Invalidate();
 
 	return nLabel;
 }
 
 bool Render::UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel)
 {
-	if (!IRender::AddNewObjectMask(pData, nWidth, nHeight, nDepth))
+	if (!IRender::UpdateObjectMask(pData, nWidth, nHeight, nDepth, nLabel))
 		return false;
 
-	cu_copyMaskData(m_dataMan.GetMaskData().get());
+	cu_copyMaskData(m_pContext, m_dataMan.GetMaskData().get());
+	m_progressive.Invalidate();
 
 	return true;
 }
@@ -269,9 +338,60 @@ void Render::SetVolumeFile( const char* szFile, int nWidth, int nHeight, int nDe
 	m_VolumeSize.height = m_dataMan.GetDim(1);
 	m_VolumeSize.depth = m_dataMan.GetDim(2);
 
-	cu_copyVolumeData(m_dataMan.GetVolumeData().get(), m_VolumeSize, m_dataMan.GetOrientation());
+	CopyVolume2Device();
+	cu_copyEmptyBricks(m_pContext, NULL, 0, 0, 0, NULL, 0, 0, 0);
+
+	InitLights();
+}
+
+bool Render::LoadVolumeContainer(const char* szFile)
+{
+	Logger::Info("load volume container: %s", szFile);
+
+	if (!IRender::LoadVolumeContainer(szFile))
+		return false;
+
+	m_VolumeSize.width = m_dataMan.GetDim(0);
+	m_VolumeSize.height = m_dataMan.GetDim(1);
+	m_VolumeSize.depth = m_dataMan.GetDim(2);
+
+	CopyVolume2Device();
+	if (m_dataMan.GetMaskData())
+		cu_copyMaskData(m_pContext, m_dataMan.GetMaskData().get());
+	cu_copyEmptyBricks(m_pContext, NULL, 0, 0, 0, NULL, 0, 0, 0);
 
 	InitLights();
+
+	return true;
+}
+
+bool Render::BeginVolume(int nWidth, int nHeight, int nDepth)
+{
+	if (!IRender::BeginVolume(nWidth, nHeight, nDepth))
+		return false;
+
+	m_VolumeSize.width = m_dataMan.GetDim(0);
+	m_VolumeSize.height = m_dataMan.GetDim(1);
+	m_VolumeSize.depth = m_dataMan.GetDim(2);
+
+	CopyVolume2Device();
+	cu_copyEmptyBricks(m_pContext, NULL, 0, 0, 0, NULL, 0, 0, 0);
+
+	InitLights();
+
+	return true;
+}
+
+void Render::CommitVolumeSlices(bool bComplete)
+{
+	IRender::CommitVolumeSlices(bComplete);
+
+	// the whole texture is uploaded again, which is why the slices are committed in a few large steps
+	CopyVolume2Device();
+	if (m_dataMan.GetMaskData())
+		cu_copyMaskData(m_pContext, m_dataMan.GetMaskData().get());
+	cu_copyEmptyBricks(m_pContext, NULL, 0, 0, 0, NULL, 0, 0, 0);
+	m_progressive.Invalidate();
 }
 
 void Render::NormalizeVOI()
@@ -304,14 +424,14 @@ void Render::NormalizeVOI()
 void Render::SetSpacing( double x, double y, double z )
 {
 	IRender::SetSpacing(x, y, z);
-	cu_InitCommon(x, y, z);
+	cu_InitCommon(m_pContext, x, y, z);
+	m_progressive.Invalidate();
 }
 
-bool Render::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneType& planeType)
+bool Render::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneInfo& planeInfo, Point3d ptCenter)
 {
-	if (!m_dataMan.GetPlaneSize(nWidth, nHeight, planeType))
-		return false;
-
+	nWidth = planeInfo.m_nWidth;
+	nHeight = planeInfo.m_nHeight;
 	if (nWidth % 2){
 		nWidth += 1;
 	}
@@ -319,15 +439,11 @@ bool Render::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneT
 	if (NULL == pData || nWidth<=0 || nHeight<=0)
 		return false;
 
-	PlaneInfo info;
-	if (!m_dataMan.GetPlaneInfo(planeType, info))
-		return false;
-
+	PlaneInfo info = planeInfo;
 	Direction3d& dirH = info.m_dirH;
 	Direction3d& dirV = info.m_dirV;
 	Direction3d dirN = info.GetNormDirection();
 	double fPixelSpacing = info.m_fPixelSpacing;
-	Point3d ptCenter = m_dataMan.GetCenterPointPlane(dirN);
 	Point3d ptLeftTop = ptCenter - dirH*(0.5*nWidth*fPixelSpacing);
 	ptLeftTop = ptLeftTop - dirV*(0.5*nHeight*fPixelSpacing);
 
@@ -336,6 +452,14 @@ bool Render::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneT
 	nSliceNum = nSliceNum<1 ? 1:nSliceNum;
 	float halfNum = 1.0f*(nSliceNum-1)/2;
 
+	// axis aligned single slices come straight from the volume
+	{
+		int nDims[3] = {m_dataMan.GetDim(0), m_dataMan.GetDim(1), m_dataMan.GetDim(2)};
+		double fSpacing[3] = {m_dataMan.GetSpacing(0), m_dataMan.GetSpacing(1), m_dataMan.GetSpacing(2)};
+		if (OrthoSlicer::GetPlaneData(pData, nWidth, nHeight, m_pTextureVolume.get(), m_textureType, NULL, nDims, fSpacing, dirH, dirV, ptLeftTop, fPixelSpacing, nSliceNum))
+			return true;
+	}
+
 	float3 dirH_cu;
 	dirH_cu.x = info.m_dirH.x();
 	dirH_cu.y = info.m_dirH.y();
@@ -358,19 +482,19 @@ bool Render::GetPlaneData( short* pData, int& nWidth, int& nHeight, const PlaneT
 	{
 	case MPRTypeAverage:
 		{
-			cu_renderPlane_Average(pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
+			cu_renderPlane_Average(m_pContext, pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
 			return true;
 		}
 		break;
 	case MPRTypeMIP:
 		{
-			cu_renderPlane_MIP(pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
+			cu_renderPlane_MIP(m_pContext, pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
 			return true;
 		}
 		break;
 	case MPRTypeMinIP:
 		{
-			cu_renderPlane_MinIP(pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
+			cu_renderPlane_MinIP(m_pContext, pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, info.m_fPixelSpacing, halfNum);
 			return true;
 		}
 		break;
@@ -389,9 +513,8 @@ bool Render::GetCrossHairPoint( double& x, double& y, const PlaneType& planeType
 {
 	if (PlaneVR == planeType)
 	{
-		int nWidth = 0;
-		int nHeight = 0;
-		m_dataMan.GetPlaneSize(nWidth, nHeight, planeType);
+		int nWidth = m_nVRWidth;
+		int nHeight = m_nVRHeight;
 		Point3d ptCrossHair = m_dataMan.GetCrossHair();
 		Point3d ptDelta = ptCrossHair - m_dataMan.GetCenterPoint();
 		Point3d ptRotate = Methods::matrixMul(m_pTransposeTransformMatrix, ptDelta);
@@ -416,100 +539,58 @@ bool Render::GetCrossHairPoint( double& x, double& y, const PlaneType& planeType
 
 void Render::PanCrossHair( int nx, int ny, PlaneType planeType )
 {
-	if (PlaneVR == planeType)
-	{
-		// std::shared_ptr<RGBA> ptfBuffer(NULL);
-		// int ntfLength = 0;
-		// // if (!m_dataMan.GetTransferFunction(ptfBuffer, ntfLength))
-		// // 	return;
-
-		// double xLen = m_dataMan.GetDim(0)*m_dataMan.GetSpacing(0);
-		// double yLen = m_dataMan.GetDim(1)*m_dataMan.GetSpacing(1);
-		// double zLen = m_dataMan.GetDim(2)*m_dataMan.GetSpacing(2);
-		// double maxLen = xLen > yLen ? xLen : yLen;
-		// maxLen = maxLen > zLen ? maxLen : zLen;
-		// double xMaxPer = maxLen/xLen;
-		// double yMaxPer = maxLen/yLen;
-		// double zMaxPer = maxLen/zLen;
-		// double xPerMax = 1.0/xMaxPer;
-		// double yPerMax = 1.0/yMaxPer;
-		// double zPerMax = 1.0/zMaxPer;
-		// double fStep = 1.0/m_dataMan.GetDim(2);
-		// short* pVolumeData = m_dataMan.GetVolumeData().get();
-		// int nFrameSize = m_dataMan.GetDim(0)*m_dataMan.GetDim(1);
-		// int nLineSize = m_dataMan.GetDim(0);
-
-		// float fMinV = m_fWL - m_fWW*0.5f;
-
-		// int nWidth = 0;
-		// int nHeight = 0;
-		// m_dataMan.GetPlaneSize(nWidth, nHeight, planeType);
-		// double u = 1.0*(nx - nWidth/2 - m_fTotalXTranslate)/nWidth;
-		// double v = 1.0*(ny- nHeight/2 - m_fTotalYTranslate)/nHeight;
-		// double accuLength = 0.0f;
-		// double alpha_acc = 0.0f;
-		// double fy = 0;
-		// int nx=0, ny=0, nz=0;
-		// int nxPos = nx, nyPos = ny, nzPos = nz;
-		// while (accuLength < 1.732)
-		// {
-		// 	fy = (accuLength - 0.866)*m_fTotalScale;
-		// 	Point3d pt(u, fy, v);
-		// 	Point3d ptRotate = Methods::matrixMul(m_pTransformMatrix, pt);
-		// 	double x = ptRotate[0] * xMaxPer + 0.5;
-		// 	double y = ptRotate[1] * yMaxPer + 0.5;
-		// 	double z = ptRotate[2] * zMaxPer + 0.5;
-		// 	if (x<0 || x>=1 || y<0 || y>=1 || z<0 || z>=1)
-		// 	{
-		// 		accuLength += fStep;
-		// 		continue;
-		// 	}
-		// 	nx = x*m_dataMan.GetDim(0);
-		// 	ny = y*m_dataMan.GetDim(1);
-		// 	nz = z*m_dataMan.GetDim(2);
-		// 	short huValue = pVolumeData[nz*nFrameSize+ny*nLineSize+nx];
-		// 	short hut = (huValue-fMinV)/m_fWW * ntfLength;
-		// 	hut = hut<0 ? 0:hut;
-		// 	hut = hut>=ntfLength ? (ntfLength-1):hut;
-
-		// 	double w = ptfBuffer.get()[hut].alpha;
-
-		// 	if (w > 0)
-		// 	{
-		// 		nxPos = nx;
-		// 		nyPos = ny;
-		// 		nzPos = nz;
-		// 		alpha_acc += w;
-		// 		if (alpha_acc > 0.995)
-		// 			break;
-		// 	}
-
-		// 	accuLength += fStep;
-		// }
-		// if (alpha_acc <= 0)
-		// {
-		// 	fy = 0;
-		// 	Point3d pt(u, fy, v);
-		// 	Point3d ptRotate = Methods::matrixMul(m_pTransformMatrix, pt);
-		// 	double x = ptRotate[0] * xMaxPer + 0.5;
-		// 	double y = ptRotate[1] * yMaxPer + 0.5;
-		// 	double z = ptRotate[2] * zMaxPer + 0.5;
-		// 	nxPos = x*m_dataMan.GetDim(0);
-		// 	nyPos = y*m_dataMan.GetDim(1);
-		// 	nzPos = z*m_dataMan.GetDim(2);
-		// }
-
-		// Point3d ptObject(nxPos*m_dataMan.GetSpacing(0), nyPos*m_dataMan.GetSpacing(1), nzPos*m_dataMan.GetSpacing(2));
-		// m_dataMan.SetCrossHair(ptObject);
-	}
-	else
+	if (PlaneVR != planeType)
 	{
 		m_dataMan.PanCrossHair(nx, ny, planeType);
+		return;
+	}
+	if (!m_dataMan.HasVolumeData())
+		return;
+
+	// a single ray does not pay for a kernel launch, d_render's march is replayed on the host
+	int nDims[3] = {m_dataMan.GetDim(0), m_dataMan.GetDim(1), m_dataMan.GetDim(2)};
+	m_picker.SetVolume(m_pTextureVolume.get(), m_textureType, m_dataMan.GetMaskData().get(), nDims[0], nDims[1], nDims[2]);
+	m_picker.SetLevelScale(1.0f);
+	m_picker.SetSpacing(m_dataMan.GetSpacing(0), m_dataMan.GetSpacing(1), m_dataMan.GetSpacing(2));
+	m_picker.SetOrientation(m_dataMan.GetOrientation());
+	VOI voi;
+	voi.left = 0;
+	voi.right = nDims[0] - 1;
+	voi.posterior = 0;
+	voi.anterior = nDims[1] - 1;
+	voi.head = 0;
+	voi.foot = nDims[2] - 1;
+	m_picker.SetVOI(voi);
+	m_picker.SetTransformMatrix(m_pTransformMatrix);
+	m_picker.SetView(m_nVRWidth, m_nVRHeight, m_fTotalXTranslate, m_fTotalYTranslate, m_fTotalScale);
+
+	m_dataMan.UpdateTransferFunctions();
+	const TransferFunctionManager& tfManager = m_dataMan.GetTransferFunctionManager();
+	for (int label=0; label<=MAXOBJECTCOUNT; label++){
+		m_picker.SetTransferFunc(tfManager.GetLUT(label), TransferFunctionManager::LUT_SIZE, label);
+		m_picker.SetPreIntegrationTable(tfManager.GetPreIntegrationTable(label), TransferFunctionManager::PREINTEGRATION_SIZE, label);
+		// the host reads raw values, the kernel reads them normalized by m_fVolumeScale
+		m_PickAlphaAndMapping[label] = m_AlphaAndMapping[label];
+		m_PickAlphaAndMapping[label].scale /= m_fVolumeScale;
 	}
+	m_picker.SetPreIntegration(tfManager.IsPreIntegrationEnabled(), 1.0f);
+	m_picker.SetAlphaAndMapping(m_PickAlphaAndMapping);
+
+	m_dataMan.UpdateEmptyBricks();
+	BrickTable& brickTable = m_dataMan.GetBrickTable();
+	m_picker.SetBrickTable(brickTable.IsValid() ? &brickTable : NULL);
+
+	// a ray through empty background picks nothing, the crosshair stays
+	float pos[3];
+	if (!m_picker.PickRay(nx, ny, pos))
+		return;
+	SetCrossHairFromVR(pos);
 }
 
 bool Render::GetVRData( unsigned char* pVR, int nWidth, int nHeight )
 {
+	m_nVRWidth = nWidth;
+	m_nVRHeight = nHeight;
 	m_fVOI_xStart = 0;
 	m_fVOI_xEnd = m_VolumeSize.width - 1;
 	m_fVOI_yStart = 0;
@@ -517,13 +598,75 @@ bool Render::GetVRData( unsigned char* pVR, int nWidth, int nHeight )
 	m_fVOI_zStart = 0;
 	m_fVOI_zEnd = m_VolumeSize.depth - 1;
 	NormalizeVOI();
-	cu_setVOI(m_voi_Normalize);
+	cu_setVOI(m_pContext, m_voi_Normalize);
+
+	if (m_dataMan.UpdateEmptyBricks())
+	{
+		BrickTable& brickTable = m_dataMan.GetBrickTable();
+		cu_copyEmptyBricks(
+			m_pContext,
+			brickTable.GetEmptyBricks(), brickTable.GetBrickCount(0), brickTable.GetBrickCount(1), brickTable.GetBrickCount(2),
+			brickTable.GetEmptyRegions(), brickTable.GetRegionCount(0), brickTable.GetRegionCount(1), brickTable.GetRegionCount(2)
+		);
+	}
 
-	cu_render(pVR, nWidth, nHeight, m_fTotalXTranslate, m_fTotalYTranslate, m_fTotalScale, m_dataMan.GetColorBackground());
+	cu_render(m_pContext, pVR, nWidth, nHeight, m_fTotalXTranslate, m_fTotalYTranslate, m_fTotalScale, m_dataMan.GetColorBackground(), m_dataMan.IsPreIntegrationEnabled());
 
 	return true;
 }
 
+void Render::GetVRViewKey( std::vector<double>& vecViewKey )
+{
+	vecViewKey.insert(vecViewKey.end(), m_pTransformMatrix, m_pTransformMatrix+9);
+	vecViewKey.push_back(m_fTotalXTranslate);
+	vecViewKey.push_back(m_fTotalYTranslate);
+	vecViewKey.push_back(m_fTotalScale);
+	RGBA clrBG = m_dataMan.GetColorBackground();
+	vecViewKey.push_back(clrBG.red);
+	vecViewKey.push_back(clrBG.green);
+	vecViewKey.push_back(clrBG.blue);
+}
+
+bool Render::GetVRDataProgressive( unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal )
+{
+	// the coarse passes render a reduced frame, which needs the grid to divide the view
+	if (NULL == pVR || nWidth%4 != 0 || nHeight%4 != 0)
+		return IRender::GetVRDataProgressive(pVR, nWidth, nHeight, nQualityLevel, bFinal);
+
+	std::vector<double> vecViewKey;
+	GetVRViewKey(vecViewKey);
+
+	return m_progressive.Render(pVR, nWidth, nHeight, vecViewKey, [&](unsigned char* pFrame, int w, int h, int nStep, int nSkipStep, bool bPreview){
+		if (nStep == 1)
+			return GetVRData(pFrame, w, h);
+
+		// the kernel casts one ray per pixel, so a coarse pass renders the grid pixels
+		// as a reduced frame and scatters them back, the preview flag is not used here
+		int nGridWidth = w/nStep;
+		int nGridHeight = h/nStep;
+		std::vector<unsigned char> vecGrid(3*nGridWidth*nGridHeight);
+		float fxTranslate = m_fTotalXTranslate, fyTranslate = m_fTotalYTranslate;
+		m_fTotalXTranslate /= nStep;
+		m_fTotalYTranslate /= nStep;
+		bool bRet = GetVRData(vecGrid.data(), nGridWidth, nGridHeight);
+		m_fTotalXTranslate = fxTranslate;
+		m_fTotalYTranslate = fyTranslate;
+		m_nVRWidth = w;
+		m_nVRHeight = h;
+		if (!bRet)
+			return false;
+
+		for (int y=0; y<nGridHeight; y++){
+			for (int x=0; x<nGridWidth; x++){
+				if (nSkipStep > 0 && (x*nStep)%nSkipStep == 0 && (y*nStep)%nSkipStep == 0)
+					continue;
+				memcpy(pFrame + 3*(y*nStep*w + x*nStep), vecGrid.data() + 3*(y*nGridWidth + x), 3);
+			}
+		}
+		return true;
+	}, nQualityLevel, bFinal);
+}
+
 void Render::testcuda()
 {
 #if 0
@@ -571,90 +714,45 @@ void Render::testcuda()
 #endif
 }
 
-bool Render::GetBatchData( std::vector<short*>& vecBatchData, BatchInfo batchInfo )
+bool Render::RenderBatchPlanes( short* pData, int nWidth, int nHeight, const std::vector<BatchPlane>& vecPlanes, double fPixelSpacing, float halfNum, MPRType mprType )
 {
-	for (int i=0; i<vecBatchData.size(); i++)
+	for (int i=0; i<(int)vecPlanes.size(); i++)
 	{
-		if (nullptr != vecBatchData[i])
-		{
-			delete [] vecBatchData[i];
-			vecBatchData[i] = nullptr;
-		}
-	}
-	vecBatchData.clear();
-
-	int nWidth = batchInfo.Width();
-	int nHeight = batchInfo.Height();
-
-	Direction3d& dirH = batchInfo.m_dirH;
-	Direction3d& dirV = batchInfo.m_dirV;
-	Direction3d dirN = dirH.cross(dirV);
-	int& nNum = batchInfo.m_nNum;
-	Point3d& ptCenter = batchInfo.m_ptCenter;
-	double& fSliceDist = batchInfo.m_fSliceDistance;
-
-	double fSliceThickness = batchInfo.m_fSliceThickness;
-	int nSliceNum = fSliceThickness/batchInfo.m_fPixelSpacing;
-	nSliceNum = nSliceNum<1 ? 1:nSliceNum;
-	float halfNum = 1.0f*(nSliceNum-1)/2;
-
-	float3 dirH_cu;
-	dirH_cu.x = dirH.x();
-	dirH_cu.y = dirH.y();
-	dirH_cu.z = dirH.z();
-	float3 dirV_cu;
-	dirV_cu.x = dirV.x();
-	dirV_cu.y = dirV.y();
-	dirV_cu.z = dirV.z();
-	float3 dirN_cu;
-	dirN_cu.x = dirN.x();
-	dirN_cu.y = dirN.y();
-	dirN_cu.z = dirN.z();
-
-	for (int i=-nNum/2; i<=nNum/2; i++)
-	{
-		Point3d ptCenterSlice = ptCenter;
-		double fDist = 0;
-		if (nNum % 2 == 0)
-		{
-			if (i == 0)
-				continue;
-			if (i < 0)
-			{
-				fDist = (i+0.5) * fSliceDist;
-			}
-			else
-			{
-				fDist = (i-0.5) * fSliceDist;
-			}
-		}
-		else
-		{
-			fDist = i * fSliceDist;
-		}
-
-		ptCenterSlice = ptCenterSlice + dirN * fDist;
-
-		Point3d ptLeftTop = ptCenterSlice - dirH*(0.5*batchInfo.m_fLengthH);
-		ptLeftTop = ptLeftTop - dirV*(0.5*batchInfo.m_fLengthV);
+		BatchPlane plane = vecPlanes[i];
+
+		float3 dirH_cu;
+		dirH_cu.x = plane.dirH.x();
+		dirH_cu.y = plane.dirH.y();
+		dirH_cu.z = plane.dirH.z();
+		float3 dirV_cu;
+		dirV_cu.x = plane.dirV.x();
+		dirV_cu.y = plane.dirV.y();
+		dirV_cu.z = plane.dirV.z();
+		float3 dirN_cu;
+		dirN_cu.x = plane.dirN.x();
+		dirN_cu.y = plane.dirN.y();
+		dirN_cu.z = plane.dirN.z();
 
 		float3 ptLeftTop_cu;
-		ptLeftTop_cu.x = ptLeftTop[0];
-		ptLeftTop_cu.y = ptLeftTop[1];
-		ptLeftTop_cu.z = ptLeftTop[2];
+		ptLeftTop_cu.x = plane.ptLeftTop[0];
+		ptLeftTop_cu.y = plane.ptLeftTop[1];
+		ptLeftTop_cu.z = plane.ptLeftTop[2];
 
-		short* pData = new short[nWidth*nHeight];
-		switch (batchInfo.m_MPRType)
+		short* pSlice = pData + (size_t)i*nWidth*nHeight;
+		switch (mprType)
 		{
 		case MPRTypeAverage:
-			{
-				cu_renderPlane_Average(pData, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, batchInfo.m_fPixelSpacing, halfNum);
-			}
+			cu_renderPlane_Average(m_pContext, pSlice, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, fPixelSpacing, halfNum);
+			break;
+		case MPRTypeMIP:
+			cu_renderPlane_MIP(m_pContext, pSlice, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, fPixelSpacing, halfNum);
+			break;
+		case MPRTypeMinIP:
+			cu_renderPlane_MinIP(m_pContext, pSlice, nWidth, nHeight, dirH_cu, dirV_cu, dirN_cu, ptLeftTop_cu, fPixelSpacing, halfNum);
 			break;
 		default:
 			return false;
 		}
-		vecBatchData.push_back(pData);
 	}
 	return true;
 }
@@ -676,7 +774,7 @@ void Render::Anterior()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, 0.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Posterior()
@@ -686,7 +784,7 @@ void Render::Posterior()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, 180.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Left()
@@ -696,7 +794,7 @@ void Render::Left()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, -90.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Right()
@@ -706,7 +804,7 @@ void Render::Right()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, 90.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Head()
@@ -716,7 +814,7 @@ void Render::Head()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 90.0f, 180.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Foot()
@@ -726,20 +824,20 @@ void Render::Foot()
 	Methods::SetSeg(m_pTransformMatrix, 3);
 	Methods::SetSeg(m_pTransposeTransformMatrix, 3);
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, -90.0f, 0.0f, m_fTotalScale);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 };
 
 void Render::Rotate( float fxRotate, float fyRotate )
 {
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, fyRotate, fxRotate, 1.0f);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Zoom( float ratio)
 {
 	m_fTotalScale *= ratio;
 	Methods::ComputeTransformMatrix(m_pRotateMatrix, m_pTransposRotateMatrix, m_pTransformMatrix, m_pTransposeTransformMatrix, 0.0f, 0.0f, ratio);
-	cu_copyOperatorMatrix( m_pTransformMatrix, m_pTransposeTransformMatrix );
+	cu_copyOperatorMatrix(m_pContext, m_pTransformMatrix, m_pTransposeTransformMatrix );
 }
 
 void Render::Pan(float fxShift, float fyShift)
@@ -21,14 +21,19 @@
 // SOFTWARE.
 
 #pragma once
+#include <driver_types.h>
 #include "Defines.h"
 #include "TransferFunction.h"
 #include "VolumeInfo.h"
 #include "Methods.h"
 #include "IRender.h"
+#include "ProgressiveRefinement.h"
+#include "RayCaster.h"
 
 namespace MonkeyGL {
 
+    struct RenderContext;
+
     class Render : public IRender
     {
     public:
@@ -37,22 +42,29 @@ namespace MonkeyGL {
 
     public:
     // volume info
-        virtual bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        using IRender::SetVolumeData;
+        virtual bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
         virtual unsigned char AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth);
         virtual bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
         virtual void SetVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        virtual bool LoadVolumeContainer(const char* szFile);
+        virtual bool BeginVolume(int nWidth, int nHeight, int nDepth);
+        virtual void CommitVolumeSlices(bool bComplete);
         virtual void SetSpacing(double x, double y, double z);
+        // the kernels read a linear 3D texture, the volume stays linear
+        virtual void SetBrickedLayoutEnabled(bool bEnable){}
 
     // output
         virtual bool GetPlaneMaxSize(int& nWidth, int& nHeight, const PlaneType& planeType);
-        virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneType& planeType);
+        using IRender::GetPlaneData;
+        virtual bool GetPlaneData(short* pData, int& nWidth, int& nHeight, const PlaneInfo& planeInfo, Point3d ptCenter);
 
         virtual bool GetCrossHairPoint(double& x, double& y, const PlaneType& planeType);
         virtual void PanCrossHair(int nx, int ny, PlaneType planeType);
 
         virtual bool GetVRData(unsigned char* pVR, int nWidth, int nHeight);
+        virtual bool GetVRDataProgressive(unsigned char* pVR, int nWidth, int nHeight, int& nQualityLevel, bool& bFinal);
 
-        virtual bool GetBatchData( std::vector<short*>& vecBatchData, BatchInfo batchInfo );
 
         virtual bool GetPlaneRotateMatrix(float* pMatirx, PlaneType planeType);
 
@@ -76,16 +88,32 @@ namespace MonkeyGL {
         virtual bool SetTransferFunc(std::map<int, RGBA> ctrlPts, unsigned char nLabel);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts);
         virtual bool SetTransferFunc(std::map<int, RGBA> rgbPts, std::map<int, float> alphaPts, unsigned char nLabel);
+        virtual void SetPreIntegrationEnabled(bool bEnable);
+
+    protected:
+        virtual bool RenderBatchPlanes(short* pData, int nWidth, int nHeight, const std::vector<BatchPlane>& vecPlanes, double fPixelSpacing, float halfNum, MPRType mprType);
+        virtual void GetVRViewKey(std::vector<double>& vecViewKey);
 
     private:
         void InitLights();
         void CopyTransferFunc2Device();
         void CopyAlphaWWWL2Device();
+        void CopyVolume2Device();
         void NormalizeVOI();
 
         void testcuda();
 
     private:
+        RenderContext* m_pContext;
+        ProgressiveRefinement m_progressive;
+        cudaExtent m_VolumeSize;
+        // the volume in the texture, in its own voxel type except int32, which is
+        // uploaded as float32. host paths that mirror the kernels sample it
+        std::shared_ptr<void> m_pTextureVolume;
+        VoxelType m_textureType;
+        // a texture fetch times m_fVolumeScale is a voxel value
+        float m_fVolumeScale;
+
         float m_fVOI_xStart;
         float m_fVOI_xEnd;
         float m_fVOI_yStart;
@@ -97,8 +125,15 @@ namespace MonkeyGL {
         float m_fTotalXTranslate;
         float m_fTotalYTranslate;
         float m_fTotalScale;
-
-        AlphaAndWWWL m_AlphaAndWWWL[MAXOBJECTCOUNT+1];
+        // size of the last VR frame, clicks and the crosshair are in its pixels
+        int m_nVRWidth;
+        int m_nVRHeight;
+
+        AlphaAndMapping m_AlphaAndMapping[MAXOBJECTCOUNT+1];
+        // host replay of the kernel for VR picking, with the mapping for raw values
+        RayCaster m_picker;
+        AlphaAndMapping m_PickAlphaAndMapping[MAXOBJECTCOUNT+1];
+        unsigned int m_nTransferFuncVersions[MAXOBJECTCOUNT+1];
         float* m_pRotateMatrix;
         float* m_pTransposRotateMatrix;
         float* m_pTransformMatrix;
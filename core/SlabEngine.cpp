@@ -0,0 +1,321 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SlabEngine.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace MonkeyGL;
+
+namespace {
+
+	// adds or removes a plane from the running sums, a double carries the float
+	// samples of a slab with bits to spare so the sums do not drift while browsing
+	void AccumulatePlane(double* pSum, const float* pPlane, int nCount, bool bAdd)
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		for (; i+4<=nCount; i+=4){
+			__m128 v = _mm_loadu_ps(pPlane + i);
+			__m128d lo = _mm_cvtps_pd(v);
+			__m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+			__m128d s0 = _mm_loadu_pd(pSum + i);
+			__m128d s1 = _mm_loadu_pd(pSum + i + 2);
+			if (bAdd){
+				s0 = _mm_add_pd(s0, lo);
+				s1 = _mm_add_pd(s1, hi);
+			}
+			else{
+				s0 = _mm_sub_pd(s0, lo);
+				s1 = _mm_sub_pd(s1, hi);
+			}
+			_mm_storeu_pd(pSum + i, s0);
+			_mm_storeu_pd(pSum + i + 2, s1);
+		}
+#endif
+		for (; i<nCount; i++){
+			if (bAdd)
+				pSum[i] += pPlane[i];
+			else
+				pSum[i] -= pPlane[i];
+		}
+	}
+
+	// truncates like the short conversion of the generic plane renderers, values out of
+	// the short range saturate as in the packs
+	void TruncatePlane(short* pDst, const float* pSrc, int nCount)
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		for (; i+8<=nCount; i+=8){
+			__m128i a = _mm_cvttps_epi32(_mm_loadu_ps(pSrc + i));
+			__m128i b = _mm_cvttps_epi32(_mm_loadu_ps(pSrc + i + 4));
+			_mm_storeu_si128((__m128i*)(pDst + i), _mm_packs_epi32(a, b));
+		}
+#endif
+		for (; i<nCount; i++){
+			pDst[i] = SaturateShort(pSrc[i]);
+		}
+	}
+
+	void ExtremePlane(short* pDst, const short* pA, const short* pB, int nCount, bool bMax)
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		for (; i+8<=nCount; i+=8){
+			__m128i a = _mm_loadu_si128((const __m128i*)(pA + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(pB + i));
+			_mm_storeu_si128((__m128i*)(pDst + i), bMax ? _mm_max_epi16(a, b) : _mm_min_epi16(a, b));
+		}
+#endif
+		for (; i<nCount; i++){
+			if (bMax)
+				pDst[i] = pA[i]>pB[i] ? pA[i]:pB[i];
+			else
+				pDst[i] = pA[i]<pB[i] ? pA[i]:pB[i];
+		}
+	}
+
+	void AveragePlane(short* pDst, const double* pSum, int nCount, int nSliceNum)
+	{
+		double fSliceNum = nSliceNum;
+		int i = 0;
+#if defined(__SSE2__)
+		__m128d vSliceNum = _mm_set1_pd(fSliceNum);
+		for (; i+4<=nCount; i+=4){
+			__m128i a = _mm_cvttpd_epi32(_mm_div_pd(_mm_loadu_pd(pSum + i), vSliceNum));
+			__m128i b = _mm_cvttpd_epi32(_mm_div_pd(_mm_loadu_pd(pSum + i + 2), vSliceNum));
+			__m128i v = _mm_packs_epi32(_mm_unpacklo_epi64(a, b), _mm_setzero_si128());
+			_mm_storel_epi64((__m128i*)(pDst + i), v);
+		}
+#endif
+		for (; i<nCount; i++){
+			pDst[i] = SaturateShort(pSum[i]/fSliceNum);
+		}
+	}
+}
+
+SlabEngine::SlabEngine(void) :
+	m_fPosition(0),
+	m_bValid(false),
+	m_mprType(MPRTypeNotDefined),
+	m_nSliceNum(0),
+	m_nPixels(0),
+	m_nFirst(0),
+	m_nLowCount(0),
+	m_nHighCount(0)
+{
+}
+
+SlabEngine::~SlabEngine(void)
+{
+}
+
+void SlabEngine::Invalidate()
+{
+	m_bValid = false;
+}
+
+int SlabEngine::Slot(int nIndex) const
+{
+	int nSlot = nIndex % m_nSliceNum;
+	return nSlot<0 ? nSlot+m_nSliceNum : nSlot;
+}
+
+void SlabEngine::SamplePlane(int nIndex, float t, const SampleFunc& sample)
+{
+	size_t nOffset = (size_t)Slot(nIndex)*m_nPixels;
+	float* pPlane = &m_vecPlanes[nOffset];
+	sample(pPlane, t);
+	if (m_mprType != MPRTypeAverage)
+		TruncatePlane(&m_vecShortPlanes[nOffset], pPlane, m_nPixels);
+}
+
+void SlabEngine::PushLow(int nIndex)
+{
+	size_t nOffset = (size_t)Slot(nIndex)*m_nPixels;
+	if (m_mprType == MPRTypeAverage){
+		AccumulatePlane(&m_vecSum[0], &m_vecPlanes[nOffset], m_nPixels, true);
+		return;
+	}
+	short* pTop = &m_vecLowStack[(size_t)m_nLowCount*m_nPixels];
+	if (m_nLowCount == 0)
+		memcpy(pTop, &m_vecShortPlanes[nOffset], m_nPixels*sizeof(short));
+	else
+		ExtremePlane(pTop, pTop-m_nPixels, &m_vecShortPlanes[nOffset], m_nPixels, m_mprType==MPRTypeMIP);
+	m_nLowCount++;
+}
+
+void SlabEngine::PushHigh(int nIndex)
+{
+	size_t nOffset = (size_t)Slot(nIndex)*m_nPixels;
+	if (m_mprType == MPRTypeAverage){
+		AccumulatePlane(&m_vecSum[0], &m_vecPlanes[nOffset], m_nPixels, true);
+		return;
+	}
+	short* pTop = &m_vecHighStack[(size_t)m_nHighCount*m_nPixels];
+	if (m_nHighCount == 0)
+		memcpy(pTop, &m_vecShortPlanes[nOffset], m_nPixels*sizeof(short));
+	else
+		ExtremePlane(pTop, pTop-m_nPixels, &m_vecShortPlanes[nOffset], m_nPixels, m_mprType==MPRTypeMIP);
+	m_nHighCount++;
+}
+
+void SlabEngine::PopLow()
+{
+	if (m_mprType == MPRTypeAverage){
+		AccumulatePlane(&m_vecSum[0], &m_vecPlanes[(size_t)Slot(m_nFirst)*m_nPixels], m_nPixels, false);
+		return;
+	}
+	// splitting in halves keeps alternating directions from rebuilding on every step
+	if (m_nLowCount == 0)
+		Rebalance((m_nHighCount+1)/2);
+	m_nLowCount--;
+}
+
+void SlabEngine::PopHigh()
+{
+	if (m_mprType == MPRTypeAverage){
+		AccumulatePlane(&m_vecSum[0], &m_vecPlanes[(size_t)Slot(m_nFirst+m_nSliceNum-1)*m_nPixels], m_nPixels, false);
+		return;
+	}
+	if (m_nHighCount == 0)
+		Rebalance(m_nLowCount/2);
+	m_nHighCount--;
+}
+
+void SlabEngine::Rebalance(int nLowCount)
+{
+	int nCount = m_nLowCount + m_nHighCount;
+	m_nLowCount = 0;
+	m_nHighCount = 0;
+	for (int i=nLowCount-1; i>=0; i--){
+		PushLow(m_nFirst + i);
+	}
+	for (int i=nLowCount; i<nCount; i++){
+		PushHigh(m_nFirst + i);
+	}
+}
+
+void SlabEngine::Compose(short* pData)
+{
+	if (m_mprType == MPRTypeAverage){
+		AveragePlane(pData, &m_vecSum[0], m_nPixels, m_nSliceNum);
+		return;
+	}
+	const short* pLow = m_nLowCount>0 ? &m_vecLowStack[(size_t)(m_nLowCount-1)*m_nPixels] : NULL;
+	const short* pHigh = m_nHighCount>0 ? &m_vecHighStack[(size_t)(m_nHighCount-1)*m_nPixels] : NULL;
+	if (pLow && pHigh)
+		ExtremePlane(pData, pLow, pHigh, m_nPixels, m_mprType==MPRTypeMIP);
+	else
+		memcpy(pData, pLow ? pLow : pHigh, m_nPixels*sizeof(short));
+}
+
+void SlabEngine::Render(short* pData, int nWidth, int nHeight, Direction3d dirH, Direction3d dirV, Direction3d dirN, Point3d ptLeftTop, double fPixelSpacing, int nSliceNum, MPRType mprType, const SampleFunc& sample)
+{
+	float halfNum = 1.0f*(nSliceNum-1)/2;
+
+	// the slab may only move along its normal, everything else has to stay put,
+	// including where the left top point sits within the plane
+	double fDepth = ptLeftTop.x()*dirN.x() + ptLeftTop.y()*dirN.y() + ptLeftTop.z()*dirN.z();
+	Point3d ptInPlane = ptLeftTop - dirN*fDepth;
+	std::vector<double> vecKey;
+	vecKey.push_back(nWidth);
+	vecKey.push_back(nHeight);
+	vecKey.push_back(nSliceNum);
+	vecKey.push_back(mprType);
+	vecKey.push_back(fPixelSpacing);
+	Direction3d dirs[3] = {dirH, dirV, dirN};
+	for (int i=0; i<3; i++){
+		vecKey.push_back(dirs[i].x());
+		vecKey.push_back(dirs[i].y());
+		vecKey.push_back(dirs[i].z());
+	}
+
+	const double fTolerance = 1e-3;
+	double fShift = fDepth/fPixelSpacing - m_fPosition;
+	int nShift = (int)floor(fShift + 0.5);
+	bool bReuse = m_bValid && vecKey == m_vecKey;
+	bReuse = bReuse && fabs(fShift - nShift) < fTolerance && abs(nShift) < nSliceNum;
+	for (int i=0; bReuse && i<3; i++){
+		bReuse = fabs(ptInPlane[i] - m_ptInPlane[i]) < fTolerance*fPixelSpacing;
+	}
+
+	if (!bReuse){
+		m_vecKey = vecKey;
+		m_ptInPlane = ptInPlane;
+		m_fPosition = fDepth/fPixelSpacing;
+		m_mprType = mprType;
+		m_nSliceNum = nSliceNum;
+		m_nPixels = nWidth*nHeight;
+		m_nFirst = 0;
+		m_nLowCount = 0;
+		m_nHighCount = 0;
+		m_vecPlanes.resize((size_t)nSliceNum*m_nPixels);
+		if (mprType == MPRTypeAverage){
+			m_vecSum.assign(m_nPixels, 0.0);
+			m_vecShortPlanes.clear();
+			m_vecLowStack.clear();
+			m_vecHighStack.clear();
+		}
+		else{
+			m_vecSum.clear();
+			m_vecShortPlanes.resize((size_t)nSliceNum*m_nPixels);
+			m_vecLowStack.resize((size_t)nSliceNum*m_nPixels);
+			m_vecHighStack.resize((size_t)nSliceNum*m_nPixels);
+		}
+
+		for (int i=0; i<nSliceNum; i++){
+			SamplePlane(i, i-halfNum, sample);
+			PushHigh(i);
+		}
+		if (mprType != MPRTypeAverage)
+			Rebalance(nSliceNum/2);
+		m_bValid = true;
+		Compose(pData);
+		return;
+	}
+
+	// the planes entering the slab are sampled relative to the current left top point,
+	// plane i of the lattice sits at t = i - nFirst - halfNum once the slab has moved
+	int nFirst = m_nFirst + nShift;
+	for (int k=0; k<nShift; k++){
+		int nIndex = m_nFirst + m_nSliceNum;
+		PopLow();
+		m_nFirst++;
+		SamplePlane(nIndex, nIndex-nFirst-halfNum, sample);
+		PushHigh(nIndex);
+	}
+	for (int k=0; k>nShift; k--){
+		int nIndex = m_nFirst - 1;
+		PopHigh();
+		m_nFirst--;
+		SamplePlane(nIndex, nIndex-nFirst-halfNum, sample);
+		PushLow(nIndex);
+	}
+	m_fPosition += nShift;
+	Compose(pData);
+}
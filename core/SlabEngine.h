@@ -0,0 +1,97 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <vector>
+#include <functional>
+#include "Defines.h"
+#include "Direction.h"
+#include "Point.h"
+
+namespace MonkeyGL {
+
+    // host side thick slab MPR for browsing. the sampled planes of the last slab are
+    // kept, and when the plane moves along its normal by whole pixel spacings only the
+    // planes entering the slab are sampled. Average keeps a running per pixel sum,
+    // MIP and MinIP keep the window as a deque made of two stacks of running extremes,
+    // so a browse step costs a few plane operations instead of the whole slab.
+    class SlabEngine
+    {
+    public:
+        SlabEngine(void);
+        ~SlabEngine(void);
+
+    public:
+        // fills pPlane with the samples of the plane t pixel spacings along the normal
+        // from the left top point, -32768 outside the volume
+        typedef std::function<void(float* pPlane, float t)> SampleFunc;
+
+        // same result as sampling the nSliceNum planes around ptLeftTop every time
+        void Render(
+            short* pData,
+            int nWidth,
+            int nHeight,
+            Direction3d dirH,
+            Direction3d dirV,
+            Direction3d dirN,
+            Point3d ptLeftTop,
+            double fPixelSpacing,
+            int nSliceNum,
+            MPRType mprType,
+            const SampleFunc& sample
+        );
+
+        // the volume or spacing changed, the next call samples the whole slab again
+        void Invalidate();
+
+    private:
+        int Slot(int nIndex) const;
+        void SamplePlane(int nIndex, float t, const SampleFunc& sample);
+        void PushLow(int nIndex);
+        void PushHigh(int nIndex);
+        void PopLow();
+        void PopHigh();
+        void Rebalance(int nLowCount);
+        void Compose(short* pData);
+
+    private:
+        std::vector<double> m_vecKey;
+        Point3d m_ptInPlane;
+        // depth of the left top point the sampled planes are relative to, in pixel spacings
+        double m_fPosition;
+        bool m_bValid;
+        MPRType m_mprType;
+        int m_nSliceNum;
+        int m_nPixels;
+        // lattice index of the lowest plane in the slab, plane i lives in slot i mod nSliceNum
+        int m_nFirst;
+
+        std::vector<float> m_vecPlanes;
+        std::vector<double> m_vecSum;
+        std::vector<short> m_vecShortPlanes;
+        // the low stack tops at the lowest plane and the high stack at the highest, each
+        // entry holds the extreme of its plane and all the entries below it
+        std::vector<short> m_vecLowStack;
+        std::vector<short> m_vecHighStack;
+        int m_nLowCount;
+        int m_nHighCount;
+    };
+}
@@ -0,0 +1,423 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SliceCodec.h"
+#include <cstring>
+#include "ThreadPool.h"
+
+using namespace MonkeyGL;
+
+namespace {
+	const int c_nGradientContexts = 16;
+	const int c_nRunContext = c_nGradientContexts;
+	const int c_nContexts = c_nGradientContexts + 1;
+	const int c_nLimit = 24;
+	const int c_nHeaderWords = 6;
+
+	// a context keeps the Rice parameter in quarter steps, k = state >> 2. the quotient of
+	// every code moves it by a fixed amount: down after a zero, up the more ones were sent
+	const int c_nStateShift = 2;
+	const int c_nMaxK = 15;
+	const int c_nStates = (c_nMaxK + 1) << c_nStateShift;
+	const int c_nQuotientBuckets = 8;
+	const int c_nInitState = 2 << c_nStateShift;
+	const int c_nStateDelta[c_nQuotientBuckets] = {-2, 1, 2, 4, 6, 8, 10, 12};
+
+	struct StateTable
+	{
+		uint8_t next[c_nStates][c_nQuotientBuckets];
+
+		StateTable()
+		{
+			for (int s=0; s<c_nStates; s++)
+			{
+				for (int q=0; q<c_nQuotientBuckets; q++)
+				{
+					int nNext = s + c_nStateDelta[q];
+					next[s][q] = (uint8_t)(nNext < 0 ? 0 : (nNext >= c_nStates ? c_nStates-1 : nNext));
+				}
+			}
+		}
+	};
+	const StateTable c_stateTable;
+
+	inline void InitContexts(uint32_t* pStates)
+	{
+		for (int i=0; i<c_nContexts; i++)
+			pStates[i] = c_nInitState;
+	}
+
+	inline uint32_t NextState(uint32_t nState, uint32_t q)
+	{
+		return c_stateTable.next[nState][q < (uint32_t)c_nQuotientBuckets ? q : c_nQuotientBuckets-1];
+	}
+
+	inline int GetGradientContext(int a, int b, int c)
+	{
+		uint32_t g = (a>c ? a-c : c-a) + (b>c ? b-c : c-b);
+		int nBits = (g != 0)*(32 - __builtin_clz(g | 1));
+		return nBits < c_nGradientContexts-1 ? nBits : c_nGradientContexts-1;
+	}
+
+	inline int PredictMED(int a, int b, int c)
+	{
+		int nMax = a>b ? a : b;
+		int nMin = a>b ? b : a;
+		int nPred = a + b - c;
+		nPred = c >= nMax ? nMin : nPred;
+		nPred = c <= nMin ? nMax : nPred;
+		return nPred;
+	}
+
+	// neighbours of (x, y), a band never looks at rows above its first one
+	inline void GetNeighbours(int& a, int& b, int& c, const short* pRow, const short* pPrev, int x)
+	{
+		if (pPrev)
+		{
+			b = pPrev[x];
+			a = x>0 ? pRow[x-1] : b;
+			c = x>0 ? pPrev[x-1] : b;
+		}
+		else
+		{
+			a = x>0 ? pRow[x-1] : 0;
+			b = a;
+			c = a;
+		}
+	}
+
+	// msb first writer. the pending bits sit left aligned in a 64 bit word that is stored
+	// whole after every code, the output then moves on by the bytes completed, so a code
+	// of up to 56 bits is one shift, one or and one store
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<uint8_t>& vecOut, size_t nReserve) : m_vecOut(vecOut), m_nAcc(0), m_nBits(0)
+		{
+			m_vecOut.resize(nReserve + 16);
+			m_pOut = &m_vecOut[0];
+		}
+
+		// room for a row of nCount pixels, each at most a run and an escaped residual
+		void Reserve(int nCount)
+		{
+			size_t nPos = m_pOut - &m_vecOut[0];
+			size_t nNeed = nPos + (size_t)nCount*12 + 16;
+			if (nNeed > m_vecOut.size())
+			{
+				m_vecOut.resize(nNeed > 2*m_vecOut.size() ? nNeed : 2*m_vecOut.size());
+				m_pOut = &m_vecOut[nPos];
+			}
+		}
+
+		void Put(uint64_t nCode, int nCount)
+		{
+			m_nAcc |= nCode << (64 - m_nBits - nCount);
+			m_nBits += nCount;
+			uint64_t nWord = __builtin_bswap64(m_nAcc);
+			memcpy(m_pOut, &nWord, 8);
+			m_pOut += m_nBits >> 3;
+			m_nAcc <<= m_nBits & ~7;
+			m_nBits &= 7;
+		}
+
+		// q ones, a zero and the k low bits, or c_nLimit ones and the raw value when q
+		// reaches the limit. both are made and the code is picked without a branch
+		void PutRice(uint32_t nValue, int k, int nRawBits)
+		{
+			uint32_t q = nValue >> k;
+			bool bEscape = q >= (uint32_t)c_nLimit;
+			q = bEscape ? 0 : q;
+			uint64_t nRice = ((((uint64_t)1 << q) - 1) << (k + 1)) | (nValue & ((1u << k) - 1));
+			uint64_t nEscape = ((((uint64_t)1 << c_nLimit) - 1) << nRawBits) | nValue;
+			Put(bEscape ? nEscape : nRice, bEscape ? c_nLimit + nRawBits : (int)q + 1 + k);
+		}
+
+		void Flush()
+		{
+			if (m_nBits > 0)
+				*m_pOut++ = (uint8_t)(m_nAcc >> 56);
+			m_nBits = 0;
+			m_vecOut.resize(m_pOut - &m_vecOut[0]);
+		}
+
+	private:
+		std::vector<uint8_t>& m_vecOut;
+		uint8_t* m_pOut;
+		uint64_t m_nAcc;
+		int m_nBits;
+	};
+
+	// msb first reader, the accumulator keeps the pending bits left aligned
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* pData, size_t nLen) : m_pData(pData), m_nLen(nLen), m_nPos(0), m_nAcc(0), m_nBits(0) {}
+
+		uint32_t Get(int nCount)
+		{
+			if (nCount <= 0)
+				return 0;
+			Refill();
+			uint32_t nValue = (uint32_t)(m_nAcc >> (64 - nCount));
+			Skip(nCount);
+			return nValue;
+		}
+
+		// the value and its quotient, which moves the context state
+		uint32_t GetRice(int k, int nRawBits, uint32_t& q)
+		{
+			Refill();
+			uint64_t nInverted = ~m_nAcc;
+			int nOnes = nInverted ? __builtin_clzll(nInverted) : 64;
+			if (nOnes >= c_nLimit)
+			{
+				Skip(c_nLimit);
+				uint32_t nValue = Get(nRawBits);
+				q = nValue >> k;
+				return nValue;
+			}
+			Skip(nOnes + 1);
+			q = nOnes;
+			return ((uint32_t)nOnes << k) | Get(k);
+		}
+
+		bool IsOverrun(){
+			return m_nPos*8 - m_nBits > m_nLen*8;
+		}
+
+	private:
+		void Refill()
+		{
+			if (m_nBits > 56)
+				return;
+			if (m_nPos + 8 <= m_nLen)
+			{
+				// whole bytes up to 64 pending bits with a single load
+				uint64_t nWord;
+				memcpy(&nWord, m_pData + m_nPos, 8);
+				m_nAcc |= __builtin_bswap64(nWord) >> m_nBits;
+				m_nPos += (63 - m_nBits) >> 3;
+				m_nBits |= 56;
+				return;
+			}
+			while (m_nBits <= 56)
+			{
+				uint64_t nByte = m_nPos < m_nLen ? m_pData[m_nPos] : 0;
+				m_nPos++;
+				m_nAcc |= nByte << (56 - m_nBits);
+				m_nBits += 8;
+			}
+		}
+
+		void Skip(int nCount)
+		{
+			m_nAcc <<= nCount;
+			m_nBits -= nCount;
+		}
+
+		const uint8_t* m_pData;
+		size_t m_nLen;
+		size_t m_nPos;
+		uint64_t m_nAcc;
+		int m_nBits;
+	};
+
+	void EncodeBand(std::vector<uint8_t>& vecOut, const short* pData, int nWidth, int yStart, int yEnd)
+	{
+		uint32_t states[c_nContexts];
+		InitContexts(states);
+		BitWriter writer(vecOut, (size_t)nWidth*(yEnd-yStart)*2);
+
+		for (int y=yStart; y<yEnd; y++)
+		{
+			const short* pRow = pData + (size_t)y*nWidth;
+			const short* pPrev = y>yStart ? pRow - nWidth : NULL;
+			writer.Reserve(nWidth);
+			int x = 0;
+			while (x < nWidth)
+			{
+				int a, b, c;
+				GetNeighbours(a, b, c, pRow, pPrev, x);
+				if (a == b && b == c)
+				{
+					int nRun = 0;
+					while (x+nRun < nWidth && pRow[x+nRun] == a)
+						nRun++;
+					uint32_t& nRunState = states[c_nRunContext];
+					int k = nRunState >> c_nStateShift;
+					writer.PutRice(nRun, k, 32);
+					nRunState = NextState(nRunState, (uint32_t)nRun >> k);
+					x += nRun;
+					if (x >= nWidth)
+						break;
+					GetNeighbours(a, b, c, pRow, pPrev, x);
+				}
+
+				uint16_t nResidual = (uint16_t)(pRow[x] - PredictMED(a, b, c));
+				uint16_t nMapped = (uint16_t)(nResidual << 1) ^ (uint16_t)(0 - (nResidual >> 15));
+				uint32_t& nState = states[GetGradientContext(a, b, c)];
+				int k = nState >> c_nStateShift;
+				writer.PutRice(nMapped, k, 16);
+				nState = NextState(nState, (uint32_t)nMapped >> k);
+				x++;
+			}
+		}
+		writer.Flush();
+	}
+
+	bool DecodeBand(short* pData, int nWidth, int yStart, int yEnd, const uint8_t* pBand, size_t nLen)
+	{
+		uint32_t states[c_nContexts];
+		InitContexts(states);
+		BitReader reader(pBand, nLen);
+
+		for (int y=yStart; y<yEnd; y++)
+		{
+			short* pRow = pData + (size_t)y*nWidth;
+			const short* pPrev = y>yStart ? pRow - nWidth : NULL;
+			int x = 0;
+			while (x < nWidth)
+			{
+				int a, b, c;
+				GetNeighbours(a, b, c, pRow, pPrev, x);
+				uint32_t q = 0;
+				if (a == b && b == c)
+				{
+					uint32_t& nRunState = states[c_nRunContext];
+					uint32_t nRun = reader.GetRice(nRunState >> c_nStateShift, 32, q);
+					nRunState = NextState(nRunState, q);
+					if (nRun > (uint32_t)(nWidth - x))
+						return false;
+					for (uint32_t i=0; i<nRun; i++)
+						pRow[x+i] = (short)a;
+					x += nRun;
+					if (x >= nWidth)
+						break;
+					GetNeighbours(a, b, c, pRow, pPrev, x);
+				}
+
+				uint32_t& nState = states[GetGradientContext(a, b, c)];
+				uint32_t nMapped = reader.GetRice(nState >> c_nStateShift, 16, q);
+				nState = NextState(nState, q);
+				uint16_t nResidual = (uint16_t)((nMapped >> 1) ^ (0 - (nMapped & 1)));
+				pRow[x] = (short)(uint16_t)(PredictMED(a, b, c) + nResidual);
+				x++;
+			}
+		}
+		return !reader.IsOverrun();
+	}
+
+	inline void PutU32(uint8_t* p, uint32_t v)
+	{
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+		p[2] = (uint8_t)(v >> 16);
+		p[3] = (uint8_t)(v >> 24);
+	}
+
+	inline uint32_t GetU32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+}
+
+bool SliceCodec::Encode(std::vector<uint8_t>& vecOut, const short* pData, int nWidth, int nHeight)
+{
+	vecOut.clear();
+	if (NULL == pData || nWidth<=0 || nHeight<=0)
+		return false;
+
+	int nBands = (nHeight + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+	std::vector< std::vector<uint8_t> > vecBands(nBands);
+	ThreadPool::Instance()->ParallelFor(0, nBands, [&](int nBand){
+		int yStart = nBand*ROWS_PER_BAND;
+		int yEnd = yStart+ROWS_PER_BAND < nHeight ? yStart+ROWS_PER_BAND : nHeight;
+		EncodeBand(vecBands[nBand], pData, nWidth, yStart, yEnd);
+	});
+
+	size_t nHeaderBytes = 4*(c_nHeaderWords + nBands);
+	size_t nTotal = nHeaderBytes;
+	for (int i=0; i<nBands; i++)
+	{
+		nTotal += vecBands[i].size();
+	}
+	vecOut.resize(nTotal);
+
+	uint8_t* pOut = &vecOut[0];
+	memcpy(pOut, "MK16", 4);
+	PutU32(pOut+4, VERSION);
+	PutU32(pOut+8, nWidth);
+	PutU32(pOut+12, nHeight);
+	PutU32(pOut+16, ROWS_PER_BAND);
+	PutU32(pOut+20, nBands);
+	size_t nOffset = nHeaderBytes;
+	for (int i=0; i<nBands; i++)
+	{
+		PutU32(pOut + 4*(c_nHeaderWords+i), (uint32_t)vecBands[i].size());
+		if (!vecBands[i].empty())
+			memcpy(pOut+nOffset, &vecBands[i][0], vecBands[i].size());
+		nOffset += vecBands[i].size();
+	}
+	return true;
+}
+
+bool SliceCodec::Decode(std::vector<short>& vecOut, int& nWidth, int& nHeight, const uint8_t* pData, size_t nLen)
+{
+	if (NULL == pData || nLen < 4*c_nHeaderWords || memcmp(pData, "MK16", 4) != 0)
+		return false;
+	if (GetU32(pData+4) != VERSION)
+		return false;
+
+	nWidth = GetU32(pData+8);
+	nHeight = GetU32(pData+12);
+	int nRowsPerBand = GetU32(pData+16);
+	int nBands = GetU32(pData+20);
+	if (nWidth<=0 || nHeight<=0 || nRowsPerBand<=0 || nBands != (nHeight+nRowsPerBand-1)/nRowsPerBand)
+		return false;
+	size_t nHeaderBytes = 4*(c_nHeaderWords + (size_t)nBands);
+	if (nLen < nHeaderBytes)
+		return false;
+
+	std::vector<size_t> vecOffsets(nBands+1);
+	vecOffsets[0] = nHeaderBytes;
+	for (int i=0; i<nBands; i++)
+	{
+		vecOffsets[i+1] = vecOffsets[i] + GetU32(pData + 4*(c_nHeaderWords+i));
+	}
+	if (vecOffsets[nBands] > nLen)
+		return false;
+
+	vecOut.resize((size_t)nWidth*nHeight);
+	std::vector<unsigned char> vecValid(nBands, 0);
+	ThreadPool::Instance()->ParallelFor(0, nBands, [&](int nBand){
+		int yStart = nBand*nRowsPerBand;
+		int yEnd = yStart+nRowsPerBand < nHeight ? yStart+nRowsPerBand : nHeight;
+		vecValid[nBand] = DecodeBand(&vecOut[0], nWidth, yStart, yEnd, pData+vecOffsets[nBand], vecOffsets[nBand+1]-vecOffsets[nBand]) ? 1 : 0;
+	});
+	for (int i=0; i<nBands; i++)
+	{
+		if (!vecValid[i])
+			return false;
+	}
+	return true;
+}
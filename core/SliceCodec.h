@@ -0,0 +1,50 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace MonkeyGL {
+
+    // lossless codec for int16 slices.
+    // the slice is cut into bands of rows that are coded independently: each pixel is
+    // predicted with the median edge detector from its left, upper and upper-left
+    // neighbours, the residual is zigzag mapped and written with adaptive Golomb-Rice
+    // codes, one context per gradient magnitude. a context is a small state that holds k
+    // in quarter steps and moves through a fixed table by the quotient of every code.
+    // flat neighbourhoods switch to run mode.
+    //
+    // layout, little endian:
+    //   "MK16", u32 version, u32 width, u32 height, u32 rows per band, u32 band count,
+    //   u32 byte size of every band, band payloads (bit streams, msb first)
+    class SliceCodec
+    {
+    public:
+        static const uint32_t VERSION = 2;
+        static const int ROWS_PER_BAND = 32;
+
+        static bool Encode(std::vector<uint8_t>& vecOut, const short* pData, int nWidth, int nHeight);
+        static bool Decode(std::vector<short>& vecOut, int& nWidth, int& nHeight, const uint8_t* pData, size_t nLen);
+    };
+}
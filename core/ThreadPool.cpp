@@ -0,0 +1,214 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ThreadPool.h"
+#include <limits>
+
+using namespace MonkeyGL;
+
+ThreadPool::ThreadPool(int nThreads)
+{
+	if (nThreads <= 0)
+		nThreads = std::thread::hardware_concurrency();
+	if (nThreads <= 0)
+		nThreads = 1;
+
+	m_nQueued = 0;
+	m_nNextQueue = 0;
+	m_bStop = false;
+	for (int i=0; i<nThreads; i++)
+	{
+		m_queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+	for (int i=0; i<nThreads; i++)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxWake);
+		m_bStop = true;
+	}
+	m_cvWake.notify_all();
+	for (size_t i=0; i<m_threads.size(); i++)
+	{
+		m_threads[i].join();
+	}
+}
+
+ThreadPool* ThreadPool::Instance()
+{
+	static ThreadPool* pThreadPool = new ThreadPool();
+	return pThreadPool;
+}
+
+void ThreadPool::Push(int nQueue, const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queues[nQueue]->mtx);
+		m_queues[nQueue]->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mtxWake);
+		m_nQueued++;
+	}
+	m_cvWake.notify_one();
+}
+
+bool ThreadPool::Pop(int nQueue, std::function<void()>& task)
+{
+	int nCount = (int)m_queues.size();
+	if (nQueue >= 0 && nQueue < nCount)
+	{
+		WorkQueue& own = *m_queues[nQueue];
+		std::lock_guard<std::mutex> lock(own.mtx);
+		if (!own.tasks.empty())
+		{
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			m_nQueued--;
+			return true;
+		}
+	}
+
+	int nStart = nQueue < 0 ? 0 : nQueue+1;
+	for (int i=0; i<nCount; i++)
+	{
+		int nVictim = (nStart + i) % nCount;
+		if (nVictim == nQueue)
+			continue;
+		WorkQueue& victim = *m_queues[nVictim];
+		std::lock_guard<std::mutex> lock(victim.mtx);
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			m_nQueued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(int nIndex)
+{
+	std::function<void()> task;
+	while (true)
+	{
+		if (Pop(nIndex, task))
+		{
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mtxWake);
+		m_cvWake.wait(lock, [this](){
+			return m_bStop || m_nQueued > 0;
+		});
+		if (m_bStop && m_nQueued <= 0)
+			return;
+	}
+}
+
+void ThreadPool::ParallelFor(int nBegin, int nEnd, const std::function<void(int)>& func)
+{
+	int nTotal = nEnd - nBegin;
+	if (nTotal <= 0)
+		return;
+
+	int nThreads = GetThreadCount();
+	if (nTotal == 1 || nThreads <= 1)
+	{
+		for (int i=nBegin; i<nEnd; i++)
+			func(i);
+		return;
+	}
+
+	// a few chunks per worker leaves room for stealing when the cost per index is uneven
+	int nChunks = nThreads * 8;
+	nChunks = nChunks < nTotal ? nChunks : nTotal;
+	int nChunkSize = (nTotal + nChunks - 1) / nChunks;
+	nChunks = (nTotal + nChunkSize - 1) / nChunkSize;
+
+	struct Group
+	{
+		std::atomic<int> nRemaining;
+		std::mutex mtx;
+		std::condition_variable cv;
+	};
+	std::shared_ptr<Group> pGroup(new Group());
+	pGroup->nRemaining = nChunks;
+
+	for (int c=0; c<nChunks; c++)
+	{
+		int nChunkBegin = nBegin + c*nChunkSize;
+		int nChunkEnd = nChunkBegin + nChunkSize;
+		nChunkEnd = nChunkEnd < nEnd ? nChunkEnd : nEnd;
+		const std::function<void(int)>* pFunc = &func;
+		Push(m_nNextQueue++ % nThreads, [pGroup, pFunc, nChunkBegin, nChunkEnd](){
+			for (int i=nChunkBegin; i<nChunkEnd; i++)
+				(*pFunc)(i);
+			if (--pGroup->nRemaining == 0)
+			{
+				std::lock_guard<std::mutex> lock(pGroup->mtx);
+				pGroup->cv.notify_all();
+			}
+		});
+	}
+
+	// help out instead of blocking, this also keeps nested calls from a worker deadlock free
+	std::function<void()> task;
+	while (pGroup->nRemaining > 0)
+	{
+		if (Pop(-1, task))
+		{
+			task();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(pGroup->mtx);
+		pGroup->cv.wait(lock, [pGroup](){
+			return pGroup->nRemaining <= 0;
+		});
+	}
+}
+
+void ThreadPool::ParallelForBlocks(size_t nCount, size_t nBlock, const std::function<void(size_t, size_t)>& func)
+{
+	if (nCount == 0)
+		return;
+	if (nBlock == 0)
+		nBlock = 1;
+	// the block index has to fit ParallelFor
+	size_t nMaxBlocks = (size_t)std::numeric_limits<int>::max();
+	if ((nCount - 1)/nBlock >= nMaxBlocks)
+		nBlock = (nCount - 1)/nMaxBlocks + 1;
+
+	int nBlocks = (int)((nCount - 1)/nBlock + 1);
+	ParallelFor(0, nBlocks, [&](int b){
+		size_t nStart = (size_t)b*nBlock;
+		size_t nEnd = nCount - nStart > nBlock ? nStart + nBlock : nCount;
+		func(nStart, nEnd);
+	});
+}
@@ -0,0 +1,77 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace MonkeyGL {
+
+    // work-stealing pool, every worker owns a deque and steals from the others when it runs dry.
+    class ThreadPool
+    {
+    public:
+        ThreadPool(int nThreads = 0);
+        ~ThreadPool(void);
+
+        static ThreadPool* Instance();
+
+    public:
+        int GetThreadCount(){
+            return (int)m_threads.size();
+        }
+
+        // runs func(i) for i in [nBegin, nEnd), the calling thread joins in until all are done.
+        void ParallelFor(int nBegin, int nEnd, const std::function<void(int)>& func);
+
+        // runs func(nStart, nEnd) over [0, nCount) in blocks of nBlock items, for per voxel loops
+        // over whole volumes: the counts stay 64 bit and every block is a plain loop to vectorize.
+        void ParallelForBlocks(size_t nCount, size_t nBlock, const std::function<void(size_t, size_t)>& func);
+
+    private:
+        struct WorkQueue
+        {
+            std::deque<std::function<void()> > tasks;
+            std::mutex mtx;
+        };
+
+        void Push(int nQueue, const std::function<void()>& task);
+        bool Pop(int nQueue, std::function<void()>& task);
+        void WorkerLoop(int nIndex);
+
+    private:
+        std::vector<std::thread> m_threads;
+        std::vector<std::unique_ptr<WorkQueue> > m_queues;
+        std::mutex m_mtxWake;
+        std::condition_variable m_cvWake;
+        std::atomic<int> m_nQueued;
+        std::atomic<unsigned int> m_nNextQueue;
+        bool m_bStop;
+    };
+
+}
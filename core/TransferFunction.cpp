@@ -37,17 +37,9 @@ TransferFunction::~TransferFunction(void)
 
 bool TransferFunction::GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int& nLen )
 {
-	std::map<int, RGBA>::iterator iter = m_pos2rgba.begin();
-	while (iter != m_pos2rgba.end())
-	{
-		if (iter->first<m_nMinPos || iter->first>m_nMaxPos)
-		{
-			m_pos2rgba.erase(iter);
-			iter = m_pos2rgba.begin();
-			continue;
-		}
-		iter++;
-	}
+	// the map is ordered, so the out of range points are its two ends
+	m_pos2rgba.erase(m_pos2rgba.begin(), m_pos2rgba.lower_bound(m_nMinPos));
+	m_pos2rgba.erase(m_pos2rgba.upper_bound(m_nMaxPos), m_pos2rgba.end());
 
 	if (m_pos2rgba.size() < 2)
 		return false;
@@ -64,9 +56,9 @@ bool TransferFunction::GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int&
 	}
 
 	nLen = m_nMaxPos - m_nMinPos + 1;
-	pBuffer.reset(new RGBA[nLen]);
+	pBuffer.reset(new RGBA[nLen], std::default_delete<RGBA[]>());
 
-	iter = m_pos2rgba.begin();
+	std::map<int, RGBA>::iterator iter = m_pos2rgba.begin();
 	int posPrev = iter->first;
 	RGBA rgbaPrev = iter->second;
 	iter++;
@@ -91,20 +83,12 @@ bool TransferFunction::GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int&
 		iter++;
 	}
 
-	if (m_pos2alpha.size() > 1)
-	{
-		std::map<int, float>::iterator iterAlpha = m_pos2alpha.begin();
-		while (iterAlpha != m_pos2alpha.end())
-		{
-			if (iterAlpha->first<m_nMinPos || iterAlpha->first>m_nMaxPos)
-			{
-				m_pos2alpha.erase(iterAlpha);
-				iterAlpha = m_pos2alpha.begin();
-				continue;
-			}
-			iterAlpha++;
-		}
+	bool bAlphaCurve = m_pos2alpha.size() > 1;
+	m_pos2alpha.erase(m_pos2alpha.begin(), m_pos2alpha.lower_bound(m_nMinPos));
+	m_pos2alpha.erase(m_pos2alpha.upper_bound(m_nMaxPos), m_pos2alpha.end());
 
+	if (bAlphaCurve && !m_pos2alpha.empty())
+	{
 		if (m_pos2alpha.begin()->first != m_nMinPos)
 		{
 			m_pos2alpha[m_nMinPos] = 0;
@@ -115,7 +99,7 @@ bool TransferFunction::GetTransferFunction( std::shared_ptr<RGBA>& pBuffer, int&
 			m_pos2alpha[m_nMaxPos] = alpha;
 		}
 
-		iterAlpha = m_pos2alpha.begin();
+		std::map<int, float>::iterator iterAlpha = m_pos2alpha.begin();
 		int posPrev = iterAlpha->first;
 		float alphaPrev = iterAlpha->second;
 		iterAlpha++;
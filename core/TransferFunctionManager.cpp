@@ -0,0 +1,311 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "TransferFunctionManager.h"
+#include "ThreadPool.h"
+#include <cmath>
+
+using namespace MonkeyGL;
+
+namespace {
+	const unsigned long long c_nFnvOffset = 14695981039346656037ULL;
+	const unsigned long long c_nFnvPrime = 1099511628211ULL;
+
+	void HashBytes(unsigned long long& nHash, const void* pData, size_t nSize)
+	{
+		const unsigned char* p = (const unsigned char*)pData;
+		for (size_t i=0; i<nSize; i++)
+		{
+			nHash ^= p[i];
+			nHash *= c_nFnvPrime;
+		}
+	}
+
+	int ClampIndex(int i, int nLen)
+	{
+		return i < 0 ? 0 : (i >= nLen ? nLen-1 : i);
+	}
+}
+
+TransferFunctionManager::TransferFunctionManager(void)
+{
+	m_nNextVersion = 1;
+	m_bPreIntegration = false;
+	for (int i=0; i<=MAXOBJECTCOUNT; i++)
+	{
+		m_entries[i].bValid = false;
+		m_entries[i].nHash = 0;
+		m_entries[i].nVersion = 0;
+		m_entries[i].nLen = 0;
+		m_entries[i].fScale = 0.0f;
+		m_entries[i].fOffset = 0.0f;
+	}
+}
+
+TransferFunctionManager::~TransferFunctionManager(void)
+{
+}
+
+void TransferFunctionManager::Clear()
+{
+	for (int i=0; i<=MAXOBJECTCOUNT; i++)
+	{
+		Entry& entry = m_entries[i];
+		if (entry.bValid)
+			entry.nVersion = m_nNextVersion++;
+		entry.bValid = false;
+		entry.nHash = 0;
+		entry.pTransferFunc.reset();
+		entry.nLen = 0;
+		entry.vecPreIntegration.clear();
+	}
+}
+
+int TransferFunctionManager::Update(const std::map<unsigned char, ObjectInfo>& objectInfos)
+{
+	bool bPresent[MAXOBJECTCOUNT+1] = {false};
+	int nRebuilt = 0;
+	for (std::map<unsigned char, ObjectInfo>::const_iterator iter=objectInfos.begin(); iter!=objectInfos.end(); iter++)
+	{
+		unsigned char label = iter->first;
+		if (label > MAXOBJECTCOUNT)
+			continue;
+		const ObjectInfo& info = iter->second;
+		Entry& entry = m_entries[label];
+
+		// the window only moves the mapping, the table is over the window so it stays
+		float fWW = fabsf(info.ww) < 1e-6f ? 1e-6f : info.ww;
+		entry.fScale = 1.0f/fWW;
+		entry.fOffset = 0.5f - info.wl/fWW;
+
+		unsigned long long nHash = Hash(info);
+		bPresent[label] = true;
+		if (entry.bValid && entry.nHash == nHash)
+			continue;
+
+		entry.nHash = nHash;
+		entry.nVersion = m_nNextVersion++;
+		entry.bValid = info.GetTransferFunction(entry.pTransferFunc, entry.nLen);
+		if (!entry.bValid)
+		{
+			entry.pTransferFunc.reset();
+			entry.nLen = 0;
+			continue;
+		}
+		if (entry.vecLUT.size() != LUT_SIZE)
+			entry.vecLUT.resize(LUT_SIZE);
+		BuildLUT(&entry.vecLUT[0], entry.pTransferFunc.get(), entry.nLen);
+		if (m_bPreIntegration)
+			BuildPreIntegration(entry);
+		nRebuilt++;
+	}
+
+	for (int i=0; i<=MAXOBJECTCOUNT; i++)
+	{
+		Entry& entry = m_entries[i];
+		if (bPresent[i] || (!entry.bValid && entry.nHash == 0))
+			continue;
+		entry.bValid = false;
+		entry.nHash = 0;
+		entry.nVersion = m_nNextVersion++;
+		entry.pTransferFunc.reset();
+		entry.nLen = 0;
+		entry.vecPreIntegration.clear();
+	}
+	return nRebuilt;
+}
+
+void TransferFunctionManager::SetPreIntegrationEnabled(bool bEnable)
+{
+	if (m_bPreIntegration == bEnable)
+		return;
+	m_bPreIntegration = bEnable;
+	for (int i=0; i<=MAXOBJECTCOUNT; i++)
+	{
+		Entry& entry = m_entries[i];
+		if (!entry.bValid)
+			continue;
+		if (bEnable)
+			BuildPreIntegration(entry);
+		else
+			std::vector<RGBA>().swap(entry.vecPreIntegration);
+		entry.nVersion = m_nNextVersion++;
+	}
+}
+
+const RGBA* TransferFunctionManager::GetPreIntegrationTable(unsigned char nLabel) const
+{
+	if (!IsValid(nLabel) || m_entries[nLabel].vecPreIntegration.empty())
+		return NULL;
+	return &m_entries[nLabel].vecPreIntegration[0];
+}
+
+void TransferFunctionManager::BuildPreIntegration(Entry& entry)
+{
+	if (entry.vecPreIntegration.size() != PREINTEGRATION_SIZE*PREINTEGRATION_SIZE)
+		entry.vecPreIntegration.resize(PREINTEGRATION_SIZE*PREINTEGRATION_SIZE);
+	BuildPreIntegrationTable(&entry.vecPreIntegration[0], PREINTEGRATION_SIZE, &entry.vecLUT[0], LUT_SIZE);
+}
+
+const RGBA* TransferFunctionManager::GetTransferFunction(unsigned char nLabel, int& nLen) const
+{
+	if (!IsValid(nLabel))
+	{
+		nLen = 0;
+		return NULL;
+	}
+	nLen = m_entries[nLabel].nLen;
+	return m_entries[nLabel].pTransferFunc.get();
+}
+
+const RGBA* TransferFunctionManager::GetLUT(unsigned char nLabel) const
+{
+	if (!IsValid(nLabel))
+		return NULL;
+	return &m_entries[nLabel].vecLUT[0];
+}
+
+void TransferFunctionManager::GetLUTMapping(unsigned char nLabel, float& fScale, float& fOffset) const
+{
+	if (nLabel > MAXOBJECTCOUNT)
+	{
+		fScale = 0.0f;
+		fOffset = 0.0f;
+		return;
+	}
+	fScale = m_entries[nLabel].fScale;
+	fOffset = m_entries[nLabel].fOffset;
+}
+
+unsigned long long TransferFunctionManager::Hash(const ObjectInfo& info)
+{
+	unsigned long long nHash = c_nFnvOffset;
+	size_t nCount = info.idx2rgba.size();
+	HashBytes(nHash, &nCount, sizeof(nCount));
+	for (std::map<int, RGBA>::const_iterator iter=info.idx2rgba.begin(); iter!=info.idx2rgba.end(); iter++)
+	{
+		HashBytes(nHash, &iter->first, sizeof(int));
+		HashBytes(nHash, &iter->second, sizeof(RGBA));
+	}
+	nCount = info.idx2alpha.size();
+	HashBytes(nHash, &nCount, sizeof(nCount));
+	for (std::map<int, float>::const_iterator iter=info.idx2alpha.begin(); iter!=info.idx2alpha.end(); iter++)
+	{
+		HashBytes(nHash, &iter->first, sizeof(int));
+		HashBytes(nHash, &iter->second, sizeof(float));
+	}
+	// 0 marks an entry that was never filled
+	return nHash == 0 ? 1 : nHash;
+}
+
+void TransferFunctionManager::BuildLUT(RGBA* pLUT, const RGBA* pTransferFunc, int nLen)
+{
+	// entry i sits at the texel center (i+0.5)/LUT_SIZE and takes what a linear,
+	// clamped fetch of the transfer function returned there. the entries are
+	// walked per transfer function segment so the inner loop has no floor or clamp
+	int i = 0;
+	for (int k=-1; k<nLen && i<LUT_SIZE; k++)
+	{
+		const RGBA& c0 = pTransferFunc[ClampIndex(k, nLen)];
+		const RGBA& c1 = pTransferFunc[ClampIndex(k+1, nLen)];
+		for (; i<LUT_SIZE; i++)
+		{
+			float t = (i + 0.5f)*nLen/LUT_SIZE - 0.5f;
+			if (t >= k+1)
+				break;
+			float f = t - k;
+			pLUT[i].red = c0.red + (c1.red - c0.red)*f;
+			pLUT[i].green = c0.green + (c1.green - c0.green)*f;
+			pLUT[i].blue = c0.blue + (c1.blue - c0.blue)*f;
+			pLUT[i].alpha = c0.alpha + (c1.alpha - c0.alpha)*f;
+		}
+	}
+}
+
+void TransferFunctionManager::BuildPreIntegrationTable(RGBA* pTable, int nSize, const RGBA* pLUT, int nLUTLen)
+{
+	// the lut alpha is the opacity of one fStepL1, so its extinction per step is
+	// -log(1-alpha). the lut is taken as constant per entry and integrated once,
+	// pTau[k] and pColor[3*k..3*k+2] hold the integrals of the extinction and of
+	// the extinction weighted color over [0, k/nLUTLen]
+	std::vector<float> vecTau(nLUTLen+1);
+	std::vector<float> vecColor(3*(nLUTLen+1));
+	float* pTau = &vecTau[0];
+	float* pColor = &vecColor[0];
+	pTau[0] = 0.0f;
+	pColor[0] = pColor[1] = pColor[2] = 0.0f;
+	float fCell = 1.0f/nLUTLen;
+	for (int k=0; k<nLUTLen; k++)
+	{
+		float fAlpha = pLUT[k].alpha < 0.999999f ? pLUT[k].alpha : 0.999999f;
+		float fTau = fAlpha > 0.0f ? -logf(1.0f - fAlpha)*fCell : 0.0f;
+		pTau[k+1] = pTau[k] + fTau;
+		pColor[3*(k+1)+0] = pColor[3*k+0] + pLUT[k].red*fTau;
+		pColor[3*(k+1)+1] = pColor[3*k+1] + pLUT[k].green*fTau;
+		pColor[3*(k+1)+2] = pColor[3*k+2] + pLUT[k].blue*fTau;
+	}
+
+	// every table entry is then a difference of two integrals, O(1) each
+	ThreadPool::Instance()->ParallelFor(0, nSize, [&](int nFront){
+		float sFront = (nFront + 0.5f)/nSize;
+		int kFront = (int)(sFront*nLUTLen);
+		float fFront = sFront*nLUTLen - kFront;
+		float tauFront = pTau[kFront] + (pTau[kFront+1] - pTau[kFront])*fFront;
+		float colorFront[3];
+		for (int c=0; c<3; c++)
+			colorFront[c] = pColor[3*kFront+c] + (pColor[3*(kFront+1)+c] - pColor[3*kFront+c])*fFront;
+
+		RGBA* pRow = pTable + nFront*nSize;
+		for (int nBack=0; nBack<nSize; nBack++)
+		{
+			if (nBack == nFront)
+			{
+				pRow[nBack] = pLUT[kFront];
+				continue;
+			}
+			float sBack = (nBack + 0.5f)/nSize;
+			int kBack = (int)(sBack*nLUTLen);
+			float fBack = sBack*nLUTLen - kBack;
+			float tauBack = pTau[kBack] + (pTau[kBack+1] - pTau[kBack])*fBack;
+
+			// the value runs linearly from front to back over the segment
+			float fTau = tauBack - tauFront;
+			float fOpticalDepth = fTau/(sBack - sFront);
+			RGBA& out = pRow[nBack];
+			out.alpha = 1.0f - expf(-fOpticalDepth);
+			if (fabsf(fTau) > 1.0e-12f)
+			{
+				// extinction weighted mean color, self attenuation inside the segment is left out
+				out.red = (pColor[3*kBack+0] + (pColor[3*(kBack+1)+0] - pColor[3*kBack+0])*fBack - colorFront[0])/fTau;
+				out.green = (pColor[3*kBack+1] + (pColor[3*(kBack+1)+1] - pColor[3*kBack+1])*fBack - colorFront[1])/fTau;
+				out.blue = (pColor[3*kBack+2] + (pColor[3*(kBack+1)+2] - pColor[3*kBack+2])*fBack - colorFront[2])/fTau;
+			}
+			else
+			{
+				const RGBA& mid = pLUT[(kFront + kBack)/2];
+				out.red = mid.red;
+				out.green = mid.green;
+				out.blue = mid.blue;
+			}
+		}
+	});
+}
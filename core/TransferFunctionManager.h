@@ -0,0 +1,102 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <map>
+#include <memory>
+#include <vector>
+#include "Defines.h"
+#include "ObjectInfo.h"
+
+namespace MonkeyGL {
+
+    // per label transfer function tables shared by the render backends and the
+    // brick table. the control points are hashed so only the labels that really
+    // changed are rebuilt, and every rebuild bumps the label's version so a
+    // backend uploads just those. the table handed to the ray casters is the
+    // transfer function resampled to LUT_SIZE entries over the window, the
+    // window itself is folded into a scale and offset, so a sample is looked
+    // up as lut(value*scale + offset) with normalized, clamped coordinates.
+    // when pre-integration is on, every label also gets a table of the ray
+    // segment between a front and a back sample one fStepL1 apart.
+    class TransferFunctionManager
+    {
+    public:
+        TransferFunctionManager(void);
+        ~TransferFunctionManager(void);
+
+    public:
+        static const int LUT_SIZE = 4096;
+        static const int PREINTEGRATION_SIZE = 256;
+
+        void Clear();
+        // returns the number of labels whose tables were rebuilt
+        int Update(const std::map<unsigned char, ObjectInfo>& objectInfos);
+
+        bool IsValid(unsigned char nLabel) const {
+            return nLabel <= MAXOBJECTCOUNT && m_entries[nLabel].bValid;
+        }
+        // changes whenever the tables of the label change, never 0 once updated
+        unsigned int GetVersion(unsigned char nLabel) const {
+            return nLabel <= MAXOBJECTCOUNT ? m_entries[nLabel].nVersion : 0;
+        }
+        // the transfer function over the control point positions
+        const RGBA* GetTransferFunction(unsigned char nLabel, int& nLen) const;
+        // LUT_SIZE entries covering [wl-ww/2, wl+ww/2]
+        const RGBA* GetLUT(unsigned char nLabel) const;
+        void GetLUTMapping(unsigned char nLabel, float& fScale, float& fOffset) const;
+
+        // builds the tables of all labels when switched on, bumping their versions
+        void SetPreIntegrationEnabled(bool bEnable);
+        bool IsPreIntegrationEnabled() const {
+            return m_bPreIntegration;
+        }
+        // PREINTEGRATION_SIZE^2 entries, the row is the front sample and the column
+        // the back sample, both in lut coordinates. color is not premultiplied and
+        // alpha is the opacity of a segment of length fStepL1
+        const RGBA* GetPreIntegrationTable(unsigned char nLabel) const;
+        static void BuildPreIntegrationTable(RGBA* pTable, int nSize, const RGBA* pLUT, int nLUTLen);
+
+    private:
+        static unsigned long long Hash(const ObjectInfo& info);
+        static void BuildLUT(RGBA* pLUT, const RGBA* pTransferFunc, int nLen);
+
+    private:
+        struct Entry
+        {
+            bool bValid;
+            unsigned long long nHash;
+            unsigned int nVersion;
+            std::shared_ptr<RGBA> pTransferFunc;
+            int nLen;
+            std::vector<RGBA> vecLUT;
+            float fScale;
+            float fOffset;
+            std::vector<RGBA> vecPreIntegration;
+        };
+        void BuildPreIntegration(Entry& entry);
+
+        Entry m_entries[MAXOBJECTCOUNT+1];
+        unsigned int m_nNextVersion;
+        bool m_bPreIntegration;
+    };
+}
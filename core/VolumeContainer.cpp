@@ -0,0 +1,475 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "VolumeContainer.h"
+#include "Defines.h"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <zlib.h>
+#include "ThreadPool.h"
+#include "StopWatch.h"
+#include "Logger.h"
+
+using namespace MonkeyGL;
+
+namespace {
+
+	const unsigned int kVersion = 1;
+	const unsigned int kFlagInvertedZ = 1;
+
+	enum BrickCodec
+	{
+		CodecStored = 0,
+		// zlib deflate of the voxels as they are
+		CodecDeflate = 1,
+		// differences along x, low bytes before high bytes, then deflate. neighbouring
+		// CT voxels differ by little, which leaves long runs in the high byte plane
+		CodecDeltaDeflate = 2
+	};
+
+	// fixed 256 byte little endian header at the start of the file
+	struct FileHeader
+	{
+		char magic[4];
+		unsigned int nVersion;
+		int dims[3];
+		unsigned int nBrickSize;
+		double spacing[3];
+		double dirs[9];
+		unsigned int nFlags;
+		unsigned int nReserved;
+		unsigned long long nIndexOffset[VolumeContainer::ChannelCount];
+		unsigned char labels[32];
+		unsigned char reserved[80];
+	};
+	static_assert(sizeof(FileHeader) == 256, "container header layout");
+
+	size_t GetChannelBytes(VolumeContainer::Channel channel)
+	{
+		return channel == VolumeContainer::ChannelVolume ? sizeof(short) : sizeof(unsigned char);
+	}
+
+	void EncodeDelta(const short* pSrc, int nRowLen, size_t nVoxels, unsigned char* pDst)
+	{
+		unsigned char* pLow = pDst;
+		unsigned char* pHigh = pDst + nVoxels;
+		for (size_t i=0; i<nVoxels; i++){
+			unsigned short nValue = (unsigned short)pSrc[i];
+			if (i % nRowLen != 0)
+				nValue = (unsigned short)(nValue - (unsigned short)pSrc[i - 1]);
+			pLow[i] = (unsigned char)(nValue & 0xff);
+			pHigh[i] = (unsigned char)(nValue >> 8);
+		}
+	}
+
+	void DecodeDelta(const unsigned char* pSrc, int nRowLen, size_t nVoxels, short* pDst)
+	{
+		const unsigned char* pLow = pSrc;
+		const unsigned char* pHigh = pSrc + nVoxels;
+		for (size_t nRow=0; nRow<nVoxels; nRow+=nRowLen){
+			unsigned short nPrev = 0;
+			for (size_t i=nRow; i<nRow+nRowLen; i++){
+				nPrev = (unsigned short)(nPrev + (pLow[i] | (pHigh[i] << 8)));
+				pDst[i] = (short)nPrev;
+			}
+		}
+	}
+
+	bool EncodeBrick(VolumeContainer::Channel channel, const unsigned char* pBrick, int nRowLen, size_t nVoxels, int nLevel, std::vector<unsigned char>& vecOut, unsigned int& nCodec)
+	{
+		size_t nBytes = nVoxels*GetChannelBytes(channel);
+		const unsigned char* pSrc = pBrick;
+		std::vector<unsigned char> vecFiltered;
+		nCodec = CodecDeflate;
+		if (channel == VolumeContainer::ChannelVolume){
+			vecFiltered.resize(nBytes);
+			EncodeDelta((const short*)pBrick, nRowLen, nVoxels, &vecFiltered[0]);
+			pSrc = &vecFiltered[0];
+			nCodec = CodecDeltaDeflate;
+		}
+
+		uLongf nOut = compressBound((uLong)nBytes);
+		vecOut.resize(nOut);
+		if (compress2(&vecOut[0], &nOut, pSrc, (uLong)nBytes, nLevel) != Z_OK)
+			return false;
+		if (nOut >= nBytes){
+			vecOut.assign(pBrick, pBrick + nBytes);
+			nCodec = CodecStored;
+			return true;
+		}
+		vecOut.resize(nOut);
+		return true;
+	}
+
+	bool DecodeBrick(VolumeContainer::Channel channel, unsigned int nCodec, const unsigned char* pIn, size_t nIn, int nRowLen, size_t nVoxels, unsigned char* pBrick, std::vector<unsigned char>& vecScratch)
+	{
+		size_t nBytes = nVoxels*GetChannelBytes(channel);
+		switch (nCodec)
+		{
+		case CodecStored:
+			if (nIn != nBytes)
+				return false;
+			memcpy(pBrick, pIn, nBytes);
+			return true;
+		case CodecDeflate:
+			{
+				uLongf nOut = (uLongf)nBytes;
+				return uncompress(pBrick, &nOut, pIn, (uLong)nIn) == Z_OK && nOut == nBytes;
+			}
+		case CodecDeltaDeflate:
+			{
+				if (channel != VolumeContainer::ChannelVolume)
+					return false;
+				vecScratch.resize(nBytes);
+				uLongf nOut = (uLongf)nBytes;
+				if (uncompress(&vecScratch[0], &nOut, pIn, (uLong)nIn) != Z_OK || nOut != nBytes)
+					return false;
+				DecodeDelta(&vecScratch[0], nRowLen, nVoxels, (short*)pBrick);
+				return true;
+			}
+		default:
+			return false;
+		}
+	}
+
+	void CopyBrick(const unsigned char* pSrc, unsigned char* pDst, const int* pDims, const int* pStart, const int* pExtent, size_t nVoxelBytes, bool bToBrick)
+	{
+		size_t nRowBytes = pExtent[0]*nVoxelBytes;
+		for (int z=0; z<pExtent[2]; z++){
+			for (int y=0; y<pExtent[1]; y++){
+				size_t nLinear = (((size_t)(pStart[2] + z)*pDims[1] + pStart[1] + y)*pDims[0] + pStart[0])*nVoxelBytes;
+				size_t nBrick = ((size_t)z*pExtent[1] + y)*nRowBytes;
+				if (bToBrick)
+					memcpy(pDst + nBrick, pSrc + nLinear, nRowBytes);
+				else
+					memcpy(pDst + nLinear, pSrc + nBrick, nRowBytes);
+			}
+		}
+	}
+}
+
+const int VolumeContainer::BRICK_SIZE;
+
+VolumeContainer::Header::Header()
+{
+	for (int i=0; i<3; i++){
+		dims[i] = 0;
+		spacing[i] = 1.0;
+		for (int j=0; j<3; j++)
+			dirs[i][j] = i == j ? 1.0 : 0.0;
+	}
+	bInvertedZ = false;
+}
+
+VolumeContainer::VolumeContainer(void)
+{
+	m_fp = NULL;
+	m_nBricks[0] = m_nBricks[1] = m_nBricks[2] = 0;
+}
+
+VolumeContainer::~VolumeContainer(void)
+{
+	Close();
+}
+
+bool VolumeContainer::Write(const char* szFile, const Header& header, const short* pVolume, const unsigned char* pMask, int nLevel)
+{
+	StopWatch sw("VolumeContainer::Write");
+	if (!szFile || !pVolume || header.dims[0]<=0 || header.dims[1]<=0 || header.dims[2]<=0)
+		return false;
+
+	// written next to the target and renamed at the end, a failed write never leaves a broken cache behind
+	std::string strTemp = std::string(szFile) + ".tmp";
+	FILE* fp = fopen(strTemp.c_str(), "wb");
+	if (!fp){
+		Logger::Warn("failed to create volume container: %s", szFile);
+		return false;
+	}
+
+	FileHeader fh;
+	memset(&fh, 0, sizeof(fh));
+	memcpy(fh.magic, "MGLV", 4);
+	fh.nVersion = kVersion;
+	fh.nBrickSize = BRICK_SIZE;
+	for (int i=0; i<3; i++){
+		fh.dims[i] = header.dims[i];
+		fh.spacing[i] = header.spacing[i];
+		for (int j=0; j<3; j++)
+			fh.dirs[3*i + j] = header.dirs[i][j];
+	}
+	fh.nFlags = header.bInvertedZ ? kFlagInvertedZ : 0;
+	for (size_t i=0; i<header.vecLabels.size(); i++)
+		fh.labels[header.vecLabels[i] >> 3] |= 1 << (header.vecLabels[i] & 7);
+
+	bool bOK = fwrite(&fh, sizeof(fh), 1, fp) == 1;
+	unsigned long long nPos = sizeof(fh);
+
+	int nBricks[3];
+	for (int i=0; i<3; i++)
+		nBricks[i] = (header.dims[i] + BRICK_SIZE - 1) / BRICK_SIZE;
+	int nLayerBricks = nBricks[0]*nBricks[1];
+
+	const unsigned char* pChannels[ChannelCount] = {(const unsigned char*)pVolume, pMask};
+	for (int c=0; c<ChannelCount && bOK; c++){
+		if (!pChannels[c])
+			continue;
+		Channel channel = (Channel)c;
+		size_t nVoxelBytes = GetChannelBytes(channel);
+		std::vector<BrickEntry> vecIndex;
+		std::vector< std::vector<unsigned char> > vecEncoded(nLayerBricks);
+		std::vector<unsigned int> vecCodec(nLayerBricks);
+
+		for (int bz=0; bz<nBricks[2] && bOK; bz++){
+			std::atomic<bool> bEncoded(true);
+			ThreadPool::Instance()->ParallelFor(0, nLayerBricks, [&](int i){
+				int nStart[3] = {(i % nBricks[0])*BRICK_SIZE, (i / nBricks[0])*BRICK_SIZE, bz*BRICK_SIZE};
+				int nExtent[3];
+				for (int k=0; k<3; k++)
+					nExtent[k] = std::min(BRICK_SIZE, header.dims[k] - nStart[k]);
+				size_t nVoxels = (size_t)nExtent[0]*nExtent[1]*nExtent[2];
+				std::vector<unsigned char> vecBrick(nVoxels*nVoxelBytes);
+				CopyBrick(pChannels[c], &vecBrick[0], header.dims, nStart, nExtent, nVoxelBytes, true);
+				if (!EncodeBrick(channel, &vecBrick[0], nExtent[0], nVoxels, nLevel, vecEncoded[i], vecCodec[i]))
+					bEncoded = false;
+			});
+			bOK = bEncoded;
+
+			for (int i=0; i<nLayerBricks && bOK; i++){
+				BrickEntry entry;
+				entry.nOffset = nPos;
+				entry.nSize = (unsigned int)vecEncoded[i].size();
+				entry.nCodec = vecCodec[i];
+				vecIndex.push_back(entry);
+				bOK = fwrite(&vecEncoded[i][0], 1, entry.nSize, fp) == entry.nSize;
+				nPos += entry.nSize;
+			}
+		}
+
+		fh.nIndexOffset[c] = nPos;
+		if (bOK)
+			bOK = fwrite(&vecIndex[0], sizeof(BrickEntry), vecIndex.size(), fp) == vecIndex.size();
+		nPos += sizeof(BrickEntry)*vecIndex.size();
+	}
+
+	if (bOK)
+		bOK = SeekFile(fp, 0, SEEK_SET) == 0 && fwrite(&fh, sizeof(fh), 1, fp) == 1;
+	bOK = fclose(fp) == 0 && bOK;
+	if (bOK)
+		bOK = rename(strTemp.c_str(), szFile) == 0;
+	if (!bOK){
+		remove(strTemp.c_str());
+		Logger::Warn("failed to write volume container: %s", szFile);
+		return false;
+	}
+	Logger::Info("volume container written: %s, %llu bytes", szFile, nPos);
+	return true;
+}
+
+bool VolumeContainer::Open(const char* szFile)
+{
+	Close();
+	if (!szFile)
+		return false;
+
+	m_fp = fopen(szFile, "rb");
+	if (!m_fp){
+		Logger::Warn("failed to open volume container: %s", szFile);
+		return false;
+	}
+
+	FileHeader fh;
+	if (fread(&fh, sizeof(fh), 1, m_fp) != 1 || memcmp(fh.magic, "MGLV", 4) != 0 ||
+		fh.nVersion != kVersion || fh.nBrickSize != (unsigned int)BRICK_SIZE){
+		Logger::Warn("not a volume container: %s", szFile);
+		Close();
+		return false;
+	}
+	SeekFile(m_fp, 0, SEEK_END);
+	unsigned long long nFileSize = (unsigned long long)TellFile(m_fp);
+
+	m_header = Header();
+	for (int i=0; i<3; i++){
+		m_header.dims[i] = fh.dims[i];
+		m_header.spacing[i] = fh.spacing[i];
+		for (int j=0; j<3; j++)
+			m_header.dirs[i][j] = fh.dirs[3*i + j];
+		m_nBricks[i] = fh.dims[i] > 0 ? (fh.dims[i] + BRICK_SIZE - 1) / BRICK_SIZE : 0;
+	}
+	m_header.bInvertedZ = (fh.nFlags & kFlagInvertedZ) != 0;
+	for (int i=1; i<256; i++){
+		if (fh.labels[i >> 3] & (1 << (i & 7)))
+			m_header.vecLabels.push_back((unsigned char)i);
+	}
+
+	size_t nTotal = (size_t)m_nBricks[0]*m_nBricks[1]*m_nBricks[2];
+	bool bOK = nTotal > 0 && fh.nIndexOffset[ChannelVolume] > 0;
+	for (int c=0; c<ChannelCount && bOK; c++){
+		if (fh.nIndexOffset[c] == 0)
+			continue;
+		std::vector<BrickEntry>& vecIndex = m_vecIndex[c];
+		vecIndex.resize(nTotal);
+		bOK = fh.nIndexOffset[c] + nTotal*sizeof(BrickEntry) <= nFileSize &&
+			SeekFile(m_fp, fh.nIndexOffset[c], SEEK_SET) == 0 &&
+			fread(&vecIndex[0], sizeof(BrickEntry), nTotal, m_fp) == nTotal;
+		for (size_t i=0; i<nTotal && bOK; i++)
+			bOK = vecIndex[i].nOffset + vecIndex[i].nSize <= fh.nIndexOffset[c];
+	}
+	if (!bOK){
+		Logger::Warn("corrupted volume container: %s", szFile);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void VolumeContainer::Close()
+{
+	if (m_fp)
+		fclose(m_fp);
+	m_fp = NULL;
+	m_nBricks[0] = m_nBricks[1] = m_nBricks[2] = 0;
+	for (int c=0; c<ChannelCount; c++)
+		m_vecIndex[c].clear();
+}
+
+void VolumeContainer::GetBrickExtent(int bx, int by, int bz, int* pExtent) const
+{
+	int nBrick[3] = {bx, by, bz};
+	for (int i=0; i<3; i++)
+		pExtent[i] = std::min(BRICK_SIZE, m_header.dims[i] - nBrick[i]*BRICK_SIZE);
+}
+
+bool VolumeContainer::ReadBytes(unsigned long long nOffset, size_t nSize, unsigned char* pDst)
+{
+	std::lock_guard<std::mutex> lock(m_mtxFile);
+	if (!m_fp)
+		return false;
+	return SeekFile(m_fp, nOffset, SEEK_SET) == 0 && fread(pDst, 1, nSize, m_fp) == nSize;
+}
+
+bool VolumeContainer::ReadBrick(Channel channel, int bx, int by, int bz, void* pDst)
+{
+	if (!HasChannel(channel) || bx<0 || by<0 || bz<0 || bx>=m_nBricks[0] || by>=m_nBricks[1] || bz>=m_nBricks[2])
+		return false;
+
+	const BrickEntry& entry = m_vecIndex[channel][GetBrickIndex(bx, by, bz)];
+	std::vector<unsigned char> vecIn(entry.nSize);
+	if (entry.nSize > 0 && !ReadBytes(entry.nOffset, entry.nSize, &vecIn[0]))
+		return false;
+
+	int nExtent[3];
+	GetBrickExtent(bx, by, bz, nExtent);
+	std::vector<unsigned char> vecScratch;
+	return DecodeBrick(channel, entry.nCodec, vecIn.empty() ? NULL : &vecIn[0], vecIn.size(), nExtent[0],
+		(size_t)nExtent[0]*nExtent[1]*nExtent[2], (unsigned char*)pDst, vecScratch);
+}
+
+bool VolumeContainer::ReadLayers(Channel channel, int nLayerBegin, int nLayerEnd, void* pLinear)
+{
+	if (!HasChannel(channel) || nLayerBegin < 0 || nLayerEnd > m_nBricks[2] || nLayerBegin >= nLayerEnd)
+		return false;
+
+	std::vector<unsigned char> vecIn;
+	if (!FetchLayers(channel, nLayerBegin, nLayerEnd, vecIn))
+		return false;
+	return DecodeLayers(channel, nLayerBegin, nLayerEnd, vecIn, pLinear);
+}
+
+bool VolumeContainer::FetchLayers(Channel channel, int nLayerBegin, int nLayerEnd, std::vector<unsigned char>& vecIn)
+{
+	// the bricks of consecutive layers are contiguous, they come in with one read
+	const std::vector<BrickEntry>& vecIndex = m_vecIndex[channel];
+	size_t nFirst = GetBrickIndex(0, 0, nLayerBegin);
+	size_t nLast = GetBrickIndex(0, 0, nLayerEnd);
+	unsigned long long nBegin = vecIndex[nFirst].nOffset;
+	unsigned long long nEnd = vecIndex[nLast - 1].nOffset + vecIndex[nLast - 1].nSize;
+	vecIn.resize(nEnd - nBegin + 1);
+	return ReadBytes(nBegin, nEnd - nBegin, &vecIn[0]);
+}
+
+bool VolumeContainer::DecodeLayers(Channel channel, int nLayerBegin, int nLayerEnd, const std::vector<unsigned char>& vecIn, void* pLinear)
+{
+	const std::vector<BrickEntry>& vecIndex = m_vecIndex[channel];
+	size_t nFirst = GetBrickIndex(0, 0, nLayerBegin);
+	size_t nLast = GetBrickIndex(0, 0, nLayerEnd);
+	unsigned long long nBegin = vecIndex[nFirst].nOffset;
+	unsigned long long nEnd = nBegin + vecIn.size() - 1;
+	const unsigned char* pIn = &vecIn[0];
+
+	size_t nVoxelBytes = GetChannelBytes(channel);
+	std::atomic<bool> bOK(true);
+	ThreadPool::Instance()->ParallelFor((int)nFirst, (int)nLast, [&](int i){
+		const BrickEntry& entry = vecIndex[i];
+		int bx = i % m_nBricks[0];
+		int by = (i / m_nBricks[0]) % m_nBricks[1];
+		int bz = i / (m_nBricks[0]*m_nBricks[1]);
+		int nStart[3] = {bx*BRICK_SIZE, by*BRICK_SIZE, bz*BRICK_SIZE};
+		int nExtent[3];
+		GetBrickExtent(bx, by, bz, nExtent);
+		size_t nVoxels = (size_t)nExtent[0]*nExtent[1]*nExtent[2];
+
+		std::vector<unsigned char> vecBrick(nVoxels*nVoxelBytes);
+		std::vector<unsigned char> vecScratch;
+		if (entry.nOffset < nBegin || entry.nOffset + entry.nSize > nEnd ||
+			!DecodeBrick(channel, entry.nCodec, pIn + (entry.nOffset - nBegin), entry.nSize, nExtent[0], nVoxels, &vecBrick[0], vecScratch)){
+			bOK = false;
+			return;
+		}
+		CopyBrick(&vecBrick[0], (unsigned char*)pLinear, m_header.dims, nStart, nExtent, nVoxelBytes, false);
+	});
+	return bOK;
+}
+
+bool VolumeContainer::ReadChannel(Channel channel, void* pLinear, const std::function<void(int nSlices)>& onLayer)
+{
+	if (!HasChannel(channel))
+		return false;
+
+	// the next layer is read while the pool decodes the current one, slow storage
+	// then costs the larger of the read and the decode time instead of their sum
+	std::vector<unsigned char> vecIn;
+	bool bFetched = FetchLayers(channel, 0, 1, vecIn);
+	for (int bz=0; bz<m_nBricks[2]; bz++){
+		if (!bFetched){
+			Logger::Warn("failed to read brick layer %d of the volume container", bz);
+			return false;
+		}
+		std::vector<unsigned char> vecNext;
+		std::future<bool> next;
+		if (bz + 1 < m_nBricks[2])
+			next = std::async(std::launch::async, &VolumeContainer::FetchLayers, this, channel, bz + 1, bz + 2, std::ref(vecNext));
+
+		bool bDecoded = DecodeLayers(channel, bz, bz + 1, vecIn, pLinear);
+		bFetched = next.valid() ? next.get() : true;
+		if (!bDecoded){
+			Logger::Warn("failed to decode brick layer %d of the volume container", bz);
+			return false;
+		}
+		if (onLayer)
+			onLayer(std::min((bz + 1)*BRICK_SIZE, m_header.dims[2]));
+		vecIn.swap(vecNext);
+	}
+	return true;
+}
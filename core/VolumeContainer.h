@@ -0,0 +1,116 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+namespace MonkeyGL {
+
+    // MonkeyGL volume container (.mgv): the normalized volume and its label mask stored
+    // as independently deflated 64^3 bricks behind an offset index. the header keeps the
+    // geometry after NormVolumeData, so a reopened study is used as it is stored, and any
+    // brick can be read on its own. bricks are stored z layer by z layer.
+    class VolumeContainer
+    {
+    public:
+        VolumeContainer(void);
+        ~VolumeContainer(void);
+
+    public:
+        static const int BRICK_SIZE = 64;
+
+        enum Channel
+        {
+            ChannelVolume = 0,
+            ChannelMask,
+            ChannelCount
+        };
+
+        struct Header
+        {
+            int dims[3];
+            double spacing[3];
+            // normalized x, y and z directions
+            double dirs[3][3];
+            // the slices were reversed by the normalization, masks added later follow it
+            bool bInvertedZ;
+            // labels present in the mask channel
+            std::vector<unsigned char> vecLabels;
+
+            Header();
+        };
+
+        // pMask may be NULL, nLevel is the zlib level
+        static bool Write(const char* szFile, const Header& header, const short* pVolume, const unsigned char* pMask, int nLevel = 6);
+
+        bool Open(const char* szFile);
+        void Close();
+        bool IsOpen() const{
+            return m_fp != NULL;
+        }
+        const Header& GetHeader() const{
+            return m_header;
+        }
+        bool HasChannel(Channel channel) const{
+            return !m_vecIndex[channel].empty();
+        }
+        int GetBrickCount(int axis) const{
+            return m_nBricks[axis];
+        }
+        // extent of a brick, the bricks on the far sides are cut to the volume
+        void GetBrickExtent(int bx, int by, int bz, int* pExtent) const;
+
+        // one brick x fastest within its extent, pDst holds extent voxels of the channel type
+        bool ReadBrick(Channel channel, int bx, int by, int bz, void* pDst);
+        // the bricks of z layers [nLayerBegin, nLayerEnd) decoded in parallel into the
+        // linear volume pLinear (dims[0]*dims[1]*dims[2] voxels of the channel type)
+        bool ReadLayers(Channel channel, int nLayerBegin, int nLayerEnd, void* pLinear);
+        // all layers, onLayer is called after each one with the number of slices complete
+        bool ReadChannel(Channel channel, void* pLinear, const std::function<void(int nSlices)>& onLayer = std::function<void(int)>());
+
+    private:
+        struct BrickEntry
+        {
+            unsigned long long nOffset;
+            unsigned int nSize;
+            unsigned int nCodec;
+        };
+
+        size_t GetBrickIndex(int bx, int by, int bz) const{
+            return ((size_t)bz*m_nBricks[1] + by)*m_nBricks[0] + bx;
+        }
+        bool ReadBytes(unsigned long long nOffset, size_t nSize, unsigned char* pDst);
+        bool FetchLayers(Channel channel, int nLayerBegin, int nLayerEnd, std::vector<unsigned char>& vecIn);
+        bool DecodeLayers(Channel channel, int nLayerBegin, int nLayerEnd, const std::vector<unsigned char>& vecIn, void* pLinear);
+
+    private:
+        FILE* m_fp;
+        std::mutex m_mtxFile;
+        Header m_header;
+        int m_nBricks[3];
+        std::vector<BrickEntry> m_vecIndex[ChannelCount];
+    };
+
+}
@@ -23,17 +23,36 @@
 #include "VolumeInfo.h"
 #include "Defines.h"
 #include "DataManager.h"
+#include "VolumeContainer.h"
 #include <cstring>
 #include "StopWatch.h"
 #include "Logger.h"
+#include "ThreadPool.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define MONKEYGL_USE_MMAP
+#endif
 
 using namespace MonkeyGL;
 
+namespace {
+	const size_t c_nMaskBlock = 1 << 20;
+}
+
 VolumeInfo::VolumeInfo( void )
 {
 	m_pVolume.reset();
+	m_voxelType = VoxelTypeInt16;
 	m_pMask.reset();
+	m_bMemoryMapEnabled = false;
+	m_bVolumeMapped = false;
 	m_bVolumeHasInverted = false;
+	m_bPyramidEnabled = true;
+	m_bBrickedEnabled = false;
+	m_bAccelerationsPending = false;
 	m_fSliceThickness = 1.0;
 	memset(m_Dims, 0, 3*sizeof(int));
 	m_Spacing[0] = 1.0;
@@ -51,7 +70,12 @@ VolumeInfo::~VolumeInfo( void )
 void VolumeInfo::Clear(){
 	m_pVolume.reset();
 	m_pMask.reset();
+	m_bVolumeMapped = false;
 	m_bVolumeHasInverted = false;
+	m_brickTable.Clear();
+	m_pyramid.Clear();
+	m_bricked.Clear();
+	m_bAccelerationsPending = false;
 }
 
 bool VolumeInfo::LoadVolumeFile( const char* szFile, int nWidth, int nHeight, int nDepth )
@@ -60,23 +84,296 @@ bool VolumeInfo::LoadVolumeFile( const char* szFile, int nWidth, int nHeight, in
 
 	if (nWidth<=0 || nHeight<=0 || nDepth<=0)
 		return false;
-	FILE* fp = fopen(szFile, "rb");
-	if (NULL == fp)
+
+	size_t nBytes = sizeof(short)*nWidth*nHeight*nDepth;
+	std::shared_ptr<short> pVolume;
+	bool bMapped = false;
+	if (m_bMemoryMapEnabled){
+		pVolume = MapVolumeFile(szFile, nBytes);
+		bMapped = bool(pVolume);
+	}
+	if (!pVolume){
+		pVolume = ReadVolumeFile(szFile, nBytes);
+	}
+	if (!pVolume)
 		return false;
+
 	m_Dims[0] = nWidth;
 	m_Dims[1] = nHeight;
 	m_Dims[2] = nDepth;
-	m_pVolume.reset(new short[GetVolumeSize()]);
-	fread(m_pVolume.get(), GetVolumeBytes(), 1, fp);
-	fclose(fp);
+	m_pVolume = pVolume;
+	m_voxelType = VoxelTypeInt16;
+	m_bVolumeMapped = bMapped;
 
 	m_pMask.reset();
 	NormVolumeData();
+	DeferAccelerations();
+
+	return true;
+}
+
+bool VolumeInfo::SaveVolumeContainer(const char* szFile, const std::vector<unsigned char>& vecLabels)
+{
+	if (VoxelTypeInt16 != m_voxelType){
+		Logger::Error("volume containers hold 16 bit volumes only, voxel type %d is rejected", (int)m_voxelType);
+		return false;
+	}
+	std::shared_ptr<short> pVolume = GetVolumeData();
+	if (!pVolume)
+		return false;
+
+	VolumeContainer::Header header;
+	Direction3d* pDirs[3] = {&m_dirX, &m_dirY, &m_dirZ};
+	for (int i=0; i<3; i++){
+		header.dims[i] = m_Dims[i];
+		header.spacing[i] = m_Spacing[i];
+		header.dirs[i][0] = pDirs[i]->x();
+		header.dirs[i][1] = pDirs[i]->y();
+		header.dirs[i][2] = pDirs[i]->z();
+	}
+	header.bInvertedZ = m_bVolumeHasInverted;
+	if (m_pMask)
+		header.vecLabels = vecLabels;
+	return VolumeContainer::Write(szFile, header, pVolume.get(), m_pMask.get());
+}
+
+bool VolumeInfo::LoadVolumeContainer(const char* szFile, std::vector<unsigned char>& vecLabels)
+{
+	StopWatch sw("VolumeInfo::LoadVolumeContainer");
 
+	VolumeContainer container;
+	if (!container.Open(szFile))
+		return false;
+
+	const VolumeContainer::Header& header = container.GetHeader();
+	size_t nVoxels = (size_t)header.dims[0]*header.dims[1]*header.dims[2];
+	std::shared_ptr<short> pVolume(new short[nVoxels], std::default_delete<short[]>());
+	if (!container.ReadChannel(VolumeContainer::ChannelVolume, pVolume.get()))
+		return false;
+	std::shared_ptr<unsigned char> pMask;
+	if (container.HasChannel(VolumeContainer::ChannelMask)){
+		pMask.reset(new unsigned char[nVoxels], std::default_delete<unsigned char[]>());
+		if (!container.ReadChannel(VolumeContainer::ChannelMask, pMask.get()))
+			return false;
+	}
+
+	for (int i=0; i<3; i++){
+		m_Dims[i] = header.dims[i];
+		m_Spacing[i] = header.spacing[i];
+	}
+	m_dirX = Direction3d(header.dirs[0][0], header.dirs[0][1], header.dirs[0][2]);
+	m_dirY = Direction3d(header.dirs[1][0], header.dirs[1][1], header.dirs[1][2]);
+	m_dirZ = Direction3d(header.dirs[2][0], header.dirs[2][1], header.dirs[2][2]);
+	m_bVolumeHasInverted = header.bInvertedZ;
+	m_pVolume = pVolume;
+	m_voxelType = VoxelTypeInt16;
+	m_bVolumeMapped = false;
+	m_pMask = pMask;
+
+	DeferAccelerations();
+	vecLabels = header.vecLabels;
 	return true;
 }
 
+void VolumeInfo::BuildAccelerations(bool bBricked)
+{
+	m_bAccelerationsPending = false;
+	m_brickTable.Build(m_pVolume.get(), m_voxelType, m_Dims[0], m_Dims[1], m_Dims[2]);
+	m_pyramid.Clear();
+	if (m_bPyramidEnabled)
+		m_pyramid.Build(m_pVolume.get(), m_voxelType, m_Dims[0], m_Dims[1], m_Dims[2]);
+
+	m_bricked.Clear();
+	if (bBricked)
+		BuildBrickedLayout();
+}
+
+void VolumeInfo::DeferAccelerations()
+{
+	m_brickTable.Clear();
+	m_pyramid.Clear();
+	m_bricked.Clear();
+	m_bAccelerationsPending = true;
+}
+
+void VolumeInfo::BuildPendingAccelerations()
+{
+	if (!m_bAccelerationsPending || !m_pVolume)
+		return;
+
+	StopWatch sw("VolumeInfo::BuildPendingAccelerations");
+	BuildAccelerations();
+	if (m_pMask){
+		m_brickTable.BuildMask(m_pMask.get());
+		m_pyramid.BuildMask(m_pMask.get());
+	}
+}
+
+int VolumeInfo::SelectLevel(double fPixelSpacing)
+{
+	// level 1 is the first that VolumePyramid::SelectLevel can pick
+	double fMinSpacing = GetMinSpacing();
+	if (fMinSpacing <= 0.0 || fPixelSpacing < 2*fMinSpacing)
+		return 0;
+	return GetVolumePyramid().SelectLevel(fPixelSpacing, fMinSpacing);
+}
+
+void VolumeInfo::BuildBrickedLayout()
+{
+	if (m_bBrickedEnabled && VoxelTypeInt16 != m_voxelType){
+		Logger::Error("the bricked layout holds 16 bit volumes only, voxel type %d is rejected and kept linear", (int)m_voxelType);
+	}
+	else if (m_bBrickedEnabled){
+		if (m_bricked.Build((const short*)m_pVolume.get(), m_Dims[0], m_Dims[1], m_Dims[2])){
+			m_pVolume.reset();
+			m_bVolumeMapped = false;
+		}
+		else{
+			Logger::Warn("volume %dx%dx%d is too large for the bricked layout, keeping it linear", m_Dims[0], m_Dims[1], m_Dims[2]);
+		}
+	}
+}
+
+bool VolumeInfo::BeginVolume(int nWidth, int nHeight, int nDepth)
+{
+	if (nWidth<=0 || nHeight<=0 || nDepth<=0)
+		return false;
+
+	std::shared_ptr<short> pVolume(new short[(size_t)nWidth*nHeight*nDepth](), std::default_delete<short[]>());
+	m_Dims[0] = nWidth;
+	m_Dims[1] = nHeight;
+	m_Dims[2] = nDepth;
+	m_pVolume = pVolume;
+	m_voxelType = VoxelTypeInt16;
+	m_bVolumeMapped = false;
+	m_pMask.reset();
+	// built once on the empty volume, SetVolumeSlices keeps them in step from here
+	BuildAccelerations(false);
+
+	// the slices are put in flipped order as they come, which is all NormVolumeData
+	// does for a volume with perpendicular axes
+	if (Need2InvertZ()){
+		m_dirZ = Direction3d(-m_dirZ.x(), -m_dirZ.y(), -m_dirZ.z());
+		m_bVolumeHasInverted = true;
+	}
+	return true;
+}
+
+void VolumeInfo::SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride)
+{
+	if (!m_pVolume || !pSlices || VoxelTypeInt16 != m_voxelType)
+		return;
+
+	size_t nSliceVoxels = (size_t)m_Dims[0]*m_Dims[1];
+	int zMin = m_Dims[2], zMax = -1;
+	for (int i=0; i<nCount; i++){
+		for (int k=0; k<nStride; k++){
+			int z = nFirst + i*nStride + k;
+			if (z < 0 || z >= m_Dims[2])
+				break;
+			if (m_bVolumeHasInverted)
+				z = m_Dims[2] - 1 - z;
+			memcpy((short*)m_pVolume.get() + z*nSliceVoxels, pSlices + i*nSliceVoxels, nSliceVoxels*sizeof(short));
+			zMin = z < zMin ? z : zMin;
+			zMax = z > zMax ? z : zMax;
+		}
+	}
+
+	// the renderers sample this volume between commits, so the bricks and the pyramid
+	// slices made from the new slices are redone before it is handed back
+	m_brickTable.UpdateSlices(m_pVolume.get(), m_voxelType, zMin, zMax);
+	m_pyramid.UpdateSlices(m_pVolume.get(), zMin, zMax);
+}
+
+void VolumeInfo::CommitVolumeSlices(bool bComplete)
+{
+	if (!m_pVolume)
+		return;
+
+	// the brick table and the pyramid follow every SetVolumeSlices, only the bricked
+	// copy waits for the whole volume
+	if (bComplete)
+		BuildBrickedLayout();
+}
+
+std::shared_ptr<short> VolumeInfo::GetVolumeData()
+{
+	std::shared_ptr<void> pVoxels = GetVoxelData();
+	if (!pVoxels || VoxelTypeInt16 == m_voxelType)
+		return std::static_pointer_cast<short>(pVoxels);
+
+	StopWatch sw("VolumeInfo::GetVolumeData");
+	std::shared_ptr<short> pVolume(new short[GetVolumeSize()], std::default_delete<short[]>());
+	CopyVoxelsToShort(pVolume.get(), pVoxels.get(), m_voxelType, GetVolumeSize());
+	return pVolume;
+}
+
+std::shared_ptr<void> VolumeInfo::GetVoxelData()
+{
+	if (!m_pVolume && m_bricked.IsValid()){
+		StopWatch sw("VolumeInfo::GetVoxelData");
+		std::shared_ptr<short> pVolume(new short[GetVolumeSize()], std::default_delete<short[]>());
+		m_bricked.CopyToLinear(pVolume.get());
+		m_pVolume = pVolume;
+	}
+	return m_pVolume;
+}
+
+std::shared_ptr<short> VolumeInfo::MapVolumeFile( const char* szFile, size_t nBytes )
+{
+#ifdef MONKEYGL_USE_MMAP
+	int fd = open(szFile, O_RDONLY);
+	if (fd < 0)
+		return std::shared_ptr<short>(NULL);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < nBytes){
+		// pages past the end of the file would fault on access, leave short files to fread
+		close(fd);
+		return std::shared_ptr<short>(NULL);
+	}
+
+	// private writable mapping: nothing is copied unless a page is written to
+	void* pAddr = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pAddr == MAP_FAILED){
+		Logger::Warn("failed to map volume file: %s", szFile);
+		return std::shared_ptr<short>(NULL);
+	}
+
+	madvise(pAddr, nBytes, MADV_SEQUENTIAL);
+	madvise(pAddr, nBytes, MADV_WILLNEED);
+
+	Logger::Info("volume file mapped: %s, %zu bytes", szFile, nBytes);
+	return std::shared_ptr<short>((short*)pAddr, [nBytes](short* p){
+		munmap(p, nBytes);
+	});
+#else
+	return std::shared_ptr<short>(NULL);
+#endif
+}
+
+std::shared_ptr<short> VolumeInfo::ReadVolumeFile( const char* szFile, size_t nBytes )
+{
+	FILE* fp = fopen(szFile, "rb");
+	if (NULL == fp)
+		return std::shared_ptr<short>(NULL);
+	std::shared_ptr<short> pVolume(new short[nBytes/sizeof(short)], std::default_delete<short[]>());
+	size_t nRead = fread(pVolume.get(), 1, nBytes, fp);
+	fclose(fp);
+	if (nRead < nBytes){
+		Logger::Warn("volume file %s is shorter than expected, %zu of %zu bytes read", szFile, nRead, nBytes);
+		memset((char*)pVolume.get() + nRead, 0, nBytes - nRead);
+	}
+	return pVolume;
+}
+
 bool VolumeInfo::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth)
+{
+	return SetVolumeData(pData, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool VolumeInfo::SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth)
 {
 	StopWatch sw("VolumeInfo::SetVolumeData");
 	if (!pData || nWidth<=0 || nHeight<=0 || nDepth<=0)
@@ -86,9 +383,12 @@ bool VolumeInfo::SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHei
 	m_Dims[1] = nHeight;
 	m_Dims[2] = nDepth;
 	m_pVolume = pData;
+	m_voxelType = type;
+	m_bVolumeMapped = false;
 	m_pMask.reset();
 
 	NormVolumeData();
+	DeferAccelerations();
 
 	return true;
 }
@@ -99,22 +399,19 @@ bool VolumeInfo::AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidt
 	if (!pData){
 		return false;
 	}
-	int nTotalVoxel = nWidth * nHeight * nDepth;
 	if (!m_pMask){
-		m_pMask.reset(new unsigned char[nTotalVoxel]);
-		for (int i=0; i<nTotalVoxel; i++){
-			if (pData.get()[i] > 0){
-				m_pMask.get()[i] = nLabel;
-			}
-		}
+		m_pMask.reset(new unsigned char[GetVolumeSize()](), std::default_delete<unsigned char[]>());
 	}
-	else{
-		for (int i=0; i<nWidth*nHeight*nDepth; i++){
-			if (pData.get()[i] > 0){
-				m_pMask.get()[i] = nLabel;
-			}
+	const unsigned char* pSrc = pData.get();
+	unsigned char* pDst = m_pMask.get();
+	unsigned char label = nLabel;
+	ThreadPool::Instance()->ParallelForBlocks(GetVolumeSize(), c_nMaskBlock, [&](size_t nStart, size_t nEnd){
+		for (size_t i=nStart; i<nEnd; i++){
+			pDst[i] = pSrc[i] > 0 ? label : pDst[i];
 		}
-	}
+	});
+	m_brickTable.BuildMask(m_pMask.get());
+	m_pyramid.BuildMask(m_pMask.get());
 	return true;
 }
 
@@ -125,14 +422,17 @@ bool VolumeInfo::UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidt
 		return false;
 	}
 
-	for (int i=0; i<nWidth*nHeight*nDepth; i++){
-		if (pData.get()[i] > 0){
-			m_pMask.get()[i] = nLabel;
-		}
-		else if (pData.get()[i] == 0 && m_pMask.get()[i] == nLabel){
-			m_pMask.get()[i] = 0;
+	const unsigned char* pSrc = pData.get();
+	unsigned char* pDst = m_pMask.get();
+	unsigned char label = nLabel;
+	ThreadPool::Instance()->ParallelForBlocks(GetVolumeSize(), c_nMaskBlock, [&](size_t nStart, size_t nEnd){
+		for (size_t i=nStart; i<nEnd; i++){
+			unsigned char nOld = pDst[i] == label ? 0 : pDst[i];
+			pDst[i] = pSrc[i] > 0 ? label : nOld;
 		}
-	}
+	});
+	m_brickTable.BuildMask(m_pMask.get());
+	m_pyramid.BuildMask(m_pMask.get());
 	return true;
 }
 
@@ -164,15 +464,32 @@ void VolumeInfo::NormVolumeData()
 	if (!m_pVolume)
 		return;
 
+	// the voxels are moved as bytes, whatever their type
+	size_t nVoxelBytes = GetVoxelBytes(m_voxelType);
 	if (Need2InvertZ())
 	{
-		int nSizeSlice = m_Dims[0] * m_Dims[1];
-		std::shared_ptr<short> pslice(new short[nSizeSlice]);
-		for (int i=0; i<m_Dims[2]/2; i++)
+		size_t nSliceBytes = (size_t)m_Dims[0] * m_Dims[1] * nVoxelBytes;
+		char* pVolume = (char*)m_pVolume.get();
+		if (m_bVolumeMapped)
+		{
+			// swapping in place would dirty every mapped page, copy the flipped slices out once instead
+			std::shared_ptr<char> pVolumeFlip(new char[nSliceBytes*m_Dims[2]], std::default_delete<char[]>());
+			for (int i=0; i<m_Dims[2]; i++)
+			{
+				memcpy(pVolumeFlip.get() + nSliceBytes * i, pVolume + nSliceBytes * (m_Dims[2]-1-i), nSliceBytes);
+			}
+			m_pVolume = pVolumeFlip;
+			m_bVolumeMapped = false;
+		}
+		else
 		{
-			memcpy(pslice.get(), m_pVolume.get() + nSizeSlice * i, nSizeSlice * sizeof(short));
-			memcpy(m_pVolume.get() + nSizeSlice * i, m_pVolume.get() + nSizeSlice * (m_Dims[2]-1-i), nSizeSlice * sizeof(short));
-			memcpy(m_pVolume.get() + nSizeSlice * (m_Dims[2] - 1 - i), pslice.get(), nSizeSlice * sizeof(short));
+			std::shared_ptr<char> pslice(new char[nSliceBytes], std::default_delete<char[]>());
+			for (int i=0; i<m_Dims[2]/2; i++)
+			{
+				memcpy(pslice.get(), pVolume + nSliceBytes * i, nSliceBytes);
+				memcpy(pVolume + nSliceBytes * i, pVolume + nSliceBytes * (m_Dims[2]-1-i), nSliceBytes);
+				memcpy(pVolume + nSliceBytes * (m_Dims[2] - 1 - i), pslice.get(), nSliceBytes);
+			}
 		}
 
 		m_dirZ = Direction3d(-m_dirZ.x(), -m_dirZ.y(), -m_dirZ.z());
@@ -222,7 +539,7 @@ void VolumeInfo::NormVolumeData()
 
 	//m_Dims[0] = nWidth;
 	//m_Dims[1] = nHeight;
-	std::shared_ptr<short> pVolumeExt(new short[nWidth*nHeight*m_Dims[2]]);
+	std::shared_ptr<char> pVolumeExt(new char[(size_t)nWidth*nHeight*m_Dims[2]*nVoxelBytes], std::default_delete<char[]>());
 	for (auto i=0; i<m_Dims[2]; i++)
 	{
 		double zdelta = i*m_Spacing[2];
@@ -242,31 +559,18 @@ void VolumeInfo::NormVolumeData()
 		int xShift = xdelta/m_Spacing[0];
 		int yShift = ydelta/m_Spacing[1];
 
-		short* pVolumeExt_slice = pVolumeExt.get() + nWidth*nHeight*i;
-		short* pVolume_slice = m_pVolume.get() + m_Dims[0]*m_Dims[1]*i;
+		// the source row lands at xShift and the rest of the row is zero, which is 0 or
+		// 0.0 for every voxel type
+		int nCopy = xShift < nWidth ? (m_Dims[0] < nWidth-xShift ? m_Dims[0] : nWidth-xShift) : 0;
+		char* pVolumeExt_slice = pVolumeExt.get() + (size_t)nWidth*nHeight*i*nVoxelBytes;
+		const char* pVolume_slice = (const char*)m_pVolume.get() + (size_t)m_Dims[0]*m_Dims[1]*i*nVoxelBytes;
 		for (auto y=0; y<nHeight; y++)
 		{
-			if (y<yShift || y>=yShift+m_Dims[1])
-			{
-				for (auto x=0; x<nWidth; x++)
-				{
-					pVolumeExt_slice[y*nWidth+x] = 0;
-				}
-			}
-			else
+			char* pRow = pVolumeExt_slice + (size_t)y*nWidth*nVoxelBytes;
+			memset(pRow, 0, nWidth*nVoxelBytes);
+			if (y>=yShift && y<yShift+m_Dims[1])
 			{
-				for (auto x=0; x<nWidth; x++)
-				{
-					if (x<xShift || x>=xShift+m_Dims[0])
-					{
-						pVolumeExt_slice[y*nWidth+x] = 0;
-					}
-					else
-					{
-						memcpy(pVolumeExt_slice+y*nWidth+x, pVolume_slice+m_Dims[0]*(y-yShift), m_Dims[0]*sizeof(short));
-						x += m_Dims[0];
-					}
-				}
+				memcpy(pRow + xShift*nVoxelBytes, pVolume_slice + (size_t)m_Dims[0]*(y-yShift)*nVoxelBytes, nCopy*nVoxelBytes);
 			}
 		}
 	}
@@ -275,6 +579,7 @@ void VolumeInfo::NormVolumeData()
 	m_Dims[1] = nHeight;
 	m_dirZ = dirNorm;
 	m_pVolume = pVolumeExt;
+	m_bVolumeMapped = false;
 }
 
 std::shared_ptr<unsigned char> VolumeInfo::NormMaskData(std::shared_ptr<unsigned char>pData)
@@ -284,8 +589,8 @@ std::shared_ptr<unsigned char> VolumeInfo::NormMaskData(std::shared_ptr<unsigned
 
 	if (m_bVolumeHasInverted)
 	{
-		int nSizeSlice = m_Dims[0] * m_Dims[1];
-		std::shared_ptr<unsigned char> pslice(new unsigned char[nSizeSlice]);
+		size_t nSizeSlice = (size_t)m_Dims[0] * m_Dims[1];
+		std::shared_ptr<unsigned char> pslice(new unsigned char[nSizeSlice], std::default_delete<unsigned char[]>());
 		for (int i=0; i<m_Dims[2]/2; i++)
 		{
 			memcpy(pslice.get(), pData.get() + nSizeSlice * i, nSizeSlice * sizeof(unsigned char));
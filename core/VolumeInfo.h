@@ -25,7 +25,11 @@
 #include "Direction.h"
 #include <memory>
 #include <string>
+#include <vector>
 #include "Defines.h"
+#include "BrickTable.h"
+#include "VolumePyramid.h"
+#include "BrickedVolume.h"
 
 namespace MonkeyGL {
 
@@ -37,33 +41,93 @@ namespace MonkeyGL {
 
     public:
         bool LoadVolumeFile(const char* szFile, int nWidth, int nHeight, int nDepth);
+        // the normalized 16 bit volume, mask and geometry as a brick compressed container, see
+        // VolumeContainer, other voxel types are rejected. a loaded container is used as stored, without NormVolumeData
+        bool SaveVolumeContainer(const char* szFile, const std::vector<unsigned char>& vecLabels);
+        bool LoadVolumeContainer(const char* szFile, std::vector<unsigned char>& vecLabels);
+        // loading in pieces: BeginVolume allocates the volume and applies the z flip of the
+        // normalization up front, SetVolumeSlices writes file slices into it, every slice
+        // of pSlices over nStride consecutive slices, updating the brick table and pyramid
+        // for them, and CommitVolumeSlices builds the bricked copy once the volume is complete
+        bool BeginVolume(int nWidth, int nHeight, int nDepth);
+        void SetVolumeSlices(const short* pSlices, int nFirst, int nCount, int nStride);
+        void CommitVolumeSlices(bool bComplete);
+        // off by default. raw files are mapped instead of read when enabled, the volume then aliases
+        // the page cache: the file must stay unchanged while the volume is loaded, truncating or
+        // replacing it makes the next access to the volume fault (SIGBUS)
+        void SetMemoryMapEnabled(bool bEnable){
+            m_bMemoryMapEnabled = bEnable;
+        }
+        bool IsVolumeMapped(){
+            return m_bVolumeMapped;
+        }
+        // the downsampled levels are built with the brick table when enabled
+        void SetPyramidEnabled(bool bEnable){
+            m_bPyramidEnabled = bEnable;
+        }
+        // a bricked copy is built with the brick table when enabled and the linear volume is
+        // released, GetVolumeData rebuilds it from the bricks on first use. planes drawn
+        // before that sample the linear volume
+        void SetBrickedLayoutEnabled(bool bEnable){
+            m_bBrickedEnabled = bEnable;
+        }
+        bool IsBrickedLayout(){
+            return m_bricked.IsValid();
+        }
+        BrickedVolume& GetBrickedVolume(){
+            return m_bricked;
+        }
         bool SetVolumeData(std::shared_ptr<short>pData, int nWidth, int nHeight, int nDepth);
+        // voxels of any VoxelType, kept in that type. the bricked layout, the containers
+        // and loading in pieces are for 16 bit volumes only
+        bool SetVolumeData(std::shared_ptr<void>pData, VoxelType type, int nWidth, int nHeight, int nDepth);
         bool AddNewObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
         bool UpdateObjectMask(std::shared_ptr<unsigned char>pData, int nWidth, int nHeight, int nDepth, const unsigned char& nLabel);
 
-        std::shared_ptr<short> GetVolumeData(){
-            return m_pVolume;
+        // the volume as shorts, a converted copy when the voxels are of another type
+        std::shared_ptr<short> GetVolumeData();
+        // the volume in its own type
+        std::shared_ptr<void> GetVoxelData();
+        VoxelType GetVoxelType(){
+            return m_voxelType;
         }
 
         std::shared_ptr<short> GetVolumeData(int& nWidth, int& nHeight, int& nDepth){
             nWidth = m_Dims[0];
             nHeight = m_Dims[1];
             nDepth = m_Dims[2];
-            return m_pVolume;
+            return GetVolumeData();
         }
 
         std::shared_ptr<unsigned char> GetMaskData(){
             return m_pMask;
         }
 
+        // the brick table, pyramid and bricked copy of a loaded volume are built on the first
+        // VR or LOD request rather than by the load, so planes of a mapped volume page in
+        // only the voxels they sample
+        BrickTable& GetBrickTable(){
+            BuildPendingAccelerations();
+            return m_brickTable;
+        }
+
+        VolumePyramid& GetVolumePyramid(){
+            BuildPendingAccelerations();
+            return m_pyramid;
+        }
+        // pyramid level for an output of fPixelSpacing mm per pixel, 0 is full resolution.
+        // finer outputs need no pyramid and leave it unbuilt
+        int SelectLevel(double fPixelSpacing);
+
         void Clear();
 
         void SetDirection(Direction3d dirX, Direction3d dirY, Direction3d dirZ);
-        int GetVolumeSize(){
-            return m_Dims[0]*m_Dims[1]*m_Dims[2];
+        // voxel count, 64 bit: a 1024x1024x2048 volume already has 2^31 voxels
+        size_t GetVolumeSize(){
+            return (size_t)m_Dims[0]*m_Dims[1]*m_Dims[2];
         }
-        int GetVolumeBytes(){
-            return GetVolumeSize()*sizeof(short);
+        size_t GetVolumeBytes(){
+            return GetVolumeSize()*GetVoxelBytes(m_voxelType);
         }
         void SetSpacing(double x, double y, double z){
             m_Spacing[0] = x;
@@ -75,7 +139,7 @@ namespace MonkeyGL {
         }
 
         bool HasVolumeData(){
-            return bool(m_pVolume);
+            return bool(m_pVolume) || m_bricked.IsValid();
         }
 
         int GetDim(int index){
@@ -99,7 +163,21 @@ namespace MonkeyGL {
         std::shared_ptr<unsigned char> NormMaskData(std::shared_ptr<unsigned char>pData);
 
     private:
-        std::shared_ptr<short> m_pVolume;
+        std::shared_ptr<short> MapVolumeFile(const char* szFile, size_t nBytes);
+        std::shared_ptr<short> ReadVolumeFile(const char* szFile, size_t nBytes);
+        // brick table, pyramid and bricked copy of a freshly loaded m_pVolume
+        void BuildAccelerations(bool bBricked = true);
+        // drops those of the previous volume, BuildPendingAccelerations makes them on first use
+        void DeferAccelerations();
+        void BuildPendingAccelerations();
+        // replaces m_pVolume by the bricked copy when that layout is enabled
+        void BuildBrickedLayout();
+
+    private:
+        std::shared_ptr<void> m_pVolume;
+        VoxelType m_voxelType;
+        bool m_bMemoryMapEnabled;
+        bool m_bVolumeMapped;
         bool m_bVolumeHasInverted;
         std::shared_ptr<unsigned char> m_pMask;
         double m_fSliceThickness; //mm
@@ -109,6 +187,12 @@ namespace MonkeyGL {
         Direction3d m_dirX;
         Direction3d m_dirY;
         Direction3d m_dirZ;
+        BrickTable m_brickTable;
+        bool m_bPyramidEnabled;
+        VolumePyramid m_pyramid;
+        bool m_bBrickedEnabled;
+        BrickedVolume m_bricked;
+        bool m_bAccelerationsPending;
     };
 
 }
\ No newline at end of file
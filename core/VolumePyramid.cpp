@@ -0,0 +1,289 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "VolumePyramid.h"
+#include <cstring>
+#include "ThreadPool.h"
+#include "StopWatch.h"
+#include "Logger.h"
+
+using namespace MonkeyGL;
+
+namespace {
+	// levels stop once a side would be shorter than this
+	const int c_nMinSize = 16;
+
+	// each output voxel takes the 2x2x2 block below it, an odd last block repeats its
+	// last voxel. intensities are box filtered, labels take the most frequent one.
+	// only the output slices zFirst..zLast are written
+	template <typename T, typename Reduce>
+	void Downsample(T* pDst, const int* pDstDims, const T* pSrc, const int* pSrcDims, Reduce reduce, int zFirst, int zLast)
+	{
+		ThreadPool::Instance()->ParallelFor(zFirst, zLast+1, [&](int z){
+			int z0 = 2*z;
+			int z1 = z0+1 < pSrcDims[2] ? z0+1 : z0;
+			for (int y=0; y<pDstDims[1]; y++)
+			{
+				int y0 = 2*y;
+				int y1 = y0+1 < pSrcDims[1] ? y0+1 : y0;
+				const T* pRows[4] = {
+					pSrc + ((long long)z0*pSrcDims[1] + y0)*pSrcDims[0],
+					pSrc + ((long long)z0*pSrcDims[1] + y1)*pSrcDims[0],
+					pSrc + ((long long)z1*pSrcDims[1] + y0)*pSrcDims[0],
+					pSrc + ((long long)z1*pSrcDims[1] + y1)*pSrcDims[0]
+				};
+				T* pDstRow = pDst + ((long long)z*pDstDims[1] + y)*pDstDims[0];
+				for (int x=0; x<pDstDims[0]; x++)
+				{
+					int x0 = 2*x;
+					int x1 = x0+1 < pSrcDims[0] ? x0+1 : x0;
+					T v[8] = {
+						pRows[0][x0], pRows[0][x1], pRows[1][x0], pRows[1][x1],
+						pRows[2][x0], pRows[2][x1], pRows[3][x0], pRows[3][x1]
+					};
+					pDstRow[x] = reduce(v);
+				}
+			}
+		});
+	}
+
+	template <typename T>
+	inline T BoxFilter(const T* v)
+	{
+		long long nSum = (long long)v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+		// round half away from zero, as the sum may be signed
+		return (T)(nSum >= 0 ? (nSum + 4) >> 3 : -((-nSum + 4) >> 3));
+	}
+
+	template <>
+	inline float BoxFilter<float>(const float* v)
+	{
+		return (v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7])*0.125f;
+	}
+
+	inline unsigned char ModeFilter(const unsigned char* v)
+	{
+		if (v[0] == v[1] && v[0] == v[2] && v[0] == v[3] && v[0] == v[4] && v[0] == v[5] && v[0] == v[6] && v[0] == v[7])
+			return v[0];
+
+		// ties go to the larger label, so thin objects survive against the background
+		unsigned char nMode = 0;
+		int nModeCount = 0;
+		for (int i=0; i<8; i++)
+		{
+			int nCount = 0;
+			for (int j=0; j<8; j++)
+				nCount += v[j] == v[i] ? 1 : 0;
+			if (nCount > nModeCount || (nCount == nModeCount && v[i] > nMode))
+			{
+				nMode = v[i];
+				nModeCount = nCount;
+			}
+		}
+		return nMode;
+	}
+}
+
+VolumePyramid::VolumePyramid(void)
+{
+	Clear();
+}
+
+VolumePyramid::~VolumePyramid(void)
+{
+}
+
+void VolumePyramid::Clear()
+{
+	memset(m_Dims, 0, 3*sizeof(int));
+	m_voxelType = VoxelTypeInt16;
+	m_levels.clear();
+}
+
+bool VolumePyramid::Build(const short* pVolume, int nWidth, int nHeight, int nDepth)
+{
+	return Build(pVolume, VoxelTypeInt16, nWidth, nHeight, nDepth);
+}
+
+bool VolumePyramid::Build(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	StopWatch sw("VolumePyramid::Build");
+	Clear();
+	if (NULL == pVolume || nWidth<=0 || nHeight<=0 || nDepth<=0)
+		return false;
+
+	m_Dims[0] = nWidth;
+	m_Dims[1] = nHeight;
+	m_Dims[2] = nDepth;
+	m_voxelType = type;
+	switch (type)
+	{
+	case VoxelTypeUInt8:
+		BuildLevels((const unsigned char*)pVolume);
+		break;
+	case VoxelTypeUInt16:
+		BuildLevels((const unsigned short*)pVolume);
+		break;
+	case VoxelTypeInt32:
+		BuildLevels((const int*)pVolume);
+		break;
+	case VoxelTypeFloat32:
+		BuildLevels((const float*)pVolume);
+		break;
+	default:
+		BuildLevels((const short*)pVolume);
+		break;
+	}
+	return true;
+}
+
+template <typename T>
+void VolumePyramid::BuildLevels(const T* pVolume)
+{
+	// the loop keeps pointers into the previous level
+	m_levels.reserve(LEVEL_COUNT-1);
+	const T* pSrc = pVolume;
+	const int* pSrcDims = m_Dims;
+	for (int nLevel=1; nLevel<LEVEL_COUNT; nLevel++)
+	{
+		if (pSrcDims[0] < 2*c_nMinSize || pSrcDims[1] < 2*c_nMinSize || pSrcDims[2] < 2*c_nMinSize)
+			break;
+
+		m_levels.push_back(Level());
+		Level& level = m_levels.back();
+		for (int i=0; i<3; i++)
+			level.nDims[i] = (pSrcDims[i] + 1)/2;
+		level.nVoxels = (size_t)level.nDims[0]*level.nDims[1]*level.nDims[2];
+		level.vecVolume.resize(level.nVoxels*sizeof(T));
+		T* pDst = (T*)&level.vecVolume[0];
+		Downsample(pDst, level.nDims, pSrc, pSrcDims, BoxFilter<T>, 0, level.nDims[2]-1);
+
+		pSrc = pDst;
+		pSrcDims = level.nDims;
+		Logger::Info("VolumePyramid::Build: level[%d], size[%d, %d, %d]", nLevel, level.nDims[0], level.nDims[1], level.nDims[2]);
+	}
+}
+
+bool VolumePyramid::UpdateSlices(const void* pVolume, int nFirst, int nLast)
+{
+	if (m_levels.empty() || NULL == pVolume)
+		return false;
+
+	nFirst = nFirst < 0 ? 0 : nFirst;
+	nLast = nLast > m_Dims[2]-1 ? m_Dims[2]-1 : nLast;
+	if (nFirst > nLast)
+		return true;
+
+	switch (m_voxelType)
+	{
+	case VoxelTypeUInt8:
+		UpdateLevels((const unsigned char*)pVolume, nFirst, nLast);
+		break;
+	case VoxelTypeUInt16:
+		UpdateLevels((const unsigned short*)pVolume, nFirst, nLast);
+		break;
+	case VoxelTypeInt32:
+		UpdateLevels((const int*)pVolume, nFirst, nLast);
+		break;
+	case VoxelTypeFloat32:
+		UpdateLevels((const float*)pVolume, nFirst, nLast);
+		break;
+	default:
+		UpdateLevels((const short*)pVolume, nFirst, nLast);
+		break;
+	}
+	return true;
+}
+
+template <typename T>
+void VolumePyramid::UpdateLevels(const T* pVolume, int nFirst, int nLast)
+{
+	// slice z of a level is made from slices 2z and 2z+1 of the one below
+	const T* pSrc = pVolume;
+	const int* pSrcDims = m_Dims;
+	for (size_t i=0; i<m_levels.size(); i++)
+	{
+		Level& level = m_levels[i];
+		nFirst /= 2;
+		nLast /= 2;
+		T* pDst = (T*)&level.vecVolume[0];
+		Downsample(pDst, level.nDims, pSrc, pSrcDims, BoxFilter<T>, nFirst, nLast);
+		pSrc = pDst;
+		pSrcDims = level.nDims;
+	}
+}
+
+bool VolumePyramid::BuildMask(const unsigned char* pMask)
+{
+	if (m_levels.empty())
+		return false;
+
+	if (NULL == pMask)
+	{
+		for (size_t i=0; i<m_levels.size(); i++)
+			m_levels[i].vecMask.clear();
+		return true;
+	}
+
+	StopWatch sw("VolumePyramid::BuildMask");
+	const unsigned char* pSrc = pMask;
+	const int* pSrcDims = m_Dims;
+	for (size_t i=0; i<m_levels.size(); i++)
+	{
+		Level& level = m_levels[i];
+		level.vecMask.resize(level.nVoxels);
+		Downsample(&level.vecMask[0], level.nDims, pSrc, pSrcDims, ModeFilter, 0, level.nDims[2]-1);
+		pSrc = &level.vecMask[0];
+		pSrcDims = level.nDims;
+	}
+	return true;
+}
+
+const void* VolumePyramid::GetVolumeData(int nLevel)
+{
+	if (nLevel < 1 || nLevel > (int)m_levels.size())
+		return NULL;
+	return &m_levels[nLevel-1].vecVolume[0];
+}
+
+const unsigned char* VolumePyramid::GetMaskData(int nLevel)
+{
+	if (nLevel < 1 || nLevel > (int)m_levels.size() || m_levels[nLevel-1].vecMask.empty())
+		return NULL;
+	return &m_levels[nLevel-1].vecMask[0];
+}
+
+int VolumePyramid::GetDim(int nLevel, int index)
+{
+	if (nLevel < 1 || nLevel > (int)m_levels.size())
+		return m_Dims[index];
+	return m_levels[nLevel-1].nDims[index];
+}
+
+int VolumePyramid::SelectLevel(double fPixelSpacing, double fMinSpacing)
+{
+	int nLevel = 0;
+	if (fMinSpacing <= 0.0)
+		return nLevel;
+	while (nLevel+1 < GetLevelCount() && fMinSpacing*(2 << nLevel) <= fPixelSpacing)
+		nLevel++;
+	return nLevel;
+}
@@ -0,0 +1,84 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <vector>
+#include "Defines.h"
+
+namespace MonkeyGL {
+
+    // 2x and 4x downsampled copies of the volume and of the label mask. every level
+    // spans the same physical extent as level 0, so normalized coordinates carry over
+    // and a level is picked by comparing the output pixel spacing to its voxel spacing.
+    class VolumePyramid
+    {
+    public:
+        VolumePyramid(void);
+        ~VolumePyramid(void);
+
+    public:
+        // level 0 is the volume itself and is not stored here
+        static const int LEVEL_COUNT = 3;
+
+        void Clear();
+        bool Build(const short* pVolume, int nWidth, int nHeight, int nDepth);
+        // the levels keep the voxel type of the volume
+        bool Build(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth);
+        bool BuildMask(const unsigned char* pMask);
+        // slices nFirst..nLast of the volume were rewritten in place, the level slices
+        // made from them are filtered again. the levels keep their addresses
+        bool UpdateSlices(const void* pVolume, int nFirst, int nLast);
+
+        // number of levels available, including level 0, 1 when nothing is built
+        int GetLevelCount(){
+            return 1 + (int)m_levels.size();
+        }
+        // NULL for level 0 and for levels that are not built
+        const void* GetVolumeData(int nLevel);
+        VoxelType GetVoxelType(){
+            return m_voxelType;
+        }
+        const unsigned char* GetMaskData(int nLevel);
+        int GetDim(int nLevel, int index);
+
+        // the coarsest level whose voxels are not larger than the output pixels
+        int SelectLevel(double fPixelSpacing, double fMinSpacing);
+
+    private:
+        template <typename T>
+        void BuildLevels(const T* pVolume);
+        template <typename T>
+        void UpdateLevels(const T* pVolume, int nFirst, int nLast);
+
+    private:
+        struct Level
+        {
+            int nDims[3];
+            size_t nVoxels;
+            // voxels of m_voxelType
+            std::vector<unsigned char> vecVolume;
+            std::vector<unsigned char> vecMask;
+        };
+        int m_Dims[3];
+        VoxelType m_voxelType;
+        std::vector<Level> m_levels;
+    };
+}
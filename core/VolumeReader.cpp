@@ -0,0 +1,949 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "VolumeReader.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <zlib.h>
+#include "ThreadPool.h"
+#include "StopWatch.h"
+#include "Logger.h"
+
+using namespace MonkeyGL;
+
+namespace {
+
+	const size_t kInflateChunk = 1 << 20;
+	const size_t kConvertBlock = 1 << 20;
+
+	std::string ToLower(std::string str)
+	{
+		for (size_t i=0; i<str.size(); i++)
+			str[i] = (char)tolower((unsigned char)str[i]);
+		return str;
+	}
+
+	std::string Trim(const std::string& str)
+	{
+		size_t nBegin = str.find_first_not_of(" \t\r\n");
+		if (nBegin == std::string::npos)
+			return std::string();
+		size_t nEnd = str.find_last_not_of(" \t\r\n");
+		return str.substr(nBegin, nEnd - nBegin + 1);
+	}
+
+	bool EndsWith(const std::string& str, const char* szSuffix)
+	{
+		size_t nLen = strlen(szSuffix);
+		return str.size() >= nLen && str.compare(str.size() - nLen, nLen, szSuffix) == 0;
+	}
+
+	bool IsLittleEndian()
+	{
+		const unsigned short nValue = 1;
+		return *(const unsigned char*)&nValue == 1;
+	}
+
+	long long GetFileSize(FILE* fp)
+	{
+		if (SeekFile(fp, 0, SEEK_END) != 0)
+			return -1;
+		return TellFile(fp);
+	}
+
+	VolumeReader::VoxelType ParseNrrdType(const std::string& strType)
+	{
+		static const struct { const char* szName; VolumeReader::VoxelType type; } types[] = {
+			{"signed char", VolumeReader::VoxelInt8}, {"int8", VolumeReader::VoxelInt8}, {"int8_t", VolumeReader::VoxelInt8},
+			{"uchar", VolumeReader::VoxelUInt8}, {"unsigned char", VolumeReader::VoxelUInt8},
+			{"uint8", VolumeReader::VoxelUInt8}, {"uint8_t", VolumeReader::VoxelUInt8},
+			{"short", VolumeReader::VoxelInt16}, {"short int", VolumeReader::VoxelInt16},
+			{"signed short", VolumeReader::VoxelInt16}, {"signed short int", VolumeReader::VoxelInt16},
+			{"int16", VolumeReader::VoxelInt16}, {"int16_t", VolumeReader::VoxelInt16},
+			{"ushort", VolumeReader::VoxelUInt16}, {"unsigned short", VolumeReader::VoxelUInt16},
+			{"unsigned short int", VolumeReader::VoxelUInt16}, {"uint16", VolumeReader::VoxelUInt16}, {"uint16_t", VolumeReader::VoxelUInt16},
+			{"int", VolumeReader::VoxelInt32}, {"signed int", VolumeReader::VoxelInt32},
+			{"int32", VolumeReader::VoxelInt32}, {"int32_t", VolumeReader::VoxelInt32},
+			{"uint", VolumeReader::VoxelUInt32}, {"unsigned int", VolumeReader::VoxelUInt32},
+			{"uint32", VolumeReader::VoxelUInt32}, {"uint32_t", VolumeReader::VoxelUInt32},
+			{"longlong", VolumeReader::VoxelInt64}, {"long long", VolumeReader::VoxelInt64},
+			{"long long int", VolumeReader::VoxelInt64}, {"signed long long", VolumeReader::VoxelInt64},
+			{"signed long long int", VolumeReader::VoxelInt64}, {"int64", VolumeReader::VoxelInt64}, {"int64_t", VolumeReader::VoxelInt64},
+			{"ulonglong", VolumeReader::VoxelUInt64}, {"unsigned long long", VolumeReader::VoxelUInt64},
+			{"unsigned long long int", VolumeReader::VoxelUInt64}, {"uint64", VolumeReader::VoxelUInt64}, {"uint64_t", VolumeReader::VoxelUInt64},
+			{"float", VolumeReader::VoxelFloat32}, {"double", VolumeReader::VoxelFloat64}
+		};
+		for (size_t i=0; i<sizeof(types)/sizeof(types[0]); i++){
+			if (strType == types[i].szName)
+				return types[i].type;
+		}
+		return VolumeReader::VoxelUnknown;
+	}
+
+	VolumeReader::VoxelType ParseNiftiType(short nDataType)
+	{
+		switch (nDataType)
+		{
+		case 2: return VolumeReader::VoxelUInt8;
+		case 4: return VolumeReader::VoxelInt16;
+		case 8: return VolumeReader::VoxelInt32;
+		case 16: return VolumeReader::VoxelFloat32;
+		case 64: return VolumeReader::VoxelFloat64;
+		case 256: return VolumeReader::VoxelInt8;
+		case 512: return VolumeReader::VoxelUInt16;
+		case 768: return VolumeReader::VoxelUInt32;
+		case 1024: return VolumeReader::VoxelInt64;
+		case 1280: return VolumeReader::VoxelUInt64;
+		default: return VolumeReader::VoxelUnknown;
+		}
+	}
+
+	// parses "(x,y,z) (x,y,z) (x,y,z)", an axis without a direction is "none"
+	bool ParseNrrdVectors(const std::string& strValue, double vecs[3][3])
+	{
+		size_t nPos = 0;
+		for (int i=0; i<3; i++){
+			size_t nOpen = strValue.find('(', nPos);
+			if (nOpen == std::string::npos)
+				return false;
+			size_t nClose = strValue.find(')', nOpen);
+			if (nClose == std::string::npos)
+				return false;
+			std::string strVec = strValue.substr(nOpen + 1, nClose - nOpen - 1);
+			if (sscanf(strVec.c_str(), "%lf ,%lf ,%lf", &vecs[i][0], &vecs[i][1], &vecs[i][2]) != 3)
+				return false;
+			nPos = nClose + 1;
+		}
+		return true;
+	}
+
+	void SwapBytes(char* pData, size_t nVoxelBytes, size_t nVoxels)
+	{
+		if (nVoxelBytes <= 1)
+			return;
+		ThreadPool::Instance()->ParallelForBlocks(nVoxels, kConvertBlock, [&](size_t nBegin, size_t nEnd){
+			for (size_t i=nBegin; i<nEnd; i++){
+				char* p = pData + i*nVoxelBytes;
+				std::reverse(p, p + nVoxelBytes);
+			}
+		});
+	}
+
+	template <typename TSrc, typename TDst>
+	void ConvertVoxels(const char* pSrcBytes, char* pDstBytes, size_t nVoxels, double fSlope, double fIntercept)
+	{
+		const TSrc* pSrc = (const TSrc*)pSrcBytes;
+		TDst* pDst = (TDst*)pDstBytes;
+		const double fMin = (double)std::numeric_limits<TDst>::min();
+		const double fMax = (double)std::numeric_limits<TDst>::max();
+		ThreadPool::Instance()->ParallelForBlocks(nVoxels, kConvertBlock, [&](size_t nBegin, size_t nEnd){
+			for (size_t i=nBegin; i<nEnd; i++){
+				double fValue = (double)pSrc[i]*fSlope + fIntercept;
+				// float voxels keep the fraction, integers are rounded and clamped
+				if (std::numeric_limits<TDst>::is_integer){
+					fValue = floor(fValue + 0.5);
+					if (!(fValue >= fMin))
+						fValue = fMin;
+					else if (fValue > fMax)
+						fValue = fMax;
+				}
+				pDst[i] = (TDst)fValue;
+			}
+		});
+	}
+
+	template <typename TDst>
+	bool ConvertVoxels(VolumeReader::VoxelType type, const char* pSrc, char* pDst, size_t nVoxels, double fSlope, double fIntercept)
+	{
+		switch (type)
+		{
+		case VolumeReader::VoxelInt8: ConvertVoxels<signed char, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelUInt8: ConvertVoxels<unsigned char, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelInt16: ConvertVoxels<short, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelUInt16: ConvertVoxels<unsigned short, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelInt32: ConvertVoxels<int, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelUInt32: ConvertVoxels<unsigned int, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelInt64: ConvertVoxels<long long, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelUInt64: ConvertVoxels<unsigned long long, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelFloat32: ConvertVoxels<float, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		case VolumeReader::VoxelFloat64: ConvertVoxels<double, TDst>(pSrc, pDst, nVoxels, fSlope, fIntercept); break;
+		default: return false;
+		}
+		return true;
+	}
+
+	// one bgzip member: a gzip member carrying its compressed size in the "BC" extra field
+	struct GzipMember
+	{
+		size_t nDeflate;
+		size_t nDeflateSize;
+		size_t nStream;
+		size_t nStreamSize;
+	};
+
+	bool IsBgzfHeader(const unsigned char* p, size_t nSize)
+	{
+		return nSize >= 16 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && (p[3] & 4) &&
+			(p[10] | (p[11] << 8)) >= 6 && p[12] == 'B' && p[13] == 'C';
+	}
+
+	bool ParseBgzfMember(const unsigned char* pData, size_t nSize, size_t nPos, GzipMember& member, size_t& nNext)
+	{
+		if (nSize - nPos < 18)
+			return false;
+		const unsigned char* p = pData + nPos;
+		if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+			return false;
+		size_t nXLen = p[10] | (p[11] << 8);
+		if (nSize - nPos < 12 + nXLen)
+			return false;
+
+		long long nBlockSize = -1;
+		size_t nField = 12;
+		while (nField + 4 <= 12 + nXLen){
+			size_t nLen = p[nField + 2] | (p[nField + 3] << 8);
+			if (p[nField] == 'B' && p[nField + 1] == 'C' && nLen == 2 && nField + 6 <= 12 + nXLen)
+				nBlockSize = (p[nField + 4] | (p[nField + 5] << 8)) + 1;
+			nField += 4 + nLen;
+		}
+		if (nBlockSize < 0 || (size_t)nBlockSize > nSize - nPos)
+			return false;
+
+		size_t nHeader = 12 + nXLen;
+		if (p[3] & 8){
+			while (nHeader < (size_t)nBlockSize && p[nHeader] != 0)
+				nHeader++;
+			nHeader++;
+		}
+		if (p[3] & 16){
+			while (nHeader < (size_t)nBlockSize && p[nHeader] != 0)
+				nHeader++;
+			nHeader++;
+		}
+		if (p[3] & 2)
+			nHeader += 2;
+		if (nHeader + 8 > (size_t)nBlockSize)
+			return false;
+
+		const unsigned char* pTrailer = p + nBlockSize - 4;
+		member.nDeflate = nPos + nHeader;
+		member.nDeflateSize = nBlockSize - nHeader - 8;
+		member.nStreamSize = pTrailer[0] | (pTrailer[1] << 8) | (pTrailer[2] << 16) | ((size_t)pTrailer[3] << 24);
+		nNext = nPos + nBlockSize;
+		return true;
+	}
+
+	bool InflateRaw(const unsigned char* pIn, size_t nIn, unsigned char* pOut, size_t nOut)
+	{
+		z_stream strm;
+		memset(&strm, 0, sizeof(strm));
+		if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+			return false;
+		strm.next_in = (Bytef*)pIn;
+		strm.avail_in = (uInt)nIn;
+		strm.next_out = pOut;
+		strm.avail_out = (uInt)nOut;
+		int nRet = inflate(&strm, Z_FINISH);
+		bool bOK = nRet == Z_STREAM_END && strm.avail_out == 0;
+		inflateEnd(&strm);
+		return bOK;
+	}
+
+	long long SkipLines(FILE* fp, long long nOffset, long long nLines)
+	{
+		if (SeekFile(fp, nOffset, SEEK_SET) != 0)
+			return -1;
+		for (long long i=0; i<nLines; i++){
+			int c = 0;
+			while ((c = fgetc(fp)) != EOF && c != '\n');
+			if (c == EOF)
+				return -1;
+		}
+		return TellFile(fp);
+	}
+}
+
+bool VolumeReader::ReadVolume(const char* szFile, VolumeHeader& header, std::shared_ptr<short>& pData)
+{
+	StopWatch sw("VolumeReader::ReadVolume");
+
+	Layout layout;
+	if (!ReadHeader(szFile, header, layout))
+		return false;
+
+	size_t nVoxels = (size_t)header.dims[0]*header.dims[1]*header.dims[2];
+	std::shared_ptr<short> pVolume(new short[nVoxels], std::default_delete<short[]>());
+	if (!ReadVoxels(layout, nVoxels, VoxelInt16, (char*)pVolume.get()))
+		return false;
+
+	pData = pVolume;
+	Logger::Info("volume file loaded: %s, %dx%dx%d", szFile, header.dims[0], header.dims[1], header.dims[2]);
+	return true;
+}
+
+bool VolumeReader::ReadVolume(const char* szFile, VolumeHeader& header, std::shared_ptr<void>& pData, MonkeyGL::VoxelType& type)
+{
+	StopWatch sw("VolumeReader::ReadVolume");
+
+	Layout layout;
+	if (!ReadHeader(szFile, header, layout))
+		return false;
+
+	VoxelType dstType = GetVolumeType(layout);
+	size_t nVoxels = (size_t)header.dims[0]*header.dims[1]*header.dims[2];
+	std::shared_ptr<char> pVolume(new char[nVoxels*GetVoxelBytes(dstType)], std::default_delete<char[]>());
+	if (!ReadVoxels(layout, nVoxels, dstType, pVolume.get()))
+		return false;
+
+	switch (dstType)
+	{
+	case VoxelUInt8:
+		type = MonkeyGL::VoxelTypeUInt8;
+		break;
+	case VoxelUInt16:
+		type = MonkeyGL::VoxelTypeUInt16;
+		break;
+	case VoxelInt32:
+		type = MonkeyGL::VoxelTypeInt32;
+		break;
+	case VoxelFloat32:
+		type = MonkeyGL::VoxelTypeFloat32;
+		break;
+	default:
+		type = MonkeyGL::VoxelTypeInt16;
+		break;
+	}
+	pData = pVolume;
+	Logger::Info("volume file loaded: %s, %dx%dx%d, voxel type %d", szFile, header.dims[0], header.dims[1], header.dims[2], (int)type);
+	return true;
+}
+
+bool VolumeReader::ReadMask(const char* szFile, VolumeHeader& header, std::shared_ptr<unsigned char>& pData)
+{
+	StopWatch sw("VolumeReader::ReadMask");
+
+	Layout layout;
+	if (!ReadHeader(szFile, header, layout))
+		return false;
+
+	size_t nVoxels = (size_t)header.dims[0]*header.dims[1]*header.dims[2];
+	std::shared_ptr<unsigned char> pMask(new unsigned char[nVoxels], std::default_delete<unsigned char[]>());
+	if (!ReadVoxels(layout, nVoxels, VoxelUInt8, (char*)pMask.get()))
+		return false;
+
+	pData = pMask;
+	return true;
+}
+
+bool VolumeReader::ReadHeader(const char* szFile, VolumeHeader& header, Layout& layout)
+{
+	if (!szFile)
+		return false;
+
+	std::string strFile = ToLower(szFile);
+	bool bOK = false;
+	if (EndsWith(strFile, ".nrrd") || EndsWith(strFile, ".nhdr")){
+		bOK = ReadNrrdHeader(szFile, header, layout);
+	}
+	else if (EndsWith(strFile, ".nii") || EndsWith(strFile, ".nii.gz")){
+		bOK = ReadNiftiHeader(szFile, header, layout);
+	}
+	else{
+		Logger::Warn("unknown volume file format: %s", szFile);
+		return false;
+	}
+	if (!bOK)
+		return false;
+
+	if (header.dims[0] <= 0 || header.dims[1] <= 0 || header.dims[2] <= 0){
+		Logger::Warn("invalid volume size[%d, %d, %d] in %s", header.dims[0], header.dims[1], header.dims[2], szFile);
+		return false;
+	}
+	if (layout.type == VoxelUnknown){
+		Logger::Warn("unsupported voxel type in %s", szFile);
+		return false;
+	}
+	return true;
+}
+
+bool VolumeReader::ReadNrrdHeader(const char* szFile, VolumeHeader& header, Layout& layout)
+{
+	std::ifstream ifs(szFile, std::ios::binary);
+	if (!ifs.is_open()){
+		Logger::Warn("failed to open volume file: %s", szFile);
+		return false;
+	}
+
+	std::string strLine;
+	if (!std::getline(ifs, strLine) || strLine.compare(0, 7, "NRRD000") != 0){
+		Logger::Warn("not a nrrd file: %s", szFile);
+		return false;
+	}
+
+	int nDimension = 0;
+	bool bDirections = false;
+	bool bAttached = false;
+	double vecs[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+	double fFlip[3] = {1, 1, 1};
+	std::string strEncoding = "raw";
+	std::string strEndian = IsLittleEndian() ? "little" : "big";
+	long long nByteSkip = 0;
+
+	while (std::getline(ifs, strLine)){
+		if (!strLine.empty() && strLine[strLine.size() - 1] == '\r')
+			strLine.erase(strLine.size() - 1);
+		if (strLine.empty()){
+			bAttached = true;
+			break;
+		}
+		if (strLine[0] == '#')
+			continue;
+
+		size_t nColon = strLine.find(": ");
+		if (nColon == std::string::npos || strLine.find(":=") < nColon)
+			continue;
+		std::string strKey = ToLower(Trim(strLine.substr(0, nColon)));
+		std::string strValue = Trim(strLine.substr(nColon + 2));
+
+		if (strKey == "type"){
+			layout.type = ParseNrrdType(ToLower(strValue));
+		}
+		else if (strKey == "dimension"){
+			nDimension = atoi(strValue.c_str());
+		}
+		else if (strKey == "sizes"){
+			sscanf(strValue.c_str(), "%d %d %d", &header.dims[0], &header.dims[1], &header.dims[2]);
+		}
+		else if (strKey == "spacings"){
+			sscanf(strValue.c_str(), "%lf %lf %lf", &header.spacing[0], &header.spacing[1], &header.spacing[2]);
+		}
+		else if (strKey == "space directions"){
+			bDirections = ParseNrrdVectors(strValue, vecs);
+			if (!bDirections)
+				Logger::Warn("invalid space directions in %s: %s", szFile, strValue.c_str());
+		}
+		else if (strKey == "space"){
+			// directions are kept in LPS like the dicom series the raw volumes come from
+			std::string strSpace = ToLower(strValue);
+			if (strSpace == "right-anterior-superior" || strSpace == "ras"){
+				fFlip[0] = fFlip[1] = -1;
+			}
+			else if (strSpace == "left-anterior-superior" || strSpace == "las"){
+				fFlip[1] = -1;
+			}
+		}
+		else if (strKey == "encoding"){
+			strEncoding = ToLower(strValue);
+		}
+		else if (strKey == "endian"){
+			strEndian = ToLower(strValue);
+		}
+		else if (strKey == "byte skip" || strKey == "byteskip"){
+			nByteSkip = atoll(strValue.c_str());
+		}
+		else if (strKey == "line skip" || strKey == "lineskip"){
+			layout.nLineSkip = atoll(strValue.c_str());
+		}
+		else if (strKey == "data file" || strKey == "datafile"){
+			if (strValue.compare(0, 4, "LIST") == 0 || strValue.find('%') != std::string::npos){
+				Logger::Warn("nrrd data file lists are not supported: %s", szFile);
+				return false;
+			}
+			layout.strDataFile = strValue;
+		}
+	}
+
+	if (nDimension != 3){
+		Logger::Warn("only 3 dimensional nrrd files are supported, %s has %d", szFile, nDimension);
+		return false;
+	}
+
+	if (layout.strDataFile.empty()){
+		if (!bAttached){
+			Logger::Warn("nrrd header without data: %s", szFile);
+			return false;
+		}
+		layout.strDataFile = szFile;
+		layout.nFileOffset = (long long)ifs.tellg();
+	}
+	else if (layout.strDataFile[0] != '/'){
+		std::string strHeader = szFile;
+		size_t nSlash = strHeader.find_last_of('/');
+		if (nSlash != std::string::npos)
+			layout.strDataFile = strHeader.substr(0, nSlash + 1) + layout.strDataFile;
+	}
+
+	if (strEncoding == "gzip" || strEncoding == "gz"){
+		layout.bGzip = true;
+		if (nByteSkip < 0){
+			Logger::Warn("byte skip -1 needs raw encoding: %s", szFile);
+			return false;
+		}
+		layout.nStreamOffset = nByteSkip;
+	}
+	else if (strEncoding == "raw"){
+		// -1 places the data at the end of the file
+		layout.nStreamOffset = nByteSkip;
+	}
+	else{
+		Logger::Warn("unsupported nrrd encoding %s: %s", strEncoding.c_str(), szFile);
+		return false;
+	}
+	layout.bSwapBytes = (strEndian == "big") == IsLittleEndian();
+
+	if (bDirections){
+		Direction3d* pDirs[3] = {&header.dirX, &header.dirY, &header.dirZ};
+		for (int i=0; i<3; i++){
+			double fLen = sqrt(vecs[i][0]*vecs[i][0] + vecs[i][1]*vecs[i][1] + vecs[i][2]*vecs[i][2]);
+			if (fLen <= 0){
+				Logger::Warn("zero length space direction in %s", szFile);
+				return false;
+			}
+			header.spacing[i] = fLen;
+			*pDirs[i] = Direction3d(fFlip[0]*vecs[i][0], fFlip[1]*vecs[i][1], fFlip[2]*vecs[i][2]);
+		}
+	}
+	return true;
+}
+
+bool VolumeReader::ReadNiftiHeader(const char* szFile, VolumeHeader& header, Layout& layout)
+{
+	const size_t nHeaderSize = 348;
+	unsigned char buf[nHeaderSize];
+
+	FILE* fp = fopen(szFile, "rb");
+	if (!fp){
+		Logger::Warn("failed to open volume file: %s", szFile);
+		return false;
+	}
+	unsigned char magic[2] = {0, 0};
+	size_t nMagic = fread(magic, 1, 2, fp);
+	fclose(fp);
+	layout.bGzip = nMagic == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+	layout.strDataFile = szFile;
+
+	bool bRead = layout.bGzip ? InflateStream(layout.strDataFile, 0, 0, (char*)buf, nHeaderSize) : ReadRaw(layout, (char*)buf, nHeaderSize);
+	if (!bRead){
+		Logger::Warn("failed to read nifti header: %s", szFile);
+		return false;
+	}
+
+	int nSizeofHdr = 0;
+	memcpy(&nSizeofHdr, buf, 4);
+	if (nSizeofHdr != (int)nHeaderSize){
+		std::reverse((char*)&nSizeofHdr, (char*)&nSizeofHdr + 4);
+		if (nSizeofHdr != (int)nHeaderSize){
+			Logger::Warn("not a nifti-1 file: %s", szFile);
+			return false;
+		}
+		layout.bSwapBytes = true;
+	}
+	if (memcmp(buf + 344, "n+1", 4) != 0){
+		Logger::Warn("only single file nifti-1 is supported: %s", szFile);
+		return false;
+	}
+
+	bool bSwap = layout.bSwapBytes;
+	auto i16 = [&](size_t nOffset) -> short {
+		short v;
+		memcpy(&v, buf + nOffset, 2);
+		if (bSwap)
+			std::reverse((char*)&v, (char*)&v + 2);
+		return v;
+	};
+	auto f32 = [&](size_t nOffset) -> double {
+		float v;
+		memcpy(&v, buf + nOffset, 4);
+		if (bSwap)
+			std::reverse((char*)&v, (char*)&v + 4);
+		return v;
+	};
+
+	int nDims = i16(40);
+	if (nDims < 3 || nDims > 7){
+		Logger::Warn("only 3 dimensional nifti files are supported, %s has %d", szFile, nDims);
+		return false;
+	}
+	for (int i=4; i<=nDims; i++){
+		if (i16(40 + 2*i) > 1){
+			Logger::Warn("only 3 dimensional nifti files are supported: %s", szFile);
+			return false;
+		}
+	}
+	for (int i=0; i<3; i++){
+		header.dims[i] = i16(42 + 2*i);
+		double fSpacing = fabs(f32(80 + 4*i));
+		header.spacing[i] = fSpacing > 0 ? fSpacing : 1.0;
+	}
+
+	layout.type = ParseNiftiType(i16(70));
+	long long nVoxOffset = (long long)f32(108);
+	if (nVoxOffset < (long long)nHeaderSize)
+		nVoxOffset = nHeaderSize;
+	if (layout.bGzip)
+		layout.nStreamOffset = nVoxOffset;
+	else
+		layout.nFileOffset = nVoxOffset;
+
+	double fSlope = f32(112);
+	if (fSlope != 0 && std::isfinite(fSlope)){
+		layout.fSlope = fSlope;
+		double fIntercept = f32(116);
+		layout.fIntercept = std::isfinite(fIntercept) ? fIntercept : 0.0;
+	}
+
+	// columns of the RAS rotation, the qform is the scanner orientation and wins like in itk
+	double mat[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+	short nQForm = i16(252);
+	short nSForm = i16(254);
+	if (nQForm > 0){
+		double b = f32(256), c = f32(260), d = f32(264);
+		double a = 1.0 - (b*b + c*c + d*d);
+		if (a < 1e-7){
+			a = 1.0 / sqrt(b*b + c*c + d*d);
+			b *= a;
+			c *= a;
+			d *= a;
+			a = 0;
+		}
+		else{
+			a = sqrt(a);
+		}
+		double qfac = f32(76) < 0 ? -1.0 : 1.0;
+		mat[0][0] = a*a + b*b - c*c - d*d;
+		mat[0][1] = 2*(b*c - a*d);
+		mat[0][2] = 2*(b*d + a*c)*qfac;
+		mat[1][0] = 2*(b*c + a*d);
+		mat[1][1] = a*a + c*c - b*b - d*d;
+		mat[1][2] = 2*(c*d - a*b)*qfac;
+		mat[2][0] = 2*(b*d - a*c);
+		mat[2][1] = 2*(c*d + a*b);
+		mat[2][2] = (a*a + d*d - c*c - b*b)*qfac;
+	}
+	else if (nSForm > 0){
+		for (int r=0; r<3; r++){
+			for (int c=0; c<3; c++){
+				mat[r][c] = f32(280 + 16*r + 4*c);
+			}
+		}
+	}
+	header.dirX = Direction3d(-mat[0][0], -mat[1][0], mat[2][0]);
+	header.dirY = Direction3d(-mat[0][1], -mat[1][1], mat[2][1]);
+	header.dirZ = Direction3d(-mat[0][2], -mat[1][2], mat[2][2]);
+	return true;
+}
+
+bool VolumeReader::ReadVoxels(const Layout& layout, size_t nVoxels, VoxelType dstType, char* pDst)
+{
+	size_t nSrcBytes = GetVoxelBytes(layout.type);
+	size_t nDstBytes = GetVoxelBytes(dstType);
+	bool bScaled = layout.fSlope != 1.0 || layout.fIntercept != 0.0;
+
+	// matching voxels are decoded in place, anything else goes through one staging buffer
+	std::unique_ptr<char[]> pStaging;
+	char* pSrc = pDst;
+	if (nSrcBytes != nDstBytes){
+		pStaging.reset(new char[nVoxels*nSrcBytes]);
+		pSrc = pStaging.get();
+	}
+
+	if (!ReadPayload(layout, pSrc, nVoxels*nSrcBytes))
+		return false;
+	if (layout.bSwapBytes)
+		SwapBytes(pSrc, nSrcBytes, nVoxels);
+	if (layout.type == dstType && !bScaled)
+		return true;
+
+	switch (dstType)
+	{
+	case VoxelInt16:
+		return ConvertVoxels<short>(layout.type, pSrc, pDst, nVoxels, layout.fSlope, layout.fIntercept);
+	case VoxelUInt16:
+		return ConvertVoxels<unsigned short>(layout.type, pSrc, pDst, nVoxels, layout.fSlope, layout.fIntercept);
+	case VoxelInt32:
+		return ConvertVoxels<int>(layout.type, pSrc, pDst, nVoxels, layout.fSlope, layout.fIntercept);
+	case VoxelFloat32:
+		return ConvertVoxels<float>(layout.type, pSrc, pDst, nVoxels, layout.fSlope, layout.fIntercept);
+	default:
+		return ConvertVoxels<unsigned char>(layout.type, pSrc, pDst, nVoxels, layout.fSlope, layout.fIntercept);
+	}
+}
+
+VolumeReader::VoxelType VolumeReader::GetVolumeType(const Layout& layout)
+{
+	if (layout.fSlope != 1.0 || layout.fIntercept != 0.0){
+		bool bNarrow = layout.type == VoxelInt8 || layout.type == VoxelUInt8 || layout.type == VoxelInt16 || layout.type == VoxelUInt16;
+		bool bIntegral = floor(layout.fSlope) == layout.fSlope && floor(layout.fIntercept) == layout.fIntercept;
+		return bNarrow && bIntegral ? VoxelInt16 : VoxelFloat32;
+	}
+
+	switch (layout.type)
+	{
+	case VoxelUInt8:
+	case VoxelInt16:
+	case VoxelUInt16:
+	case VoxelInt32:
+	case VoxelFloat32:
+		return layout.type;
+	case VoxelUInt32:
+	case VoxelInt64:
+	case VoxelUInt64:
+		return VoxelInt32;
+	case VoxelFloat64:
+		return VoxelFloat32;
+	default:
+		return VoxelInt16;
+	}
+}
+
+bool VolumeReader::ReadPayload(const Layout& layout, char* pDst, size_t nBytes)
+{
+	if (!layout.bGzip)
+		return ReadRaw(layout, pDst, nBytes);
+
+	FILE* fp = fopen(layout.strDataFile.c_str(), "rb");
+	if (!fp){
+		Logger::Warn("failed to open volume data: %s", layout.strDataFile.c_str());
+		return false;
+	}
+	long long nFileOffset = SkipLines(fp, layout.nFileOffset, layout.nLineSkip);
+	unsigned char head[18];
+	size_t nHead = nFileOffset < 0 ? 0 : fread(head, 1, sizeof(head), fp);
+	fclose(fp);
+	if (nFileOffset < 0){
+		Logger::Warn("volume data is truncated: %s", layout.strDataFile.c_str());
+		return false;
+	}
+
+	if (IsBgzfHeader(head, nHead)){
+		if (InflateMembers(layout.strDataFile, nFileOffset, layout.nStreamOffset, pDst, nBytes))
+			return true;
+	}
+	return InflateStream(layout.strDataFile, nFileOffset, layout.nStreamOffset, pDst, nBytes);
+}
+
+bool VolumeReader::ReadRaw(const Layout& layout, char* pDst, size_t nBytes)
+{
+	FILE* fp = fopen(layout.strDataFile.c_str(), "rb");
+	if (!fp){
+		Logger::Warn("failed to open volume data: %s", layout.strDataFile.c_str());
+		return false;
+	}
+
+	long long nOffset = 0;
+	if (layout.nStreamOffset < 0){
+		nOffset = GetFileSize(fp) - (long long)nBytes;
+	}
+	else{
+		nOffset = SkipLines(fp, layout.nFileOffset, layout.nLineSkip);
+		if (nOffset >= 0)
+			nOffset += layout.nStreamOffset;
+	}
+
+	size_t nRead = 0;
+	if (nOffset >= 0 && SeekFile(fp, nOffset, SEEK_SET) == 0)
+		nRead = fread(pDst, 1, nBytes, fp);
+	fclose(fp);
+
+	if (nRead != nBytes){
+		Logger::Warn("volume data is truncated, %zu of %zu bytes read: %s", nRead, nBytes, layout.strDataFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool VolumeReader::InflateMembers(const std::string& strFile, long long nFileOffset, long long nStreamOffset, char* pDst, size_t nBytes)
+{
+	FILE* fp = fopen(strFile.c_str(), "rb");
+	if (!fp)
+		return false;
+	long long nFileSize = GetFileSize(fp);
+	if (nFileSize < nFileOffset){
+		fclose(fp);
+		return false;
+	}
+	size_t nSize = (size_t)(nFileSize - nFileOffset);
+	std::unique_ptr<unsigned char[]> pCompressed(new unsigned char[nSize]);
+	size_t nRead = 0;
+	if (SeekFile(fp, nFileOffset, SEEK_SET) == 0)
+		nRead = fread(pCompressed.get(), 1, nSize, fp);
+	fclose(fp);
+	if (nRead != nSize)
+		return false;
+
+	// every member records its own compressed and inflated size, so the members
+	// can be laid out in the output before any of them is inflated
+	std::vector<GzipMember> members;
+	size_t nPos = 0;
+	size_t nStream = 0;
+	size_t nEnd = (size_t)nStreamOffset + nBytes;
+	while (nPos < nSize && nStream < nEnd){
+		GzipMember member;
+		size_t nNext = 0;
+		if (!ParseBgzfMember(pCompressed.get(), nSize, nPos, member, nNext))
+			return false;
+		member.nStream = nStream;
+		nStream += member.nStreamSize;
+		nPos = nNext;
+		if (member.nStreamSize > 0)
+			members.push_back(member);
+	}
+	if (nStream < nEnd){
+		Logger::Warn("volume data is truncated, %zu of %zu bytes in the stream: %s", nStream, nEnd, strFile.c_str());
+		return false;
+	}
+
+	std::atomic<bool> bOK(true);
+	const unsigned char* pIn = pCompressed.get();
+	ThreadPool::Instance()->ParallelFor(0, (int)members.size(), [&](int i){
+		const GzipMember& member = members[i];
+		size_t nBegin = std::max(member.nStream, (size_t)nStreamOffset);
+		size_t nStop = std::min(member.nStream + member.nStreamSize, nEnd);
+		if (nBegin >= nStop)
+			return;
+		unsigned char* pOut = (unsigned char*)pDst + (nBegin - nStreamOffset);
+		if (nBegin == member.nStream && nStop == member.nStream + member.nStreamSize){
+			if (!InflateRaw(pIn + member.nDeflate, member.nDeflateSize, pOut, member.nStreamSize))
+				bOK = false;
+			return;
+		}
+		std::unique_ptr<unsigned char[]> pMember(new unsigned char[member.nStreamSize]);
+		if (!InflateRaw(pIn + member.nDeflate, member.nDeflateSize, pMember.get(), member.nStreamSize)){
+			bOK = false;
+			return;
+		}
+		memcpy(pOut, pMember.get() + (nBegin - member.nStream), nStop - nBegin);
+	});
+
+	if (!bOK)
+		Logger::Warn("corrupted gzip member in %s", strFile.c_str());
+	return bOK;
+}
+
+bool VolumeReader::InflateStream(const std::string& strFile, long long nFileOffset, long long nStreamOffset, char* pDst, size_t nBytes)
+{
+	FILE* fp = fopen(strFile.c_str(), "rb");
+	if (!fp){
+		Logger::Warn("failed to open volume data: %s", strFile.c_str());
+		return false;
+	}
+	if (SeekFile(fp, nFileOffset, SEEK_SET) != 0){
+		fclose(fp);
+		return false;
+	}
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK){
+		fclose(fp);
+		return false;
+	}
+
+	std::unique_ptr<unsigned char[]> pIn(new unsigned char[kInflateChunk]);
+	std::unique_ptr<unsigned char[]> pSkip;
+	size_t nSkip = (size_t)nStreamOffset;
+	size_t nDone = 0;
+	bool bError = false;
+	while (nDone < nBytes){
+		if (strm.avail_in == 0){
+			strm.avail_in = (uInt)fread(pIn.get(), 1, kInflateChunk, fp);
+			strm.next_in = pIn.get();
+			if (strm.avail_in == 0)
+				break;
+		}
+
+		// the bytes before the voxels (the nifti header) are inflated into a scratch
+		// buffer, the voxels straight into their destination
+		size_t nWant = 0;
+		if (nSkip > 0){
+			if (!pSkip)
+				pSkip.reset(new unsigned char[kInflateChunk]);
+			nWant = std::min(nSkip, kInflateChunk);
+			strm.next_out = pSkip.get();
+		}
+		else{
+			nWant = std::min(nBytes - nDone, (size_t)1 << 30);
+			strm.next_out = (Bytef*)pDst + nDone;
+		}
+		strm.avail_out = (uInt)nWant;
+
+		int nRet = inflate(&strm, Z_NO_FLUSH);
+		size_t nOut = nWant - strm.avail_out;
+		if (nSkip > 0)
+			nSkip -= nOut;
+		else
+			nDone += nOut;
+
+		if (nRet == Z_STREAM_END){
+			// concatenated gzip members continue the same stream
+			if (strm.avail_in == 0){
+				strm.avail_in = (uInt)fread(pIn.get(), 1, kInflateChunk, fp);
+				strm.next_in = pIn.get();
+			}
+			if (strm.avail_in == 0 || strm.next_in[0] != 0x1f)
+				break;
+			inflateReset(&strm);
+		}
+		else if (nRet != Z_OK && nRet != Z_BUF_ERROR){
+			bError = true;
+			break;
+		}
+	}
+	inflateEnd(&strm);
+	fclose(fp);
+
+	if (bError || nDone < nBytes){
+		Logger::Warn("failed to inflate volume data, %zu of %zu bytes: %s", nDone, nBytes, strFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+size_t VolumeReader::GetVoxelBytes(VoxelType type)
+{
+	switch (type)
+	{
+	case VoxelInt8:
+	case VoxelUInt8:
+		return 1;
+	case VoxelInt16:
+	case VoxelUInt16:
+		return 2;
+	case VoxelInt32:
+	case VoxelUInt32:
+	case VoxelFloat32:
+		return 4;
+	case VoxelInt64:
+	case VoxelUInt64:
+	case VoxelFloat64:
+		return 8;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,120 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Direction.h"
+#include "Defines.h"
+
+namespace MonkeyGL {
+
+    // geometry read from a volume file header. directions are the patient LPS
+    // directions of the x, y and z voxel axes, the same as SetDirection takes.
+    struct VolumeHeader
+    {
+        int dims[3];
+        double spacing[3];
+        Direction3d dirX;
+        Direction3d dirY;
+        Direction3d dirZ;
+
+        VolumeHeader(){
+            dims[0] = dims[1] = dims[2] = 0;
+            spacing[0] = spacing[1] = spacing[2] = 1.0;
+            dirX = Direction3d(1, 0, 0);
+            dirY = Direction3d(0, 1, 0);
+            dirZ = Direction3d(0, 0, 1);
+        }
+    };
+
+    // native readers for NRRD (.nrrd/.nhdr, raw or gzip encoding) and single file
+    // NIfTI-1 (.nii/.nii.gz). the voxels are decoded straight into the buffer that
+    // is handed to the volume, x fastest. gzip files made of independent members
+    // (bgzip) are inflated in parallel, any other gzip stream is inflated in one pass.
+    class VolumeReader
+    {
+    public:
+        static bool ReadVolume(const char* szFile, VolumeHeader& header, std::shared_ptr<short>& pData);
+        // keeps the voxel type of the file where the volume can: uint8, int16, uint16, int32
+        // and float32 as stored, int8 as int16, wider integers as int32 and doubles as
+        // float32. rescaled voxels are int16 when the rescaling of 8 or 16 bit integers is
+        // integral and float32 otherwise
+        static bool ReadVolume(const char* szFile, VolumeHeader& header, std::shared_ptr<void>& pData, MonkeyGL::VoxelType& type);
+        static bool ReadMask(const char* szFile, VolumeHeader& header, std::shared_ptr<unsigned char>& pData);
+
+    public:
+        enum VoxelType
+        {
+            VoxelUnknown = 0,
+            VoxelInt8,
+            VoxelUInt8,
+            VoxelInt16,
+            VoxelUInt16,
+            VoxelInt32,
+            VoxelUInt32,
+            VoxelInt64,
+            VoxelUInt64,
+            VoxelFloat32,
+            VoxelFloat64
+        };
+
+        // where and how the voxels of a file are stored
+        struct Layout
+        {
+            VoxelType type;
+            bool bSwapBytes;
+            bool bGzip;
+            std::string strDataFile;
+            long long nFileOffset;
+            long long nLineSkip;
+            long long nStreamOffset;
+            double fSlope;
+            double fIntercept;
+
+            Layout(){
+                type = VoxelUnknown;
+                bSwapBytes = false;
+                bGzip = false;
+                nFileOffset = 0;
+                nLineSkip = 0;
+                nStreamOffset = 0;
+                fSlope = 1.0;
+                fIntercept = 0.0;
+            }
+        };
+
+    private:
+        static bool ReadHeader(const char* szFile, VolumeHeader& header, Layout& layout);
+        static bool ReadNrrdHeader(const char* szFile, VolumeHeader& header, Layout& layout);
+        static bool ReadNiftiHeader(const char* szFile, VolumeHeader& header, Layout& layout);
+        static bool ReadVoxels(const Layout& layout, size_t nVoxels, VoxelType dstType, char* pDst);
+        static VoxelType GetVolumeType(const Layout& layout);
+        static bool ReadPayload(const Layout& layout, char* pDst, size_t nBytes);
+        static bool ReadRaw(const Layout& layout, char* pDst, size_t nBytes);
+        static bool InflateMembers(const std::string& strFile, long long nFileOffset, long long nStreamOffset, char* pDst, size_t nBytes);
+        static bool InflateStream(const std::string& strFile, long long nFileOffset, long long nStreamOffset, char* pDst, size_t nBytes);
+        static size_t GetVoxelBytes(VoxelType type);
+    };
+
+}
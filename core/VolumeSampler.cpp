@@ -0,0 +1,556 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "VolumeSampler.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <climits>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SAMPLER_X86
+#endif
+
+using namespace MonkeyGL;
+
+namespace {
+
+	inline int ClampIndex(int i, int n)
+	{
+		return i<0 ? 0 : (i>=n ? n-1 : i);
+	}
+
+	inline size_t Address(const VolumeSampler::Layout& layout, int x, int y, int z)
+	{
+		if (NULL == layout.pOffsetX)
+			return (size_t)x + (size_t)y*layout.nLine + (size_t)z*layout.nFrame;
+		return (size_t)layout.pOffsetX[x] + layout.pOffsetY[y] + layout.pOffsetZ[z];
+	}
+
+	// catmull-rom weights, interpolating so integer positions give the voxel values back
+	inline void CubicWeights(float t, float* w)
+	{
+		float t2 = t*t;
+		float t3 = t2*t;
+		w[0] = 0.5f*(-t3 + 2*t2 - t);
+		w[1] = 0.5f*(3*t3 - 5*t2 + 2);
+		w[2] = 0.5f*(-3*t3 + 4*t2 + t);
+		w[3] = 0.5f*(t3 - t2);
+	}
+
+	template <typename T>
+	float SampleNearest(const VolumeSampler::Layout& layout, float x, float y, float z)
+	{
+		int xi = ClampIndex((int)floorf(x + 0.5f), layout.nDims[0]);
+		int yi = ClampIndex((int)floorf(y + 0.5f), layout.nDims[1]);
+		int zi = ClampIndex((int)floorf(z + 0.5f), layout.nDims[2]);
+		return ((const T*)layout.pData)[Address(layout, xi, yi, zi)];
+	}
+
+	// same operations in the same order as the ray caster's trilinear fetch
+	template <typename T>
+	float SampleTrilinear(const VolumeSampler::Layout& layout, float x, float y, float z)
+	{
+		float fx0 = floorf(x);
+		float fy0 = floorf(y);
+		float fz0 = floorf(z);
+		float fx = x - fx0;
+		float fy = y - fy0;
+		float fz = z - fz0;
+		int x0 = ClampIndex((int)fx0, layout.nDims[0]);
+		int x1 = ClampIndex((int)fx0+1, layout.nDims[0]);
+		int y0 = ClampIndex((int)fy0, layout.nDims[1]);
+		int y1 = ClampIndex((int)fy0+1, layout.nDims[1]);
+		int z0 = ClampIndex((int)fz0, layout.nDims[2]);
+		int z1 = ClampIndex((int)fz0+1, layout.nDims[2]);
+
+		const T* p = (const T*)layout.pData;
+		float v000 = p[Address(layout, x0, y0, z0)];
+		float v100 = p[Address(layout, x1, y0, z0)];
+		float v010 = p[Address(layout, x0, y1, z0)];
+		float v110 = p[Address(layout, x1, y1, z0)];
+		float v001 = p[Address(layout, x0, y0, z1)];
+		float v101 = p[Address(layout, x1, y0, z1)];
+		float v011 = p[Address(layout, x0, y1, z1)];
+		float v111 = p[Address(layout, x1, y1, z1)];
+		float c00 = v000 + fx*(v100 - v000);
+		float c10 = v010 + fx*(v110 - v010);
+		float c01 = v001 + fx*(v101 - v001);
+		float c11 = v011 + fx*(v111 - v011);
+		float d0 = c00 + fy*(c10 - c00);
+		float d1 = c01 + fy*(c11 - c01);
+		return d0 + fz*(d1 - d0);
+	}
+
+	template <typename T>
+	float SampleTricubic(const VolumeSampler::Layout& layout, float x, float y, float z)
+	{
+		const T* p = (const T*)layout.pData;
+		float fx0 = floorf(x);
+		float fy0 = floorf(y);
+		float fz0 = floorf(z);
+		float wx[4], wy[4], wz[4];
+		CubicWeights(x - fx0, wx);
+		CubicWeights(y - fy0, wy);
+		CubicWeights(z - fz0, wz);
+		int xi[4], yi[4], zi[4];
+		for (int i=0; i<4; i++){
+			xi[i] = ClampIndex((int)fx0 - 1 + i, layout.nDims[0]);
+			yi[i] = ClampIndex((int)fy0 - 1 + i, layout.nDims[1]);
+			zi[i] = ClampIndex((int)fz0 - 1 + i, layout.nDims[2]);
+		}
+
+		float fResult = 0;
+		for (int k=0; k<4; k++){
+			float fPlane = 0;
+			for (int j=0; j<4; j++){
+				float fLine = 0;
+				for (int i=0; i<4; i++){
+					fLine += wx[i]*p[Address(layout, xi[i], yi[j], zi[k])];
+				}
+				fPlane += wy[j]*fLine;
+			}
+			fResult += wz[k]*fPlane;
+		}
+		return fResult;
+	}
+
+#ifdef SAMPLER_X86
+	bool HasAVX2()
+	{
+		static const bool bAVX2 = __builtin_cpu_supports("avx2");
+		return bAVX2;
+	}
+
+	// the gathers read 32 bits per lane. narrower voxels are cut out of the word, which
+	// starts early enough at the end of the volume that no lane reads past it
+	template <typename T>
+	__m256 Gather(const VolumeSampler::Layout& layout, __m256i vIndex);
+
+	// 16 bit voxels come in pairs of one 32 bit word, which Split turns into the values of
+	// the lower and the upper voxel. a linear 16 bit volume reads x and x+1 with one gather
+	template <typename T>
+	struct PairedX{
+		static const bool value = false;
+		static void Split(__m256i, __m256&, __m256&){}
+	};
+
+	template <>
+	struct PairedX<short>{
+		static const bool value = true;
+		__attribute__((target("avx2")))
+		static void Split(__m256i vPair, __m256& vLo, __m256& vHi){
+			vLo = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(vPair, 16), 16));
+			vHi = _mm256_cvtepi32_ps(_mm256_srai_epi32(vPair, 16));
+		}
+	};
+
+	template <>
+	struct PairedX<unsigned short>{
+		static const bool value = true;
+		__attribute__((target("avx2")))
+		static void Split(__m256i vPair, __m256& vLo, __m256& vHi){
+			vLo = _mm256_cvtepi32_ps(_mm256_and_si256(vPair, _mm256_set1_epi32(0xFFFF)));
+			vHi = _mm256_cvtepi32_ps(_mm256_srli_epi32(vPair, 16));
+		}
+	};
+
+	template <typename T>
+	__attribute__((target("avx2")))
+	inline __m256 Gather16(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		__m256i vLast = _mm256_set1_epi32((int)layout.nVoxels - 2);
+		__m256i vBase = _mm256_min_epi32(vIndex, vLast);
+		__m256i vPair = _mm256_i32gather_epi32((const int*)layout.pData, vBase, 2);
+		__m256 vLo, vHi;
+		PairedX<T>::Split(vPair, vLo, vHi);
+		return _mm256_blendv_ps(vLo, vHi, _mm256_castsi256_ps(_mm256_cmpgt_epi32(vIndex, vBase)));
+	}
+
+	template <>
+	__attribute__((target("avx2")))
+	inline __m256 Gather<short>(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		return Gather16<short>(layout, vIndex);
+	}
+
+	template <>
+	__attribute__((target("avx2")))
+	inline __m256 Gather<unsigned short>(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		return Gather16<unsigned short>(layout, vIndex);
+	}
+
+	template <>
+	__attribute__((target("avx2")))
+	inline __m256 Gather<unsigned char>(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		__m256i vLast = _mm256_set1_epi32((int)layout.nVoxels - 4);
+		__m256i vBase = _mm256_min_epi32(vIndex, vLast);
+		__m256i vWord = _mm256_i32gather_epi32((const int*)layout.pData, vBase, 1);
+		__m256i vShift = _mm256_slli_epi32(_mm256_sub_epi32(vIndex, vBase), 3);
+		return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srlv_epi32(vWord, vShift), _mm256_set1_epi32(0xFF)));
+	}
+
+	template <>
+	__attribute__((target("avx2")))
+	inline __m256 Gather<int>(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		return _mm256_cvtepi32_ps(_mm256_i32gather_epi32((const int*)layout.pData, vIndex, 4));
+	}
+
+	template <>
+	__attribute__((target("avx2")))
+	inline __m256 Gather<float>(const VolumeSampler::Layout& layout, __m256i vIndex)
+	{
+		return _mm256_i32gather_ps((const float*)layout.pData, vIndex, 4);
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256i Clamp(__m256i v, int n)
+	{
+		return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(n-1));
+	}
+
+	// offsets of the y and z parts of the address, x is added by the caller
+	__attribute__((target("avx2")))
+	inline __m256i OffsetYZ(const VolumeSampler::Layout& layout, __m256i vY, __m256i vZ)
+	{
+		if (NULL == layout.pOffsetX){
+			return _mm256_add_epi32(_mm256_mullo_epi32(vY, _mm256_set1_epi32(layout.nLine)), _mm256_mullo_epi32(vZ, _mm256_set1_epi32(layout.nFrame)));
+		}
+		return _mm256_add_epi32(_mm256_i32gather_epi32(layout.pOffsetY, vY, 4), _mm256_i32gather_epi32(layout.pOffsetZ, vZ, 4));
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256i OffsetX(const VolumeSampler::Layout& layout, __m256i vX)
+	{
+		if (NULL == layout.pOffsetX)
+			return vX;
+		return _mm256_i32gather_epi32(layout.pOffsetX, vX, 4);
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256 Lerp(__m256 a, __m256 b, __m256 t)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+	}
+
+	template <typename T>
+	__attribute__((target("avx2")))
+	void Sample8Nearest(const VolumeSampler::Layout& layout, const float* pX, const float* pY, const float* pZ, float* pOut)
+	{
+		__m256 vHalf = _mm256_set1_ps(0.5f);
+		__m256i vX = Clamp(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_loadu_ps(pX), vHalf))), layout.nDims[0]);
+		__m256i vY = Clamp(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_loadu_ps(pY), vHalf))), layout.nDims[1]);
+		__m256i vZ = Clamp(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_loadu_ps(pZ), vHalf))), layout.nDims[2]);
+		_mm256_storeu_ps(pOut, Gather<T>(layout, _mm256_add_epi32(OffsetX(layout, vX), OffsetYZ(layout, vY, vZ))));
+	}
+
+	template <typename T>
+	__attribute__((target("avx2")))
+	void Sample8Trilinear(const VolumeSampler::Layout& layout, const float* pX, const float* pY, const float* pZ, float* pOut)
+	{
+		__m256 x = _mm256_loadu_ps(pX);
+		__m256 y = _mm256_loadu_ps(pY);
+		__m256 z = _mm256_loadu_ps(pZ);
+		__m256 fx0 = _mm256_floor_ps(x);
+		__m256 fy0 = _mm256_floor_ps(y);
+		__m256 fz0 = _mm256_floor_ps(z);
+		__m256 fx = _mm256_sub_ps(x, fx0);
+		__m256 fy = _mm256_sub_ps(y, fy0);
+		__m256 fz = _mm256_sub_ps(z, fz0);
+		__m256i vOne = _mm256_set1_epi32(1);
+		__m256i ix = _mm256_cvttps_epi32(fx0);
+		__m256i iy = _mm256_cvttps_epi32(fy0);
+		__m256i iz = _mm256_cvttps_epi32(fz0);
+		__m256i y0 = Clamp(iy, layout.nDims[1]);
+		__m256i y1 = Clamp(_mm256_add_epi32(iy, vOne), layout.nDims[1]);
+		__m256i z0 = Clamp(iz, layout.nDims[2]);
+		__m256i z1 = Clamp(_mm256_add_epi32(iz, vOne), layout.nDims[2]);
+		__m256i o00 = OffsetYZ(layout, y0, z0);
+		__m256i o10 = OffsetYZ(layout, y1, z0);
+		__m256i o01 = OffsetYZ(layout, y0, z1);
+		__m256i o11 = OffsetYZ(layout, y1, z1);
+
+		__m256 c00, c10, c01, c11;
+		if (PairedX<T>::value && NULL == layout.pOffsetX && layout.nDims[0] > 1){
+			// x and x+1 are neighbours in a linear volume, one gather reads both. the
+			// pair start is kept inside the row and the weight pinned at the edges, which
+			// gives the same value as clamping both indices
+			__m256i xb = _mm256_min_epi32(_mm256_max_epi32(ix, _mm256_setzero_si256()), _mm256_set1_epi32(layout.nDims[0]-2));
+			__m256 vZero = _mm256_setzero_ps();
+			__m256 vOnef = _mm256_set1_ps(1.0f);
+			fx = _mm256_blendv_ps(fx, vZero, _mm256_castsi256_ps(_mm256_cmpgt_epi32(xb, ix)));
+			fx = _mm256_blendv_ps(fx, vOnef, _mm256_castsi256_ps(_mm256_cmpgt_epi32(ix, xb)));
+			__m256i vPair[4];
+			__m256i vOffsets[4] = {o00, o10, o01, o11};
+			__m256 vC[4];
+			for (int i=0; i<4; i++){
+				vPair[i] = _mm256_i32gather_epi32((const int*)layout.pData, _mm256_add_epi32(xb, vOffsets[i]), 2);
+				__m256 a, b;
+				PairedX<T>::Split(vPair[i], a, b);
+				vC[i] = Lerp(a, b, fx);
+			}
+			c00 = vC[0];
+			c10 = vC[1];
+			c01 = vC[2];
+			c11 = vC[3];
+		}
+		else{
+			__m256i x0 = OffsetX(layout, Clamp(ix, layout.nDims[0]));
+			__m256i x1 = OffsetX(layout, Clamp(_mm256_add_epi32(ix, vOne), layout.nDims[0]));
+			c00 = Lerp(Gather<T>(layout, _mm256_add_epi32(x0, o00)), Gather<T>(layout, _mm256_add_epi32(x1, o00)), fx);
+			c10 = Lerp(Gather<T>(layout, _mm256_add_epi32(x0, o10)), Gather<T>(layout, _mm256_add_epi32(x1, o10)), fx);
+			c01 = Lerp(Gather<T>(layout, _mm256_add_epi32(x0, o01)), Gather<T>(layout, _mm256_add_epi32(x1, o01)), fx);
+			c11 = Lerp(Gather<T>(layout, _mm256_add_epi32(x0, o11)), Gather<T>(layout, _mm256_add_epi32(x1, o11)), fx);
+		}
+		__m256 d0 = Lerp(c00, c10, fy);
+		__m256 d1 = Lerp(c01, c11, fy);
+		_mm256_storeu_ps(pOut, Lerp(d0, d1, fz));
+	}
+
+	__attribute__((target("avx2")))
+	inline void CubicWeights8(__m256 t, __m256* w)
+	{
+		__m256 vHalf = _mm256_set1_ps(0.5f);
+		__m256 t2 = _mm256_mul_ps(t, t);
+		__m256 t3 = _mm256_mul_ps(t2, t);
+		__m256 v2 = _mm256_set1_ps(2.0f);
+		__m256 v3 = _mm256_set1_ps(3.0f);
+		__m256 v4 = _mm256_set1_ps(4.0f);
+		__m256 v5 = _mm256_set1_ps(5.0f);
+		w[0] = _mm256_mul_ps(vHalf, _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(v2, t2), t3), t));
+		w[1] = _mm256_mul_ps(vHalf, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(v3, t3), _mm256_mul_ps(v5, t2)), v2));
+		w[2] = _mm256_mul_ps(vHalf, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(v4, t2), _mm256_mul_ps(v3, t3)), t));
+		w[3] = _mm256_mul_ps(vHalf, _mm256_sub_ps(t3, t2));
+	}
+
+	template <typename T>
+	__attribute__((target("avx2")))
+	void Sample8Tricubic(const VolumeSampler::Layout& layout, const float* pX, const float* pY, const float* pZ, float* pOut)
+	{
+		__m256 x = _mm256_loadu_ps(pX);
+		__m256 y = _mm256_loadu_ps(pY);
+		__m256 z = _mm256_loadu_ps(pZ);
+		__m256 fx0 = _mm256_floor_ps(x);
+		__m256 fy0 = _mm256_floor_ps(y);
+		__m256 fz0 = _mm256_floor_ps(z);
+		__m256 wx[4], wy[4], wz[4];
+		CubicWeights8(_mm256_sub_ps(x, fx0), wx);
+		CubicWeights8(_mm256_sub_ps(y, fy0), wy);
+		CubicWeights8(_mm256_sub_ps(z, fz0), wz);
+		__m256i ix = _mm256_cvttps_epi32(fx0);
+		__m256i iy = _mm256_cvttps_epi32(fy0);
+		__m256i iz = _mm256_cvttps_epi32(fz0);
+		__m256i xi[4], yi[4], zi[4];
+		for (int i=0; i<4; i++){
+			__m256i vShift = _mm256_set1_epi32(i-1);
+			xi[i] = OffsetX(layout, Clamp(_mm256_add_epi32(ix, vShift), layout.nDims[0]));
+			yi[i] = Clamp(_mm256_add_epi32(iy, vShift), layout.nDims[1]);
+			zi[i] = Clamp(_mm256_add_epi32(iz, vShift), layout.nDims[2]);
+		}
+
+		__m256 vResult = _mm256_setzero_ps();
+		for (int k=0; k<4; k++){
+			__m256 vPlane = _mm256_setzero_ps();
+			for (int j=0; j<4; j++){
+				__m256i vOffset = OffsetYZ(layout, yi[j], zi[k]);
+				__m256 vLine = _mm256_setzero_ps();
+				for (int i=0; i<4; i++){
+					vLine = _mm256_add_ps(vLine, _mm256_mul_ps(wx[i], Gather<T>(layout, _mm256_add_epi32(xi[i], vOffset))));
+				}
+				vPlane = _mm256_add_ps(vPlane, _mm256_mul_ps(wy[j], vLine));
+			}
+			vResult = _mm256_add_ps(vResult, _mm256_mul_ps(wz[k], vPlane));
+		}
+		_mm256_storeu_ps(pOut, vResult);
+	}
+#endif
+
+
+	template <typename T>
+	void GetKernels(bool bGather, float (*pfnSample[3])(const VolumeSampler::Layout&, float, float, float), void (*pfnSample8[3])(const VolumeSampler::Layout&, const float*, const float*, const float*, float*))
+	{
+		pfnSample[VolumeSampler::FilterNearest] = SampleNearest<T>;
+		pfnSample[VolumeSampler::FilterTrilinear] = SampleTrilinear<T>;
+		pfnSample[VolumeSampler::FilterTricubic] = SampleTricubic<T>;
+		for (int i=0; i<3; i++){
+			pfnSample8[i] = NULL;
+		}
+#ifdef SAMPLER_X86
+		if (bGather && HasAVX2()){
+			pfnSample8[VolumeSampler::FilterNearest] = Sample8Nearest<T>;
+			pfnSample8[VolumeSampler::FilterTrilinear] = Sample8Trilinear<T>;
+			pfnSample8[VolumeSampler::FilterTricubic] = Sample8Tricubic<T>;
+		}
+#endif
+	}
+}
+
+VolumeSampler::VolumeSampler(void)
+{
+	SetVolume(NULL, 0, 0, 0);
+	SetSpacing(1.0, 1.0, 1.0);
+}
+
+VolumeSampler::~VolumeSampler(void)
+{
+}
+
+void VolumeSampler::SetVolume(const short* pVolume, int nWidth, int nHeight, int nDepth)
+{
+	SetLayout(pVolume, VoxelTypeInt16, nWidth, nHeight, nDepth, NULL, NULL, NULL, (size_t)nWidth*nHeight*nDepth);
+}
+
+void VolumeSampler::SetVolume(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth)
+{
+	SetLayout(pVolume, type, nWidth, nHeight, nDepth, NULL, NULL, NULL, (size_t)nWidth*nHeight*nDepth);
+}
+
+void VolumeSampler::SetVolume(const short* pVolume, int nWidth, int nHeight, int nDepth, const int* pOffsetX, const int* pOffsetY, const int* pOffsetZ, size_t nVoxels)
+{
+	SetLayout(pVolume, VoxelTypeInt16, nWidth, nHeight, nDepth, pOffsetX, pOffsetY, pOffsetZ, nVoxels);
+}
+
+void VolumeSampler::SetLayout(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth, const int* pOffsetX, const int* pOffsetY, const int* pOffsetZ, size_t nVoxels)
+{
+	m_layout.pData = pVolume;
+	m_layout.type = type;
+	m_layout.nDims[0] = nWidth;
+	m_layout.nDims[1] = nHeight;
+	m_layout.nDims[2] = nDepth;
+	m_layout.nLine = nWidth;
+	m_layout.nFrame = nWidth*nHeight;
+	m_layout.pOffsetX = pOffsetX;
+	m_layout.pOffsetY = pOffsetY;
+	m_layout.pOffsetZ = pOffsetZ;
+	m_layout.nVoxels = nVoxels;
+
+	// the narrow types read a whole word at the end of the volume
+	bool bGather = (NULL != pVolume) && nVoxels*GetVoxelBytes(type) >= 4 && nVoxels <= (size_t)INT_MAX;
+	switch (type)
+	{
+	case VoxelTypeUInt8:
+		GetKernels<unsigned char>(bGather, m_pfnSample, m_pfnSample8);
+		break;
+	case VoxelTypeUInt16:
+		GetKernels<unsigned short>(bGather, m_pfnSample, m_pfnSample8);
+		break;
+	case VoxelTypeInt32:
+		GetKernels<int>(bGather, m_pfnSample, m_pfnSample8);
+		break;
+	case VoxelTypeFloat32:
+		GetKernels<float>(bGather, m_pfnSample, m_pfnSample8);
+		break;
+	default:
+		GetKernels<short>(bGather, m_pfnSample, m_pfnSample8);
+		break;
+	}
+}
+
+void VolumeSampler::SetSpacing(double x, double y, double z)
+{
+	m_fInvSpacing[0] = x>0 ? 1.0/x : 1.0;
+	m_fInvSpacing[1] = y>0 ? 1.0/y : 1.0;
+	m_fInvSpacing[2] = z>0 ? 1.0/z : 1.0;
+}
+
+float VolumeSampler::Sample(float x, float y, float z, Filter filter) const
+{
+	return m_pfnSample[filter](m_layout, x, y, z);
+}
+
+void VolumeSampler::Sample8(const float* pX, const float* pY, const float* pZ, float* pOut, Filter filter) const
+{
+	if (NULL != m_pfnSample8[filter]){
+		m_pfnSample8[filter](m_layout, pX, pY, pZ, pOut);
+		return;
+	}
+	for (int i=0; i<BATCH_SIZE; i++){
+		pOut[i] = m_pfnSample[filter](m_layout, pX[i], pY[i], pZ[i]);
+	}
+}
+
+void VolumeSampler::SampleObject8(const float* pX, const float* pY, const float* pZ, float* pOut, Filter filter) const
+{
+	float x[BATCH_SIZE], y[BATCH_SIZE], z[BATCH_SIZE];
+	for (int i=0; i<BATCH_SIZE; i++){
+		x[i] = pX[i]*m_fInvSpacing[0] - 0.5f;
+		y[i] = pY[i]*m_fInvSpacing[1] - 0.5f;
+		z[i] = pZ[i]*m_fInvSpacing[2] - 0.5f;
+	}
+	Sample8(x, y, z, pOut, filter);
+}
+
+bool VolumeSampler::BuildBricked(const short* pLinear, int nWidth, int nHeight, int nDepth, int nBrickBits, std::vector<short>& vecBricked, std::vector<int>& vecOffsetX, std::vector<int>& vecOffsetY, std::vector<int>& vecOffsetZ)
+{
+	if (NULL == pLinear || nWidth <= 0 || nHeight <= 0 || nDepth <= 0 || nBrickBits < 1 || nBrickBits > 6)
+		return false;
+
+	const int nGroupBits = 2;
+	int nBrick = 1 << nBrickBits;
+	int nGroup = nBrick << nGroupBits;
+	int nDims[3] = {nWidth, nHeight, nDepth};
+	size_t nGroups[3];
+	for (int i=0; i<3; i++){
+		nGroups[i] = (nDims[i] + nGroup - 1)/nGroup;
+	}
+	size_t nBrickVoxels = (size_t)nBrick*nBrick*nBrick;
+	size_t nGroupVoxels = nBrickVoxels << (3*nGroupBits);
+	size_t nTotal = nGroups[0]*nGroups[1]*nGroups[2]*nGroupVoxels;
+	if (nTotal > (size_t)INT_MAX)
+		return false;
+
+	// voxel (x, y, z) = group + brick in the group (interleaved bits) + voxel in the brick,
+	// every term depends on one axis only
+	std::vector<int>* pOffsets[3] = {&vecOffsetX, &vecOffsetY, &vecOffsetZ};
+	size_t nGroupStride[3] = {nGroupVoxels, nGroupVoxels*nGroups[0], nGroupVoxels*nGroups[0]*nGroups[1]};
+	size_t nVoxelStride[3] = {1, (size_t)nBrick, (size_t)nBrick*nBrick};
+	for (int i=0; i<3; i++){
+		pOffsets[i]->resize(nDims[i]);
+		for (int v=0; v<nDims[i]; v++){
+			int b = v >> nBrickBits;
+			int nInGroup = b & ((1<<nGroupBits)-1);
+			size_t nMorton = 0;
+			for (int bit=0; bit<nGroupBits; bit++){
+				nMorton |= (size_t)((nInGroup >> bit) & 1) << (3*bit + i);
+			}
+			(*pOffsets[i])[v] = (int)((b >> nGroupBits)*nGroupStride[i] + nMorton*nBrickVoxels + (v & (nBrick-1))*nVoxelStride[i]);
+		}
+	}
+
+	vecBricked.assign(nTotal, 0);
+	short* pBricked = vecBricked.data();
+	const int* pX = vecOffsetX.data();
+	const int* pY = vecOffsetY.data();
+	const int* pZ = vecOffsetZ.data();
+	ThreadPool::Instance()->ParallelFor(0, nDepth, [&](int z){
+		for (int y=0; y<nHeight; y++){
+			const short* pSrc = pLinear + ((size_t)z*nHeight + y)*nWidth;
+			short* pDst = pBricked + pY[y] + pZ[z];
+			for (int x=0; x<nWidth; x++){
+				pDst[pX[x]] = pSrc[x];
+			}
+		}
+	});
+	return true;
+}
@@ -0,0 +1,107 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Defines.h"
+
+namespace MonkeyGL {
+
+    // host side sampling of volumes for the CPU paths (MPR, CPR, picking, resampling).
+    // positions are in voxel coordinates with voxel centers on integers and are clamped to
+    // the edge, which is the addressing of a normalized, clamped cuda texture once the
+    // coordinate is scaled by the dimension and shifted by half a voxel. Sample8 evaluates
+    // 8 positions per call with AVX2 gathers when the cpu has them. every voxel type has
+    // its own instance of the kernels, picked once in SetVolume.
+    class VolumeSampler
+    {
+    public:
+        VolumeSampler(void);
+        ~VolumeSampler(void);
+
+    public:
+        enum Filter
+        {
+            FilterNearest = 0,
+            FilterTrilinear,
+            FilterTricubic
+        };
+
+        static const int BATCH_SIZE = 8;
+
+        // addressing constants, voxel (x, y, z) lives at x + y*nLine + z*nFrame in a linear
+        // volume and at pOffsetX[x] + pOffsetY[y] + pOffsetZ[z] in any other layout
+        struct Layout
+        {
+            const void* pData;
+            VoxelType type;
+            int nDims[3];
+            int nLine;
+            int nFrame;
+            const int* pOffsetX;
+            const int* pOffsetY;
+            const int* pOffsetZ;
+            size_t nVoxels;
+        };
+
+        // x fastest linear volume
+        void SetVolume(const short* pVolume, int nWidth, int nHeight, int nDepth);
+        void SetVolume(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth);
+        // separable layouts such as bricks, nVoxels is the size of pVolume in voxels. the
+        // offset tables are referenced, not copied
+        void SetVolume(const short* pVolume, int nWidth, int nHeight, int nDepth, const int* pOffsetX, const int* pOffsetY, const int* pOffsetZ, size_t nVoxels);
+        // for the object coordinate calls, in mm per voxel
+        void SetSpacing(double x, double y, double z);
+
+        const Layout& GetLayout() const{
+            return m_layout;
+        }
+        // Sample8 runs on AVX2 gathers rather than 8 single samples
+        bool HasGather() const{
+            return NULL != m_pfnSample8[FilterTrilinear];
+        }
+
+        float Sample(float x, float y, float z, Filter filter) const;
+        void Sample8(const float* pX, const float* pY, const float* pZ, float* pOut, Filter filter) const;
+        // positions in mm from the volume corner
+        void SampleObject8(const float* pX, const float* pY, const float* pZ, float* pOut, Filter filter) const;
+
+        // copies a linear volume into bricks of 2^nBrickBits voxels a side. the bricks are
+        // in z-order within groups of 4x4x4 bricks and the groups are x fastest, which keeps
+        // the layout separable and pads the volume to whole groups only
+        static bool BuildBricked(const short* pLinear, int nWidth, int nHeight, int nDepth, int nBrickBits, std::vector<short>& vecBricked, std::vector<int>& vecOffsetX, std::vector<int>& vecOffsetY, std::vector<int>& vecOffsetZ);
+
+    private:
+        void SetLayout(const void* pVolume, VoxelType type, int nWidth, int nHeight, int nDepth, const int* pOffsetX, const int* pOffsetY, const int* pOffsetZ, size_t nVoxels);
+
+    private:
+        typedef float (*SampleFunc)(const Layout& layout, float x, float y, float z);
+        typedef void (*Sample8Func)(const Layout& layout, const float* pX, const float* pY, const float* pZ, float* pOut);
+
+        Layout m_layout;
+        float m_fInvSpacing[3];
+        // kernels of the voxel type by Filter, the batched ones are NULL without AVX2 or
+        // when the volume is too large for 32 bit gather offsets
+        SampleFunc m_pfnSample[3];
+        Sample8Func m_pfnSample8[3];
+    };
+}
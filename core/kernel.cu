@@ -21,9 +21,11 @@
 // SOFTWARE.
 
 #include <cuda_runtime.h>
+#include <mutex>
 #include <helper_cuda.h>
 #include <helper_math.h>
 #include "Defines.h"
+#include "BrickTable.h"
 
 using namespace MonkeyGL;
 
@@ -31,98 +33,216 @@ typedef struct {
 	float3 m[3];
 } float3x3;
 
-cudaTextureObject_t volumeText;
-cudaArray* d_volumeArray = 0;
-
 __constant__ cudaTextureObject_t constTransferFuncTexts[MAXOBJECTCOUNT+1];
-cudaTextureObject_t transferFuncTexts[MAXOBJECTCOUNT+1];
-cudaArray *d_transferFuncArrays[MAXOBJECTCOUNT+1];
-
-__constant__ float3 constAlphaAndWWWL[MAXOBJECTCOUNT+1];
-float3 alphaAndWWWL[MAXOBJECTCOUNT+1];
-
-cudaTextureObject_t maskText;
-cudaArray* d_maskArray = 0;
-
-float3 m_f3Nor, m_f3Spacing, m_f3maxper, m_f3permax;
-VOI m_voi;
-cudaExtent m_volumeSize;
-Orientation m_orientation;
-
+__constant__ float3 constAlphaAndMapping[MAXOBJECTCOUNT+1];
+__constant__ cudaTextureObject_t constPreIntegrationTexts[MAXOBJECTCOUNT+1];
 __constant__ float3x3 constTransposeTransformMatrix;
 __constant__ float3x3 constTransformMatrix;
 __constant__ Lightparams constLightPara;
 
-unsigned char* d_pVR = 0;
-int nWidth_VR = 0;
-int nHeight_VR = 0;
-short* d_pMPR = 0;
-int nWidth_MPR = 0;
-int nHeight_MPR = 0;
+namespace MonkeyGL {
 
-extern "C"
-void ReleaseCuda()
-{	
-	if (d_volumeArray != 0)
+	// device state of one renderer. everything used to live in file scope globals,
+	// so two renderers in one process shared a single volume. the __constant__
+	// symbols above are still one per module: a context keeps host copies and
+	// uploads them under g_mutexConstants right before a launch that reads them.
+	struct RenderContext
 	{
-		checkCudaErrors(cudaFreeArray(d_volumeArray));
-		d_volumeArray = 0;
-	}
-	if (d_maskArray != 0)
+		std::mutex mutex;
+
+		cudaTextureObject_t volumeText;
+		cudaArray* d_volumeArray;
+		// a fetch times fVolumeScale is a voxel value, see VolumeTexture
+		float fVolumeScale;
+
+		cudaTextureObject_t transferFuncTexts[MAXOBJECTCOUNT+1];
+		cudaArray* d_transferFuncArrays[MAXOBJECTCOUNT+1];
+		int nLenTransferFuncs[MAXOBJECTCOUNT+1];
+		cudaTextureObject_t preIntegrationTexts[MAXOBJECTCOUNT+1];
+		cudaArray* d_preIntegrationArrays[MAXOBJECTCOUNT+1];
+
+		float3 alphaAndMapping[MAXOBJECTCOUNT+1];
+		float3x3 transformMatrix;
+		float3x3 transposeTransformMatrix;
+		Lightparams lightPara;
+		unsigned int nConstantsVersion;
+
+		cudaTextureObject_t maskText;
+		cudaArray* d_maskArray;
+
+		float3 f3Nor, f3Spacing, f3maxper, f3permax;
+		VOI voi;
+		cudaExtent volumeSize;
+		Orientation orientation;
+
+		unsigned char* d_pVR;
+		int nWidth_VR;
+		int nHeight_VR;
+		short* d_pMPR;
+		int nWidth_MPR;
+		int nHeight_MPR;
+
+		unsigned char* d_pEmptyBricks;
+		unsigned char* d_pEmptyRegions;
+		int3 n3Bricks;
+		int3 n3Regions;
+	};
+}
+
+std::mutex g_mutexConstants;
+const RenderContext* g_pConstantsOwner = NULL;
+unsigned int g_nConstantsVersion = 0;
+
+// caller holds g_mutexConstants
+void bindConstants(RenderContext* ctx)
+{
+	if (g_pConstantsOwner == ctx && g_nConstantsVersion == ctx->nConstantsVersion)
+		return;
+	checkCudaErrors( cudaMemcpyToSymbol(constTransferFuncTexts, ctx->transferFuncTexts, sizeof(ctx->transferFuncTexts)) );
+	checkCudaErrors( cudaMemcpyToSymbol(constAlphaAndMapping, ctx->alphaAndMapping, sizeof(ctx->alphaAndMapping)) );
+	checkCudaErrors( cudaMemcpyToSymbol(constPreIntegrationTexts, ctx->preIntegrationTexts, sizeof(ctx->preIntegrationTexts)) );
+	checkCudaErrors( cudaMemcpyToSymbol(constTransformMatrix, &ctx->transformMatrix, sizeof(float3x3)) );
+	checkCudaErrors( cudaMemcpyToSymbol(constTransposeTransformMatrix, &ctx->transposeTransformMatrix, sizeof(float3x3)) );
+	checkCudaErrors( cudaMemcpyToSymbol(constLightPara, &ctx->lightPara, sizeof(Lightparams)) );
+	g_pConstantsOwner = ctx;
+	g_nConstantsVersion = ctx->nConstantsVersion;
+}
+
+void ensureMPRBuffer(RenderContext* ctx, int width, int height)
+{
+	if (width>ctx->nWidth_MPR || height>ctx->nHeight_MPR)
 	{
-		checkCudaErrors(cudaFreeArray(d_maskArray));
-		d_maskArray = 0;
+		if (ctx->d_pMPR != 0)
+			checkCudaErrors(cudaFree(ctx->d_pMPR));
+		ctx->nWidth_MPR = width;
+		ctx->nHeight_MPR = height;
+		checkCudaErrors(cudaMalloc( (void**)&ctx->d_pMPR, ctx->nWidth_MPR*ctx->nHeight_MPR*sizeof(short) ));
 	}
-	for (int i=0; i<MAXOBJECTCOUNT; i++){
-		if (d_transferFuncArrays[i] != 0)
-		{
-			checkCudaErrors(cudaFreeArray(d_transferFuncArrays[i]));
-			d_transferFuncArrays[i] = 0;
-		}
+	checkCudaErrors( cudaMemset( ctx->d_pMPR, 0, width*height*sizeof(short) ) );
+}
+
+extern "C"
+RenderContext* cu_createContext()
+{
+	RenderContext* ctx = new RenderContext();
+	ctx->volumeText = 0;
+	ctx->fVolumeScale = 32768.0f;
+	ctx->d_volumeArray = 0;
+	for (int i=0; i<MAXOBJECTCOUNT+1; i++){
+		ctx->transferFuncTexts[i] = 0;
+		ctx->d_transferFuncArrays[i] = 0;
+		ctx->nLenTransferFuncs[i] = 0;
+		ctx->preIntegrationTexts[i] = 0;
+		ctx->d_preIntegrationArrays[i] = 0;
+		ctx->alphaAndMapping[i] = make_float3(0.0f, 0.0f, 0.0f);
 	}
-	if (d_pVR != 0)
-	{
-		checkCudaErrors(cudaFree(d_pVR));
-		d_pVR = 0;
+	for (int i=0; i<3; i++){
+		ctx->transformMatrix.m[i] = make_float3(i==0, i==1, i==2);
+		ctx->transposeTransformMatrix.m[i] = make_float3(i==0, i==1, i==2);
 	}
+	memset(&ctx->lightPara, 0, sizeof(Lightparams));
+	ctx->nConstantsVersion = 0;
+	ctx->maskText = 0;
+	ctx->d_maskArray = 0;
+	ctx->f3Nor = ctx->f3Spacing = ctx->f3maxper = ctx->f3permax = make_float3(1.0f, 1.0f, 1.0f);
+	memset(&ctx->voi, 0, sizeof(VOI));
+	ctx->volumeSize = make_cudaExtent(0, 0, 0);
+	memset(&ctx->orientation, 0, sizeof(Orientation));
+	ctx->d_pVR = 0;
+	ctx->nWidth_VR = 0;
+	ctx->nHeight_VR = 0;
+	ctx->d_pMPR = 0;
+	ctx->nWidth_MPR = 0;
+	ctx->nHeight_MPR = 0;
+	ctx->d_pEmptyBricks = 0;
+	ctx->d_pEmptyRegions = 0;
+	ctx->n3Bricks = make_int3(0, 0, 0);
+	ctx->n3Regions = make_int3(0, 0, 0);
+	return ctx;
 }
 
 extern "C"
-void cu_copyVolumeData( short* h_volumeData, cudaExtent volumeSize, Orientation orientation)
+void cu_destroyContext(RenderContext* ctx)
 {
-	m_volumeSize = make_cudaExtent(volumeSize.width, volumeSize.height, volumeSize.depth);
-	m_orientation.rx = orientation.rx;
-	m_orientation.ry = orientation.ry;
-	m_orientation.rz = orientation.rz;
-	m_orientation.cx = orientation.cx;
-	m_orientation.cy = orientation.cy;
-	m_orientation.cz = orientation.cz;
-
-	if (d_volumeArray != 0)
+	if (NULL == ctx)
+		return;
 	{
-		checkCudaErrors(cudaFreeArray(d_volumeArray));
-		d_volumeArray = 0;
-		volumeText = 0;
+		std::lock_guard<std::mutex> lock(g_mutexConstants);
+		if (g_pConstantsOwner == ctx)
+			g_pConstantsOwner = NULL;
 	}
-	if (d_maskArray != 0)
-	{
-		checkCudaErrors(cudaFreeArray(d_maskArray));
-		d_maskArray = 0;
-		maskText = 0;
+
+	if (ctx->volumeText != 0)
+		checkCudaErrors(cudaDestroyTextureObject(ctx->volumeText));
+	if (ctx->d_volumeArray != 0)
+		checkCudaErrors(cudaFreeArray(ctx->d_volumeArray));
+	if (ctx->maskText != 0)
+		checkCudaErrors(cudaDestroyTextureObject(ctx->maskText));
+	if (ctx->d_maskArray != 0)
+		checkCudaErrors(cudaFreeArray(ctx->d_maskArray));
+	for (int i=0; i<MAXOBJECTCOUNT+1; i++){
+		if (ctx->transferFuncTexts[i] != 0)
+			checkCudaErrors(cudaDestroyTextureObject(ctx->transferFuncTexts[i]));
+		if (ctx->d_transferFuncArrays[i] != 0)
+			checkCudaErrors(cudaFreeArray(ctx->d_transferFuncArrays[i]));
+		if (ctx->preIntegrationTexts[i] != 0)
+			checkCudaErrors(cudaDestroyTextureObject(ctx->preIntegrationTexts[i]));
+		if (ctx->d_preIntegrationArrays[i] != 0)
+			checkCudaErrors(cudaFreeArray(ctx->d_preIntegrationArrays[i]));
 	}
+	if (ctx->d_pVR != 0)
+		checkCudaErrors(cudaFree(ctx->d_pVR));
+	if (ctx->d_pMPR != 0)
+		checkCudaErrors(cudaFree(ctx->d_pMPR));
+	if (ctx->d_pEmptyBricks != 0)
+		checkCudaErrors(cudaFree(ctx->d_pEmptyBricks));
+	if (ctx->d_pEmptyRegions != 0)
+		checkCudaErrors(cudaFree(ctx->d_pEmptyRegions));
+	delete ctx;
+}
+
+// the volume texture of each voxel type, in the type's own channel format. the
+// integer types read normalized, float32 as is. 32 bit integer textures can not
+// be filtered, Render hands int32 volumes over as float32
+template <typename T>
+struct VolumeTexture;
+template <> struct VolumeTexture<short>
+{
+	static cudaTextureReadMode ReadMode(){ return cudaReadModeNormalizedFloat; }
+	static float Scale(){ return 32768.0f; }
+};
+template <> struct VolumeTexture<unsigned char>
+{
+	static cudaTextureReadMode ReadMode(){ return cudaReadModeNormalizedFloat; }
+	static float Scale(){ return 255.0f; }
+};
+template <> struct VolumeTexture<unsigned short>
+{
+	static cudaTextureReadMode ReadMode(){ return cudaReadModeNormalizedFloat; }
+	static float Scale(){ return 65535.0f; }
+};
+template <> struct VolumeTexture<float>
+{
+	static cudaTextureReadMode ReadMode(){ return cudaReadModeElementType; }
+	static float Scale(){ return 1.0f; }
+};
 
-	cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<short>();
-	checkCudaErrors( cudaMalloc3DArray(&d_volumeArray, &channelDesc, m_volumeSize) );
+// caller holds ctx->mutex and has released the old array
+template <typename T>
+void copyVolumeArray(RenderContext* ctx, const T* h_volumeData)
+{
+	cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<T>();
+	checkCudaErrors( cudaMalloc3DArray(&ctx->d_volumeArray, &channelDesc, ctx->volumeSize) );
 
 	cudaMemcpy3DParms copyParams = {0};
-	copyParams.dstArray = d_volumeArray;
-	copyParams.extent   = m_volumeSize;
+	copyParams.dstArray = ctx->d_volumeArray;
+	copyParams.extent   = ctx->volumeSize;
 	copyParams.kind     = cudaMemcpyHostToDevice;
 	copyParams.srcPtr   = make_cudaPitchedPtr(
 		(void*)h_volumeData,
-		m_volumeSize.width*sizeof(short),
-		m_volumeSize.width,
-		m_volumeSize.height
+		ctx->volumeSize.width*sizeof(T),
+		ctx->volumeSize.width,
+		ctx->volumeSize.height
 	);
 
 	checkCudaErrors( cudaMemcpy3D(&copyParams) );  
@@ -131,7 +251,7 @@ void cu_copyVolumeData( short* h_volumeData, cudaExtent volumeSize, Orientation
 	memset(&texRes, 0, sizeof(cudaResourceDesc));
 
 	texRes.resType = cudaResourceTypeArray;
-	texRes.res.array.array = d_volumeArray;
+	texRes.res.array.array = ctx->d_volumeArray;
 
 	cudaTextureDesc texDescr;
 	memset(&texDescr, 0, sizeof(cudaTextureDesc));
@@ -143,32 +263,84 @@ void cu_copyVolumeData( short* h_volumeData, cudaExtent volumeSize, Orientation
 	texDescr.addressMode[1] = cudaAddressModeClamp;
 	texDescr.addressMode[2] = cudaAddressModeClamp;
 
-	texDescr.readMode = cudaReadModeNormalizedFloat;
+	texDescr.readMode = VolumeTexture<T>::ReadMode();
 		
-	checkCudaErrors( cudaCreateTextureObject(&volumeText, &texRes, &texDescr, NULL) );
+	checkCudaErrors( cudaCreateTextureObject(&ctx->volumeText, &texRes, &texDescr, NULL) );
+	ctx->fVolumeScale = VolumeTexture<T>::Scale();
+}
+
+// returns the scale that takes a fetch back to voxel values
+extern "C"
+float cu_copyVolumeData(RenderContext* ctx, const void* h_volumeData, int nVoxelType, cudaExtent volumeSize, Orientation orientation)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	ctx->volumeSize = make_cudaExtent(volumeSize.width, volumeSize.height, volumeSize.depth);
+	ctx->orientation.rx = orientation.rx;
+	ctx->orientation.ry = orientation.ry;
+	ctx->orientation.rz = orientation.rz;
+	ctx->orientation.cx = orientation.cx;
+	ctx->orientation.cy = orientation.cy;
+	ctx->orientation.cz = orientation.cz;
+
+	if (ctx->d_volumeArray != 0)
+	{
+		checkCudaErrors(cudaDestroyTextureObject(ctx->volumeText));
+		checkCudaErrors(cudaFreeArray(ctx->d_volumeArray));
+		ctx->d_volumeArray = 0;
+		ctx->volumeText = 0;
+	}
+	if (ctx->d_maskArray != 0)
+	{
+		checkCudaErrors(cudaDestroyTextureObject(ctx->maskText));
+		checkCudaErrors(cudaFreeArray(ctx->d_maskArray));
+		ctx->d_maskArray = 0;
+		ctx->maskText = 0;
+	}
+
+	switch (nVoxelType)
+	{
+	case VoxelTypeUInt8:
+		copyVolumeArray(ctx, (const unsigned char*)h_volumeData);
+		break;
+	case VoxelTypeUInt16:
+		copyVolumeArray(ctx, (const unsigned short*)h_volumeData);
+		break;
+	case VoxelTypeFloat32:
+		copyVolumeArray(ctx, (const float*)h_volumeData);
+		break;
+	default:
+		copyVolumeArray(ctx, (const short*)h_volumeData);
+		break;
+	}
+	return ctx->fVolumeScale;
 }
 
 extern "C"
-void cu_copyMaskData( unsigned char* h_maskData)
+void cu_copyMaskData(RenderContext* ctx, unsigned char* h_maskData)
 {
-	if (d_maskArray != 0)
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	if (ctx->d_maskArray != 0)
 	{
-		checkCudaErrors(cudaFreeArray(d_maskArray));
-		d_maskArray = 0;
+		checkCudaErrors(cudaDestroyTextureObject(ctx->maskText));
+		checkCudaErrors(cudaFreeArray(ctx->d_maskArray));
+		ctx->d_maskArray = 0;
+		ctx->maskText = 0;
 	}
 
 	cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<unsigned char>();
-	checkCudaErrors( cudaMalloc3DArray(&d_maskArray, &channelDesc, m_volumeSize) );
+	checkCudaErrors( cudaMalloc3DArray(&ctx->d_maskArray, &channelDesc, ctx->volumeSize) );
 
 	cudaMemcpy3DParms copyParams = {0};
-	copyParams.dstArray = d_maskArray;
-	copyParams.extent   = m_volumeSize;
+	copyParams.dstArray = ctx->d_maskArray;
+	copyParams.extent   = ctx->volumeSize;
 	copyParams.kind     = cudaMemcpyHostToDevice;
 	copyParams.srcPtr   = make_cudaPitchedPtr(
 		(void*)h_maskData,
-		m_volumeSize.width*sizeof(unsigned char),
-		m_volumeSize.width,
-		m_volumeSize.height
+		ctx->volumeSize.width*sizeof(unsigned char),
+		ctx->volumeSize.width,
+		ctx->volumeSize.height
 	);
 
 	checkCudaErrors( cudaMemcpy3D(&copyParams) );  
@@ -177,7 +349,7 @@ void cu_copyMaskData( unsigned char* h_maskData)
 	memset(&texRes, 0, sizeof(cudaResourceDesc));
 
 	texRes.resType = cudaResourceTypeArray;
-	texRes.res.array.array = d_maskArray;
+	texRes.res.array.array = ctx->d_maskArray;
 
 	cudaTextureDesc texDescr;
 	memset(&texDescr, 0, sizeof(cudaTextureDesc));
@@ -191,44 +363,56 @@ void cu_copyMaskData( unsigned char* h_maskData)
 
 	texDescr.readMode = cudaReadModeNormalizedFloat;
 		
-	checkCudaErrors( cudaCreateTextureObject(&maskText, &texRes, &texDescr, NULL) );
+	checkCudaErrors( cudaCreateTextureObject(&ctx->maskText, &texRes, &texDescr, NULL) );
 }
 
 extern "C"
-void cu_InitCommon(float fxSpacing, float fySpacing, float fzSpacing)
+void cu_InitCommon(RenderContext* ctx, float fxSpacing, float fySpacing, float fzSpacing)
 {	
-	d_pVR = 0;
-	nWidth_VR = 0;
-	nHeight_VR = 0;
-
-	m_f3Spacing.x = fxSpacing;
-	m_f3Spacing.y = fySpacing;
-	m_f3Spacing.z = fzSpacing;
-	m_f3Nor.x = 1.0f / m_volumeSize.width;
-	m_f3Nor.y = 1.0f / m_volumeSize.height;
-	m_f3Nor.z = 1.0f / m_volumeSize.depth;
-	float fMaxSpacing = max(fxSpacing, max(fySpacing, fzSpacing));	
-
-	float fMaxLen = max(m_volumeSize.width*fxSpacing, max(m_volumeSize.height*fySpacing, m_volumeSize.depth*fzSpacing));
-	m_f3maxper.x = 1.0f*fMaxLen/(m_volumeSize.width*fxSpacing);
-	m_f3maxper.y = 1.0f*fMaxLen/(m_volumeSize.height*fySpacing);
-	m_f3maxper.z = 1.0f*fMaxLen/(m_volumeSize.depth*fzSpacing);	
-
-	m_f3permax.x = 1.0f / m_f3maxper.x;
-	m_f3permax.y = 1.0f / m_f3maxper.y;
-	m_f3permax.z = 1.0f / m_f3maxper.z;
-
-    for (int i=0; i<MAXOBJECTCOUNT; i++){
-        d_transferFuncArrays[i] = 0;
-    }
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	ctx->f3Spacing.x = fxSpacing;
+	ctx->f3Spacing.y = fySpacing;
+	ctx->f3Spacing.z = fzSpacing;
+	ctx->f3Nor.x = 1.0f / ctx->volumeSize.width;
+	ctx->f3Nor.y = 1.0f / ctx->volumeSize.height;
+	ctx->f3Nor.z = 1.0f / ctx->volumeSize.depth;
+
+	float fMaxLen = max(ctx->volumeSize.width*fxSpacing, max(ctx->volumeSize.height*fySpacing, ctx->volumeSize.depth*fzSpacing));
+	ctx->f3maxper.x = 1.0f*fMaxLen/(ctx->volumeSize.width*fxSpacing);
+	ctx->f3maxper.y = 1.0f*fMaxLen/(ctx->volumeSize.height*fySpacing);
+	ctx->f3maxper.z = 1.0f*fMaxLen/(ctx->volumeSize.depth*fzSpacing);	
+
+	ctx->f3permax.x = 1.0f / ctx->f3maxper.x;
+	ctx->f3permax.y = 1.0f / ctx->f3maxper.y;
+	ctx->f3permax.z = 1.0f / ctx->f3maxper.z;
 }
 
 extern "C"
-bool cu_setTransferFunc( float* pTransferFunc, int nLenTransferFunc, unsigned char nLabel)
+bool cu_setTransferFunc(RenderContext* ctx, float* pTransferFunc, int nLenTransferFunc, unsigned char nLabel)
 {
-	if (nLabel >= MAXOBJECTCOUNT){
+	if (nLabel > MAXOBJECTCOUNT){
 		return false;
 	}
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	// a table of the same size is refilled in place, the texture object stays valid
+	if (ctx->d_transferFuncArrays[nLabel] != 0 && ctx->nLenTransferFuncs[nLabel] == nLenTransferFunc)
+	{
+		checkCudaErrors(
+			cudaMemcpy2DToArray(
+				ctx->d_transferFuncArrays[nLabel], 
+				0, 
+				0, 
+				pTransferFunc,
+				0, 
+				nLenTransferFunc*sizeof(float4), 
+				1,
+				cudaMemcpyHostToDevice
+			)
+		);
+		return true;
+	}
 
 	cudaResourceDesc texRes;
     memset(&texRes, 0, sizeof(cudaResourceDesc));
@@ -243,15 +427,21 @@ bool cu_setTransferFunc( float* pTransferFunc, int nLenTransferFunc, unsigned ch
 
     cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<float4>();
 
-    if (d_transferFuncArrays[nLabel] != 0)
+    if (ctx->transferFuncTexts[nLabel] != 0)
 	{
-		checkCudaErrors(cudaFreeArray(d_transferFuncArrays[nLabel]));
-		d_transferFuncArrays[nLabel] = 0;
+		checkCudaErrors(cudaDestroyTextureObject(ctx->transferFuncTexts[nLabel]));
+		ctx->transferFuncTexts[nLabel] = 0;
 	}
-    checkCudaErrors(cudaMallocArray( &d_transferFuncArrays[nLabel], &channelDesc, nLenTransferFunc, 1));
+    if (ctx->d_transferFuncArrays[nLabel] != 0)
+	{
+		checkCudaErrors(cudaFreeArray(ctx->d_transferFuncArrays[nLabel]));
+		ctx->d_transferFuncArrays[nLabel] = 0;
+	}
+    checkCudaErrors(cudaMallocArray( &ctx->d_transferFuncArrays[nLabel], &channelDesc, nLenTransferFunc, 1));
+    ctx->nLenTransferFuncs[nLabel] = nLenTransferFunc;
     checkCudaErrors(
         cudaMemcpy2DToArray(
-            d_transferFuncArrays[nLabel], 
+            ctx->d_transferFuncArrays[nLabel], 
             0, 
             0, 
             pTransferFunc,
@@ -262,52 +452,140 @@ bool cu_setTransferFunc( float* pTransferFunc, int nLenTransferFunc, unsigned ch
         )
     );
 
-    texRes.res.array.array = d_transferFuncArrays[nLabel];
+    texRes.res.array.array = ctx->d_transferFuncArrays[nLabel];
 
     cudaTextureObject_t text = 0;
     checkCudaErrors(
         cudaCreateTextureObject(&text, &texRes, &texDescr, NULL)
     );
 
-    transferFuncTexts[nLabel] = text;
-    cudaMemcpyToSymbol(constTransferFuncTexts, transferFuncTexts, sizeof(transferFuncTexts));
+    ctx->transferFuncTexts[nLabel] = text;
+    ctx->nConstantsVersion++;
 
     return true;
 }
 
+// nSize x nSize table, x is the back sample and y the front sample, the size never changes
 extern "C"
-void cu_copyOperatorMatrix( float *pTransformMatrix, float *pTransposeTransformMatrix)
+bool cu_setPreIntegrationTable(RenderContext* ctx, float* pTable, int nSize, unsigned char nLabel)
 {
-	checkCudaErrors( cudaMemcpyToSymbol(constTransformMatrix, pTransformMatrix, sizeof(float3)*3) );
-	checkCudaErrors( cudaMemcpyToSymbol(constTransposeTransformMatrix, pTransposeTransformMatrix, sizeof(float3)*3) );
+	if (nLabel > MAXOBJECTCOUNT){
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	bool bNew = ctx->d_preIntegrationArrays[nLabel] == 0;
+	if (bNew)
+	{
+		cudaChannelFormatDesc channelDesc = cudaCreateChannelDesc<float4>();
+		checkCudaErrors(cudaMallocArray( &ctx->d_preIntegrationArrays[nLabel], &channelDesc, nSize, nSize));
+	}
+	checkCudaErrors(
+		cudaMemcpy2DToArray(
+			ctx->d_preIntegrationArrays[nLabel], 
+			0, 
+			0, 
+			pTable,
+			nSize*sizeof(float4), 
+			nSize*sizeof(float4), 
+			nSize,
+			cudaMemcpyHostToDevice
+		)
+	);
+	if (!bNew)
+		return true;
+
+	cudaResourceDesc texRes;
+	memset(&texRes, 0, sizeof(cudaResourceDesc));
+	texRes.resType = cudaResourceTypeArray;
+	texRes.res.array.array = ctx->d_preIntegrationArrays[nLabel];
+
+	cudaTextureDesc texDescr;
+	memset(&texDescr, 0, sizeof(cudaTextureDesc));
+	texDescr.normalizedCoords = true;
+	texDescr.filterMode = cudaFilterModeLinear;
+	texDescr.addressMode[0] = cudaAddressModeClamp;
+	texDescr.addressMode[1] = cudaAddressModeClamp;
+	texDescr.readMode = cudaReadModeElementType;
+
+	checkCudaErrors(cudaCreateTextureObject(&ctx->preIntegrationTexts[nLabel], &texRes, &texDescr, NULL));
+	ctx->nConstantsVersion++;
+
+	return true;
+}
+
+extern "C"
+void cu_copyOperatorMatrix(RenderContext* ctx, float *pTransformMatrix, float *pTransposeTransformMatrix)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	memcpy(&ctx->transformMatrix, pTransformMatrix, sizeof(float3)*3);
+	memcpy(&ctx->transposeTransformMatrix, pTransposeTransformMatrix, sizeof(float3)*3);
+	ctx->nConstantsVersion++;
 }
 
 extern "C"
-void cu_copyLightPara( float *pLightPara, int nLen)
+void cu_copyLightPara(RenderContext* ctx, float *pLightPara, int nLen)
 {
 	int nBytes = nLen * sizeof(float);
 
 	if (nBytes>sizeof(Lightparams) )
 		nBytes = sizeof(Lightparams);
 
-	checkCudaErrors( cudaMemcpyToSymbol(constLightPara, pLightPara, nBytes ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	memcpy(&ctx->lightPara, pLightPara, nBytes);
+	ctx->nConstantsVersion++;
 }
 
 extern "C"
-void cu_copyAlphaAndWWWL(float *pAlphaAndWWWL)
+void cu_copyAlphaAndMapping(RenderContext* ctx, float *pAlphaAndMapping)
 {
-	checkCudaErrors( cudaMemcpyToSymbol(constAlphaAndWWWL, pAlphaAndWWWL, sizeof(float3)*MAXOBJECTCOUNT+1) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	memcpy(ctx->alphaAndMapping, pAlphaAndMapping, sizeof(float3)*(MAXOBJECTCOUNT+1));
+	ctx->nConstantsVersion++;
 }
 
 extern "C"
-void cu_setVOI(VOI voi)
+void cu_copyEmptyBricks(RenderContext* ctx, const unsigned char* h_pEmptyBricks, int nxBricks, int nyBricks, int nzBricks, const unsigned char* h_pEmptyRegions, int nxRegions, int nyRegions, int nzRegions)
 {
-	m_voi.left = voi.left;
-	m_voi.right = voi.right;
-	m_voi.anterior = voi.anterior;
-	m_voi.posterior = voi.posterior;
-	m_voi.head = voi.head;
-	m_voi.foot = voi.foot;
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	int nBricks = nxBricks*nyBricks*nzBricks;
+	if (nBricks != ctx->n3Bricks.x*ctx->n3Bricks.y*ctx->n3Bricks.z)
+	{
+		if (ctx->d_pEmptyBricks != 0)
+			checkCudaErrors(cudaFree(ctx->d_pEmptyBricks));
+		ctx->d_pEmptyBricks = 0;
+		if (nBricks > 0)
+			checkCudaErrors(cudaMalloc( (void**)&ctx->d_pEmptyBricks, nBricks*sizeof(unsigned char) ));
+	}
+	int nRegions = nxRegions*nyRegions*nzRegions;
+	if (nRegions != ctx->n3Regions.x*ctx->n3Regions.y*ctx->n3Regions.z)
+	{
+		if (ctx->d_pEmptyRegions != 0)
+			checkCudaErrors(cudaFree(ctx->d_pEmptyRegions));
+		ctx->d_pEmptyRegions = 0;
+		if (nRegions > 0)
+			checkCudaErrors(cudaMalloc( (void**)&ctx->d_pEmptyRegions, nRegions*sizeof(unsigned char) ));
+	}
+	ctx->n3Bricks = make_int3(nxBricks, nyBricks, nzBricks);
+	ctx->n3Regions = make_int3(nxRegions, nyRegions, nzRegions);
+
+	if (nBricks <= 0 || nRegions <= 0 || NULL == h_pEmptyBricks || NULL == h_pEmptyRegions)
+		return;
+	checkCudaErrors( cudaMemcpy( ctx->d_pEmptyBricks, h_pEmptyBricks, nBricks*sizeof(unsigned char), cudaMemcpyHostToDevice ) );
+	checkCudaErrors( cudaMemcpy( ctx->d_pEmptyRegions, h_pEmptyRegions, nRegions*sizeof(unsigned char), cudaMemcpyHostToDevice ) );
+}
+
+extern "C"
+void cu_setVOI(RenderContext* ctx, VOI voi)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ctx->voi.left = voi.left;
+	ctx->voi.right = voi.right;
+	ctx->voi.anterior = voi.anterior;
+	ctx->voi.posterior = voi.posterior;
+	ctx->voi.head = voi.head;
+	ctx->voi.foot = voi.foot;
 }
 
 __device__ float3 mul(const float3x3 &M, const float3 &v)
@@ -425,6 +703,49 @@ __device__ bool getNextStep(
 **  /-y
 */
 
+__device__ float getEmptySkipLength(
+	float3 pos,
+	float3 dirRay,
+	int nxIdx,
+	int nyIdx,
+	int nzIdx,
+	const unsigned char* pEmptyBricks,
+	int3 n3Bricks,
+	const unsigned char* pEmptyRegions,
+	int3 n3Regions,
+	cudaExtent volumeSize
+)
+{
+	const int nRegionShift = BrickTable::BRICK_SHIFT + BrickTable::REGION_SHIFT;
+	const int nBrickShift = BrickTable::BRICK_SHIFT;
+
+	int nShift = 0;
+	if (pEmptyRegions[((nzIdx>>nRegionShift)*n3Regions.y + (nyIdx>>nRegionShift))*n3Regions.x + (nxIdx>>nRegionShift)])
+		nShift = nRegionShift;
+	else if (pEmptyBricks[((nzIdx>>nBrickShift)*n3Bricks.y + (nyIdx>>nBrickShift))*n3Bricks.x + (nxIdx>>nBrickShift)])
+		nShift = nBrickShift;
+	else
+		return 0.0f;
+
+	float fLength = 1.0e10f;
+	if (dirRay.x != 0.0f)
+	{
+		int nBound = dirRay.x > 0.0f ? (((nxIdx>>nShift)+1)<<nShift) : ((nxIdx>>nShift)<<nShift);
+		fLength = fminf(fLength, (1.0f*nBound/volumeSize.width - pos.x)/dirRay.x);
+	}
+	if (dirRay.y != 0.0f)
+	{
+		int nBound = dirRay.y > 0.0f ? (((nyIdx>>nShift)+1)<<nShift) : ((nyIdx>>nShift)<<nShift);
+		fLength = fminf(fLength, (1.0f*nBound/volumeSize.height - pos.y)/dirRay.y);
+	}
+	if (dirRay.z != 0.0f)
+	{
+		int nBound = dirRay.z > 0.0f ? (((nzIdx>>nShift)+1)<<nShift) : ((nzIdx>>nShift)<<nShift);
+		fLength = fminf(fLength, (1.0f*nBound/volumeSize.depth - pos.z)/dirRay.z);
+	}
+	return fLength;
+}
+
 __global__ void d_render(
 	unsigned char* pPixelData,
 	cudaTextureObject_t volumeText,
@@ -440,7 +761,12 @@ __global__ void d_render(
 	VOI voi,
 	cudaExtent volumeSize,
 	Orientation orientation,
-	float4 f4ColorBG
+	float4 f4ColorBG,
+	const unsigned char* pEmptyBricks,
+	int3 n3Bricks,
+	const unsigned char* pEmptyRegions,
+	int3 n3Regions,
+	bool bPreIntegration
 )
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
@@ -458,12 +784,21 @@ __global__ void d_render(
 		float3 dirLight = make_float3(0.0f, 1.0f, 0.0f);
 		dirLight = normalize(mul(constTransformMatrix, dirLight));
 
+		// derivative of the texture position along the ray, for leaving empty bricks
+		float3 dirRay = mul(constTransformMatrix, make_float3(0.0f, scale, 0.0f));
+		float3 dirRayTemp = make_float3(dirRay.x * f3maxper.x, dirRay.y * f3maxper.y, dirRay.z * f3maxper.z);
+		dirRay.x = dirRayTemp.x*orientation.rx + dirRayTemp.y*orientation.ry;
+		dirRay.y = dirRayTemp.x*orientation.cx + dirRayTemp.y*orientation.cy;
+		dirRay.z = dirRayTemp.z;
+
 		float fStepL1 = 1.0f/volumeSize.depth;
 		float fStepL4 = fStepL1/4.0f;
 		float fStepL8 = fStepL1/8.0f;
 		float fStepTemp = fStepL1;
 
 		float temp = 0.0f;
+		float tempPre = 0.0f;
+		int nLabelPre = -1;
 		float mask = 0.0f;
 
 		float3 pos;
@@ -486,7 +821,7 @@ __global__ void d_render(
 		float fAlphaPre = 0.0f;
 
 		unsigned char label = 0;
-		float3 alphawwwl = make_float3(0.0f, 0.0f, 0.0f);
+		float3 alphaMapping = make_float3(0.0f, 0.0f, 0.0f);
 
 		while (accuLength < 1.732)
 		{
@@ -508,8 +843,21 @@ __global__ void d_render(
 			if (nxIdx<voi.left || nxIdx>voi.right || nyIdx<voi.posterior || nyIdx>voi.anterior || nzIdx<voi.head || nzIdx>voi.foot)
 			{
 				accuLength += fStepTemp;
+				nLabelPre = -1;
 				continue;
 			}
+			if (pEmptyBricks != 0 && fStepTemp == fStepL1 && fAlphaPre <= 0.001f)
+			{
+				float fSkipLength = getEmptySkipLength(pos, dirRay, nxIdx, nyIdx, nzIdx, pEmptyBricks, n3Bricks, pEmptyRegions, n3Regions, volumeSize);
+				if (fSkipLength > 0.0f)
+				{
+					int nSteps = (int)(fSkipLength/fStepL1);
+					accuLength += max(nSteps, 1)*fStepL1;
+					fAlphaPre = 0.0f;
+					nLabelPre = -1;
+					continue;
+				}
+			}
 			if(maskText == 0){
 				label = 0;
 			}
@@ -517,20 +865,26 @@ __global__ void d_render(
 				mask = 255*tex3D<float>(maskText, pos.x, pos.y, pos.z);
 				label = getMaskLabel(mask);
 			}
-			alphawwwl = constAlphaAndWWWL[label];
+			alphaMapping = constAlphaAndMapping[label];
 
-			temp = 32768*tex3D<float>(volumeText, pos.x, pos.y, pos.z);
-			temp = (temp - alphawwwl.z)/alphawwwl.y + 0.5;
-			if (temp>1)
-				temp = 1;
+			// the window is folded into the mapping and the lut clamps, one fma per sample
+			temp = tex3D<float>(volumeText, pos.x, pos.y, pos.z)*alphaMapping.y + alphaMapping.z;
 
-			col = tex1D<float4>(constTransferFuncTexts[label], temp);
-
-			fAlphaTemp = col.w;
+			if (bPreIntegration){
+				// the segment from the previous sample at a fixed fStepL1, a label change starts a new one
+				col = tex2D<float4>(constPreIntegrationTexts[label], temp, label == nLabelPre ? tempPre : temp);
+				tempPre = temp;
+				nLabelPre = label;
+				fAlphaTemp = col.w;
+			}
+			else{
+				col = tex1D<float4>(constTransferFuncTexts[label], temp);
+				fAlphaTemp = col.w;
+			}
 
 			if (true){
 
-				if (!getNextStep(fAlphaTemp, fStepTemp, accuLength, fAlphaPre, fStepL1, fStepL4, fStepL8)){
+				if (!bPreIntegration && !getNextStep(fAlphaTemp, fStepTemp, accuLength, fAlphaPre, fStepL1, fStepL4, fStepL8)){
 					continue;
 				}	
 				
@@ -539,7 +893,7 @@ __global__ void d_render(
 
 				col.w = fAlphaTemp;
 
-				if (col.w > 0.0005f && alphaAccObject[label] < alphawwwl.x){
+				if (col.w > 0.0005f && alphaAccObject[label] < alphaMapping.x){
 					sum = tracing(sum, alphaAcc, volumeText, pos, col, dirLight, f3Spacing, f3Nor, orientation);
 					alphaAccObject[label] += (1.0f - alphaAcc) * col.w;
 					alphaAcc += (1.0f - alphaAcc) * col.w;
@@ -582,15 +936,17 @@ __global__ void d_render(
 }
 
 extern "C"
-void cu_render(unsigned char* pVR, int width, int height, float xTranslate, float yTranslate, float scale, RGBA colorBG)
+void cu_render(RenderContext* ctx, unsigned char* pVR, int width, int height, float xTranslate, float yTranslate, float scale, RGBA colorBG, bool bPreIntegration)
 {
-	if (width>nWidth_VR || height>nHeight_VR)
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+
+	if (width>ctx->nWidth_VR || height>ctx->nHeight_VR)
 	{
-		if (d_pVR != 0)
-			checkCudaErrors(cudaFree(d_pVR));
-		nWidth_VR = width;
-		nHeight_VR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pVR, nWidth_VR*nHeight_VR*3*sizeof(unsigned char) ));
+		if (ctx->d_pVR != 0)
+			checkCudaErrors(cudaFree(ctx->d_pVR));
+		ctx->nWidth_VR = width;
+		ctx->nHeight_VR = height;
+		checkCudaErrors(cudaMalloc( (void**)&ctx->d_pVR, ctx->nWidth_VR*ctx->nHeight_VR*3*sizeof(unsigned char) ));
 	}
 
 	dim3 blockSize(32, 32);
@@ -598,27 +954,43 @@ void cu_render(unsigned char* pVR, int width, int height, float xTranslate, floa
 
 	float4 clrBG = make_float4(colorBG.red, colorBG.green, colorBG.blue, colorBG.alpha);
 
+	// the constant bank is shared by all contexts, keep it ours until the kernel is done
+	std::lock_guard<std::mutex> lockConstants(g_mutexConstants);
+	bindConstants(ctx);
+
 	d_render<<<gridSize, blockSize>>>(
-		d_pVR,
-		volumeText,
-		maskText,
+		ctx->d_pVR,
+		ctx->volumeText,
+		ctx->maskText,
 		width,
 		height,
 		xTranslate,
 		yTranslate,
 		scale,
-		m_f3maxper,
-		m_f3Spacing,
-		m_f3Nor,
-		m_voi,
-		m_volumeSize,
-		m_orientation,
-		clrBG
+		ctx->f3maxper,
+		ctx->f3Spacing,
+		ctx->f3Nor,
+		ctx->voi,
+		ctx->volumeSize,
+		ctx->orientation,
+		clrBG,
+		ctx->d_pEmptyBricks,
+		ctx->n3Bricks,
+		ctx->d_pEmptyRegions,
+		ctx->n3Regions,
+		bPreIntegration
 	);
-	cudaError_t t = cudaMemcpy( pVR, d_pVR, width*height*3*sizeof(unsigned char), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pVR, ctx->d_pVR, width*height*3*sizeof(unsigned char), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderAxial(short* pData, cudaTextureObject_t volumeText, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
+// a fetch as a voxel value, clamped to the short planes
+__device__ short fetchShort(cudaTextureObject_t volumeText, float fVolumeScale, float x, float y, float z)
+{
+	float v = fVolumeScale*tex3D<float>(volumeText, x, y, z);
+	return (short)fminf(fmaxf(v, -32768.0f), 32767.0f);
+}
+
+__global__ void d_renderAxial(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -630,32 +1002,25 @@ __global__ void d_renderAxial(short* pData, cudaTextureObject_t volumeText, int
 		float u = 1.0f*x/width;
 		float v = 1.0f*y/height;
 
-		pData[nIdx] = 32768*tex3D<float>(volumeText, u, v, fDepth);
+		pData[nIdx] = fetchShort(volumeText, fVolumeScale, u, v, fDepth);
 	}
 }
 
 extern "C"
-void cu_renderAxial(short* pData, int width, int height, float fDepth)
+void cu_renderAxial(RenderContext* ctx, short* pData, int width, int height, float fDepth)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderAxial<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, fDepth, m_voi, m_volumeSize);
+	d_renderAxial<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, fDepth, ctx->voi, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderSagittal(short* pData, cudaTextureObject_t volumeText, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
+__global__ void d_renderSagittal(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -667,32 +1032,25 @@ __global__ void d_renderSagittal(short* pData, cudaTextureObject_t volumeText, i
 		float u = 1.0f*x/width;
 		float v = 1.0f - 1.0f*y/height;
 
-		pData[nIdx] = 32768*tex3D<float>(volumeText, fDepth, u, v);
+		pData[nIdx] = fetchShort(volumeText, fVolumeScale, fDepth, u, v);
 	}
 }
 
 extern "C"
-void cu_renderSagittal(short* pData, int width, int height, float fDepth)
+void cu_renderSagittal(RenderContext* ctx, short* pData, int width, int height, float fDepth)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderSagittal<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, fDepth, m_voi, m_volumeSize);
+	d_renderSagittal<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, fDepth, ctx->voi, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderConoral(short* pData, cudaTextureObject_t volumeText, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
+__global__ void d_renderConoral(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float fDepth, VOI voi, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -704,32 +1062,25 @@ __global__ void d_renderConoral(short* pData, cudaTextureObject_t volumeText, in
 		float u = 1.0f*x/width;
 		float v = 1.0f - 1.0f*y/height;
 
-		pData[nIdx] = 32768*tex3D<float>(volumeText, u, fDepth, v);
+		pData[nIdx] = fetchShort(volumeText, fVolumeScale, u, fDepth, v);
 	}
 }
 
 extern "C"
-void cu_renderCoronal(short* pData, int width, int height, float fDepth)
+void cu_renderCoronal(RenderContext* ctx, short* pData, int width, int height, float fDepth)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderConoral<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, fDepth, m_voi, m_volumeSize);
+	d_renderConoral<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, fDepth, ctx->voi, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderPlane_MIP(short* pData, cudaTextureObject_t volumeText, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
+__global__ void d_renderPlane_MIP(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -751,7 +1102,7 @@ __global__ void d_renderPlane_MIP(short* pData, cudaTextureObject_t volumeText,
 			float fz = (pt_z + x*fPixelSpacing*dirH.z + y*fPixelSpacing*dirV.z)/(f3Spacing.z*volumeSize.depth);
 
 			if (fx>=0 && fx<=1 && fy>=0 && fy<=1 && fz>=0 && fz<=1)
-				nVal = 32768*tex3D<float>(volumeText, fx, fy, 1.0f-fz);
+				nVal = fetchShort(volumeText, fVolumeScale, fx, fy, 1.0f-fz);
 			else
 				nVal = -32768;
 			pData[nIdx] = pData[nIdx]>nVal ? pData[nIdx]:nVal;
@@ -760,27 +1111,20 @@ __global__ void d_renderPlane_MIP(short* pData, cudaTextureObject_t volumeText,
 }
 
 extern "C"
-void cu_renderPlane_MIP(short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
+void cu_renderPlane_MIP(RenderContext* ctx, short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderPlane_MIP<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, m_f3Spacing, m_volumeSize);
+	d_renderPlane_MIP<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, ctx->f3Spacing, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderPlane_MinIP(short* pData, cudaTextureObject_t volumeText, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
+__global__ void d_renderPlane_MinIP(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -802,7 +1146,7 @@ __global__ void d_renderPlane_MinIP(short* pData, cudaTextureObject_t volumeText
 			float fz = (pt_z + x*fPixelSpacing*dirH.z + y*fPixelSpacing*dirV.z)/(f3Spacing.z*volumeSize.depth);
 
 			if (fx>=0 && fx<=1 && fy>=0 && fy<=1 && fz>=0 && fz<=1)
-				nVal = 32768*tex3D<float>(volumeText, fx, fy, 1.0f-fz);
+				nVal = fetchShort(volumeText, fVolumeScale, fx, fy, 1.0f-fz);
 			else
 				nVal = -32768;
 			pData[nIdx] = pData[nIdx]<nVal ? pData[nIdx]:nVal;
@@ -811,27 +1155,20 @@ __global__ void d_renderPlane_MinIP(short* pData, cudaTextureObject_t volumeText
 }
 
 extern "C"
-void cu_renderPlane_MinIP(short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
+void cu_renderPlane_MinIP(RenderContext* ctx, short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderPlane_MinIP<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, m_f3Spacing, m_volumeSize);
+	d_renderPlane_MinIP<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, ctx->f3Spacing, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
 
-__global__ void d_renderPlane_Average(short* pData, cudaTextureObject_t volumeText, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
+__global__ void d_renderPlane_Average(short* pData, cudaTextureObject_t volumeText, float fVolumeScale, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum, float3 f3Spacing, cudaExtent volumeSize)
 {
 	const int x = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
 	const int y = __umul24(blockIdx.y, blockDim.y) + threadIdx.y;
@@ -852,31 +1189,25 @@ __global__ void d_renderPlane_Average(short* pData, cudaTextureObject_t volumeTe
 			float fz = (pt_z + x*fPixelSpacing*dirH.z + y*fPixelSpacing*dirV.z)/(f3Spacing.z*volumeSize.depth);
 
 			if (fx>=0 && fx<=1 && fy>=0 && fy<=1 && fz>=0 && fz<=1)
-				fSum += 32768*tex3D<float>(volumeText, fx, fy, 1.0f-fz);
+				fSum += fVolumeScale*tex3D<float>(volumeText, fx, fy, 1.0f-fz);
 			else
 				fSum += -32768;
 		}
-		pData[nIdx] = fSum/(2*halfNum+1);
+		fSum /= 2*halfNum+1;
+		pData[nIdx] = (short)fmin(fmax(fSum, -32768.0), 32767.0);
 	}
 }
 
 extern "C"
-void cu_renderPlane_Average(short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
+void cu_renderPlane_Average(RenderContext* ctx, short* pData, int width, int height, float3 dirH, float3 dirV, float3 dirN, float3 ptLeftTop, float fPixelSpacing, float halfNum)
 {
-	if (width>nWidth_MPR || height>nHeight_MPR)
-	{
-		if (d_pMPR != 0)
-			checkCudaErrors(cudaFree(d_pMPR));
-		nWidth_MPR = width;
-		nHeight_MPR = height;
-		checkCudaErrors(cudaMalloc( (void**)&d_pMPR, nWidth_MPR*nHeight_MPR*sizeof(short) ));
-	}
-	checkCudaErrors( cudaMemset( d_pMPR, 0, width*height*sizeof(short) ) );
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ensureMPRBuffer(ctx, width, height);
 
 	dim3 blockSize(16, 16);
 	dim3 gridSize( (width-1)/blockSize.x+1, (height-1)/blockSize.y+1 );
 
-	d_renderPlane_Average<<<gridSize, blockSize>>>(d_pMPR, volumeText, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, m_f3Spacing, m_volumeSize);
+	d_renderPlane_Average<<<gridSize, blockSize>>>(ctx->d_pMPR, ctx->volumeText, ctx->fVolumeScale, width, height, dirH, dirV, dirN, ptLeftTop, fPixelSpacing, halfNum, ctx->f3Spacing, ctx->volumeSize);
 
-	cudaError_t t = cudaMemcpy( pData, d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
+	cudaError_t t = cudaMemcpy( pData, ctx->d_pMPR, width*height*sizeof(short), cudaMemcpyDeviceToHost );
 }
@@ -29,6 +29,7 @@ def test_load_volme():
     dirY = mk.Direction3d(0., 1., 0.)
     dirZ = mk.Direction3d(0., 0., 1.)
     hm.SetDirection(dirX, dirY, dirZ)
+    # hm.SetMemoryMapEnabled(True)
     hm.SetVolumeFile(f'{file_path}/cardiac.raw', 512, 512, 361)
     hm.SetSpacing(0.351, 0.351, 0.3)
     # hm.SetVolumeFile(f'{file_path}/body.raw', 512, 512, 1559)
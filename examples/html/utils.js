@@ -68,10 +68,18 @@ function decodeMPR(buffer) {
     img_b64 = jdata.image;
 
     let base64Buffer = _loadBase64(img_b64, false);
-    let png = new PNG(base64Buffer);
-    let pixelArray = png.decodePixels();
-    let width = png.width * 2;
-    let height = png.height;
+    let pixelArray, width, height;
+    if (jdata.codec == 'slice') {
+        let slice = _decodeSliceCodec(base64Buffer);
+        pixelArray = slice.pixels;
+        width = slice.width;
+        height = slice.height;
+    } else {
+        let png = new PNG(base64Buffer);
+        pixelArray = new Int16Array(png.decodePixels().buffer);
+        width = png.width * 2;
+        height = png.height;
+    }
 
     isColor = false;
     window_center = 40;
@@ -84,8 +92,6 @@ function decodeMPR(buffer) {
     invert = false;
     signed = true;
 
-    pixelArray = new Int16Array(pixelArray.buffer);
-
     let pixelValues = _getPixelValues(pixelArray);
     let minPixelValue = pixelValues.minPixelValue;
     let maxPixelValue = pixelValues.maxPixelValue;
@@ -123,6 +129,79 @@ function decodeMPR(buffer) {
     return cornerstoneMetaData;
 }
 
+// mirror of SliceCodec::Decode in core/SliceCodec.cpp
+function _decodeSliceCodec(bytes) {
+    const LIMIT = 24, GRADIENT_CONTEXTS = 16, MAX_STATE = 63;
+    const STATE_DELTA = [-2, 1, 2, 4, 6, 8, 10, 12];
+    let view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    if (String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) != 'MK16' || view.getUint32(4, true) != 2) {
+        throw new Error('unsupported slice codec stream');
+    }
+    let width = view.getUint32(8, true);
+    let height = view.getUint32(12, true);
+    let rowsPerBand = view.getUint32(16, true);
+    let bands = view.getUint32(20, true);
+    let pixels = new Int16Array(width * height);
+
+    let offset = 4 * (6 + bands);
+    for (let band = 0; band < bands; band++) {
+        let bandEnd = offset + view.getUint32(4 * (6 + band), true);
+        let pos = offset * 8;
+        let readBits = (n) => {
+            let v = 0;
+            for (let i = 0; i < n; i++, pos++) {
+                let byte = (pos >> 3) < bandEnd ? bytes[pos >> 3] : 0;
+                v = v * 2 + ((byte >> (7 - (pos & 7))) & 1);
+            }
+            return v;
+        };
+        // a context is a state, k = state >> 2, moved by the quotient of every code
+        let readRice = (ctx, rawBits) => {
+            let k = states[ctx] >> 2;
+            let q = 0;
+            while (q < LIMIT && readBits(1)) q++;
+            let v = q >= LIMIT ? readBits(rawBits) : q * Math.pow(2, k) + readBits(k);
+            if (q >= LIMIT) q = Math.floor(v / Math.pow(2, k));
+            states[ctx] = Math.min(MAX_STATE, Math.max(0, states[ctx] + STATE_DELTA[Math.min(q, 7)]));
+            return v;
+        };
+        let states = new Array(GRADIENT_CONTEXTS + 1).fill(8);
+
+        let yStart = band * rowsPerBand;
+        let yEnd = Math.min(yStart + rowsPerBand, height);
+        for (let y = yStart; y < yEnd; y++) {
+            let row = y * width, prev = row - width;
+            let neighbours = (x) => {
+                if (y > yStart) {
+                    let b = pixels[prev + x];
+                    return x > 0 ? [pixels[row + x - 1], b, pixels[prev + x - 1]] : [b, b, b];
+                }
+                let a = x > 0 ? pixels[row + x - 1] : 0;
+                return [a, a, a];
+            };
+            let x = 0;
+            while (x < width) {
+                let [a, b, c] = neighbours(x);
+                if (a == b && b == c) {
+                    let run = readRice(GRADIENT_CONTEXTS, 32);
+                    pixels.fill(a, row + x, row + x + run);
+                    x += run;
+                    if (x >= width) break;
+                    [a, b, c] = neighbours(x);
+                }
+                let g = Math.abs(a - c) + Math.abs(b - c);
+                let ctx = g == 0 ? 0 : Math.min(GRADIENT_CONTEXTS - 1, 32 - Math.clz32(g));
+                let m = readRice(ctx, 16);
+                let pred = c >= Math.max(a, b) ? Math.min(a, b) : (c <= Math.min(a, b) ? Math.max(a, b) : a + b - c);
+                pixels[row + x] = pred + ((m >>> 1) ^ -(m & 1));
+                x++;
+            }
+        }
+        offset = bandEnd;
+    }
+    return { width: width, height: height, pixels: pixels };
+}
+
 function _loadBase64(base64Str, isBuffer=true) {
     let binary_string = window.atob(base64Str);
     let len = binary_string.length;
@@ -14,7 +14,6 @@ import uvicorn
 from enum import Enum
 from fastapi.middleware.cors import CORSMiddleware
 from fastapi.responses import StreamingResponse, FileResponse
-import SimpleITK as sitk
 
 app = FastAPI()
 
@@ -101,22 +100,9 @@ def set_volume_type(
         hm.SetTransferFunc(tf)
         spacing = (0.8496089, 0.8496089, 0.625)
     elif vol_type == 4:
-        itk_img = sitk.ReadImage(f'{file_path}/neckcta.nrrd')
-        dir = itk_img.GetDirection()
-        dirX = mk.Direction3d(dir[0], dir[1], dir[2])
-        dirY = mk.Direction3d(dir[3], dir[4], dir[5])
-        dirZ = mk.Direction3d(dir[6], dir[7], dir[8])
-        spacing = itk_img.GetSpacing()
-        depth = itk_img.GetDepth()
-        npdata = sitk.GetArrayFromImage(itk_img)
-        npdatat = npdata.swapaxes(2,0)
-
-        itk_mask = sitk.ReadImage(f'{file_path}/neckcta_mask.nii.gz')
-        npmaskdata = sitk.GetArrayFromImage(itk_mask)
-        npmaskdatat = npmaskdata.swapaxes(2,0)
-
-        hm.SetDirection(dirX, dirY, dirZ)
-        hm.SetVolumeArray(npdatat)
+        # size, spacing and direction come from the file
+        hm.LoadVolumeFile(f'{file_path}/neckcta.nrrd')
+        spacing = None
 
         tf0 = {}
         tf0[10] = mk.RGBA(1.0, 1.0, 1.0, 0)
@@ -127,7 +113,7 @@ def set_volume_type(
         hm.SetObjectAlpha(0.6, 0)
         hm.SetTransferFunc(tf0)
 
-        hm.AddNewObjectMaskArray(npmaskdatat)
+        hm.AddNewObjectMaskFile(f'{file_path}/neckcta_mask.nii.gz')
         tf1 = {}
         tf1[10] = mk.RGBA(0.8, 0, 0, 0)
         tf1[90] = mk.RGBA(0.8, 0.8, 0.8, 0.8)
@@ -139,26 +125,8 @@ def set_volume_type(
 
 
     elif vol_type == 5:
-        itk_img = sitk.ReadImage(f'{file_path}/corocta.nrrd')
-        dir = itk_img.GetDirection()
-        dirX = mk.Direction3d(dir[0], dir[1], dir[2])
-        dirY = mk.Direction3d(dir[3], dir[4], dir[5])
-        dirZ = mk.Direction3d(dir[6], dir[7], dir[8])
-        spacing = itk_img.GetSpacing()
-        depth = itk_img.GetDepth()
-        npdata = sitk.GetArrayFromImage(itk_img)
-        npdatat = npdata.swapaxes(2,0)
-
-        itk_mask = sitk.ReadImage(f'{file_path}/corocta_vessel_mask.nii.gz')
-        npmaskdata = sitk.GetArrayFromImage(itk_mask)
-        npmaskdatat = npmaskdata.swapaxes(2,0)
-
-        itk_mask2 = sitk.ReadImage(f'{file_path}/corocta_heart_mask.nii.gz')
-        npmaskdata2 = sitk.GetArrayFromImage(itk_mask2)
-        npmaskdatat2 = npmaskdata2.swapaxes(2,0)
-
-        hm.SetDirection(dirX, dirY, dirZ)
-        hm.SetVolumeArray(npdatat)
+        hm.LoadVolumeFile(f'{file_path}/corocta.nrrd')
+        spacing = None
 
         tf0 = {}
         tf0[5] = mk.RGBA(0.8, 0.8, 0.8, 0)
@@ -169,7 +137,7 @@ def set_volume_type(
         hm.SetObjectAlpha(0, 0)
         hm.SetTransferFunc(tf0)
 
-        label1 = hm.AddNewObjectMaskArray(npmaskdatat)
+        label1 = hm.AddNewObjectMaskFile(f'{file_path}/corocta_vessel_mask.nii.gz')
         tf1 = {}
         tf1[5] = mk.RGBA(0.8, 0, 0, 0)
         tf1[90] = mk.RGBA(0.8, 0.8, 0.8, 0.8)
@@ -179,7 +147,7 @@ def set_volume_type(
         hm.SetObjectAlpha(1, 1)
         hm.SetTransferFunc(tf1)
 
-        label2 = hm.AddNewObjectMaskArray(npmaskdatat2)
+        label2 = hm.AddNewObjectMaskFile(f'{file_path}/corocta_heart_mask.nii.gz')
         tf1 = {}
         tf1[5] = mk.RGBA(0.8, 0, 0, 0)
         tf1[90] = mk.RGBA(0.8, 0.8, 0.8, 0.8)
@@ -189,7 +157,8 @@ def set_volume_type(
         hm.SetObjectAlpha(0.4, label2)
         hm.SetTransferFunc(tf1)
     
-    hm.SetSpacing(spacing[0], spacing[1], spacing[2])
+    if spacing is not None:
+        hm.SetSpacing(spacing[0], spacing[1], spacing[2])
 
     return {
         'message': 'successful'
@@ -198,29 +167,48 @@ def set_volume_type(
 @app.get('/vrdata')
 def get_vr_data(
     x_angle: float,
-    y_angle: float
+    y_angle: float,
+    progressive: bool = False
 ):
     width = 512
     height = 512
     hm.Rotate(x_angle, y_angle)
-    b64str = hm.GetVRData_pngString(width, height)
-
+    if not progressive:
+        b64str = hm.GetVRData_pngString(width, height)
+        return {
+            'data': {
+                'image': b64str
+            },
+            'message': 'successful'
+        }
+
+    # while dragging the client calls again with zero angles until is_final
+    b64str, quality_level, is_final = hm.GetVRDataProgressive_pngString(width, height)
     return {
         'data': {
-            'image': b64str
+            'image': b64str,
+            'quality_level': quality_level,
+            'is_final': is_final
         },
         'message': 'successful'
     }
 
+def encode_plane(plane_type, codec):
+    if codec == 'slice':
+        return hm.GetPlaneData_sliceCodecString(mk.PlaneType(plane_type))
+    return hm.GetPlaneData_pngString(mk.PlaneType(plane_type))
+
 @app.get('/mprdata')
 def get_mpr_data(
-    plane_type: int
+    plane_type: int,
+    codec: str = 'png'
 ):
-    b64str = hm.GetPlaneData_pngString(mk.PlaneType(plane_type))
+    b64str = encode_plane(plane_type, codec)
 
     return {
         'data': {
-            'image': b64str
+            'image': b64str,
+            'codec': codec
         },
         'message': 'successful'
     }
@@ -228,27 +216,34 @@ def get_mpr_data(
 @app.get('/mprbrowse')
 def browse_mpr_data(
     plane_type: int,
-    delta: float
+    delta: float,
+    codec: str = 'png'
 ):
     hm.Browse(delta, mk.PlaneType(plane_type))
-    b64str = hm.GetPlaneData_pngString(mk.PlaneType(plane_type))
+    b64str = encode_plane(plane_type, codec)
 
     return {
         'data': {
-            'image': b64str
+            'image': b64str,
+            'codec': codec
         },
         'message': 'successful'
     }
 
 @app.get('/originbrowse')
 def browse_origin_data(
-    slice: int
+    slice: int,
+    codec: str = 'png'
 ):
-    b64str = hm.GetOriginData_pngString(slice)
+    if codec == 'slice':
+        b64str = hm.GetOriginData_sliceCodecString(slice)
+    else:
+        b64str = hm.GetOriginData_pngString(slice)
 
     return {
         'data': {
-            'image': b64str
+            'image': b64str,
+            'codec': codec
         },
         'message': 'successful'
     }
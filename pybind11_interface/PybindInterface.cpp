@@ -49,7 +49,7 @@ std::shared_ptr<T> _arrays_1d_to_ptr(py::array_t<T> npData, int& cnt) {
     cnt = buf.size;
 
     T* ptr = (T*)buf.ptr;
-    std::shared_ptr<T> pData(new T[cnt * sizeof(T)]);
+    std::shared_ptr<T> pData(new T[cnt], std::default_delete<T[]>());
 
     memcpy(pData.get(), ptr, cnt*sizeof(T));
     return pData;
@@ -68,10 +68,10 @@ std::shared_ptr<T> _arrays_3d_to_ptr(py::array_t<T> npData, int& nWidth, int& nH
     nWidth = buf.shape[0];
     nHeight = buf.shape[1];
     nDepth = buf.shape[2];
-    int cnt = buf.size;
+    py::ssize_t cnt = buf.size;
 
     T* ptr = (T*)buf.ptr;
-    std::shared_ptr<T> pData(new T[cnt * sizeof(T)]);
+    std::shared_ptr<T> pData(new T[cnt], std::default_delete<T[]>());
 
     memcpy(pData.get(), ptr, cnt*sizeof(T));
     return pData;
@@ -80,18 +80,51 @@ std::shared_ptr<T> _arrays_3d_to_ptr(py::array_t<T> npData, int& nWidth, int& nH
 class pyHelloMonkey : public HelloMonkey {
 
 public:
-    virtual py::array_t<short> GetVolumeArray(){
+    // the volume in its own voxel type
+    virtual py::array GetVolumeArray(){
         int nWidth=0, nHeight=0, nDepth=0;
-        std::shared_ptr<short> pData = GetVolumeData(nWidth, nHeight, nDepth);
-        return _ptr_to_arrays_3d(pData.get(), nWidth, nHeight, nDepth);
+        VoxelType type = VoxelTypeInt16;
+        std::shared_ptr<void> pData = GetVoxelData(nWidth, nHeight, nDepth, type);
+        switch (type)
+        {
+        case VoxelTypeUInt8:
+            return _ptr_to_arrays_3d((unsigned char*)pData.get(), nWidth, nHeight, nDepth);
+        case VoxelTypeUInt16:
+            return _ptr_to_arrays_3d((unsigned short*)pData.get(), nWidth, nHeight, nDepth);
+        case VoxelTypeInt32:
+            return _ptr_to_arrays_3d((int*)pData.get(), nWidth, nHeight, nDepth);
+        case VoxelTypeFloat32:
+            return _ptr_to_arrays_3d((float*)pData.get(), nWidth, nHeight, nDepth);
+        default:
+            return _ptr_to_arrays_3d((short*)pData.get(), nWidth, nHeight, nDepth);
+        }
     };
 
-    virtual bool SetVolumeArray(py::array_t<short> npData){
+    // uint8, int16, uint16, int32 and float32 arrays are kept in their type. int8 widens
+    // to int16, the other floats become float32 and the other integers int32 as numpy
+    // casts them
+    virtual bool SetVolumeArray(py::array npData){
+        py::dtype dtype = npData.dtype();
+        char kind = dtype.kind();
+        size_t nBytes = dtype.itemsize();
+        if (kind == 'f')
+            return SetVolumeArrayAs<float>(npData, VoxelTypeFloat32);
+        if (kind == 'u' && nBytes == 1)
+            return SetVolumeArrayAs<unsigned char>(npData, VoxelTypeUInt8);
+        if (kind == 'u' && nBytes == 2)
+            return SetVolumeArrayAs<unsigned short>(npData, VoxelTypeUInt16);
+        if ((kind == 'i' || kind == 'u') && nBytes >= 4)
+            return SetVolumeArrayAs<int>(npData, VoxelTypeInt32);
+        return SetVolumeArrayAs<short>(npData, VoxelTypeInt16);
+    };
+
+    template <typename T>
+    bool SetVolumeArrayAs(py::array npData, VoxelType type){
         int nWidth = 0;
         int nHeight = 0;
         int nDepth = 0;
-        std::shared_ptr<short> pData = _arrays_3d_to_ptr(npData, nWidth, nHeight, nDepth);
-        return SetVolumeData(pData, nWidth, nHeight, nDepth);
+        std::shared_ptr<T> pData = _arrays_3d_to_ptr(py::array_t<T>::ensure(npData), nWidth, nHeight, nDepth);
+        return SetVolumeData(pData, type, nWidth, nHeight, nDepth);
     };
 
     virtual unsigned char AddNewObjectMaskArray(py::array_t<unsigned char> npData){
@@ -111,7 +144,7 @@ public:
     };
 
     virtual py::array_t<unsigned char> GetVRArray(int nWidth, int nHeight){
-	    std::shared_ptr<unsigned char> pVR (new unsigned char[nWidth*nHeight*3]);
+	    std::shared_ptr<unsigned char> pVR (new unsigned char[nWidth*nHeight*3], std::default_delete<unsigned char[]>());
         GetVRData((unsigned char*)pVR.get(), nWidth, nHeight);
         return _ptr_to_arrays_3d((unsigned char*)pVR.get(), 3, nWidth, nHeight);
     }
@@ -121,6 +154,73 @@ public:
         return _ptr_to_arrays_1d(out_buf.data(), out_buf.size());
     }
 
+    virtual py::tuple GetFrameCacheStats(){
+        unsigned long long nHits = 0, nMisses = 0;
+        size_t nBytes = 0, nCount = 0;
+        HelloMonkey::GetFrameCacheStats(nHits, nMisses, nBytes, nCount);
+        return py::make_tuple(nHits, nMisses, nBytes, nCount);
+    }
+
+    virtual py::tuple GetVRDataProgressive_pngString(int nWidth, int nHeight){
+        int nQualityLevel = 0;
+        bool bFinal = false;
+        std::string strBase64 = HelloMonkey::GetVRDataProgressive_pngString(nWidth, nHeight, nQualityLevel, bFinal);
+        return py::make_tuple(strBase64, nQualityLevel, bFinal);
+    }
+
+    // the slices are rendered straight into the returned (m_nNum, height, width) array
+    virtual py::array_t<short> GetBatchArray(BatchInfo batchInfo){
+        py::ssize_t nNum = batchInfo.m_nNum < 0 ? 0 : batchInfo.m_nNum;
+        py::ssize_t nWidth = batchInfo.Width() < 0 ? 0 : batchInfo.Width();
+        py::ssize_t nHeight = batchInfo.Height() < 0 ? 0 : batchInfo.Height();
+        auto result = py::array_t<short>({ nNum, nHeight, nWidth });
+        py::buffer_info buf = result.request();
+        bool bSuccess = false;
+        {
+            py::gil_scoped_release release;
+            bSuccess = GetBatchData((short*)buf.ptr, batchInfo);
+        }
+        if (!bSuccess)
+            throw std::runtime_error("GetBatchArray: failed to render the batch");
+        return result;
+    }
+
+    virtual bool SetCPRCenterlineArray(py::array_t<double> npPoints){
+        py::buffer_info buf = npPoints.request();
+        if (buf.ndim != 2 || buf.shape[1] != 3)
+            throw std::runtime_error("SetCPRCenterlineArray: expects an (n, 3) array of points");
+        auto points = npPoints.unchecked<2>();
+        std::vector<Point3d> vecPoints;
+        for (py::ssize_t i=0; i<points.shape(0); i++){
+            vecPoints.push_back(Point3d(points(i, 0), points(i, 1), points(i, 2)));
+        }
+        return SetCPRCenterline(vecPoints);
+    }
+
+    virtual py::array_t<short> GetCPRStraightenedArray(int nWidth, double fAngle){
+        auto result = py::array_t<short>({ (py::ssize_t)GetCPRHeight(), (py::ssize_t)nWidth });
+        py::buffer_info buf = result.request();
+        if (!GetCPRStraightenedData((short*)buf.ptr, nWidth, fAngle))
+            throw std::runtime_error("GetCPRStraightenedArray: no centerline or bad width");
+        return result;
+    }
+
+    virtual py::array_t<short> GetCPRStretchedArray(int nWidth, Direction3d dirLateral){
+        auto result = py::array_t<short>({ (py::ssize_t)GetCPRStretchedHeight(dirLateral), (py::ssize_t)nWidth });
+        py::buffer_info buf = result.request();
+        if (!GetCPRStretchedData((short*)buf.ptr, nWidth, dirLateral))
+            throw std::runtime_error("GetCPRStretchedArray: no centerline or bad width");
+        return result;
+    }
+
+    virtual py::array_t<short> GetCPRCrossSectionArray(int nWidth, int nHeight, int nNum, double fDistance, double fAngle){
+        auto result = py::array_t<short>({ (py::ssize_t)nNum, (py::ssize_t)nHeight, (py::ssize_t)nWidth });
+        py::buffer_info buf = result.request();
+        if (!GetCPRCrossSectionData((short*)buf.ptr, nWidth, nHeight, nNum, fDistance, fAngle))
+            throw std::runtime_error("GetCPRCrossSectionArray: no centerline or bad size");
+        return result;
+    }
+
 };
 
 PYBIND11_MODULE(pyMonkeyGL, m) {
@@ -150,6 +250,20 @@ PYBIND11_MODULE(pyMonkeyGL, m) {
         .value("MPRTypeMinIP", MPRType::MPRTypeMinIP)
         .export_values();
 
+    py::enum_<VoxelType>(m, "VoxelType")
+        .value("VoxelTypeInt16", VoxelType::VoxelTypeInt16)
+        .value("VoxelTypeUInt8", VoxelType::VoxelTypeUInt8)
+        .value("VoxelTypeUInt16", VoxelType::VoxelTypeUInt16)
+        .value("VoxelTypeInt32", VoxelType::VoxelTypeInt32)
+        .value("VoxelTypeFloat32", VoxelType::VoxelTypeFloat32)
+        .export_values();
+
+    py::enum_<BatchType>(m, "BatchType")
+        .value("BatchTypeParallel", BatchType::BatchTypeParallel)
+        .value("BatchTypeRadial", BatchType::BatchTypeRadial)
+        .value("BatchTypeRotating", BatchType::BatchTypeRotating)
+        .export_values();
+
     py::class_<DeviceInfo>(m, "DeviceInfo")
         .def(py::init<>())
         .def("GetCount", &DeviceInfo::GetCount);
@@ -163,10 +277,41 @@ PYBIND11_MODULE(pyMonkeyGL, m) {
         .def(py::init<>())
         .def(py::init<float, float, float>());
 
+    py::class_<Point3d>(m, "Point3d")
+        .def(py::init<>())
+        .def(py::init<double, double, double>());
+
+    py::class_<BatchInfo>(m, "BatchInfo")
+        .def(py::init<>())
+        .def_readwrite("dirH", &BatchInfo::m_dirH)
+        .def_readwrite("dirV", &BatchInfo::m_dirV)
+        .def_readwrite("ptCenter", &BatchInfo::m_ptCenter)
+        .def_readwrite("lengthH", &BatchInfo::m_fLengthH)
+        .def_readwrite("lengthV", &BatchInfo::m_fLengthV)
+        .def_readwrite("pixelSpacing", &BatchInfo::m_fPixelSpacing)
+        .def_readwrite("sliceThickness", &BatchInfo::m_fSliceThickness)
+        .def_readwrite("sliceDistance", &BatchInfo::m_fSliceDistance)
+        .def_readwrite("num", &BatchInfo::m_nNum)
+        .def_readwrite("mprType", &BatchInfo::m_MPRType)
+        .def_readwrite("batchType", &BatchInfo::m_batchType)
+        .def_readwrite("angleStep", &BatchInfo::m_fAngleStep);
+
     py::class_<pyHelloMonkey>(m, "HelloMonkey")
         .def(py::init<>())
         .def("SetLogLevel", &pyHelloMonkey::SetLogLevel)
         .def("SetVolumeFile", &pyHelloMonkey::SetVolumeFile)
+        .def("LoadVolumeFileAsync", &pyHelloMonkey::LoadVolumeFileAsync)
+        .def("GetLoadProgress", &pyHelloMonkey::GetLoadProgress)
+        .def("LoadVolumeFile", &pyHelloMonkey::LoadVolumeFile)
+        .def("AddNewObjectMaskFile", &pyHelloMonkey::AddNewObjectMaskFile)
+        .def("SaveVolumeContainer", &pyHelloMonkey::SaveVolumeContainer)
+        .def("LoadVolumeContainer", &pyHelloMonkey::LoadVolumeContainer)
+        .def("SetMemoryMapEnabled", &pyHelloMonkey::SetMemoryMapEnabled)
+        .def("SetBrickedLayoutEnabled", &pyHelloMonkey::SetBrickedLayoutEnabled)
+        .def("SetFrameCacheBudget", &pyHelloMonkey::SetFrameCacheBudget)
+        .def("GetFrameCacheStats", &pyHelloMonkey::GetFrameCacheStats)
+        .def("ClearFrameCache", &pyHelloMonkey::ClearFrameCache)
+        .def("SetPrefetchDepth", &pyHelloMonkey::SetPrefetchDepth)
         .def("SetVolumeArray", &pyHelloMonkey::SetVolumeArray)
         .def("AddNewObjectMaskArray", &pyHelloMonkey::AddNewObjectMaskArray)
         .def("UpdateMaskArray", &pyHelloMonkey::UpdateMaskArray)
@@ -176,6 +321,7 @@ PYBIND11_MODULE(pyMonkeyGL, m) {
         .def("SetTransferFunc", static_cast<bool (pyHelloMonkey::*)(std::map<int, RGBA>, unsigned char)>(&pyHelloMonkey::SetTransferFunc))
         .def("SetTransferFunc", static_cast<bool (pyHelloMonkey::*)(std::map<int, RGBA>, std::map<int, float>)>(&pyHelloMonkey::SetTransferFunc))
         .def("SetTransferFunc", static_cast<bool (pyHelloMonkey::*)(std::map<int, RGBA>, std::map<int, float>, unsigned char)>(&pyHelloMonkey::SetTransferFunc))
+        .def("SetPreIntegrationEnabled", &pyHelloMonkey::SetPreIntegrationEnabled)
         .def("SetColorBackground", &pyHelloMonkey::SetColorBackground)
         .def("Reset", &pyHelloMonkey::Reset)
         .def("SetVRWWWL", static_cast<bool (pyHelloMonkey::*)(float, float)>(&pyHelloMonkey::SetVRWWWL))
@@ -189,9 +335,20 @@ PYBIND11_MODULE(pyMonkeyGL, m) {
 
         .def("GetVolumeArray", &pyHelloMonkey::GetVolumeArray)
         .def("GetVRArray", &pyHelloMonkey::GetVRArray)
+        .def("GetBatchArray", &pyHelloMonkey::GetBatchArray)
+        .def("SetCPRCenterline", &pyHelloMonkey::SetCPRCenterline)
+        .def("SetCPRCenterlineArray", &pyHelloMonkey::SetCPRCenterlineArray)
+        .def("GetCPRHeight", &pyHelloMonkey::GetCPRHeight)
+        .def("GetCPRStretchedHeight", &pyHelloMonkey::GetCPRStretchedHeight)
+        .def("GetCPRStraightenedArray", &pyHelloMonkey::GetCPRStraightenedArray)
+        .def("GetCPRStretchedArray", &pyHelloMonkey::GetCPRStretchedArray)
+        .def("GetCPRCrossSectionArray", &pyHelloMonkey::GetCPRCrossSectionArray)
         .def("GetVRData_pngString", &pyHelloMonkey::GetVRData_pngString)
         .def("GetVRData_png", &pyHelloMonkey::GetVRData_png)
+        .def("GetVRDataProgressive_pngString", &pyHelloMonkey::GetVRDataProgressive_pngString)
         .def("SaveVR2Png", &pyHelloMonkey::SaveVR2Png)
         .def("GetPlaneData_pngString", &pyHelloMonkey::GetPlaneData_pngString)
-        .def("GetOriginData_pngString", &pyHelloMonkey::GetOriginData_pngString);
+        .def("GetOriginData_pngString", &pyHelloMonkey::GetOriginData_pngString)
+        .def("GetPlaneData_sliceCodecString", &pyHelloMonkey::GetPlaneData_sliceCodecString)
+        .def("GetOriginData_sliceCodecString", &pyHelloMonkey::GetOriginData_sliceCodecString);
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <random>
+#include "Base64.hpp"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// Base64::Encode/Decode against the byte-wise encoder they replaced, on random data
+namespace
+{
+	const char* c_szTable = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string EncodeBytewise(const unsigned char* pSrc, size_t nLen)
+	{
+		std::string strResult;
+		const unsigned char* pCur = pSrc;
+		while (nLen > 2){
+			strResult += c_szTable[pCur[0] >> 2];
+			strResult += c_szTable[((pCur[0] & 0x03) << 4) + (pCur[1] >> 4)];
+			strResult += c_szTable[((pCur[1] & 0x0f) << 2) + (pCur[2] >> 6)];
+			strResult += c_szTable[pCur[2] & 0x3f];
+			pCur += 3;
+			nLen -= 3;
+		}
+		if (nLen > 0){
+			strResult += c_szTable[pCur[0] >> 2];
+			if (nLen == 1){
+				strResult += c_szTable[(pCur[0] & 0x03) << 4];
+				strResult += "==";
+			}
+			else{
+				strResult += c_szTable[((pCur[0] & 0x03) << 4) + (pCur[1] >> 4)];
+				strResult += c_szTable[(pCur[1] & 0x0f) << 2];
+				strResult += "=";
+			}
+		}
+		return strResult;
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(5);
+	size_t sizes[] = {256*1024, 1024*1024, 4096*1024};
+	printf("%10s %16s %12s %12s\n", "bytes", "byte-wise enc", "encode", "decode");
+	for (int i=0; i<3; i++){
+		std::vector<unsigned char> vecData(sizes[i]);
+		for (size_t j=0; j<vecData.size(); j++){
+			vecData[j] = (unsigned char)rng();
+		}
+		std::string strBytewise, strEncoded, strDecoded;
+		double fBytewise = TestBestOf(5, [&](){
+			strBytewise = EncodeBytewise(vecData.data(), vecData.size());
+		});
+		double fEncode = TestBestOf(5, [&](){
+			strEncoded = Base64::Encode(vecData.data(), vecData.size());
+		});
+		double fDecode = TestBestOf(5, [&](){
+			strDecoded = Base64::Decode(strEncoded.data(), strEncoded.size());
+		});
+		printf("%10zu %13.0f us %9.0f us %9.0f us\n", sizes[i], fBytewise*1000, fEncode*1000, fDecode*1000);
+		TestCheck(strEncoded == strBytewise && strDecoded == std::string(vecData.begin(), vecData.end()), "output matches the byte-wise encoder and decodes back");
+	}
+	return TestFailures();
+}
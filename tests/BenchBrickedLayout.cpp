@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cstring>
+#include <random>
+#include "CpuRender.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// MPR planes, thin and as 15 mm MIP slabs, and VR from the linear and the bricked
+// layout of the same 512 x 512 x 300 volume
+namespace
+{
+	const int c_nWidth = 512;
+	const int c_nHeight = 512;
+	const int c_nDepth = 300;
+
+	std::shared_ptr<short> MakeVolume()
+	{
+		std::shared_ptr<short> pVolume(new short[(size_t)c_nWidth*c_nHeight*c_nDepth], std::default_delete<short[]>());
+		std::mt19937 rng(1);
+		for (int z=0; z<c_nDepth; z++){
+			for (int y=0; y<c_nHeight; y++){
+				for (int x=0; x<c_nWidth; x++){
+					float dx = x - c_nWidth/2.0f, dy = y - c_nHeight/2.0f, dz = (z - c_nDepth/2.0f)*1.6f;
+					float r = sqrtf(dx*dx + dy*dy + dz*dz);
+					short nValue = r < 220 ? (r < 90 ? 1000 : (fmodf(r, 30) < 4 ? 600 : 40)) : -1000;
+					pVolume.get()[((size_t)z*c_nHeight + y)*c_nWidth + x] = nValue + rng()%60;
+				}
+			}
+		}
+		return pVolume;
+	}
+}
+
+int main()
+{
+	CpuRender linear, bricked;
+	bricked.SetBrickedLayoutEnabled(true);
+	double fLoadLinear = TestBestOf(1, [&](){
+		linear.SetVolumeData(MakeVolume(), c_nWidth, c_nHeight, c_nDepth);
+	});
+	double fLoadBricked = TestBestOf(1, [&](){
+		bricked.SetVolumeData(MakeVolume(), c_nWidth, c_nHeight, c_nDepth);
+	});
+	printf("load, volume made and tables built: linear %.0f ms, bricked %.0f ms\n", fLoadLinear, fLoadBricked);
+	linear.SetSpacing(0.7, 0.7, 1.1);
+	bricked.SetSpacing(0.7, 0.7, 1.1);
+
+	// the planes move by more than a slab between frames so no slab is reused
+	const int nFrames = 5;
+	const char* szPlanes[] = {"axial", "sagittal", "coronal"};
+	std::vector<short> vecLinear(1024*1024), vecBricked(1024*1024);
+	for (int nPass=0; nPass<2; nPass++){
+		for (int p=0; p<3; p++){
+			PlaneType planeType = (PlaneType)p;
+			if (nPass == 1){
+				linear.RotateCrossHair(23.0f, planeType);
+				bricked.RotateCrossHair(23.0f, planeType);
+			}
+			for (int nThick=0; nThick<2; nThick++){
+				linear.SetThickness(nThick ? 15.0 : 0.7, planeType);
+				bricked.SetThickness(nThick ? 15.0 : 0.7, planeType);
+				double fLinear = 0.0, fBricked = 0.0;
+				bool bSame = true;
+				for (int i=0; i<nFrames; i++){
+					float fDelta = (i%2 ? -1.0f : 1.0f)*20.0f*(i+1);
+					linear.Browse(fDelta, planeType);
+					bricked.Browse(fDelta, planeType);
+					int nWidth = 0, nHeight = 0, nWidthB = 0, nHeightB = 0;
+					fLinear += TestBestOf(1, [&](){
+						linear.GetPlaneData(vecLinear.data(), nWidth, nHeight, planeType);
+					});
+					fBricked += TestBestOf(1, [&](){
+						bricked.GetPlaneData(vecBricked.data(), nWidthB, nHeightB, planeType);
+					});
+					bSame = bSame && nWidth == nWidthB && nHeight == nHeightB && memcmp(vecLinear.data(), vecBricked.data(), sizeof(short)*nWidth*nHeight) == 0;
+				}
+				printf("%-8s %-7s %-8s: linear %6.1f ms, bricked %6.1f ms\n", szPlanes[p], nPass ? "oblique" : "ortho", nThick ? "15mm MIP" : "thin", fLinear/nFrames, fBricked/nFrames);
+				TestCheck(bSame, "%s %s planes are identical on both layouts", nPass ? "oblique" : "ortho", szPlanes[p]);
+			}
+		}
+	}
+
+	const int nView = 256;
+	std::vector<unsigned char> vecVRLinear(nView*nView*3), vecVRBricked(nView*nView*3);
+	std::map<int, RGBA> ctrlPts;
+	ctrlPts[10] = RGBA(0.8, 0.3, 0.2, 0);
+	ctrlPts[60] = RGBA(0.9, 0.9, 0.2, 0.3);
+	ctrlPts[99] = RGBA(1, 1, 1, 0.9);
+	linear.SetTransferFunc(ctrlPts, 0);
+	bricked.SetTransferFunc(ctrlPts, 0);
+	linear.SetVRWWWL(1000, 400, 0);
+	bricked.SetVRWWWL(1000, 400, 0);
+	linear.Rotate(35.0f, 25.0f);
+	bricked.Rotate(35.0f, 25.0f);
+	double fVRLinear = TestBestOf(1, [&](){
+		linear.GetVRData(vecVRLinear.data(), nView, nView);
+	});
+	double fVRBricked = TestBestOf(1, [&](){
+		bricked.GetVRData(vecVRBricked.data(), nView, nView);
+	});
+	printf("VR %dx%d: linear %.0f ms, bricked %.0f ms\n", nView, nView, fVRLinear, fVRBricked);
+	TestCheck(vecVRLinear == vecVRBricked, "VR frames are identical on both layouts");
+	return TestFailures();
+}
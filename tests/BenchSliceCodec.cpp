@@ -0,0 +1,123 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cstring>
+#include <random>
+#include "CpuRender.h"
+#include "SliceCodec.h"
+#include "fpng/fpng.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// SliceCodec against the fpng path of GetPlaneData_pngString, which packs the int16
+// plane as a width/2 RGBA image, on the axial, sagittal and coronal planes of a CT-like
+// 512 x 512 x 300 volume and on an origin slice masked to -2048 outside a label
+namespace
+{
+	const int c_nWidth = 512;
+	const int c_nHeight = 512;
+	const int c_nDepth = 300;
+
+	// air, a body of fat and soft tissue with a spine and ribs, gaussian noise of 12 HU
+	// and 5 HU outside the body
+	std::shared_ptr<short> MakeVolume()
+	{
+		std::shared_ptr<short> pVolume(new short[(size_t)c_nWidth*c_nHeight*c_nDepth], std::default_delete<short[]>());
+		std::mt19937 rng(1);
+		std::normal_distribution<float> noise(0.0f, 1.0f);
+		for (int z=0; z<c_nDepth; z++){
+			for (int y=0; y<c_nHeight; y++){
+				for (int x=0; x<c_nWidth; x++){
+					float dx = (x - c_nWidth/2.0f)/220.0f, dy = (y - c_nHeight/2.0f)/160.0f;
+					float r = sqrtf(dx*dx + dy*dy);
+					float fValue = -1000.0f + 5.0f*noise(rng);
+					if (r < 1.0f){
+						float dxs = x - c_nWidth/2.0f, dys = y - c_nHeight/2.0f - 100.0f;
+						bool bSpine = dxs*dxs + dys*dys < 30.0f*30.0f;
+						bool bRib = r > 0.82f && r < 0.87f && ((int)(z + 20*dx) % 24) < 10;
+						fValue = (r > 0.9f ? -100.0f : 40.0f) + 12.0f*noise(rng);
+						fValue += bSpine || bRib ? 700.0f + 200.0f*sinf(0.1f*z) : 0.0f;
+					}
+					pVolume.get()[((size_t)z*c_nHeight + y)*c_nWidth + x] = (short)fValue;
+				}
+			}
+		}
+		return pVolume;
+	}
+}
+
+int main()
+{
+	fpng::fpng_init();
+	std::shared_ptr<short> pVolume = MakeVolume();
+	CpuRender render;
+	render.SetVolumeData(pVolume, c_nWidth, c_nHeight, c_nDepth);
+	render.SetSpacing(0.7, 0.7, 1.1);
+
+	const char* szNames[] = {"axial", "sagittal", "coronal", "masked slice"};
+	std::vector<short> vecPlanes[4];
+	int nWidths[4], nHeights[4];
+	for (int p=0; p<3; p++){
+		PlaneType planeType = (PlaneType)p;
+		int nMaxWidth = 0, nMaxHeight = 0;
+		render.GetPlaneMaxSize(nMaxWidth, nMaxHeight, planeType);
+		vecPlanes[p].resize((size_t)nMaxWidth*nMaxHeight);
+		render.GetPlaneData(vecPlanes[p].data(), nWidths[p], nHeights[p], planeType);
+	}
+	// GetOriginData_pngString puts -2048 wherever the mask is 0
+	nWidths[3] = c_nWidth;
+	nHeights[3] = c_nHeight;
+	vecPlanes[3].assign(pVolume.get() + (size_t)c_nWidth*c_nHeight*c_nDepth/2, pVolume.get() + (size_t)c_nWidth*c_nHeight*(c_nDepth/2+1));
+	for (int y=0; y<c_nHeight; y++){
+		for (int x=0; x<c_nWidth; x++){
+			float dx = (x - c_nWidth/2.0f)/190.0f, dy = (y - c_nHeight/2.0f)/130.0f;
+			if (dx*dx + dy*dy > 1.0f){
+				vecPlanes[3][(size_t)y*c_nWidth + x] = -2048;
+			}
+		}
+	}
+
+	printf("%d threads\n", ThreadPool::Instance()->GetThreadCount());
+	printf("%-13s %9s %10s %12s %10s %12s %12s\n", "plane", "size", "fpng bytes", "fpng enc", "mk16 bytes", "mk16 enc", "mk16 dec");
+	for (int p=0; p<4; p++){
+		int nWidth = nWidths[p], nHeight = nHeights[p];
+		std::vector<uint8_t> vecPng, vecSlice;
+		double fPng = TestBestOf(10, [&](){
+			fpng::fpng_encode_image_to_memory(vecPlanes[p].data(), nWidth/2, nHeight, 4, vecPng);
+		});
+		double fEncode = TestBestOf(10, [&](){
+			SliceCodec::Encode(vecSlice, vecPlanes[p].data(), nWidth, nHeight);
+		});
+		std::vector<short> vecDecoded;
+		int nDecodedWidth = 0, nDecodedHeight = 0;
+		bool bDecoded = false;
+		double fDecode = TestBestOf(10, [&](){
+			bDecoded = SliceCodec::Decode(vecDecoded, nDecodedWidth, nDecodedHeight, vecSlice.data(), vecSlice.size());
+		});
+		printf("%-13s %4dx%-4d %10zu %9.0f us %10zu %9.0f us %9.0f us\n", szNames[p], nWidth, nHeight,
+			vecPng.size(), fPng*1000, vecSlice.size(), fEncode*1000, fDecode*1000);
+		TestCheck(bDecoded && nDecodedWidth == nWidth && nDecodedHeight == nHeight &&
+			memcmp(vecDecoded.data(), vecPlanes[p].data(), sizeof(short)*nWidth*nHeight) == 0, "%s decodes back bit exact", szNames[p]);
+	}
+	return TestFailures();
+}
@@ -0,0 +1,187 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include "VolumeInfo.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// a raw volume loaded by SetVolumeFile read into memory and memory-mapped, with the
+// file in the page cache and evicted from it. the raw file is the voxels of a NIfTI
+// volume, by default the 512 x 512 x 256 heart mask in data, widened to 16 bits. every
+// load runs in a child process so its resident set is its own
+namespace
+{
+	const char* c_szRawFile = "BenchVolumeLoad.raw";
+
+	// kB of one line of /proc/self/status
+	long GetStatus(const char* szKey)
+	{
+		FILE* fp = fopen("/proc/self/status", "r");
+		if (NULL == fp)
+			return -1;
+		char szLine[256];
+		long nValue = -1;
+		size_t nKey = strlen(szKey);
+		while (fgets(szLine, sizeof(szLine), fp)){
+			if (strncmp(szLine, szKey, nKey) == 0 && szLine[nKey] == ':'){
+				nValue = atol(szLine + nKey + 1);
+				break;
+			}
+		}
+		fclose(fp);
+		return nValue;
+	}
+
+	void EvictFile(const char* szFile)
+	{
+		int fd = open(szFile, O_RDONLY);
+		if (fd < 0)
+			return;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+
+	unsigned long long Checksum(const short* pData, size_t nVoxels)
+	{
+		unsigned long long nSum = 0;
+		for (size_t i=0; i<nVoxels; i++){
+			nSum = nSum*31 + (unsigned short)pData[i];
+		}
+		return nSum;
+	}
+
+	// the voxels of a uint8, int16 or uint16 NIfTI-1 file, plain or gzip
+	bool ReadNifti(const char* szFile, int* pDims, std::vector<short>& vecVoxels)
+	{
+		gzFile fp = gzopen(szFile, "rb");
+		if (NULL == fp)
+			return false;
+		unsigned char header[348];
+		bool bRead = gzread(fp, header, sizeof(header)) == (int)sizeof(header);
+		int nSize = 0;
+		short nDim[8] = {0}, nType = 0;
+		float fOffset = 0.0f;
+		memcpy(&nSize, header, sizeof(nSize));
+		memcpy(nDim, header + 40, sizeof(nDim));
+		memcpy(&nType, header + 70, sizeof(nType));
+		memcpy(&fOffset, header + 108, sizeof(fOffset));
+		int nBytes = nType == 2 ? 1 : 2;
+		bRead = bRead && nSize == 348 && nDim[0] >= 3 && (nType == 2 || nType == 4 || nType == 512);
+		bRead = bRead && gzseek(fp, (z_off_t)fOffset, SEEK_SET) == (z_off_t)fOffset;
+		if (bRead){
+			for (int i=0; i<3; i++){
+				pDims[i] = nDim[i+1];
+			}
+			size_t nVoxels = (size_t)pDims[0]*pDims[1]*pDims[2];
+			std::vector<unsigned char> vecRaw(nVoxels*nBytes);
+			bRead = gzread(fp, vecRaw.data(), (unsigned)vecRaw.size()) == (int)vecRaw.size();
+			vecVoxels.resize(nVoxels);
+			for (size_t i=0; bRead && i<nVoxels; i++){
+				if (nBytes == 1){
+					vecVoxels[i] = vecRaw[i];
+				}
+				else{
+					unsigned short nValue = 0;
+					memcpy(&nValue, &vecRaw[2*i], 2);
+					vecVoxels[i] = nType == 512 ? (short)(nValue > 32767 ? 32767 : nValue) : (short)nValue;
+				}
+			}
+		}
+		gzclose(fp);
+		return bRead;
+	}
+
+	// 0 when the loaded voxels match
+	int LoadInChild(bool bMapped, bool bCold, const int* pDims, unsigned long long nChecksum)
+	{
+		if (bCold)
+			EvictFile(c_szRawFile);
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0){
+			long nBaseAnon = GetStatus("RssAnon");
+			long nBaseFile = GetStatus("RssFile");
+			VolumeInfo volInfo;
+			volInfo.SetMemoryMapEnabled(bMapped);
+			bool bLoaded = false;
+			double fTime = TestBestOf(1, [&](){
+				bLoaded = volInfo.LoadVolumeFile(c_szRawFile, pDims[0], pDims[1], pDims[2]);
+			});
+			// resident right after the load, the checksum then pages in the rest
+			long nAnon = (GetStatus("RssAnon") - nBaseAnon)/1024;
+			long nFile = (GetStatus("RssFile") - nBaseFile)/1024;
+			std::shared_ptr<short> pVolume = volInfo.GetVolumeData();
+			bool bSame = bLoaded && pVolume && Checksum(pVolume.get(), (size_t)pDims[0]*pDims[1]*pDims[2]) == nChecksum;
+			double fBuild = TestBestOf(1, [&](){
+				volInfo.GetBrickTable();
+			});
+			TestCheck(bSame, "%s, %s cache: load %.1f ms, RssAnon +%ld MB, RssFile +%ld MB, first VR request builds for %.1f ms, peak RSS %ld MB, mapped %d", bMapped ? "mmap" : "read", bCold ? "cold" : "warm", fTime,
+				nAnon, nFile, fBuild, GetStatus("VmHWM")/1024, (int)volInfo.IsVolumeMapped());
+			fflush(stdout);
+			_exit(TestFailures());
+		}
+		int nStatus = 0;
+		waitpid(pid, &nStatus, 0);
+		return WIFEXITED(nStatus) ? WEXITSTATUS(nStatus) : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string strFile = argc > 1 ? argv[1] : MONKEYGL_DATA_DIR "/corocta_heart_mask.nii.gz";
+	int nDims[3] = {0, 0, 0};
+	unsigned long long nChecksum = 0;
+	{
+		std::vector<short> vecVolume;
+		if (!ReadNifti(strFile.c_str(), nDims, vecVolume)){
+			printf("can not read %s\n", strFile.c_str());
+			return 1;
+		}
+		size_t nVoxels = vecVolume.size();
+		FILE* fp = fopen(c_szRawFile, "wb");
+		bool bWritten = NULL != fp && fwrite(vecVolume.data(), sizeof(short), nVoxels, fp) == nVoxels;
+		if (NULL != fp)
+			fclose(fp);
+		if (!bWritten){
+			printf("can not write %s\n", c_szRawFile);
+			remove(c_szRawFile);
+			return 1;
+		}
+		nChecksum = Checksum(vecVolume.data(), nVoxels);
+		printf("%s: %d x %d x %d, %zu MB as 16 bit raw\n", strFile.c_str(), nDims[0], nDims[1], nDims[2], nVoxels*sizeof(short) >> 20);
+	}
+
+	int nFailures = 0;
+	for (int nCold=1; nCold>=0; nCold--){
+		nFailures += LoadInChild(false, nCold != 0, nDims, nChecksum);
+		nFailures += LoadInChild(true, nCold != 0, nDims, nChecksum);
+	}
+	remove(c_szRawFile);
+	return nFailures;
+}
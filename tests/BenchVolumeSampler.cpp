@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <random>
+#include "VolumeSampler.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// Sample one position at a time against Sample8 on the linear and on the bricked
+// layout, for random and for plane-like coherent positions in a 512 x 512 x 300 volume
+int main()
+{
+	const int nWidth = 512, nHeight = 512, nDepth = 300;
+	std::vector<short> vecVolume((size_t)nWidth*nHeight*nDepth);
+	for (size_t i=0; i<vecVolume.size(); i++){
+		vecVolume[i] = (short)(((i*2654435761u) & 0xffffffff) >> 20) - 2000;
+	}
+	VolumeSampler linear;
+	linear.SetVolume(vecVolume.data(), nWidth, nHeight, nDepth);
+	std::vector<short> vecBricked;
+	std::vector<int> vecOffsetX, vecOffsetY, vecOffsetZ;
+	VolumeSampler::BuildBricked(vecVolume.data(), nWidth, nHeight, nDepth, 4, vecBricked, vecOffsetX, vecOffsetY, vecOffsetZ);
+	VolumeSampler bricked;
+	bricked.SetVolume(vecBricked.data(), nWidth, nHeight, nDepth, vecOffsetX.data(), vecOffsetY.data(), vecOffsetZ.data(), vecBricked.size());
+
+	// random positions over the volume and its edges, and rows of a slightly tilted axial plane
+	const int N = 1 << 21;
+	std::vector<float> vecRandom[3], vecCoherent[3];
+	std::mt19937 rng(1);
+	for (int k=0; k<3; k++){
+		vecRandom[k].resize(N);
+		vecCoherent[k].resize(N);
+	}
+	for (int i=0; i<N; i++){
+		vecRandom[0][i] = (rng()>>8)/16777216.0f*(nWidth + 4) - 2;
+		vecRandom[1][i] = (rng()>>8)/16777216.0f*(nHeight + 4) - 2;
+		vecRandom[2][i] = (rng()>>8)/16777216.0f*(nDepth + 4) - 2;
+		vecCoherent[0][i] = (i%2048)*0.25f - 1;
+		vecCoherent[1][i] = (i/2048%512)*0.9f + 0.3f;
+		vecCoherent[2][i] = 100.37f + (i/2048)*0.0001f;
+	}
+
+	const char* szFilters[] = {"nearest", "trilinear", "tricubic"};
+	printf("Msamples/s %20s %10s %12s %12s\n", "", "scalar", "batched", "bricked");
+	for (int f=0; f<3; f++){
+		VolumeSampler::Filter filter = (VolumeSampler::Filter)f;
+		for (int p=0; p<2; p++){
+			const std::vector<float>* pPos = p == 0 ? vecRandom : vecCoherent;
+			const float* pX = pPos[0].data();
+			const float* pY = pPos[1].data();
+			const float* pZ = pPos[2].data();
+			std::vector<float> vecScalar(N), vecLinear(N), vecBrick(N);
+			double fScalar = TestBestOf(3, [&](){
+				for (int i=0; i<N; i++){
+					vecScalar[i] = linear.Sample(pX[i], pY[i], pZ[i], filter);
+				}
+			});
+			double fLinear = TestBestOf(3, [&](){
+				for (int i=0; i<N; i+=VolumeSampler::BATCH_SIZE){
+					linear.Sample8(pX+i, pY+i, pZ+i, &vecLinear[i], filter);
+				}
+			});
+			double fBricked = TestBestOf(3, [&](){
+				for (int i=0; i<N; i+=VolumeSampler::BATCH_SIZE){
+					bricked.Sample8(pX+i, pY+i, pZ+i, &vecBrick[i], filter);
+				}
+			});
+			printf("%-10s %-20s %10.1f %12.1f %12.1f\n", szFilters[f], p == 0 ? "random" : "coherent", N/fScalar/1000, N/fLinear/1000, N/fBricked/1000);
+			TestCheck(vecScalar == vecLinear && vecLinear == vecBrick, "%s %s: all three give the same samples", szFilters[f], p == 0 ? "random" : "coherent");
+		}
+	}
+	return TestFailures();
+}
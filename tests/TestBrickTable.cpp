@@ -0,0 +1,281 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <random>
+#include "TestUtils.h"
+#include "VolumePyramid.h"
+
+using namespace MonkeyGL;
+
+// brick ranges against an exhaustive scan, empty bricks against random fetches and
+// a VR frame rendered with empty space skipping against one rendered without it
+namespace
+{
+	const int c_nWidth = 171;
+	const int c_nHeight = 150;
+	const int c_nDepth = 101;
+
+	float LUTAlpha(const RGBA* pLUT, int nLen, const AlphaAndMapping& mapping, float fValue)
+	{
+		float fPos = fValue*mapping.scale + mapping.offset;
+		fPos = fPos < 0.0f ? 0.0f : (fPos > 1.0f ? 1.0f : fPos);
+		float t = fPos*nLen - 0.5f;
+		int n0 = (int)floorf(t);
+		float f = t - n0;
+		int n1 = n0 + 1;
+		n0 = n0 < 0 ? 0 : (n0 >= nLen ? nLen-1 : n0);
+		n1 = n1 < 0 ? 0 : (n1 >= nLen ? nLen-1 : n1);
+		return (pLUT[n0].alpha + f*(pLUT[n1].alpha - pLUT[n0].alpha))*mapping.alpha;
+	}
+
+	// a pyramid level walks the full resolution brick table. rays entering through the x = 0
+	// face have samples a level voxel before it, which the level's VOI test lets through but
+	// which fall one brick before the table. the table wraps such a lookup onto the empty
+	// last column of bricks, so a skip there would drop the sample of the bright x = 0 wall
+	void CheckCoarseLevel()
+	{
+		const int nWidth = 160, nHeight = 96, nDepth = 128;
+		size_t nVoxels = (size_t)nWidth*nHeight*nDepth;
+		std::shared_ptr<short> pVolume(new short[nVoxels], std::default_delete<short[]>());
+		for (size_t i=0; i<nVoxels; i++){
+			pVolume.get()[i] = (i%nWidth) < 2 ? 1000 : ((i%nWidth) < 100 ? 400 : -1000);
+		}
+
+		DataManager dataMan;
+		dataMan.SetVolumeData(pVolume, nWidth, nHeight, nDepth);
+		dataMan.SetSpacing(1.0, 1.0, 1.0);
+		std::map<int, RGBA> ctrlPts;
+		ctrlPts[10] = RGBA(0.8, 0.2, 0.2, 0);
+		ctrlPts[99] = RGBA(1, 1, 1, 0.6);
+		dataMan.SetControlPoints_TF(ctrlPts, 0);
+		dataMan.SetVRWWWL(1200, 400, 0);
+		dataMan.SetObjectAlpha(1, 0);
+		dataMan.SetPreIntegrationEnabled(true);
+		dataMan.UpdateEmptyBricks();
+		BrickTable& brickTable = dataMan.GetBrickTable();
+
+		VolumePyramid pyramid;
+		pyramid.Build(pVolume.get(), nWidth, nHeight, nDepth);
+		int nDims[3] = {pyramid.GetDim(1, 0), pyramid.GetDim(1, 1), pyramid.GetDim(1, 2)};
+		RayCaster rayCaster;
+		rayCaster.SetVolume(pyramid.GetVolumeData(1), pyramid.GetVoxelType(), NULL, nDims[0], nDims[1], nDims[2]);
+		rayCaster.SetOrientation(dataMan.GetOrientation());
+		rayCaster.SetLevelScale(1.0f*nDepth/nDims[2]);
+		rayCaster.SetSpacing(1.0*nWidth/nDims[0], 1.0*nHeight/nDims[1], 1.0*nDepth/nDims[2]);
+		AlphaAndMapping alphaAndMapping[MAXOBJECTCOUNT+1];
+		TestSetTransferFuncs(rayCaster, dataMan, alphaAndMapping);
+
+		const int nView = 128;
+		TestSetView(rayCaster, nDims[0], nDims[1], nDims[2], 0.0f, 90.0f, nView, nView);
+		// keep the rays off the y = 0 and z = 0 faces, whose lookups would fall before the table
+		VOI voi;
+		voi.left = 0;
+		voi.right = nDims[0] - 1;
+		voi.posterior = 1;
+		voi.anterior = nDims[1] - 1;
+		voi.head = nDims[2]/2;
+		voi.foot = nDims[2] - 1;
+		rayCaster.SetVOI(voi);
+		// fixed steps, a refining ray would back up over the dropped sample and hide it
+		rayCaster.SetPreIntegration(true, 1.0f);
+
+		std::vector<unsigned char> vecFull, vecSkip;
+		rayCaster.SetBrickTable(NULL);
+		TestRender(rayCaster, vecFull, nView, nView);
+		rayCaster.SetBrickTable(&brickTable);
+		TestRender(rayCaster, vecSkip, nView, nView);
+		int nDiffer = 0, nMaxDiff = 0, nLit = 0;
+		for (size_t i=0; i<vecFull.size(); i++){
+			nLit += vecFull[i] > 0 ? 1 : 0;
+			int nDiff = abs((int)vecFull[i] - (int)vecSkip[i]);
+			nDiffer += nDiff > 0 ? 1 : 0;
+			nMaxDiff = std::max(nMaxDiff, nDiff);
+		}
+		TestCheck(nLit*10 > (int)vecFull.size(), "the level 1 frame shows the volume, %d lit channels", nLit);
+		TestCheck(nMaxDiff <= 1 && nDiffer*1000 < (int)vecFull.size(), "skipping at level 1 changes %d of %d channels, by at most %d", nDiffer, (int)vecFull.size(), nMaxDiff);
+	}
+}
+
+int main()
+{
+	size_t nVoxels = (size_t)c_nWidth*c_nHeight*c_nDepth;
+	std::shared_ptr<short> pVolume(new short[nVoxels], std::default_delete<short[]>());
+	std::shared_ptr<unsigned char> pMask(new unsigned char[nVoxels], std::default_delete<unsigned char[]>());
+	std::mt19937 rng(1);
+	for (int z=0; z<c_nDepth; z++){
+		for (int y=0; y<c_nHeight; y++){
+			for (int x=0; x<c_nWidth; x++){
+				float dx = x - c_nWidth/2.0f;
+				float dy = y - c_nHeight/2.0f;
+				float dz = (z - c_nDepth/2.0f)*1.3f;
+				float r = sqrtf(dx*dx + dy*dy + dz*dz);
+				size_t nIndex = ((size_t)z*c_nHeight + y)*c_nWidth + x;
+				pVolume.get()[nIndex] = (r < 45 ? (r < 18 ? 1000 : 200) : -1000) + rng()%40;
+				pMask.get()[nIndex] = (x > 120 && r < 62) ? 1 : 0;
+			}
+		}
+	}
+
+	DataManager dataMan;
+	dataMan.SetVolumeData(pVolume, c_nWidth, c_nHeight, c_nDepth);
+	dataMan.SetSpacing(1.0, 1.0, 1.3);
+	dataMan.AddNewObjectMask(pMask, c_nWidth, c_nHeight, c_nDepth);
+	BrickTable& brickTable = dataMan.GetBrickTable();
+	if (!TestCheck(brickTable.IsValid(), "brick table built")){
+		return TestFailures();
+	}
+
+	const int nBrick = BrickTable::BRICK_SIZE;
+	int nBricks[3] = {brickTable.GetBrickCount(0), brickTable.GetBrickCount(1), brickTable.GetBrickCount(2)};
+	int nMismatch = 0;
+	for (int bz=0; bz<nBricks[2]; bz++){
+		for (int by=0; by<nBricks[1]; by++){
+			for (int bx=0; bx<nBricks[0]; bx++){
+				float fMin = 32767, fMax = -32768;
+				unsigned char nLabelMin = 255, nLabelMax = 0;
+				for (int z=std::max(0, bz*nBrick-1); z<=std::min(c_nDepth-1, bz*nBrick+nBrick); z++){
+					for (int y=std::max(0, by*nBrick-1); y<=std::min(c_nHeight-1, by*nBrick+nBrick); y++){
+						for (int x=std::max(0, bx*nBrick-1); x<=std::min(c_nWidth-1, bx*nBrick+nBrick); x++){
+							size_t nIndex = ((size_t)z*c_nHeight + y)*c_nWidth + x;
+							fMin = std::min(fMin, (float)pVolume.get()[nIndex]);
+							fMax = std::max(fMax, (float)pVolume.get()[nIndex]);
+							nLabelMin = std::min(nLabelMin, pMask.get()[nIndex]);
+							nLabelMax = std::max(nLabelMax, pMask.get()[nIndex]);
+						}
+					}
+				}
+				float fTableMin, fTableMax;
+				unsigned char nTableLabelMin, nTableLabelMax;
+				brickTable.GetBrickRange(fTableMin, fTableMax, bx, by, bz);
+				brickTable.GetBrickLabelRange(nTableLabelMin, nTableLabelMax, bx, by, bz);
+				if (fTableMin != fMin || fTableMax != fMax || nTableLabelMin != nLabelMin || nTableLabelMax != nLabelMax){
+					nMismatch++;
+				}
+			}
+		}
+	}
+	TestCheck(nMismatch == 0, "brick ranges match an exhaustive scan, %d of %d bricks differ", nMismatch, nBricks[0]*nBricks[1]*nBricks[2]);
+
+	std::map<int, RGBA> ctrlPts0;
+	ctrlPts0[10] = RGBA(0.8, 0.2, 0.2, 0);
+	ctrlPts0[60] = RGBA(0.9, 0.9, 0.2, 0.3);
+	ctrlPts0[99] = RGBA(1, 1, 1, 0.9);
+	std::map<int, RGBA> ctrlPts1;
+	ctrlPts1[0] = RGBA(0.2, 0.8, 0.2, 0);
+	ctrlPts1[80] = RGBA(0.2, 0.9, 0.2, 0);
+	ctrlPts1[99] = RGBA(0.2, 1, 0.2, 0.9);
+	dataMan.SetControlPoints_TF(ctrlPts0, 0);
+	dataMan.SetControlPoints_TF(ctrlPts1, 1);
+	dataMan.SetVRWWWL(1200, 400, 0);
+	dataMan.SetVRWWWL(1500, 300, 1);
+	dataMan.SetObjectAlpha(1, 0);
+	dataMan.SetObjectAlpha(1, 1);
+	dataMan.UpdateEmptyBricks();
+
+	RayCaster rayCaster;
+	rayCaster.SetVolume(pVolume.get(), pMask.get(), c_nWidth, c_nHeight, c_nDepth);
+	rayCaster.SetOrientation(dataMan.GetOrientation());
+	rayCaster.SetSpacing(1.0, 1.0, 1.3);
+	AlphaAndMapping alphaAndMapping[MAXOBJECTCOUNT+1];
+	TestSetTransferFuncs(rayCaster, dataMan, alphaAndMapping);
+
+	// no trilinear fetch from inside an empty brick may be visible
+	const TransferFunctionManager& tfManager = dataMan.GetTransferFunctionManager();
+	int nEmpty = 0, nSamples = 0, nVisible = 0;
+	for (int bz=0; bz<nBricks[2]; bz++){
+		for (int by=0; by<nBricks[1]; by++){
+			for (int bx=0; bx<nBricks[0]; bx++){
+				if (!brickTable.IsEmptyBrick(bx, by, bz))
+					continue;
+				nEmpty++;
+				float fX[64], fY[64], fZ[64], fValues[64];
+				int nCount = 0;
+				for (int k=0; k<64; k++){
+					float x = (bx*nBrick + nBrick*(rng()>>8)/16777216.0f)/c_nWidth;
+					float y = (by*nBrick + nBrick*(rng()>>8)/16777216.0f)/c_nHeight;
+					float z = (bz*nBrick + nBrick*(rng()>>8)/16777216.0f)/c_nDepth;
+					if (x >= 1.0f || y >= 1.0f || z >= 1.0f)
+						continue;
+					fX[nCount] = x;
+					fY[nCount] = y;
+					fZ[nCount] = z;
+					nCount++;
+				}
+				rayCaster.SampleVolume(fX, fY, fZ, fValues, nCount);
+				for (int k=0; k<nCount; k++){
+					nSamples++;
+					unsigned char nLabel = rayCaster.SampleLabel(fX[k], fY[k], fZ[k]);
+					float fAlpha = LUTAlpha(tfManager.GetLUT(nLabel), TransferFunctionManager::LUT_SIZE, alphaAndMapping[nLabel], fValues[k]);
+					if (fAlpha > 0.0005f){
+						nVisible++;
+					}
+				}
+			}
+		}
+	}
+	TestCheck(nEmpty > 0 && nEmpty < nBricks[0]*nBricks[1]*nBricks[2], "some but not all bricks are empty, %d", nEmpty);
+	TestCheck(nVisible == 0, "fetches inside empty bricks are transparent, %d of %d visible", nVisible, nSamples);
+
+	int nRegions[3] = {brickTable.GetRegionCount(0), brickTable.GetRegionCount(1), brickTable.GetRegionCount(2)};
+	int nBadRegions = 0;
+	for (int rz=0; rz<nRegions[2]; rz++){
+		for (int ry=0; ry<nRegions[1]; ry++){
+			for (int rx=0; rx<nRegions[0]; rx++){
+				if (!brickTable.IsEmptyRegion(rx, ry, rz))
+					continue;
+				const int nShift = BrickTable::REGION_SHIFT;
+				for (int bz=rz<<nShift; bz<std::min(nBricks[2], (rz+1)<<nShift); bz++){
+					for (int by=ry<<nShift; by<std::min(nBricks[1], (ry+1)<<nShift); by++){
+						for (int bx=rx<<nShift; bx<std::min(nBricks[0], (rx+1)<<nShift); bx++){
+							if (!brickTable.IsEmptyBrick(bx, by, bz)){
+								nBadRegions++;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	TestCheck(nBadRegions == 0, "empty regions hold only empty bricks, %d bricks are not", nBadRegions);
+
+	// skipping moves the samples by whole coarse steps only, so the frames agree up to rounding
+	const int nView = 256;
+	TestSetView(rayCaster, c_nWidth, c_nHeight, c_nDepth, 20.0f, 30.0f, nView, nView);
+	std::vector<unsigned char> vecFull, vecSkip;
+	rayCaster.SetBrickTable(NULL);
+	TestRender(rayCaster, vecFull, nView, nView);
+	rayCaster.SetBrickTable(&brickTable);
+	TestRender(rayCaster, vecSkip, nView, nView);
+	int nDiffer = 0, nMaxDiff = 0, nLit = 0;
+	for (size_t i=0; i<vecFull.size(); i++){
+		nLit += vecFull[i] > 0 ? 1 : 0;
+		int nDiff = abs((int)vecFull[i] - (int)vecSkip[i]);
+		nDiffer += nDiff > 0 ? 1 : 0;
+		nMaxDiff = std::max(nMaxDiff, nDiff);
+	}
+	TestCheck(nLit*10 > (int)vecFull.size(), "the frame shows the volume, %d lit channels", nLit);
+	TestCheck(nMaxDiff <= 1 && nDiffer*1000 < (int)vecFull.size(), "skipping changes %d of %d channels, by at most %d", nDiffer, (int)vecFull.size(), nMaxDiff);
+
+	CheckCoarseLevel();
+
+	return TestFailures();
+}
@@ -0,0 +1,290 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include "CpuRender.h"
+#include "VolumeInfo.h"
+#include "TestUtils.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#define MONKEYGL_TEST_LARGE_VOLUME
+#endif
+
+using namespace MonkeyGL;
+
+// voxel counts past 2^31: the block loops and the mask semantics always, and a file
+// backed 1024 x 1024 x 2100 int16 volume where the memory and disk allow it. its last
+// 52 slices lie past byte offset 2^32 and are checked through the planes, SampleVolume
+// and the mask. the large part is skipped (exit code 77) otherwise
+namespace
+{
+	const int c_nWidth = 1024;
+	const int c_nHeight = 1024;
+	const int c_nDepth = 2100;
+	const int c_nSkipped = 77;
+	const char* c_szVolumeFile = "TestLargeVolume.raw";
+	const char* c_szMaskFile = "TestLargeVolumeMask.raw";
+
+	// a different value for every slice, so a voxel read from a wrong offset shows
+	short ValueOfSlice(int z)
+	{
+		return (short)(8*z - 4000);
+	}
+
+	// the small volumes keep their masks the way AddNewObjectMask and UpdateObjectMask promise
+	void CheckMaskSemantics()
+	{
+		const int nWidth = 37, nHeight = 29, nDepth = 23;
+		size_t nVoxels = (size_t)nWidth*nHeight*nDepth;
+		VolumeInfo volInfo;
+		volInfo.SetVolumeData(std::shared_ptr<short>(new short[nVoxels](), std::default_delete<short[]>()), nWidth, nHeight, nDepth);
+		std::vector<unsigned char> vecExpected(nVoxels, 0);
+		srand(3);
+		int nMismatch = 0;
+		for (int i=0; i<4; i++){
+			std::shared_ptr<unsigned char> pMask(new unsigned char[nVoxels], std::default_delete<unsigned char[]>());
+			for (size_t j=0; j<nVoxels; j++){
+				pMask.get()[j] = rand()%3 == 0 ? (unsigned char)(1 + rand()%3) : 0;
+			}
+			unsigned char nLabel = 1 + i%2;
+			for (size_t j=0; j<nVoxels; j++){
+				if (pMask.get()[j] > 0)
+					vecExpected[j] = nLabel;
+				else if (i >= 2 && vecExpected[j] == nLabel)
+					vecExpected[j] = 0;
+			}
+			if (i < 2)
+				volInfo.AddNewObjectMask(pMask, nWidth, nHeight, nDepth, nLabel);
+			else
+				volInfo.UpdateObjectMask(pMask, nWidth, nHeight, nDepth, nLabel);
+			for (size_t j=0; j<nVoxels; j++){
+				nMismatch += volInfo.GetMaskData().get()[j] != vecExpected[j] ? 1 : 0;
+			}
+		}
+		TestCheck(nMismatch == 0, "added and updated masks keep their labels, %d voxels differ", nMismatch);
+	}
+
+#ifdef MONKEYGL_TEST_LARGE_VOLUME
+	bool HasRoom(size_t nVoxels)
+	{
+		struct statvfs fs;
+		if (statvfs(".", &fs) != 0)
+			return false;
+		unsigned long long nDisk = (unsigned long long)fs.f_bavail*fs.f_frsize;
+		unsigned long long nMemory = (unsigned long long)sysconf(_SC_PHYS_PAGES)*sysconf(_SC_PAGESIZE);
+		// the volume and mask files on disk, the mask the volume keeps and some headroom in memory
+		return nDisk > 3*nVoxels + (nVoxels>>2) && nMemory > nVoxels + (nVoxels>>1);
+	}
+
+	// volume: every slice holds ValueOfSlice(z), mask: 1 in the first 100 rows of the last 9 slices
+	bool WriteFiles(size_t nVoxels)
+	{
+		std::vector<short> vecVolumeSlice((size_t)c_nWidth*c_nHeight);
+		FILE* fp = fopen(c_szVolumeFile, "wb");
+		if (!fp)
+			return false;
+		bool bWritten = true;
+		for (int z=0; z<c_nDepth && bWritten; z++){
+			std::fill(vecVolumeSlice.begin(), vecVolumeSlice.end(), ValueOfSlice(z));
+			bWritten = fwrite(vecVolumeSlice.data(), sizeof(short), vecVolumeSlice.size(), fp) == vecVolumeSlice.size();
+		}
+		fclose(fp);
+
+		std::vector<unsigned char> vecSlice((size_t)c_nWidth*c_nHeight);
+
+		fp = fopen(c_szMaskFile, "wb");
+		if (!fp || !bWritten)
+			return false;
+		std::fill(vecSlice.begin(), vecSlice.end(), 0);
+		std::fill(vecSlice.begin(), vecSlice.begin() + (size_t)100*c_nWidth, 1);
+		bWritten = SeekFile(fp, (long long)nVoxels - 1, SEEK_SET) == 0 && fputc(0, fp) != EOF;
+		for (int z=c_nDepth-9; z<c_nDepth && bWritten; z++){
+			bWritten = SeekFile(fp, (long long)z*c_nWidth*c_nHeight, SEEK_SET) == 0;
+			bWritten = bWritten && fwrite(vecSlice.data(), 1, vecSlice.size(), fp) == vecSlice.size();
+		}
+		fclose(fp);
+		return bWritten;
+	}
+
+	template <typename T>
+	std::shared_ptr<T> MapFile(const char* szFile, size_t nBytes)
+	{
+		int fd = open(szFile, O_RDONLY);
+		if (fd < 0)
+			return std::shared_ptr<T>();
+		void* p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return std::shared_ptr<T>();
+		return std::shared_ptr<T>((T*)p, [nBytes](T* p){
+			munmap(p, nBytes);
+		});
+	}
+
+	// the first column of a sagittal or coronal plane of a volume whose slices hold ValueOfSlice(z)
+	std::vector<short> Profile(CpuRender& render, PlaneType planeType)
+	{
+		int nWidth = 0, nHeight = 0;
+		render.GetPlaneMaxSize(nWidth, nHeight, planeType);
+		std::vector<short> vecPlane((size_t)nWidth*nHeight);
+		render.GetPlaneData(vecPlane.data(), nWidth, nHeight, planeType);
+		std::vector<short> vecProfile;
+		for (int y=0; y<nHeight; y++){
+			vecProfile.push_back(vecPlane[(size_t)y*nWidth]);
+		}
+		return vecProfile;
+	}
+
+	// the pixel in the middle of axial plane nIndex
+	short AxialCenter(CpuRender& render, int nIndex)
+	{
+		render.SetPlaneIndex(nIndex, PlaneAxial);
+		int nWidth = 0, nHeight = 0;
+		render.GetPlaneMaxSize(nWidth, nHeight, PlaneAxial);
+		std::vector<short> vecPlane((size_t)nWidth*nHeight);
+		render.GetPlaneData(vecPlane.data(), nWidth, nHeight, PlaneAxial);
+		return vecPlane[(size_t)(nHeight/2)*nWidth + nWidth/2];
+	}
+
+	int CheckLargeVolume()
+	{
+		size_t nVoxels = (size_t)c_nWidth*c_nHeight*c_nDepth;
+		size_t nBytes = nVoxels*sizeof(short);
+		const int nFirstHigh = (int)((1ull<<32)/sizeof(short)/((size_t)c_nWidth*c_nHeight));
+		if (!HasRoom(nVoxels)){
+			printf("[ SKIP ] not enough memory or disk for %zu voxels\n", nVoxels);
+			return c_nSkipped;
+		}
+		if (!WriteFiles(nVoxels)){
+			remove(c_szVolumeFile);
+			remove(c_szMaskFile);
+			printf("[ SKIP ] failed to write the volume files\n");
+			return c_nSkipped;
+		}
+
+		CpuRender render;
+		render.SetSpacing(1.0, 1.0, 1.0);
+		std::shared_ptr<short> pVolume = MapFile<short>(c_szVolumeFile, nBytes);
+		bool bSet = pVolume && render.SetVolumeData(pVolume, c_nWidth, c_nHeight, c_nDepth);
+		TestCheck(bSet, "%d x %d x %d int16 volume set, %zu MB, slices from %d on past byte offset 2^32", c_nWidth, c_nHeight, c_nDepth, nBytes>>20, nFirstHigh);
+		if (bSet){
+			// the same z profile in a volume well inside 32 bit offsets
+			const int nSmall = 64;
+			size_t nSmallVoxels = (size_t)nSmall*nSmall*c_nDepth;
+			std::shared_ptr<short> pSmall(new short[nSmallVoxels], std::default_delete<short[]>());
+			for (size_t i=0; i<nSmallVoxels; i++){
+				pSmall.get()[i] = ValueOfSlice((int)(i/(nSmall*nSmall)));
+			}
+			CpuRender renderSmall;
+			renderSmall.SetSpacing(1.0, 1.0, 1.0);
+			renderSmall.SetVolumeData(pSmall, nSmall, nSmall, c_nDepth);
+			std::vector<short> vecProfile = Profile(render, PlaneSagittal);
+			TestCheck(vecProfile.size() == (size_t)c_nDepth && vecProfile == Profile(renderSmall, PlaneSagittal), "sagittal plane follows z through the whole volume");
+			vecProfile = Profile(render, PlaneCoronal);
+			TestCheck(vecProfile.size() == (size_t)c_nDepth && vecProfile == Profile(renderSmall, PlaneCoronal), "coronal plane follows z through the whole volume");
+
+			// the plane index runs against z in one of the orientations, so the planes of both
+			// ends are drawn and the ones whose center lies past byte offset 2^32 compared
+			int nHigh = 0, nBad = 0;
+			std::vector<int> vecIndices;
+			for (int i=0; i<c_nDepth-nFirstHigh; i+=5){
+				vecIndices.push_back(i);
+				vecIndices.push_back(c_nDepth-1-i);
+			}
+			for (int nIndex : vecIndices){
+				short nCenter = AxialCenter(render, nIndex);
+				short nSmallCenter = AxialCenter(renderSmall, nIndex);
+				if ((nSmallCenter - ValueOfSlice(0))/8 < nFirstHigh)
+					continue;
+				nHigh++;
+				nBad += nCenter == nSmallCenter ? 0 : 1;
+			}
+			TestCheck(nHigh > 0 && nBad == 0, "axial planes past byte offset 2^32 hold their slice, %d of %d differ", nBad, nHigh);
+
+			unsigned char nLabel = render.AddNewObjectMask(MapFile<unsigned char>(c_szMaskFile, nVoxels), c_nWidth, c_nHeight, c_nDepth);
+			std::shared_ptr<unsigned char> pMask = render.GetMaskData();
+			size_t nCount = 0;
+			for (size_t i=(size_t)(c_nDepth-20)*c_nWidth*c_nHeight; pMask && i<nVoxels; i++){
+				nCount += pMask.get()[i] == nLabel ? 1 : 0;
+			}
+			TestCheck(nLabel > 0 && nCount == (size_t)9*100*c_nWidth, "mask tail holds %zu labeled voxels, expected %zu", nCount, (size_t)9*100*c_nWidth);
+
+			// trilinear samples at and between the slice centers, in voxels and labels
+			RayCaster rayCaster;
+			rayCaster.SetVolume(pVolume.get(), VoxelTypeInt16, pMask.get(), c_nWidth, c_nHeight, c_nDepth);
+			int nSamples = 0, nWrong = 0, nLabels = 0, nWrongLabels = 0;
+			for (int z=nFirstHigh; z<c_nDepth-1; z+=3){
+				for (int i=0; i<8; i++){
+					float x = (37.0f + 131*i + 0.5f)/c_nWidth;
+					float y = (i%2 == 0 ? 50.5f : 700.5f)/c_nHeight;
+					float fz = (z + 0.5f + 0.25f*(i%4))/c_nDepth;
+					float fExpected = ValueOfSlice(z) + 8*0.25f*(i%4);
+					nWrong += fabs(rayCaster.SampleVolume(x, y, fz) - fExpected) < 0.05f ? 0 : 1;
+					nSamples++;
+					if (i%4 != 0)
+						continue;
+					unsigned char nExpected = (i%2 == 0 && z >= c_nDepth-9) ? nLabel : 0;
+					nWrongLabels += rayCaster.SampleLabel(x, y, fz) == nExpected ? 0 : 1;
+					nLabels++;
+				}
+			}
+			TestCheck(nWrong == 0, "SampleVolume past byte offset 2^32, %d of %d samples wrong", nWrong, nSamples);
+			TestCheck(nWrongLabels == 0, "SampleLabel past byte offset 2^32, %d of %d labels wrong", nWrongLabels, nLabels);
+
+			std::vector<unsigned char> vecVR(96*96*3);
+			render.Rotate(20.0f, 30.0f);
+			TestCheck(render.GetVRData(vecVR.data(), 96, 96), "volume rendering runs");
+		}
+		remove(c_szVolumeFile);
+		remove(c_szMaskFile);
+		return 0;
+	}
+#endif
+}
+
+int main()
+{
+	// the blocks cover a count past INT_MAX exactly once
+	size_t nVoxels = (size_t)c_nWidth*c_nHeight*c_nDepth;
+	std::atomic<unsigned long long> nCovered(0), nEnd(0);
+	ThreadPool::Instance()->ParallelForBlocks(nVoxels, 1<<20, [&](size_t nStart, size_t nStop){
+		nCovered += nStop - nStart;
+		if (nStop == nVoxels)
+			nEnd = nStop;
+	});
+	TestCheck(nVoxels > (size_t)INT_MAX && nCovered == nVoxels && nEnd == nVoxels, "blocks cover all %zu voxels", nVoxels);
+
+	CheckMaskSemantics();
+
+#ifdef MONKEYGL_TEST_LARGE_VOLUME
+	int nResult = CheckLargeVolume();
+	if (nResult == c_nSkipped && TestFailures() == 0)
+		return c_nSkipped;
+#endif
+	return TestFailures();
+}
@@ -0,0 +1,129 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <cstdlib>
+#include <vector>
+#include "OrthoSlicer.h"
+#include "VolumeSampler.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// the planes OrthoSlicer reads straight from the volume against the generic path, which
+// samples every pixel position the way CpuRender::SampleRun does. the copy path sits on
+// voxel centers, the blend path between them, and the planes reach out of the volume
+namespace
+{
+	const int c_nWidth = 90;
+	const int c_nHeight = 70;
+	const int c_nDepth = 50;
+	const int c_nPlaneWidth = 100;
+	const int c_nPlaneHeight = 80;
+	const double c_fSpacing = 0.75;
+
+	struct TestPlane
+	{
+		const char* szName;
+		double fDirH[3];
+		double fDirV[3];
+	};
+
+	void RenderGeneric(short* pData, const VolumeSampler& sampler, const double* pDirH, const double* pDirV, const double* pLeftTop)
+	{
+		int nDims[3] = {c_nWidth, c_nHeight, c_nDepth};
+		float ps = c_fSpacing;
+		for (int y=0; y<c_nPlaneHeight; y++){
+			for (int x=0; x<c_nPlaneWidth; x++){
+				float f[3];
+				bool bInside = true;
+				for (int j=0; j<3; j++){
+					f[j] = ((float)pLeftTop[j] + x*(float)(ps*pDirH[j]) + y*(float)(ps*pDirV[j]))/(float)(c_fSpacing*nDims[j]);
+					bInside = bInside && f[j] >= 0 && f[j] <= 1;
+				}
+				float fValue = sampler.Sample(f[0]*nDims[0] - 0.5f, f[1]*nDims[1] - 0.5f, (1.0f-f[2])*nDims[2] - 0.5f, VolumeSampler::FilterTrilinear);
+				pData[y*c_nPlaneWidth + x] = bInside ? SaturateShort(fValue) : -32768;
+			}
+		}
+	}
+
+	template <typename T>
+	void CheckPlanes(const std::vector<T>& vecVolume, VoxelType type, const char* szType)
+	{
+		TestPlane planes[] = {
+			{"axial", {1, 0, 0}, {0, 1, 0}},
+			{"coronal", {1, 0, 0}, {0, 0, -1}},
+			{"sagittal", {0, 1, 0}, {0, 0, -1}},
+			{"axial turned", {0, 1, 0}, {1, 0, 0}},
+			{"sagittal turned", {0, 0, -1}, {1, 0, 0}},
+			{"axial flipped", {0, -1, 0}, {-1, 0, 0}},
+		};
+		int nDims[3] = {c_nWidth, c_nHeight, c_nDepth};
+		double fSpacing[3] = {c_fSpacing, c_fSpacing, c_fSpacing};
+		VolumeSampler sampler;
+		sampler.SetVolume(vecVolume.data(), type, c_nWidth, c_nHeight, c_nDepth);
+
+		std::vector<short> vecSliced(c_nPlaneWidth*c_nPlaneHeight), vecGeneric(c_nPlaneWidth*c_nPlaneHeight);
+		for (size_t p=0; p<sizeof(planes)/sizeof(planes[0]); p++){
+			for (int nMode=0; nMode<2; nMode++){
+				// the left top pixel a few voxels outside the volume, on a voxel center for the
+				// copy and off it along every axis for the blend
+				double fOffset[3] = {0.0, 0.0, 0.0};
+				if (nMode == 1){
+					fOffset[0] = 0.3;
+					fOffset[1] = 0.6;
+					fOffset[2] = 0.45;
+				}
+				double fLeftTop[3];
+				for (int j=0; j<3; j++){
+					double fVoxel = planes[p].fDirH[j] + planes[p].fDirV[j] > 0 ? -5 : (planes[p].fDirH[j] + planes[p].fDirV[j] < 0 ? nDims[j] + 4 : nDims[j]/2);
+					fLeftTop[j] = (fVoxel + 0.5 + fOffset[j])*c_fSpacing;
+				}
+				Direction3d dirH(planes[p].fDirH[0], planes[p].fDirH[1], planes[p].fDirH[2]);
+				Direction3d dirV(planes[p].fDirV[0], planes[p].fDirV[1], planes[p].fDirV[2]);
+				Point3d ptLeftTop(fLeftTop[0], fLeftTop[1], fLeftTop[2]);
+				bool bSliced = OrthoSlicer::GetPlaneData(vecSliced.data(), c_nPlaneWidth, c_nPlaneHeight, vecVolume.data(), type, NULL, nDims, fSpacing, dirH, dirV, ptLeftTop, c_fSpacing, 1);
+				RenderGeneric(vecGeneric.data(), sampler, planes[p].fDirH, planes[p].fDirV, fLeftTop);
+				int nMaxDiff = 0, nOutside = 0;
+				for (size_t i=0; i<vecSliced.size(); i++){
+					int nDiff = abs(vecSliced[i] - vecGeneric[i]);
+					nMaxDiff = nDiff > nMaxDiff ? nDiff : nMaxDiff;
+					nOutside += vecGeneric[i] == -32768 ? 1 : 0;
+				}
+				TestCheck(bSliced && nMaxDiff <= 1 && nOutside > 0 && nOutside < (int)vecSliced.size(), "%s %s %s: max difference %d, %d pixels outside", szType, planes[p].szName, nMode == 0 ? "copy" : "blend", nMaxDiff, nOutside);
+			}
+		}
+	}
+}
+
+int main()
+{
+	size_t nVoxels = (size_t)c_nWidth*c_nHeight*c_nDepth;
+	std::vector<short> vecShort(nVoxels);
+	std::vector<float> vecFloat(nVoxels);
+	srand(7);
+	for (size_t i=0; i<nVoxels; i++){
+		vecShort[i] = (short)(rand()%4001 - 2000);
+		vecFloat[i] = vecShort[i] + 0.25f;
+	}
+	CheckPlanes(vecShort, VoxelTypeInt16, "int16");
+	CheckPlanes(vecFloat, VoxelTypeFloat32, "float32");
+	return TestFailures();
+}
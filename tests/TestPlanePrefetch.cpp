@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <chrono>
+#include <thread>
+#include "HelloMonkey.h"
+#include "CpuRender.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// scrolling queues planes ahead on the prefetch thread. a plane asked for while that
+// queue is running is served before it, the queued planes do not move the crosshair
+// and each one matches the plane rendered once the scrolling gets there
+namespace
+{
+	const int c_nSize = 256;
+	const int c_nDepth = 8;
+
+	std::shared_ptr<short> MakeVolume(int n)
+	{
+		std::shared_ptr<short> pVolume(new short[(size_t)n*n*n], std::default_delete<short[]>());
+		for (int z=0; z<n; z++){
+			for (int y=0; y<n; y++){
+				for (int x=0; x<n; x++){
+					float dx = x - n/2.0f, dy = y - n/2.0f;
+					bool bInside = dx*dx + dy*dy < (n*0.4f)*(n*0.4f);
+					pVolume.get()[((size_t)z*n + y)*n + x] = bInside ? 40 + (x*7 + y*3 + z*5)%200 : -1000;
+				}
+			}
+		}
+		return pVolume;
+	}
+
+	size_t GetCacheCount(HelloMonkey& monkey)
+	{
+		unsigned long long nHits = 0, nMisses = 0;
+		size_t nBytes = 0, nCount = 0;
+		monkey.GetFrameCacheStats(nHits, nMisses, nBytes, nCount);
+		return nCount;
+	}
+
+	// the count once it has not changed for a while
+	size_t WaitForPrefetch(HelloMonkey& monkey)
+	{
+		size_t nCount = GetCacheCount(monkey);
+		for (int nStable=0, nTries=0; nStable<50 && nTries<5000; nTries++){
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			size_t nNow = GetCacheCount(monkey);
+			nStable = nNow == nCount ? nStable+1 : 0;
+			nCount = nNow;
+		}
+		return nCount;
+	}
+}
+
+int main()
+{
+	HelloMonkey monkey(std::shared_ptr<IRender>(new CpuRender()));
+	monkey.SetVolumeData(MakeVolume(c_nSize), c_nSize, c_nSize, c_nSize);
+	monkey.SetSpacing(1.0, 1.0, 1.0);
+
+	// quick steps without prefetching give the scroll velocity that asks for the whole depth
+	monkey.SetPrefetchDepth(0);
+	for (int i=0; i<5; i++)
+		monkey.Browse(1.0f, PlaneAxial);
+	monkey.ClearFrameCache();
+	monkey.SetPrefetchDepth(c_nDepth);
+
+	Point3d ptBefore;
+	monkey.GetCrossHairPoint3D(ptBefore);
+	monkey.Browse(1.0f, PlaneAxial);
+	Point3d ptCrossHair;
+	monkey.GetCrossHairPoint3D(ptCrossHair);
+
+	// the queue is running once its first plane is in the cache
+	for (int nTries=0; GetCacheCount(monkey) == 0 && nTries<5000; nTries++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	size_t nStart = GetCacheCount(monkey);
+	std::string strForeground = monkey.GetPlaneData_pngString(PlaneAxial);
+	size_t nAtReturn = GetCacheCount(monkey);
+	size_t nDone = WaitForPrefetch(monkey);
+	// the foreground frame is cached too
+	size_t nPrefetched = nDone - 1;
+	TestCheck(!strForeground.empty(), "the foreground plane is encoded");
+	TestCheck(nPrefetched >= c_nDepth/2, "%zu planes were queued ahead", nPrefetched);
+	TestCheck(nAtReturn - 1 <= nStart + 2, "the foreground plane waited for %zu of the queued planes", nAtReturn - 1 - nStart);
+
+	Point3d ptAfter;
+	monkey.GetCrossHairPoint3D(ptAfter);
+	TestCheck(ptAfter.DistanceTo(ptCrossHair) == 0 && ptCrossHair.DistanceTo(ptBefore) > 0, "the prefetching leaves the crosshair where the scrolling put it");
+
+	// the next step comes from the cache and matches the plane rendered from scratch
+	unsigned long long nHits = 0, nMisses = 0, nHitsAfter = 0;
+	size_t nBytes = 0, nCount = 0;
+	monkey.SetPrefetchDepth(0);
+	monkey.GetFrameCacheStats(nHits, nMisses, nBytes, nCount);
+	monkey.Browse(1.0f, PlaneAxial);
+	std::string strCached = monkey.GetPlaneData_pngString(PlaneAxial);
+	monkey.GetFrameCacheStats(nHitsAfter, nMisses, nBytes, nCount);
+	monkey.ClearFrameCache();
+	std::string strRendered = monkey.GetPlaneData_pngString(PlaneAxial);
+	TestCheck(nHitsAfter == nHits + 1, "the next plane is served from the prefetched frames");
+	TestCheck(!strCached.empty() && strCached == strRendered, "the prefetched plane matches the plane rendered after scrolling to it");
+
+	return TestFailures();
+}
@@ -0,0 +1,147 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "TransferFunctionManager.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// the window folded into the lut mapping against the transfer function sampled the
+// way it was before the fold, and pre-integrated compositing against dense point
+// sampling of the same transfer function
+namespace
+{
+	const int c_nSize = 96;
+
+	// linear, clamped fetch at the normalized position fPos, as RayCaster does it
+	RGBA Fetch(const RGBA* pTable, int nLen, float fPos)
+	{
+		fPos = fPos < 0.0f ? 0.0f : (fPos > 1.0f ? 1.0f : fPos);
+		float t = fPos*nLen - 0.5f;
+		int n0 = (int)floorf(t);
+		float f = t - n0;
+		int n1 = n0 + 1;
+		n0 = n0 < 0 ? 0 : (n0 >= nLen ? nLen-1 : n0);
+		n1 = n1 < 0 ? 0 : (n1 >= nLen ? nLen-1 : n1);
+		const RGBA& c0 = pTable[n0];
+		const RGBA& c1 = pTable[n1];
+		return RGBA(c0.red + f*(c1.red - c0.red), c0.green + f*(c1.green - c0.green), c0.blue + f*(c1.blue - c0.blue), c0.alpha + f*(c1.alpha - c0.alpha));
+	}
+}
+
+int main()
+{
+	// two narrow opacity peaks, the case pre-integration is for
+	ObjectInfo info(1.0f, 2000, 1000);
+	info.idx2rgba.clear();
+	info.idx2rgba[0] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[40] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[42] = RGBA(1, 0.8, 0.3, 0.9);
+	info.idx2rgba[44] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[70] = RGBA(0.9, 0.3, 0.3, 0);
+	info.idx2rgba[71] = RGBA(0.9, 0.3, 0.3, 0.6);
+	info.idx2rgba[72] = RGBA(0.9, 0.3, 0.3, 0);
+	info.idx2rgba[99] = RGBA(0.9, 0.3, 0.3, 0);
+	std::map<unsigned char, ObjectInfo> objectInfos;
+	objectInfos[0] = info;
+	TransferFunctionManager tfManager;
+	tfManager.Update(objectInfos);
+
+	// lut(value*scale + offset) stands for tf((value - wl)/ww + 0.5) for any window
+	float windows[][2] = {{2000, 1000}, {400, 40}, {1, 0}, {4000, -1024}};
+	float fMaxError = 0.0f;
+	for (int w=0; w<4; w++){
+		objectInfos[0].ww = windows[w][0];
+		objectInfos[0].wl = windows[w][1];
+		tfManager.Update(objectInfos);
+		int nLen = 0;
+		const RGBA* pTransferFunc = tfManager.GetTransferFunction(0, nLen);
+		float fScale = 0.0f, fOffset = 0.0f;
+		tfManager.GetLUTMapping(0, fScale, fOffset);
+		for (int i=0; i<=20000; i++){
+			float fValue = windows[w][1] + windows[w][0]*(i/10000.0f - 1.0f);
+			RGBA lut = Fetch(tfManager.GetLUT(0), TransferFunctionManager::LUT_SIZE, fValue*fScale + fOffset);
+			RGBA tf = Fetch(pTransferFunc, nLen, (fValue - windows[w][1])/windows[w][0] + 0.5f);
+			fMaxError = std::max(fMaxError, fabsf(lut.alpha - tf.alpha));
+			fMaxError = std::max(fMaxError, fabsf(lut.red - tf.red));
+		}
+	}
+	TestCheck(fMaxError < 0.01f, "folded lut matches the windowed transfer function, max error %.4f", fMaxError);
+	objectInfos[0] = info;
+	tfManager.Update(objectInfos);
+	tfManager.SetPreIntegrationEnabled(true);
+
+	std::vector<short> vecVolume((size_t)c_nSize*c_nSize*c_nSize);
+	for (int z=0; z<c_nSize; z++){
+		for (int y=0; y<c_nSize; y++){
+			for (int x=0; x<c_nSize; x++){
+				float dx = x - c_nSize/2.0f, dy = y - c_nSize/2.0f, dz = z - c_nSize/2.0f;
+				float r = sqrtf(dx*dx + dy*dy + dz*dz);
+				vecVolume[((size_t)z*c_nSize + y)*c_nSize + x] = (short)(2000 - 50*r + 300*sinf(x*0.2f)*sinf(y*0.15f));
+			}
+		}
+	}
+
+	// point sampling runs through the same code path with a table that ignores the front sample
+	const int N = TransferFunctionManager::PREINTEGRATION_SIZE;
+	const RGBA* pLUT = tfManager.GetLUT(0);
+	std::vector<RGBA> vecPoint(N*N);
+	for (int i=0; i<N; i++){
+		for (int j=0; j<N; j++){
+			vecPoint[i*N + j] = pLUT[(int)((j + 0.5f)/N*TransferFunctionManager::LUT_SIZE)];
+		}
+	}
+	float fScale = 0.0f, fOffset = 0.0f;
+	tfManager.GetLUTMapping(0, fScale, fOffset);
+	AlphaAndMapping alphaAndMapping[MAXOBJECTCOUNT+1];
+	alphaAndMapping[0] = AlphaAndMapping(1.0f, fScale, fOffset);
+
+	RayCaster rayCaster;
+	rayCaster.SetVolume(vecVolume.data(), NULL, c_nSize, c_nSize, c_nSize);
+	rayCaster.SetOrientation(Orientation());
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	rayCaster.SetTransferFunc(pLUT, TransferFunctionManager::LUT_SIZE, 0);
+	rayCaster.SetAlphaAndMapping(alphaAndMapping);
+	const int nView = 160;
+	TestSetView(rayCaster, c_nSize, c_nSize, c_nSize, 25.0f, 35.0f, nView, nView);
+
+	std::vector<unsigned char> vecReference, vecPointRender, vecPreIntegrated;
+	rayCaster.SetPreIntegrationTable(vecPoint.data(), N, 0);
+	rayCaster.SetPreIntegration(true, 1.0f/32);
+	TestRender(rayCaster, vecReference, nView, nView);
+
+	// samples per voxel, and the error pre-integration has to stay under there
+	float steps[][2] = {{1.0f, 3.0f}, {0.5f, 4.0f}};
+	for (int s=0; s<2; s++){
+		rayCaster.SetPreIntegrationTable(vecPoint.data(), N, 0);
+		rayCaster.SetPreIntegration(true, 1.0f/steps[s][0]);
+		TestRender(rayCaster, vecPointRender, nView, nView);
+		rayCaster.SetPreIntegrationTable(tfManager.GetPreIntegrationTable(0), N, 0);
+		rayCaster.SetPreIntegration(true, 1.0f/steps[s][0]);
+		TestRender(rayCaster, vecPreIntegrated, nView, nView);
+		double fPoint = TestRMSE(vecReference, vecPointRender);
+		double fPreIntegrated = TestRMSE(vecReference, vecPreIntegrated);
+		TestCheck(fPreIntegrated < steps[s][1] && fPreIntegrated*2 < fPoint, "%.1f samples/voxel: rmse pre-integrated %.2f, point sampling %.2f", steps[s][0], fPreIntegrated, fPoint);
+	}
+
+	return TestFailures();
+}
@@ -0,0 +1,187 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <cstdint>
+#include <vector>
+#include "TransferFunctionManager.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// 8 rays in lockstep against every ray on its own: the packets sample with the AVX2 gathers
+// of VolumeSampler, the single rays with RayCaster's own fetch, and both have to give the
+// same image for each voxel type, the bricked layout, a mask and every compositing mode
+namespace
+{
+	const int c_nSize = 96;
+	const int c_nView = 160;
+
+	// the test values times fScale plus fOffset, clamped to 0 for the unsigned types
+	template <typename T>
+	std::vector<T> MakeVolume(float fScale, float fOffset)
+	{
+		std::vector<T> vecVolume((size_t)c_nSize*c_nSize*c_nSize);
+		for (int z=0; z<c_nSize; z++){
+			for (int y=0; y<c_nSize; y++){
+				for (int x=0; x<c_nSize; x++){
+					float dx = x - c_nSize/2.0f, dy = y - c_nSize/2.0f, dz = z - c_nSize/2.0f;
+					float r = sqrtf(dx*dx + dy*dy + dz*dz);
+					float fValue = (2000 - 50*r + 300*sinf(x*0.2f)*sinf(y*0.15f))*fScale + fOffset;
+					if ((T)-1 > 0 && fValue < 0.0f)
+						fValue = 0.0f;
+					vecVolume[((size_t)z*c_nSize + y)*c_nSize + x] = (T)fValue;
+				}
+			}
+		}
+		return vecVolume;
+	}
+
+	int CountDifferent(const std::vector<unsigned char>& vecA, const std::vector<unsigned char>& vecB)
+	{
+		int nDifferent = 0;
+		for (size_t i=0; i<vecA.size(); i++){
+			nDifferent += vecA[i] != vecB[i] ? 1 : 0;
+		}
+		return nDifferent;
+	}
+
+	// pixels that are not the black background, an empty frame would compare equal too
+	int CountLit(const std::vector<unsigned char>& vecVR)
+	{
+		int nLit = 0;
+		for (size_t i=0; i<vecVR.size(); i+=3){
+			nLit += (vecVR[i] | vecVR[i+1] | vecVR[i+2]) != 0 ? 1 : 0;
+		}
+		return nLit;
+	}
+
+	void CheckSame(RayCaster& rayCaster, const char* szCase)
+	{
+		std::vector<unsigned char> vecPackets, vecSingle;
+		rayCaster.SetRayPackets(true);
+		double fPackets = TestBestOf(3, [&](){ TestRender(rayCaster, vecPackets, c_nView, c_nView); });
+		rayCaster.SetRayPackets(false);
+		double fSingle = TestBestOf(3, [&](){ TestRender(rayCaster, vecSingle, c_nView, c_nView); });
+		rayCaster.SetRayPackets(true);
+		int nDifferent = CountDifferent(vecPackets, vecSingle);
+		int nLit = CountLit(vecSingle);
+		TestCheck(nDifferent == 0 && nLit > c_nView*c_nView/8, "%s: %d bytes differ in %d lit pixels, packets %.1f ms, single rays %.1f ms", szCase, nDifferent, nLit, fPackets, fSingle);
+	}
+}
+
+int main()
+{
+	ObjectInfo info(1.0f, 2000, 1000);
+	info.idx2rgba.clear();
+	info.idx2rgba[0] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[40] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[42] = RGBA(1, 0.8, 0.3, 0.9);
+	info.idx2rgba[44] = RGBA(0.2, 0.2, 0.8, 0);
+	info.idx2rgba[70] = RGBA(0.9, 0.3, 0.3, 0);
+	info.idx2rgba[71] = RGBA(0.9, 0.3, 0.3, 0.6);
+	info.idx2rgba[72] = RGBA(0.9, 0.3, 0.3, 0);
+	info.idx2rgba[99] = RGBA(0.9, 0.3, 0.3, 0);
+	ObjectInfo vessel(0.8f, 400, 1500);
+	vessel.idx2rgba.clear();
+	vessel.idx2rgba[0] = RGBA(0.9, 0.1, 0.1, 0);
+	vessel.idx2rgba[50] = RGBA(0.9, 0.1, 0.1, 0.05);
+	vessel.idx2rgba[99] = RGBA(1, 0.9, 0.9, 0.3);
+	std::map<unsigned char, ObjectInfo> objectInfos;
+	objectInfos[0] = info;
+	objectInfos[1] = vessel;
+	TransferFunctionManager tfManager;
+	tfManager.SetPreIntegrationEnabled(true);
+	tfManager.Update(objectInfos);
+
+	RayCaster rayCaster;
+	AlphaAndMapping alphaAndMapping[MAXOBJECTCOUNT+1];
+	for (int label=0; label<=1; label++){
+		rayCaster.SetTransferFunc(tfManager.GetLUT(label), TransferFunctionManager::LUT_SIZE, label);
+		rayCaster.SetPreIntegrationTable(tfManager.GetPreIntegrationTable(label), TransferFunctionManager::PREINTEGRATION_SIZE, label);
+		float fScale = 0.0f, fOffset = 0.0f;
+		tfManager.GetLUTMapping(label, fScale, fOffset);
+		alphaAndMapping[label] = AlphaAndMapping(objectInfos[label].alpha, fScale, fOffset);
+	}
+	rayCaster.SetAlphaAndMapping(alphaAndMapping);
+	rayCaster.SetOrientation(Orientation());
+
+	std::vector<short> vecShort = MakeVolume<short>(1.0f, 0.0f);
+	VolumeSampler sampler;
+	sampler.SetVolume(vecShort.data(), c_nSize, c_nSize, c_nSize);
+	if (!sampler.HasGather()){
+		// without AVX2 the tiles never use packets, there is nothing to compare
+		TestCheck(true, "no AVX2 on this cpu, every ray is marched on its own");
+		return TestFailures();
+	}
+
+	rayCaster.SetVolume(vecShort.data(), NULL, c_nSize, c_nSize, c_nSize);
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	TestSetView(rayCaster, c_nSize, c_nSize, c_nSize, 25.0f, 35.0f, c_nView, c_nView);
+	CheckSame(rayCaster, "int16 linear");
+
+	rayCaster.SetPreview(true);
+	CheckSame(rayCaster, "int16 preview");
+	rayCaster.SetPreview(false);
+	rayCaster.SetPreIntegration(true, 1.0f);
+	CheckSame(rayCaster, "int16 pre-integrated");
+	rayCaster.SetPreIntegration(false, 1.0f);
+
+	std::vector<short> vecBricked;
+	std::vector<int> vecOffsetX, vecOffsetY, vecOffsetZ;
+	VolumeSampler::BuildBricked(vecShort.data(), c_nSize, c_nSize, c_nSize, 3, vecBricked, vecOffsetX, vecOffsetY, vecOffsetZ);
+	const int* pOffsets[3] = {vecOffsetX.data(), vecOffsetY.data(), vecOffsetZ.data()};
+	rayCaster.SetVolume(vecBricked.data(), NULL, c_nSize, c_nSize, c_nSize, pOffsets, vecBricked.size());
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	CheckSame(rayCaster, "int16 bricked");
+
+	// a vessel label through the middle of the volume
+	std::vector<unsigned char> vecMask((size_t)c_nSize*c_nSize*c_nSize, 0);
+	for (int z=0; z<c_nSize; z++){
+		for (int y=c_nSize/2-8; y<c_nSize/2+8; y++){
+			for (int x=c_nSize/2-8; x<c_nSize/2+8; x++){
+				vecMask[((size_t)z*c_nSize + y)*c_nSize + x] = 1;
+			}
+		}
+	}
+	rayCaster.SetVolume(vecShort.data(), vecMask.data(), c_nSize, c_nSize, c_nSize);
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	CheckSame(rayCaster, "int16 with a mask");
+
+	// the other types hold the test values scaled and shifted, the lut mapping undoes it
+	AlphaAndMapping mapping = alphaAndMapping[0];
+	std::vector<unsigned char> vecUInt8 = MakeVolume<unsigned char>(0.1f, 0.0f);
+	alphaAndMapping[0] = AlphaAndMapping(mapping.alpha, mapping.scale*10.0f, mapping.offset);
+	rayCaster.SetVolume(vecUInt8.data(), VoxelTypeUInt8, NULL, c_nSize, c_nSize, c_nSize);
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	CheckSame(rayCaster, "uint8");
+	std::vector<unsigned short> vecUInt16 = MakeVolume<unsigned short>(1.0f, 1024.0f);
+	alphaAndMapping[0] = AlphaAndMapping(mapping.alpha, mapping.scale, mapping.offset - 1024.0f*mapping.scale);
+	rayCaster.SetVolume(vecUInt16.data(), VoxelTypeUInt16, NULL, c_nSize, c_nSize, c_nSize);
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	CheckSame(rayCaster, "uint16");
+	alphaAndMapping[0] = mapping;
+	std::vector<float> vecFloat = MakeVolume<float>(1.0f, 0.25f);
+	rayCaster.SetVolume(vecFloat.data(), VoxelTypeFloat32, NULL, c_nSize, c_nSize, c_nSize);
+	rayCaster.SetSpacing(1.0, 1.0, 1.0);
+	CheckSame(rayCaster, "float32");
+
+	return TestFailures();
+}
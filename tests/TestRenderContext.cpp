@@ -0,0 +1,188 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <thread>
+#include <atomic>
+#include "HelloMonkey.h"
+#include "CpuRender.h"
+#include "TestUtils.h"
+
+using namespace MonkeyGL;
+
+// two sessions, each a HelloMonkey with its own CpuRender, study and transfer function,
+// driven from two threads at once give the VR and MPR frames each of them gives alone.
+// sessions created and destroyed next to a running one do not disturb it either
+namespace
+{
+	struct Frames
+	{
+		std::vector<unsigned char> vecVR;
+		std::vector<short> vecAxial;
+		std::vector<short> vecSagittal;
+		std::vector<short> vecCoronal;
+
+		bool operator==(const Frames& other) const{
+			return vecVR == other.vecVR && vecAxial == other.vecAxial && vecSagittal == other.vecSagittal && vecCoronal == other.vecCoronal;
+		}
+	};
+
+	struct Study
+	{
+		int nSize;
+		bool bSphere;
+		int nColor;
+		float fWW, fWL;
+	};
+
+	const Study c_studyA = {96, true, 0, 500.0f, 300.0f};
+	const Study c_studyB = {80, false, 1, 900.0f, 100.0f};
+
+	std::shared_ptr<short> MakeVolume(int n, bool bSphere)
+	{
+		std::shared_ptr<short> pVolume(new short[(size_t)n*n*n], std::default_delete<short[]>());
+		for (int z=0; z<n; z++){
+			for (int y=0; y<n; y++){
+				for (int x=0; x<n; x++){
+					float dx = x - n/2.0f, dy = y - n/2.0f, dz = z - n/2.0f;
+					bool bInside = bSphere ? dx*dx + dy*dy + dz*dz < (n*0.35f)*(n*0.35f) : (fabs(dx) < n*0.3f && fabs(dy) < n*0.2f && fabs(dz) < n*0.25f);
+					pVolume.get()[((size_t)z*n + y)*n + x] = bInside ? 400 + (x*7 + y*3 + z)%50 : -1000;
+				}
+			}
+		}
+		return pVolume;
+	}
+
+	std::shared_ptr<HelloMonkey> MakeSession(const Study& study)
+	{
+		std::shared_ptr<HelloMonkey> pMonkey(new HelloMonkey(std::shared_ptr<IRender>(new CpuRender())));
+		pMonkey->SetLogLevel(LogLevelWarn);
+		pMonkey->SetVolumeData(MakeVolume(study.nSize, study.bSphere), study.nSize, study.nSize, study.nSize);
+		pMonkey->SetSpacing(1.0, 1.0, 1.0);
+		std::map<int, RGBA> ctrlPts;
+		if (study.nColor == 0){
+			ctrlPts[0] = RGBA(0.8, 0, 0, 0);
+			ctrlPts[99] = RGBA(0.8, 0.8, 0.8, 1);
+		}
+		else{
+			ctrlPts[0] = RGBA(0, 0.2, 0.9, 0);
+			ctrlPts[60] = RGBA(0.1, 0.9, 0.4, 0.4);
+			ctrlPts[99] = RGBA(1, 1, 0.2, 0.9);
+		}
+		pMonkey->SetTransferFunc(ctrlPts);
+		pMonkey->SetVRWWWL(study.fWW, study.fWL);
+		return pMonkey;
+	}
+
+	void GetPlane(HelloMonkey& monkey, std::vector<short>& vecPlane, PlaneType planeType)
+	{
+		int nWidth = 0, nHeight = 0;
+		monkey.GetPlaneMaxSize(nWidth, nHeight, planeType);
+		vecPlane.assign((size_t)nWidth*nHeight, 0);
+		monkey.GetPlaneData(vecPlane.data(), nWidth, nHeight, planeType);
+	}
+
+	// the frames of nFrames steps of rotating and browsing, the last ones are returned
+	Frames Work(HelloMonkey& monkey, int nFrames)
+	{
+		const int nView = 128;
+		Frames frames;
+		frames.vecVR.resize(nView*nView*3);
+		for (int i=0; i<nFrames; i++){
+			monkey.Rotate(3.0f, 2.0f);
+			monkey.GetVRData(frames.vecVR.data(), nView, nView);
+			GetPlane(monkey, frames.vecAxial, PlaneAxial);
+			GetPlane(monkey, frames.vecSagittal, PlaneSagittal);
+			GetPlane(monkey, frames.vecCoronal, PlaneCoronal);
+			monkey.Browse(1.0f, PlaneAxial);
+			monkey.Browse(-1.0f, PlaneSagittal);
+		}
+		return frames;
+	}
+}
+
+int main()
+{
+	const int nFrames = 6;
+	Frames refA, refB, refOnce;
+	refA = Work(*MakeSession(c_studyA), nFrames);
+	refB = Work(*MakeSession(c_studyB), nFrames);
+	refOnce = Work(*MakeSession(c_studyB), 1);
+	TestCheck(!refA.vecAxial.empty() && !refA.vecSagittal.empty() && !refA.vecCoronal.empty(), "the first study has axial, sagittal and coronal planes");
+	TestCheck(!(refA.vecVR == refB.vecVR) && !(refA.vecAxial == refB.vecAxial), "the two studies render differently");
+
+	{
+		// both alive at once, set up interleaved, then driven concurrently
+		std::shared_ptr<HelloMonkey> pMonkeyA = MakeSession(c_studyA);
+		std::shared_ptr<HelloMonkey> pMonkeyB = MakeSession(c_studyB);
+		Frames framesA, framesB;
+		std::thread threadA([&](){
+			framesA = Work(*pMonkeyA, nFrames);
+		});
+		std::thread threadB([&](){
+			framesB = Work(*pMonkeyB, nFrames);
+		});
+		threadA.join();
+		threadB.join();
+
+		TestCheck(framesA == refA, "first session matches its VR and MPR frames rendered alone");
+		TestCheck(framesB == refB, "second session matches its VR and MPR frames rendered alone");
+
+		int nWidth = 0, nHeight = 0, nDepth = 0;
+		pMonkeyA->GetVolumeData(nWidth, nHeight, nDepth);
+		TestCheck(nWidth == 96 && nHeight == 96 && nDepth == 96, "first session keeps its volume, %d x %d x %d", nWidth, nHeight, nDepth);
+		pMonkeyB->GetVolumeData(nWidth, nHeight, nDepth);
+		TestCheck(nWidth == 80 && nHeight == 80 && nDepth == 80, "second session keeps its volume, %d x %d x %d", nWidth, nHeight, nDepth);
+	}
+
+	{
+		// renderers come and go on one thread while a session keeps rendering on another
+		const int nRuns = 4;
+		std::vector<Frames> vecRef, vecRuns;
+		std::shared_ptr<HelloMonkey> pMonkeyRef = MakeSession(c_studyA);
+		for (int i=0; i<nRuns; i++){
+			vecRef.push_back(Work(*pMonkeyRef, nFrames));
+		}
+		pMonkeyRef.reset();
+
+		std::shared_ptr<HelloMonkey> pMonkeyA = MakeSession(c_studyA);
+		std::atomic<bool> bRunning(true);
+		std::thread threadA([&](){
+			for (int i=0; i<nRuns; i++){
+				vecRuns.push_back(Work(*pMonkeyA, nFrames));
+			}
+			bRunning = false;
+		});
+		int nCycles = 0, nBad = 0;
+		while (bRunning || nCycles < 2){
+			std::shared_ptr<HelloMonkey> pMonkey = MakeSession(c_studyB);
+			if (!(Work(*pMonkey, 1) == refOnce)){
+				nBad++;
+			}
+			nCycles++;
+		}
+		threadA.join();
+		TestCheck(nBad == 0, "%d of %d short lived sessions differ from their frames rendered alone", nBad, nCycles);
+		TestCheck(vecRuns == vecRef, "the running session matches its frames rendered alone in all %d runs", nRuns);
+	}
+
+	return TestFailures();
+}
@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2022 jiwenchen(cjwbeyond@hotmail.com)
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "DataManager.h"
+#include "RayCaster.h"
+#include "ThreadPool.h"
+#include "Methods.h"
+
+namespace MonkeyGL {
+
+    // every check prints one line, the test exits with the number of failed checks
+    inline int& TestFailures(){
+        static int nFailures = 0;
+        return nFailures;
+    }
+
+    inline bool TestCheck(bool bPassed, const char* szFormat, ...){
+        va_list args;
+        va_start(args, szFormat);
+        printf(bPassed ? "[  OK  ] " : "[FAILED] ");
+        vprintf(szFormat, args);
+        printf("\n");
+        va_end(args);
+        if (!bPassed){
+            TestFailures()++;
+        }
+        return bPassed;
+    }
+
+    // points the ray caster at the transfer function tables and window mappings of the
+    // data manager, the way CpuRender::UpdateTransferFunc and UpdateAlphaWWWL do
+    inline void TestSetTransferFuncs(RayCaster& rayCaster, DataManager& dataMan, AlphaAndMapping* pAlphaAndMapping){
+        dataMan.UpdateTransferFunctions();
+        const TransferFunctionManager& tfManager = dataMan.GetTransferFunctionManager();
+        std::map<unsigned char, ObjectInfo> objectInfos = dataMan.GetObjectInfos();
+        for (int label=0; label<=MAXOBJECTCOUNT; label++){
+            rayCaster.SetTransferFunc(tfManager.GetLUT(label), TransferFunctionManager::LUT_SIZE, label);
+            rayCaster.SetPreIntegrationTable(tfManager.GetPreIntegrationTable(label), TransferFunctionManager::PREINTEGRATION_SIZE, label);
+            float fScale = 0.0f, fOffset = 0.0f;
+            tfManager.GetLUTMapping(label, fScale, fOffset);
+            float fAlpha = objectInfos.find(label) != objectInfos.end() ? objectInfos[label].alpha : 0.0f;
+            pAlphaAndMapping[label] = AlphaAndMapping(fAlpha, fScale, fOffset);
+        }
+        rayCaster.SetAlphaAndMapping(pAlphaAndMapping);
+    }
+
+    // the whole volume seen rotated by fxRotate and fzRotate degrees
+    inline void TestSetView(RayCaster& rayCaster, int nWidth, int nHeight, int nDepth, float fxRotate, float fzRotate, int nViewWidth, int nViewHeight){
+        float rotate[9], rotateT[9], transform[9], transformT[9];
+        Methods::SetSeg(rotate, 3);
+        Methods::SetSeg(rotateT, 3);
+        Methods::SetSeg(transform, 3);
+        Methods::SetSeg(transformT, 3);
+        Methods::ComputeTransformMatrix(rotate, rotateT, transform, transformT, fxRotate, fzRotate, 1.0f);
+        rayCaster.SetTransformMatrix(transform);
+
+        VOI voi;
+        voi.left = 0;
+        voi.right = nWidth - 1;
+        voi.posterior = 0;
+        voi.anterior = nHeight - 1;
+        voi.head = 0;
+        voi.foot = nDepth - 1;
+        rayCaster.SetVOI(voi);
+        rayCaster.SetView(nViewWidth, nViewHeight, 0.0f, 0.0f, 1.0f);
+    }
+
+    inline void TestRender(RayCaster& rayCaster, std::vector<unsigned char>& vecVR, int nWidth, int nHeight){
+        vecVR.assign((size_t)nWidth*nHeight*3, 0);
+        unsigned char* pVR = vecVR.data();
+        ThreadPool::Instance()->ParallelFor(0, nHeight, [&](int y){
+            rayCaster.RenderTile(pVR, 0, y, nWidth, y+1);
+        });
+    }
+
+    // root mean square difference of two frames in 8 bit levels
+    inline double TestRMSE(const std::vector<unsigned char>& vecA, const std::vector<unsigned char>& vecB){
+        if (vecA.empty() || vecA.size() != vecB.size()){
+            return 1e9;
+        }
+        double fSum = 0.0;
+        for (size_t i=0; i<vecA.size(); i++){
+            double fDiff = (double)vecA[i] - vecB[i];
+            fSum += fDiff*fDiff;
+        }
+        return sqrt(fSum/vecA.size());
+    }
+
+    // best wall time of nRepeat runs in milliseconds, for the benchmarks
+    inline double TestBestOf(int nRepeat, const std::function<void()>& func){
+        double fBest = 1e30;
+        for (int i=0; i<nRepeat; i++){
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            func();
+            double fTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            fBest = fTime < fBest ? fTime : fBest;
+        }
+        return fBest;
+    }
+}